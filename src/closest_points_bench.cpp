@@ -0,0 +1,176 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#ifdef _WIN32
+#include "./slim/platforms/win32_base.h"
+#else
+#include "./slim/platforms/posix_base.h"
+#endif
+#include "./slim/serialization/mesh.h"
+#include "./examples/ClosestPointsOnMesh.hpp"
+
+
+f64 getSecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<f64>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+INLINE void resetArena(memory::MonotonicAllocator &arena) {
+    arena.address -= arena.occupied;
+    arena.occupied = 0;
+}
+
+// Search origins spread (deterministically) over the mesh's bounds, grown by a fifth of their size on every side:
+void generateSearchOrigins(const Mesh &mesh, vec3 *search_origins, u32 count) {
+    vec3 extents = mesh.aabb.max - mesh.aabb.min;
+    vec3 min = mesh.aabb.min - extents * 0.2f;
+    vec3 size = extents * 1.4f;
+    u32 seed = 12345;
+    for (u32 i = 0; i < count; i++) {
+        f32 random[3];
+        for (f32 &value : random) {
+            seed = seed * 1664525u + 1013904223u;
+            value = (f32)(seed >> 8) / (f32)(1u << 24);
+        }
+        search_origins[i] = min + vec3{random[0] * size.x, random[1] * size.y, random[2] * size.z};
+    }
+}
+
+// The same query as ClosestPointsOnMesh::find, but testing every triangle of the mesh (sorted by distance):
+u32 findByBruteForce(const Mesh &mesh, const vec3 &search_origin, f32 radius, u32 k, ClosestPointOnTriangle *points) {
+    u32 count = 0;
+    for (u32 t = 0; t < mesh.triangle_count; t++) {
+        ClosestPointOnTriangle point{search_origin, radius};
+        point.find(mesh, t, t + 1);
+        if (!point.on) continue;
+
+        // Insert by distance, dropping the farthest one once there are k of them:
+        u32 i = count;
+        if (!k || count < k) count++;
+        else if (points[k - 1].squared_distance <= point.squared_distance) continue;
+        else i = k - 1;
+        for (; i && points[i - 1].squared_distance > point.squared_distance; i--) points[i] = points[i - 1];
+        points[i] = point;
+    }
+    return count;
+}
+
+// Whether the found points are the expected ones: The same triangles within a radius, or for the k nearest ones
+// the same distances (as triangles that are equally far can be chosen either way when they tie for the last place).
+bool matches(const ClosestPointsOnTriangles &found, const ClosestPointOnTriangle *expected, u32 expected_count, u32 k) {
+    if (found.truncated || found.count != expected_count) return false;
+    for (u32 i = 0; i < expected_count; i++) {
+        if (found.points[i].squared_distance != expected[i].squared_distance) return false;
+        if (!k) {
+            bool is_found = false;
+            for (u32 j = 0; j < found.count && !is_found; j++)
+                is_found = found.points[j].triangle_index == expected[i].triangle_index;
+            if (!is_found) return false;
+        }
+    }
+    return true;
+}
+
+u32 runQueries(const ClosestPointsOnMesh &query, const vec3 *search_origins, u32 count, f32 radius, u32 k,
+               memory::MonotonicAllocator &arena, f64 &seconds, u64 &found_count) {
+    ClosestPointsOnTriangles result;
+    found_count = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (u32 i = 0; i < count; i++) {
+        resetArena(arena);
+        found_count += query.find(search_origins[i], radius, k, result, arena);
+    }
+    seconds = getSecondsSince(start);
+    return (u32)found_count;
+}
+
+u32 checkQueries(const ClosestPointsOnMesh &query, const vec3 *search_origins, u32 count, f32 radius, u32 k,
+                 memory::MonotonicAllocator &arena, ClosestPointOnTriangle *expected) {
+    ClosestPointsOnTriangles result;
+    u32 mismatches = 0;
+    for (u32 i = 0; i < count; i++) {
+        resetArena(arena);
+        query.find(search_origins[i], radius, k, result, arena);
+        u32 expected_count = findByBruteForce(*query.mesh, search_origins[i], radius, k, expected);
+        if (!matches(result, expected, expected_count, k)) mismatches++;
+    }
+    return mismatches;
+}
+
+int closestPointsBench(char *mesh_file_path, u32 query_count, u32 k, f32 radius_fraction, bool check) {
+    Mesh mesh;
+    if (!loadHeader(mesh, mesh_file_path)) {
+        printf("Could not read %s\n", mesh_file_path);
+        return 1;
+    }
+    memory::MonotonicAllocator memory_allocator{getSizeInBytes(mesh)};
+    if (!load(mesh, mesh_file_path, &memory_allocator)) {
+        printf("Could not load %s\n", mesh_file_path);
+        return 1;
+    }
+
+    vec3 *search_origins = (vec3*)os::getMemory(sizeof(vec3) * query_count);
+    ClosestPointOnTriangle *expected = (ClosestPointOnTriangle*)os::getMemory(sizeof(ClosestPointOnTriangle) * mesh.triangle_count);
+    memory::MonotonicAllocator arena{sizeof(ClosestPointOnTriangle) * mesh.triangle_count};
+    if (!search_origins || !expected || !arena.address) {
+        printf("Could not allocate memory for %u queries\n", query_count);
+        return 1;
+    }
+    generateSearchOrigins(mesh, search_origins, query_count);
+
+    ClosestPointsOnMesh query;
+    query.mesh = &mesh;
+    query.allocate();
+
+    vec3 extents = mesh.aabb.max - mesh.aabb.min;
+    f32 radius = extents.length() * radius_fraction;
+    printf("%s: %u triangles, %u queries, k=%u, radius=%.4f\n", mesh_file_path, mesh.triangle_count, query_count, k, radius);
+
+    f64 seconds;
+    u64 found_count;
+    runQueries(query, search_origins, query_count, INFINITY, k, arena, seconds, found_count);
+    printf("k-nearest: %.3f s (%.2f us/query)\n", seconds, seconds * 1000000.0 / query_count);
+    runQueries(query, search_origins, query_count, radius, 0, arena, seconds, found_count);
+    printf("Within radius: %.3f s (%.2f us/query), %.1f triangles on average\n",
+           seconds, seconds * 1000000.0 / query_count, (f64)found_count / query_count);
+    if (!check) return 0;
+
+    u32 knn_mismatches = checkQueries(query, search_origins, query_count, INFINITY, k, arena, expected);
+    u32 range_mismatches = checkQueries(query, search_origins, query_count, radius, 0, arena, expected);
+    printf("Brute-force check: %u k-nearest and %u within-radius mismatches out of %u queries each\n",
+           knn_mismatches, range_mismatches, query_count);
+    return knn_mismatches || range_mismatches;
+}
+
+bool hasPrefix(char *arg, const char *prefix) {
+    while (*prefix) if (*(arg++) != *(prefix++)) return false;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || !strcmp(argv[1], (char*)"--help")) {
+        printf((char*)("A '.mesh' file path needs to be provided, "
+                       "an optional flag 'queries:<int>' for the number of search origins (default: 2000),"
+                       "an optional flag 'k:<int>' for the number of nearest triangles to find (default: 8),"
+                       "an optional flag 'radius:<float>' for the search radius, as a fraction of the mesh's size (default: 0.05),"
+                       "an optional flag '-check' for comparing the results against a brute-force scan (exits with 1 on mismatches)"
+                       ));
+        return argc < 2;
+    }
+
+    u32 query_count = 2000;
+    u32 k = 8;
+    f32 radius_fraction = 0.05f;
+    bool check = false;
+    for (u32 i = 2; i < (u32)argc; i++) {
+        char *arg = argv[i];
+        if (strcmp(arg, (char*)"-check") == 0) check = true;
+        else if (hasPrefix(arg, "queries:")) query_count = (u32)atoi(arg + 8);
+        else if (hasPrefix(arg, "k:")) k = (u32)atoi(arg + 2);
+        else if (hasPrefix(arg, "radius:")) radius_fraction = (f32)atof(arg + 7);
+    }
+    if (!query_count) query_count = 1;
+    if (!k) k = 1;
+
+    return closestPointsBench(argv[1], query_count, k, radius_fraction, check);
+}
@@ -2,11 +2,49 @@
 #include "../slim/draw/selection.h"
 #include "../slim/draw/hud.h"
 #include "../slim/draw/grid.h"
-#include "../slim/draw/mesh.h"
+#include "../slim/draw/bvh.h"
+#include "../slim/draw/trace.h"
+#include "../slim/draw/rasterizer.h"
+#include "../slim/draw/depth_pyramid.h"
+#include "../slim/serialization/texture.h"
 #include "../slim/app.h"
 // Or using the single-header file:
 //#include "../slim.h"
 
+#define CHECKERBOARD_SIZE 64
+#define CHECKERBOARD_SQUARE_SIZE 8
+
+// Generates a (wrapping) checkerboard texture, as there are no texture files bundled with the examples:
+void generateCheckerboard(Texture &texture, u32 size, u32 square_size, memory::MonotonicAllocator *memory_allocator) {
+    texture.width = texture.height = size;
+    texture.mip_count = 1;
+    texture.flags.wrap = true;
+    if (!allocateMemory(texture, memory_allocator)) {
+        texture.mips = nullptr;
+        return;
+    }
+
+    // Each texel quad holds the 4 texels around a corner of the texels grid (wrapping around at the edges):
+    TextureMip &mip = *texture.mips;
+    mip.width = mip.height = size;
+    TexelQuad *texel_quad = mip.texel_quads;
+    for (u32 y = 0; y <= size; y++) {
+        u32 top = ((y + size - 1) % size) / square_size;
+        u32 bottom = (y % size) / square_size;
+        for (u32 x = 0; x <= size; x++, texel_quad++) {
+            u32 left = ((x + size - 1) % size) / square_size;
+            u32 right = (x % size) / square_size;
+            TexelQuadComponent component{
+                (u8)((left  + top)    & 1 ? 255 : 64),
+                (u8)((right + top)    & 1 ? 255 : 64),
+                (u8)((left  + bottom) & 1 ? 255 : 64),
+                (u8)((right + bottom) & 1 ? 255 : 64)
+            };
+            texel_quad->R = texel_quad->G = texel_quad->B = component;
+        }
+    }
+}
+
 struct MeshApp : SlimApp {
     // Viewport:
     Camera camera{
@@ -16,6 +54,13 @@ struct MeshApp : SlimApp {
     Canvas canvas;
     Viewport viewport{canvas, &camera};
     bool antialias = false;
+    bool shaded = false;
+    bool filled = false;
+    bool textured = false;
+    bool tiled = false;
+    ThreadPool thread_pool;
+    TileRasterizer rasterizer;
+    DepthPyramid depth_pyramid;
 
     // HUD:
     HUDLine AA{(char*)"AA : ",
@@ -23,7 +68,27 @@ struct MeshApp : SlimApp {
                (char*)"Off",
                &antialias,
                true};
-    HUDSettings hud_settings{1};
+    HUDLine Shaded{(char*)"Shaded : ",
+                   (char*)"On",
+                   (char*)"Off",
+                   &shaded,
+                   true};
+    HUDLine Filled{(char*)"Filled : ",
+                   (char*)"On",
+                   (char*)"Off",
+                   &filled,
+                   true};
+    HUDLine Textured{(char*)"Textured : ",
+                     (char*)"On",
+                     (char*)"Off",
+                     &textured,
+                     true};
+    HUDLine Tiled{(char*)"Tiled : ",
+                  (char*)"On",
+                  (char*)"Off",
+                  &tiled,
+                  true};
+    HUDSettings hud_settings{5};
     HUD hud{hud_settings, &AA};
 
     // Scene:
@@ -51,6 +116,10 @@ struct MeshApp : SlimApp {
     Scene scene{counts,nullptr, cameras, geometries, grids,nullptr,nullptr,
                 meshes, mesh_files};
     Selection selection;
+    MeshVertexCache vertex_cache;
+
+    Texture checkerboard;
+    memory::MonotonicAllocator texture_memory;
 
     // Drawing:
     f32 opacity = 0.5f;
@@ -59,20 +128,77 @@ struct MeshApp : SlimApp {
     u16 max_depth = 0;
 
     void OnRender() override {
-        canvas.clear();
+        // When tiled (and not shaded), only the tiles of the canvas that changed since the last frame get redrawn,
+        // which the rasterizer clears itself:
+        rasterizer.track_damage = tiled && !shaded;
+        if (!rasterizer.track_damage) canvas.clear();
+
+        // The shaded meshes are traced first, so that the grid's lines get depth-tested against them:
+        if (shaded) traceScene(scene, viewport, &thread_pool);
+
+        // When tiled, the lines and triangles below are binned into tiles of the canvas, which are drawn across threads:
+        if (tiled) {
+            if (!rasterizer.commands) rasterizer.allocate(1 << 16);
+            rasterizer.begin(viewport, &thread_pool);
+        }
 
         drawGrid(grid, grid1.transform, viewport, grid1.color, opacity);
 
-        bool draw_normals = controls::is_pressed::ctrl;
-        Mesh &mesh{meshes[scene.geometries[1].id]};
-        drawMesh(mesh, mesh1.transform, draw_normals, viewport, mesh1.color, opacity);
-        drawMesh(mesh, mesh2.transform, draw_normals, viewport, mesh2.color, opacity);
+        if (!shaded) {
+            bool draw_normals = controls::is_pressed::ctrl;
+            Mesh &mesh{meshes[scene.geometries[1].id]};
+            if (!vertex_cache.positions) {
+                u32 max_vertex_count = 0;
+                for (const Mesh &m : meshes) if (max_vertex_count < m.vertex_count) max_vertex_count = m.vertex_count;
+                vertex_cache.allocate(max_vertex_count);
+            }
+            if (filled) {
+                Texture *texture = nullptr;
+                if (textured) {
+                    if (!checkerboard.mips) {
+                        Texture checkerboard_size;
+                        checkerboard_size.width = checkerboard_size.height = CHECKERBOARD_SIZE;
+                        texture_memory = memory::MonotonicAllocator{getSizeInBytes(checkerboard_size)};
+                        generateCheckerboard(checkerboard, CHECKERBOARD_SIZE, CHECKERBOARD_SQUARE_SIZE, &texture_memory);
+                    }
+                    texture = &checkerboard;
+                }
+                drawMeshFilled(mesh, mesh1.transform, viewport, vertex_cache, mesh1.color, 1.0f, texture);
+                drawMeshFilled(mesh, mesh2.transform, viewport, vertex_cache, mesh2.color, 1.0f, texture);
+                if (max_depth) {
+                    // The BVHs are drawn over the filled meshes, skipping the nodes that they hide. When tiled, the
+                    // meshes are only drawn into the canvas once the rasterizer ends, so nothing gets skipped then:
+                    if (!tiled) {
+                        if (!depth_pyramid.levels[0]) depth_pyramid.allocate();
+                        depth_pyramid.build(canvas, &thread_pool);
+                        viewport.depth_pyramid = &depth_pyramid;
+                    }
+                    drawBVH(mesh.bvh, mesh1.transform, viewport, min_depth, max_depth);
+                    drawBVH(mesh.bvh, mesh2.transform, viewport, min_depth, max_depth);
+                    viewport.depth_pyramid = nullptr;
+                }
+            } else {
+                drawMesh(mesh, mesh1.transform, draw_normals, viewport, vertex_cache, mesh1.color, opacity);
+                if (max_depth) drawBVH(mesh.bvh, vertex_cache, viewport, min_depth, max_depth);
+                drawMesh(mesh, mesh2.transform, draw_normals, viewport, vertex_cache, mesh2.color, opacity);
+                if (max_depth) drawBVH(mesh.bvh, vertex_cache, viewport, min_depth, max_depth);
+            }
+        }
+        if (tiled) {
+            // The selection and the HUD are drawn directly into the canvas, over the tiles that they get invalidated:
+            if (controls::is_pressed::alt) rasterizer.invalidate();
+            if (hud.enabled) rasterizer.invalidate(getHUDBounds(hud));
+            rasterizer.end();
+        }
 
         if (controls::is_pressed::alt) drawSelection(selection, viewport, scene);
         if (hud.enabled)
             drawHUD(hud, canvas);
 
-        canvas.drawToWindow();
+        if (tiled)
+            rasterizer.drawToWindow(canvas);
+        else
+            canvas.drawToWindow(&thread_pool);
     }
 
     void OnKeyChanged(u8 key, bool is_pressed) override {
@@ -93,6 +219,14 @@ struct MeshApp : SlimApp {
             else if (key == 'Q') {
                 canvas.antialias = canvas.antialias == NoAA ? SSAA : NoAA;
                 antialias = canvas.antialias == SSAA;
+            } else if (key == 'T') {
+                shaded = !shaded;
+            } else if (key == 'G') {
+                filled = !filled;
+            } else if (key == 'B') {
+                tiled = !tiled;
+            } else if (key == 'V') {
+                textured = !textured;
             } else if (key == 'M') {
                 u32 old_mesh_id = scene.geometries[1].id;
                 u32 new_mesh_id = (old_mesh_id + 1) % 3;
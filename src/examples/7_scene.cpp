@@ -7,6 +7,7 @@
 #include "../slim/draw/box.h"
 #include "../slim/draw/selection.h"
 #include "../slim/serialization/scene.h"
+#include "../slim/scene/bvh_builder.h"
 #include "../slim/app.h"
 // Or using the single-header file:
 //#include "../slim.h"
@@ -54,6 +55,13 @@ struct SceneApp : SlimApp {
     SceneCounts counts{1, 7, 1, 1, 2, 2 };
     Scene scene{counts,scene_file.char_ptr, cameras, geometries, grids, boxes, curves, meshes, mesh_files};
     Selection selection;
+    MeshVertexCache vertex_cache;
+
+    // Picking goes through a TLAS over the geometries, refitted whenever the selection transforms one of them
+    // (and rebuilt once refitting made it twice as costly to traverse):
+    memory::MonotonicAllocator tlas_memory{TLAS::getSizeInBytes(counts.geometries) + BVHBuilder::getSizeInBytes(counts.geometries)};
+    BVHBuilder tlas_builder{counts.geometries, &tlas_memory};
+    f32 tlas_rebuild_threshold = 2.0f;
 
     // Drawing:
     f32 opacity = 0.2f;
@@ -62,6 +70,11 @@ struct SceneApp : SlimApp {
         canvas.clear();
 
         bool draw_normals = controls::is_pressed::ctrl;
+        if (!vertex_cache.positions) {
+            u32 max_vertex_count = 0;
+            for (const Mesh &m : meshes) if (max_vertex_count < m.vertex_count) max_vertex_count = m.vertex_count;
+            vertex_cache.allocate(max_vertex_count);
+        }
         for (u32 i = 0; i < counts.geometries; i++) {
             Geometry &geo{geometries[i]};
             Transform &transform{geo.transform};
@@ -72,7 +85,7 @@ struct SceneApp : SlimApp {
                 case GeometryType_Grid : drawGrid(grid,   transform, viewport, color, opacity); break;
                 case GeometryType_Box  : drawBox(box,     transform, viewport, color, opacity); break;
                 case GeometryType_Curve: drawCurve(curve, transform, viewport, color, opacity); break;
-                case GeometryType_Mesh : drawMesh(mesh,   transform, draw_normals, viewport, color, opacity); break;
+                case GeometryType_Mesh : drawMesh(mesh,   transform, draw_normals, viewport, vertex_cache, color, opacity); break;
                 default: break;
             }
         }
@@ -89,7 +102,11 @@ struct SceneApp : SlimApp {
     }
 
     void OnUpdate(f32 delta_time) override {
+        if (!scene.tlas.bvh.nodes && scene.tlas.allocate(counts.geometries, &tlas_memory))
+            tlas_builder.buildTLAS(scene.tlas, geometries, counts.geometries, meshes);
+
         if (!mouse::is_captured) selection.manipulate(viewport, scene);
+        if (selection.transformed) tlas_builder.refitTLAS(scene.tlas, geometries, meshes, tlas_rebuild_threshold);
         if (!controls::is_pressed::alt) viewport.updateNavigation(delta_time);
     }
 
@@ -121,8 +138,10 @@ struct SceneApp : SlimApp {
                 scene.last_io_is_save = key == 'S';
                 if (scene.last_io_is_save)
                     save(scene, scene_file.char_ptr);
-                else
+                else {
                     load(scene, scene_file.char_ptr);
+                    tlas_builder.buildTLAS(scene.tlas, geometries, scene.counts.geometries, meshes);
+                }
                 scene.last_io_ticks = timers::getTicks();
             }
         }
@@ -1,25 +1,53 @@
 #pragma once
 
+#ifndef SLIM_SINGLE_HEADER_FILE
+#include "../slim/core/transform.h"
+#include "../slim/scene/wide_bvh.h"
+#include "../slim/core/thread_pool.h"
+#endif
 #include "./ClosestPointOnTriangle.hpp"
 
 #define BROAD_PHASE_INCLUDED 1
+#define CLOSEST_POINT_ON_MESH_CHUNK_SIZE 256
+#define CLOSEST_POINT_ON_MESH_RADIUS_MARGIN 0.00001f // Keeps inherited radii from rejecting their closest points
 
 struct ClosestPointOnMesh {
     // The query does a broad-phase to narrows the search to only triangles that are close enough to matter.
     // Leaf-node triangles get tested immediately when visited and tracked on the node flags (no aux. array needed).
     // In adaptive mode the search radius is also reduced dynamically as closer triangles are found.
+    // Given a wide BVH (of the same mesh) CPU queries traverse that instead, testing all children of a node at once
+    // and visiting the ones that overlap the search sphere nearest-first.
+    // Batches of queries can be spread over a thread pool, with each thread using its own traversal stacks.
+    // As node flagging is not thread-safe, it is only done when enabled and on the calling thread only.
+    // Batches can also be run in Morton order (of the search origins in the mesh's space), so that consecutive
+    // queries walk similar paths down the BVH. Results still land at the indices of their search origins, and in
+    // adaptive mode each query starts from a radius bounded by the result of the one before it.
+    // Queries can be warm-started from a triangle (typically the one found on the previous frame), which is tested
+    // up front so that in adaptive mode the search starts from its distance instead of the max distance.
+    // Batches warm-start from their own previous results when enabled (as long as the mesh did not change).
 
     Mesh *mesh = nullptr;
+    WideBVH *wide_bvh = nullptr;
     Transform *mesh_transform = nullptr;
     Transform *search_origin_transform = nullptr;
     u32 *stack = nullptr;
     u32 max_stack_size = 0;
+    WideBVHStackEntry *wide_stack = nullptr;
+    u32 max_wide_stack_size = 0;
+    u32 stack_count = 0;
+    bool flag_nodes = true;
+    bool morton_order = false;
+    bool warm_start = false;
+    const Mesh *warm_start_mesh = nullptr; // The mesh that the batch results were last found on
     u32 max_result_count = 0;
     ClosestPointOnTriangle *results = nullptr;
+    u64 *query_keys = nullptr; // The Morton code (high bits) and search origin index (low bits) of batched queries
+    u64 *query_keys_scratch = nullptr;
 
-    INLINE_XPU TrianglePointOn find(vec3 search_origin, f32 max_distance, ClosestPointOnTriangle &closest_point_on_triangle, bool adaptive = true) const {
+    INLINE_XPU TrianglePointOn find(vec3 search_origin, f32 max_distance, ClosestPointOnTriangle &closest_point_on_triangle, bool adaptive = true,
+                                    u32 warm_start_triangle_index = (u32)-1) const {
 #ifndef NDEBUG
-        if (max_stack_size < mesh->bvh.height) {
+        if (max_stack_size < getMaxStackSize(mesh->bvh)) {
         closest_point_on_triangle.on = TrianglePointOn_Error;
         return TrianglePointOn_Error;
     }
@@ -35,11 +63,11 @@ struct ClosestPointOnMesh {
         if (!root.aabb.overlapSphere(closest_point_on_triangle.search_origin, max_distance))
             return TrianglePointOn_None;
 
-        u32 start, end, node_id;
         if (unlikely(root.isLeaf())) {
+            u32 start, end;
             start = root.first_index;
             end = start + root.leaf_count;
-            closest_point_on_triangle.find(mesh->triangles, start, end);
+            closest_point_on_triangle.find(*mesh, start, end);
             if (closest_point_on_triangle.on) {
                 closest_point_on_triangle.search_origin = search_origin;
                 if (mesh_transform)
@@ -49,6 +77,42 @@ struct ClosestPointOnMesh {
             return closest_point_on_triangle.on;
         }
 
+        // The traversal will meet this triangle again, but will only replace it with a closer one:
+        if (adaptive && warm_start_triangle_index < mesh->triangle_count) {
+            closest_point_on_triangle.find(*mesh, warm_start_triangle_index, warm_start_triangle_index + 1);
+            if (closest_point_on_triangle.on) max_distance = sqrtf(closest_point_on_triangle.squared_distance);
+        }
+
+#ifndef __CUDA_ARCH__
+        if (wide_bvh && wide_bvh->node_count) {
+#ifndef NDEBUG
+            if (max_wide_stack_size < WideBVH::getMaxStackSize(mesh->bvh)) {
+                closest_point_on_triangle.on = TrianglePointOn_Error;
+                return TrianglePointOn_Error;
+            }
+#endif
+            findInWideBVH(closest_point_on_triangle, adaptive);
+        } else
+#endif
+        findInBVH(closest_point_on_triangle, max_distance, adaptive);
+
+        if (closest_point_on_triangle.on) {
+            closest_point_on_triangle.search_origin = search_origin;
+            if (mesh_transform)
+                closest_point_on_triangle.closest_point = mesh_transform->externPos(closest_point_on_triangle.closest_point);
+        }
+
+        return closest_point_on_triangle.on;
+    }
+
+    // Every level of the BVH below the root leaves at most one sibling on the stack, plus the 2 children last pushed
+    // (the root's children are at depth 1, and the deepest ones are at the BVH's height):
+    INLINE_XPU static u32 getMaxStackSize(const BVH &bvh) { return bvh.height + 1; }
+
+    INLINE_XPU void findInBVH(ClosestPointOnTriangle &closest_point_on_triangle, f32 max_distance, bool adaptive) const {
+        BVHNode *nodes = mesh->bvh.nodes;
+        BVHNode &root = nodes[0];
+        u32 start, end, node_id;
         f32 squared_distance_before;
         f32 radius = max_distance;
         i32 stack_size = 0;
@@ -62,11 +126,11 @@ struct ClosestPointOnMesh {
                 continue;
 
             if (node.isLeaf()) {
-                node.flags = BROAD_PHASE_INCLUDED;
+                if (flag_nodes) node.flags = BROAD_PHASE_INCLUDED;
                 start = node.first_index;
                 end = start + node.leaf_count;
                 squared_distance_before = closest_point_on_triangle.squared_distance;
-                closest_point_on_triangle.find(mesh->triangles, start, end);
+                closest_point_on_triangle.find(*mesh, start, end);
 
                 // Since triangles are tested eagerly the search radius may be safely narrowed down on the fly:
                 if (adaptive && closest_point_on_triangle.squared_distance < squared_distance_before)
@@ -76,22 +140,224 @@ struct ClosestPointOnMesh {
                 stack[stack_size++] = node.first_index + 1;
             }
         }
+    }
 
-        if (closest_point_on_triangle.on) {
-            closest_point_on_triangle.search_origin = search_origin;
-            if (mesh_transform)
-                closest_point_on_triangle.closest_point = mesh_transform->externPos(closest_point_on_triangle.closest_point);
+#ifndef __CUDA_ARCH__
+    void findInWideBVH(ClosestPointOnTriangle &closest_point_on_triangle, bool adaptive) const {
+        BVHNode *leaf_nodes = mesh->bvh.nodes;
+        const vec3 &origin = closest_point_on_triangle.search_origin;
+        simd_f32 x = simd::set1(origin.x);
+        simd_f32 y = simd::set1(origin.y);
+        simd_f32 z = simd::set1(origin.z);
+
+        f32 squared_radius = closest_point_on_triangle.squared_distance;
+        f32 squared_distance_before;
+        f32 squared_distances[WIDE_BVH_WIDTH];
+        u8 children[WIDE_BVH_WIDTH];
+        u8 child_count, internal_child_count;
+        i32 stack_size = 0;
+        wide_stack[stack_size++] = {0, 0};
+
+        while (stack_size > 0) {
+            WideBVHStackEntry entry = wide_stack[--stack_size];
+            if (entry.squared_distance > squared_radius) // The radius may have shrunk since this node was pushed
+                continue;
+
+            const WideBVHNode &node = wide_bvh->nodes[entry.node_id];
+            simd_f32 node_squared_distances = node.squaredDistances(x, y, z);
+            u32 overlap_mask = simd::lessOrEqualMask(node_squared_distances, simd::set1(squared_radius));
+            if (!overlap_mask) continue;
+
+            // Sort the overlapping children by their distance (an insertion sort of a handful of children):
+            simd::store(squared_distances, node_squared_distances);
+            child_count = 0;
+            for (u8 child = 0; child < WIDE_BVH_WIDTH; child++) {
+                if (!(overlap_mask & (1u << child))) continue;
+
+                u8 i = child_count++;
+                for (; i > 0 && squared_distances[children[i - 1]] > squared_distances[child]; i--)
+                    children[i] = children[i - 1];
+                children[i] = child;
+            }
+
+            // Test the leaves nearest-first (narrowing the radius early), while keeping the internal children in order:
+            internal_child_count = 0;
+            for (u8 i = 0; i < child_count; i++) {
+                u8 child = children[i];
+                if (squared_distances[child] > squared_radius)
+                    continue;
+
+                if (node.isLeaf(child)) {
+                    const TrianglePacket *packet = wide_bvh->packets + node.children[child];
+                    if (flag_nodes) leaf_nodes[packet->node_id].flags = BROAD_PHASE_INCLUDED;
+                    squared_distance_before = closest_point_on_triangle.squared_distance;
+                    closest_point_on_triangle.find(*packet);
+                    while (packet->has_next) closest_point_on_triangle.find(*++packet);
+                    if (adaptive && closest_point_on_triangle.squared_distance < squared_distance_before)
+                        squared_radius = closest_point_on_triangle.squared_distance;
+                } else
+                    children[internal_child_count++] = child;
+            }
+
+            // Push the farthest first, so that the nearest gets popped first:
+            while (internal_child_count) {
+                u8 child = children[--internal_child_count];
+                wide_stack[stack_size++] = {node.children[child], squared_distances[child]};
+            }
         }
+    }
+#endif
 
-        return closest_point_on_triangle.on;
+    void find(const vec3 *search_origins, u32 search_origins_count, f32 max_distance, bool adaptive = true) {
+        bool warm = warm_start && warm_start_mesh == mesh;
+        warm_start_mesh = mesh;
+        if (sortSearchOrigins(search_origins, search_origins_count, max_distance))
+            findInOrder(search_origins, 0, search_origins_count, max_distance, adaptive, warm);
+        else
+            for (u32 i = 0; i < search_origins_count; i++)
+                findInBatch(search_origins, i, max_distance, max_distance, adaptive, warm);
+    }
+
+    // Finds the closest point to a search origin of a batch within the given radius, warm-starting from its
+    // previous result. Searches within a radius smaller than the max distance are rerun with it if they find nothing:
+    INLINE void findInBatch(const vec3 *search_origins, u32 index, f32 radius, f32 max_distance, bool adaptive, bool warm) const {
+        ClosestPointOnTriangle &result = results[index];
+        u32 warm_start_triangle_index = warm && result.on ? result.triangle_index : (u32)-1;
+        find(search_origins[index], radius, result, adaptive, warm_start_triangle_index);
+        if (!result.on && radius < max_distance)
+            find(search_origins[index], max_distance, result, adaptive, warm_start_triangle_index);
+    }
+
+    struct BatchJob {
+        const ClosestPointOnMesh *query;
+        const vec3 *search_origins;
+        f32 max_distance;
+        bool adaptive;
+        bool in_order;
+        bool warm;
+    };
+
+    static void findBatchJob(void *data, u32 start, u32 end, u32 thread_index) {
+        BatchJob &job = *(BatchJob*)data;
+        ClosestPointOnMesh query{*job.query};
+        query.flag_nodes = false;
+        query.stack += query.max_stack_size * thread_index;
+        query.wide_stack += query.max_wide_stack_size * thread_index;
+        if (job.in_order)
+            query.findInOrder(job.search_origins, start, end, job.max_distance, job.adaptive, job.warm);
+        else
+            for (u32 i = start; i < end; i++)
+                query.findInBatch(job.search_origins, i, job.max_distance, job.max_distance, job.adaptive, job.warm);
+    }
+
+    // Runs on the thread pool given stacks for all its threads (see allocate) and with node flagging disabled,
+    // otherwise falls back to running on the calling thread:
+    void find(const vec3 *search_origins, u32 search_origins_count, f32 max_distance, bool adaptive, ThreadPool *thread_pool) {
+        if (!thread_pool || thread_pool->thread_count == 1 || stack_count < thread_pool->thread_count || flag_nodes) {
+            find(search_origins, search_origins_count, max_distance, adaptive);
+            return;
+        }
+
+        bool warm = warm_start && warm_start_mesh == mesh;
+        warm_start_mesh = mesh;
+        bool in_order = sortSearchOrigins(search_origins, search_origins_count, max_distance);
+        BatchJob job{this, search_origins, max_distance, adaptive, in_order, warm};
+        thread_pool->parallelFor(search_origins_count, CLOSEST_POINT_ON_MESH_CHUNK_SIZE, findBatchJob, &job, 0);
+    }
+
+    INLINE vec3 toMeshSpace(vec3 search_origin) const {
+        if (search_origin_transform) search_origin = search_origin_transform->externPos(search_origin);
+        if (mesh_transform) search_origin = mesh_transform->internPos(search_origin);
+        return search_origin;
     }
 
-    void find(const vec3 *search_origins, u32 search_origins_count, f32 max_distance, bool adaptive = true) const {
-        for (u32 i = 0; i < search_origins_count; i++)
-            find(search_origins[i], max_distance, results[i], adaptive);
+    // Spreads 10 bits out to every 3rd bit (of 30):
+    INLINE static u32 spreadBits(u32 bits) {
+        bits = (bits | (bits << 16)) & 0x030000FF;
+        bits = (bits | (bits <<  8)) & 0x0300F00F;
+        bits = (bits | (bits <<  4)) & 0x030C30C3;
+        bits = (bits | (bits <<  2)) & 0x09249249;
+        return bits;
     }
 
-    void allocate(u32 result_count = 0, memory::MonotonicAllocator *allocator = nullptr) {
+    // Sorts the batch's search origins by the Morton codes of their positions in the mesh's space (quantized to
+    // 10 bits per axis within the mesh's bounds grown by the max distance, as farther origins find nothing anyway).
+    // Returns whether the batch is to run in Morton order (which requires it and its scratch memory, see allocate):
+    bool sortSearchOrigins(const vec3 *search_origins, u32 search_origins_count, f32 max_distance) {
+        if (!morton_order || !query_keys || search_origins_count > max_result_count) return false;
+
+        vec3 min = mesh->aabb.min - max_distance;
+        vec3 extent = mesh->aabb.max + max_distance - min;
+        vec3 scale{
+            extent.x > 0 ? 1023.0f / extent.x : 0,
+            extent.y > 0 ? 1023.0f / extent.y : 0,
+            extent.z > 0 ? 1023.0f / extent.z : 0
+        };
+        for (u32 i = 0; i < search_origins_count; i++) {
+            vec3 cell = (toMeshSpace(search_origins[i]) - min) * scale;
+            u32 x = (u32)clampedValue(cell.x, 0.0f, 1023.0f);
+            u32 y = (u32)clampedValue(cell.y, 0.0f, 1023.0f);
+            u32 z = (u32)clampedValue(cell.z, 0.0f, 1023.0f);
+            u32 code = (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+            query_keys[i] = ((u64)code << 32) | i;
+        }
+
+        // Radix sort the 30 bit codes, 10 bits per pass (ping-ponging between the keys and the scratch keys):
+        u64 *keys = query_keys;
+        u64 *sorted_keys = query_keys_scratch;
+        for (u32 shift = 32; shift < 62; shift += 10) {
+            u32 offsets[1024] = {};
+            for (u32 i = 0; i < search_origins_count; i++) offsets[(keys[i] >> shift) & 1023]++;
+            for (u32 digit = 0, offset = 0; digit < 1024; digit++) {
+                u32 count = offsets[digit];
+                offsets[digit] = offset;
+                offset += count;
+            }
+            for (u32 i = 0; i < search_origins_count; i++) sorted_keys[offsets[(keys[i] >> shift) & 1023]++] = keys[i];
+
+            u64 *tmp = keys;
+            keys = sorted_keys;
+            sorted_keys = tmp;
+        }
+        query_keys_scratch = query_keys;
+        query_keys = keys;
+
+        return true;
+    }
+
+    // Runs a range of the (sorted) batch in order, scattering the results back to their search origins' indices.
+    // Each query's closest point is within the previous one's distance plus the distance between their origins,
+    // so in adaptive mode that (slightly inflated) bound can start off the search radius whenever it is smaller.
+    // As the closest points found per triangle are not always exact, a search that comes up empty is rerun with
+    // the max distance (so that the results are the same as without the bound):
+    void findInOrder(const vec3 *search_origins, u32 start, u32 end, f32 max_distance, bool adaptive, bool warm) const {
+        vec3 previous_origin;
+        f32 previous_distance = -1;
+        for (u32 i = start; i < end; i++) {
+            u32 index = (u32)query_keys[i];
+            f32 radius = max_distance;
+            vec3 origin;
+            if (adaptive) {
+                origin = toMeshSpace(search_origins[index]);
+                if (previous_distance >= 0) {
+                    f32 bound = (previous_distance + (origin - previous_origin).length()) * 1.001f + CLOSEST_POINT_ON_MESH_RADIUS_MARGIN;
+                    if (bound < radius) radius = bound;
+                }
+            }
+
+            ClosestPointOnTriangle &result = results[index];
+            findInBatch(search_origins, index, radius, max_distance, adaptive, warm);
+            if (adaptive && result.on) {
+                previous_origin = origin;
+                previous_distance = sqrtf(result.squared_distance);
+            }
+        }
+    }
+
+    // The stacks are sized for the tallest BVH of the given meshes, that the query gets switched between
+    // (defaulting to just the query's mesh):
+    void allocate(u32 result_count = 0, memory::MonotonicAllocator *allocator = nullptr, u32 thread_count = 1,
+                  const Mesh *meshes = nullptr, u32 mesh_count = 0) {
         if (result_count && results)
             result_count = 0;
 
@@ -100,12 +366,19 @@ struct ClosestPointOnMesh {
 
         u32 capacity = 0;
         if (!stack) {
-            max_stack_size = mesh->bvh.height;
-            capacity += max_stack_size * sizeof(u32);
+            stack_count = thread_count ? thread_count : 1;
+            const BVH *tallest_bvh = &mesh->bvh;
+            for (u32 i = 0; i < mesh_count; i++)
+                if (meshes[i].bvh.height > tallest_bvh->height)
+                    tallest_bvh = &meshes[i].bvh;
+            max_stack_size = getMaxStackSize(*tallest_bvh);
+            max_wide_stack_size = WideBVH::getMaxStackSize(*tallest_bvh);
+            capacity += max_stack_size * sizeof(u32) * stack_count;
+            capacity += max_wide_stack_size * sizeof(WideBVHStackEntry) * stack_count;
         }
         if (result_count) {
             max_result_count = result_count;
-            capacity += max_result_count * sizeof(ClosestPointOnTriangle);
+            capacity += max_result_count * (sizeof(ClosestPointOnTriangle) + sizeof(u64) * 2);
         }
 
         memory::MonotonicAllocator tmp;
@@ -113,7 +386,14 @@ struct ClosestPointOnMesh {
             allocator = &tmp;
             tmp = memory::MonotonicAllocator{capacity};
         }
-        if (!stack) stack = (u32*)allocator->allocate(max_stack_size * sizeof(u32));
-        if (result_count) results = (ClosestPointOnTriangle*)allocator->allocate(result_count * sizeof(ClosestPointOnTriangle));
+        if (!stack) {
+            stack = (u32*)allocator->allocate(max_stack_size * sizeof(u32) * stack_count);
+            wide_stack = (WideBVHStackEntry*)allocator->allocate(max_wide_stack_size * sizeof(WideBVHStackEntry) * stack_count);
+        }
+        if (result_count) {
+            results = (ClosestPointOnTriangle*)allocator->allocate(result_count * sizeof(ClosestPointOnTriangle));
+            query_keys = (u64*)allocator->allocate(result_count * sizeof(u64));
+            query_keys_scratch = (u64*)allocator->allocate(result_count * sizeof(u64));
+        }
     }
 };
\ No newline at end of file
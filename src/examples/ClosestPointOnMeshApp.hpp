@@ -1,3 +1,16 @@
+#include "../slim/scene/selection.h"
+#include "../slim/draw/selection.h"
+#include "../slim/draw/hud.h"
+#include "../slim/draw/grid.h"
+#include "../slim/draw/mesh.h"
+#include "../slim/draw/curve.h"
+#include "../slim/draw/bvh.h"
+#include "../slim/draw/triangle.h"
+#include "../slim/draw/rectangle.h"
+#include "../slim/app.h"
+// Or using the single-header file:
+//#include "../slim.h"
+
 #include "./ClosestPointOnMeshXPU.hpp"
 
 struct DemoApp : SlimApp {
@@ -15,6 +28,10 @@ struct DemoApp : SlimApp {
     bool draw_query_aabbs = false;
     bool draw_query_triangles = false;
     bool adaptive = true;
+    bool wide = true;
+    bool multi_threaded = true;
+    bool morton_order = true;
+    bool warm_start = true;
     bool multi = true;
     bool run_on_GPU = USE_GPU_BY_DEFAULT;
 
@@ -23,6 +40,7 @@ struct DemoApp : SlimApp {
     f32 world_max_distance = 0.3f;
 
     timers::Timer query_timer;
+    ThreadPool thread_pool;
 
     // HUD:
     HUDLine QueryLine{(char*)"Show Query     : ", (char*)"On",(char*)"Off", &draw_query_result, true, Yellow, DarkYellow} ;
@@ -31,9 +49,13 @@ struct DemoApp : SlimApp {
     HUDLine BVHLine{(char*)"Show BVH     : ", (char*)"On",(char*)"Off", &draw_bvh, true, Cyan, DarkCyan};
     HUDLine MultiLine{(char*)"Cross Mesh     : ", (char*)"On",(char*)"Off", &multi, true, BrightBlue, Blue};
     HUDLine AdaptLine{(char*)"Adaptive Mode  : ", (char*)"On",(char*)"Off", &adaptive, true, Green, Red};
+    HUDLine WideLine{ (char*)"Wide BVH       : ", (char*)"On",(char*)"Off", &wide, true, Green, Red};
+    HUDLine MTLine{   (char*)"Multi-Threaded : ", (char*)"On",(char*)"Off", &multi_threaded, true, Green, Red};
+    HUDLine OrderLine{(char*)"Morton Order   : ", (char*)"On",(char*)"Off", &morton_order, true, Green, Red};
+    HUDLine WarmLine{ (char*)"Warm Start     : ", (char*)"On",(char*)"Off", &warm_start, true, Green, Red};
     HUDLine XPULine{  (char*)"CUDA GPU Mode  : ", (char*)"On",(char*)"Off", &run_on_GPU, true, Green, Red};
     HUDLine TimerLine{(char*)"Micro Seconds  : "};
-    HUDSettings hud_settings{8};
+    HUDSettings hud_settings{12};
     HUD hud{hud_settings, &QueryLine, White};
 
     // Scene:
@@ -68,11 +90,13 @@ struct DemoApp : SlimApp {
         String::getFilePath((char*)"cube.mesh" ,strings[2],(char*)__FILE__)
     };
     Mesh dog, monkey, cube, *meshes = &dog;
+    WideBVH wide_bvhs[3];
 
     SceneCounts counts{1, 4, 1, 0, 1, 3 };
     Scene scene{counts,nullptr, cameras, geometries, grids, nullptr,curves,
                 meshes, mesh_files, nullptr};
     Selection selection;
+    MeshVertexCache vertex_cache;
 
     Geometry *query_geo = &mesh1;
     ClosestPointOnMesh query{&dog};
@@ -93,12 +117,18 @@ struct DemoApp : SlimApp {
 
         query.mesh = &mesh;
         query.mesh_transform = &transform;
+        query.wide_bvh = wide ? &wide_bvhs[query_geo->id] : nullptr;
+        query.flag_nodes = draw_query_aabbs || draw_query_triangles;
+        query.morton_order = morton_order;
+        query.warm_start = warm_start;
         if (multi) {
             Geometry *source_geo = query_geo == &mesh1 ? &mesh2 : &mesh1;
-            runQueryOnXPU(query, source_geo, query_geo, max_distance, adaptive, scene,  (draw_query_aabbs || draw_query_triangles), run_on_GPU);
+            runQueryOnXPU(query, source_geo, query_geo, max_distance, adaptive, scene,  (draw_query_aabbs || draw_query_triangles), run_on_GPU,
+                          multi_threaded ? &thread_pool : nullptr);
         } else {
             query.search_origin_transform = nullptr;
-            query.find(sphere_geo.transform.position, max_distance, closest_point_on_triangle, adaptive);
+            u32 warm_start_triangle_index = warm_start && closest_point_on_triangle.on ? closest_point_on_triangle.triangle_index : (u32)-1;
+            query.find(sphere_geo.transform.position, max_distance, closest_point_on_triangle, adaptive, warm_start_triangle_index);
         }
 
         query_timer.endFrame();
@@ -120,7 +150,13 @@ struct DemoApp : SlimApp {
         sphere_center_transform.position = sphere_geo.transform.position;
 
         if (!query.stack) {
-        	query.allocate(dog.vertex_count);
+            query.allocate(dog.vertex_count, nullptr, thread_pool.thread_count, meshes, 3);
+            for (u32 i = 0; i < 3; i++)
+                if (wide_bvhs[i].allocate(meshes[i]))
+                    wide_bvhs[i].build(meshes[i]);
+            u32 max_vertex_count = 0;
+            for (u32 i = 0; i < 3; i++) if (max_vertex_count < meshes[i].vertex_count) max_vertex_count = meshes[i].vertex_count;
+            vertex_cache.allocate(max_vertex_count);
             allocateDeviceScene(scene);
             uploadMeshes(scene);
         }
@@ -131,8 +167,8 @@ struct DemoApp : SlimApp {
     void OnRender() override {
         canvas.clear();
         drawGrid(grid, grid1.transform, viewport, grid1.color, opacity);
-        drawMesh(meshes[mesh1.id], mesh1.transform, false, viewport, mesh1.color, opacity);
-        drawMesh(meshes[mesh2.id], mesh2.transform, false, viewport, mesh2.color, opacity);
+        drawMesh(meshes[mesh1.id], mesh1.transform, false, viewport, vertex_cache, mesh1.color, opacity);
+        drawMesh(meshes[mesh2.id], mesh2.transform, false, viewport, vertex_cache, mesh2.color, opacity);
         drawCurve(sphere, sphere_geo.transform, viewport, sphere_geo.color, 0.2f);
         drawCurve(sphere, sphere_center_transform, viewport, Cyan, 0.2f);
 
@@ -211,16 +247,16 @@ struct DemoApp : SlimApp {
 
     void drawQueryResult(ClosestPointOnTriangle &query_result) {
         static Edge edge;
-        static vec3 v1, v2, v3;
+        static vec3 v1, v2, v3, position, U, V;
 
         if (!query_result.on) return;
 
         drawEdgeToClosestPoint(query_result);
 
-        Triangle &triangle = query.mesh->triangles[query_result.triangle_index];
-        v1 = camera.internPos(query.mesh_transform->externPos(triangle.position));
-        v2 = camera.internPos(query.mesh_transform->externPos(triangle.position + triangle.V));
-        v3 = camera.internPos(query.mesh_transform->externPos(triangle.position + triangle.U));
+        query.mesh->getTriangle(query_result.triangle_index, position, U, V);
+        v1 = camera.internPos(query.mesh_transform->externPos(position));
+        v2 = camera.internPos(query.mesh_transform->externPos(position + V));
+        v3 = camera.internPos(query.mesh_transform->externPos(position + U));
 
         if (query_result.on == TrianglePointOn_Edge) {
             f32 u = query_result.uv.u;
@@ -242,7 +278,7 @@ struct DemoApp : SlimApp {
     }
 
     void drawQueryTriangles() const {
-        static vec3 pos, v1, v2, v3;
+        static vec3 position, U, V, v1, v2, v3;
         static Edge edge;
 
         Mesh &mesh = meshes[query_geo->id];
@@ -253,10 +289,10 @@ struct DemoApp : SlimApp {
                 u32 start = node.first_index;
                 u32 end = start + node.leaf_count;
                 for (u32 triangle_index = start; triangle_index < end; triangle_index++) {
-                    Triangle &triangle = mesh.triangles[triangle_index];
-                    v1 = camera.internPos(transform.externPos(triangle.position));
-                    v2 = camera.internPos(transform.externPos(triangle.position + triangle.V));
-                    v3 = camera.internPos(transform.externPos(triangle.position + triangle.U));
+                    mesh.getTriangle(triangle_index, position, U, V);
+                    v1 = camera.internPos(transform.externPos(position));
+                    v2 = camera.internPos(transform.externPos(position + V));
+                    v3 = camera.internPos(transform.externPos(position + U));
                     viewport.projectPoint(v1);
                     viewport.projectPoint(v2);
                     viewport.projectPoint(v3);
@@ -309,6 +345,10 @@ struct DemoApp : SlimApp {
             else if (key == 'G') draw_query_triangles = !draw_query_triangles;
             else if (key == 'T') draw_bvh = !draw_bvh;
             else if (key == 'V') adaptive = !adaptive;
+            else if (key == 'Y') wide = !wide;
+            else if (key == 'P') multi_threaded = !multi_threaded;
+            else if (key == 'O') morton_order = !morton_order;
+            else if (key == 'K') warm_start = !warm_start;
             else if (key == 'X') run_on_GPU = (USE_GPU_BY_DEFAULT ? !run_on_GPU : false);
             else if (key == '3') { if (min_depth > 0) min_depth--; }
             else if (key == '4') { if (min_depth < depth) min_depth++; }
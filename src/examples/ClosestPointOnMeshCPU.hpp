@@ -1,7 +1,10 @@
+#ifndef SLIM_SINGLE_HEADER_FILE
+#include "../slim/scene/scene.h"
+#endif
 #include "./ClosestPointOnMesh.hpp"
 
-void runQueryOnCPU(ClosestPointOnMesh &query, Geometry *source_geo, Scene &scene, f32 max_distance, bool adaptive) {
+void runQueryOnCPU(ClosestPointOnMesh &query, Geometry *source_geo, Scene &scene, f32 max_distance, bool adaptive, ThreadPool *thread_pool = nullptr) {
     query.search_origin_transform = &source_geo->transform;
     Mesh &source_mesh = scene.meshes[source_geo->id];
-    query.find(source_mesh.vertex_positions, source_mesh.vertex_count, max_distance, adaptive);
+    query.find(source_mesh.vertex_positions, source_mesh.vertex_count, max_distance, adaptive, thread_pool);
 }
\ No newline at end of file
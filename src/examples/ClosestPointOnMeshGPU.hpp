@@ -3,6 +3,8 @@
 Geometry   *d_geometries;
 Mesh       *d_meshes;
 Triangle   *d_triangles;
+CompactTriangle *d_compact_triangles;
+TriangleVertexIndices *d_vertex_position_indices;
 vec3       *d_vertices;
 BVHNode  *d_mesh_bvh_nodes;
 
@@ -14,16 +16,24 @@ ClosestPointOnTriangle *d_results;
 
 void allocateDeviceScene(Scene &scene) {
     u32 total_triangles = 0;
+    u32 total_compact_triangles = 0;
     u32 total_vertices = 0;
     if (scene.counts.geometries)   gpuErrchk(cudaMalloc(&d_geometries,   sizeof(Geometry)  * scene.counts.geometries))
     if (scene.counts.meshes) {
         for (u32 i = 0; i < scene.counts.meshes; i++) {
+            if (scene.meshes[i].triangle_layout == TriangleLayout_Compact)
+                total_compact_triangles += scene.meshes[i].triangle_count;
             total_triangles += scene.meshes[i].triangle_count;
             total_vertices += scene.meshes[i].vertex_count;
         }
 
+        // Compact triangles (and the vertex indices they rely on) are uploaded instead of full ones:
         gpuErrchk(cudaMalloc(&d_meshes,    sizeof(Mesh)     * scene.counts.meshes))
-        gpuErrchk(cudaMalloc(&d_triangles, sizeof(Triangle) * total_triangles))
+        gpuErrchk(cudaMalloc(&d_triangles, sizeof(Triangle) * (total_triangles - total_compact_triangles)))
+        if (total_compact_triangles) {
+            gpuErrchk(cudaMalloc(&d_compact_triangles,       sizeof(CompactTriangle)       * total_compact_triangles))
+            gpuErrchk(cudaMalloc(&d_vertex_position_indices, sizeof(TriangleVertexIndices) * total_compact_triangles))
+        }
         gpuErrchk(cudaMalloc(&d_vertices,  sizeof(vec3)     * total_vertices))
         gpuErrchk(cudaMalloc(&d_mesh_bvh_node_counts, sizeof(u32) * scene.counts.meshes))
         gpuErrchk(cudaMalloc(&d_mesh_triangle_counts, sizeof(u32) * scene.counts.meshes))
@@ -44,13 +54,20 @@ void uploadMeshes(Scene &scene) {
     Mesh *mesh = scene.meshes;
     u32 nodes_offset = 0;
     u32 triangles_offset = 0;
+    u32 compact_triangles_offset = 0;
     u32 vertex_offset = 0;
     for (u32 i = 0; i < scene.counts.meshes; i++, mesh++) {
         uploadNto(mesh->bvh.nodes, d_mesh_bvh_nodes, mesh->bvh.node_count, nodes_offset)
-        uploadNto(mesh->triangles, d_triangles,      mesh->triangle_count, triangles_offset)
+        if (mesh->triangle_layout == TriangleLayout_Compact) {
+            uploadNto(mesh->compact_triangles,       d_compact_triangles,       mesh->triangle_count, compact_triangles_offset)
+            uploadNto(mesh->vertex_position_indices, d_vertex_position_indices, mesh->triangle_count, compact_triangles_offset)
+            compact_triangles_offset += mesh->triangle_count;
+        } else {
+            uploadNto(mesh->triangles, d_triangles,      mesh->triangle_count, triangles_offset)
+            triangles_offset    += mesh->triangle_count;
+        }
         uploadNto(mesh->vertex_positions, d_vertices,      mesh->vertex_count, vertex_offset)
         nodes_offset        += mesh->bvh.node_count;
-        triangles_offset    += mesh->triangle_count;
         vertex_offset       += mesh->vertex_count;
     }
 
@@ -74,6 +91,8 @@ __global__ void d_runQuery(
 		BVHNode  *mesh_bvh_nodes,
         Mesh       *meshes,
         Triangle   *mesh_triangles,
+        CompactTriangle *mesh_compact_triangles,
+        TriangleVertexIndices *mesh_vertex_position_indices,
         vec3       *mesh_vertices,
         Geometry   *geometries,
 
@@ -90,15 +109,22 @@ __global__ void d_runQuery(
     Mesh *mesh = meshes;
     u32 nodes_offset = 0;
     u32 triangles_offset = 0;
+    u32 compact_triangles_offset = 0;
     u32 vertex_offset = 0;
     for (u32 m = 0; m < mesh_count; m++, mesh++) {
         mesh->bvh.node_count = mesh_bvh_node_counts[m];
-        mesh->triangles        = mesh_triangles + triangles_offset;
-        mesh->vertex_positions = mesh_vertices + nodes_offset;
-        mesh->bvh.nodes      = mesh_bvh_nodes + vertex_offset;
+        if (mesh->triangle_layout == TriangleLayout_Compact) {
+            mesh->compact_triangles       = mesh_compact_triangles + compact_triangles_offset;
+            mesh->vertex_position_indices = mesh_vertex_position_indices + compact_triangles_offset;
+            compact_triangles_offset += mesh->triangle_count;
+        } else {
+            mesh->triangles        = mesh_triangles + triangles_offset;
+            triangles_offset    += mesh->triangle_count;
+        }
+        mesh->vertex_positions = mesh_vertices + vertex_offset;
+        mesh->bvh.nodes      = mesh_bvh_nodes + nodes_offset;
 
         nodes_offset        += mesh->bvh.node_count;
-        triangles_offset    += mesh->triangle_count;
         vertex_offset       += mesh->vertex_count;
     }
     mesh = meshes + target_mesh_id;
@@ -160,6 +186,8 @@ void runQueryOnGPU(ClosestPointOnMesh &query, Geometry *source_geo, Geometry *ta
         d_mesh_bvh_nodes,
         d_meshes,
         d_triangles,
+        d_compact_triangles,
+        d_vertex_position_indices,
         d_vertices,
         d_geometries,
 
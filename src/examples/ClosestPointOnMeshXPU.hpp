@@ -6,9 +6,9 @@
 #include "./ClosestPointOnMeshGPU.hpp"
 #define USE_GPU_BY_DEFAULT true
 
-void runQueryOnXPU(ClosestPointOnMesh &query, Geometry *source_geo, Geometry *target_geo, f32 max_distance, bool adaptive, Scene &scene, bool nodes_are_drawing, bool on_gpu = false) {
+void runQueryOnXPU(ClosestPointOnMesh &query, Geometry *source_geo, Geometry *target_geo, f32 max_distance, bool adaptive, Scene &scene, bool nodes_are_drawing, bool on_gpu = false, ThreadPool *thread_pool = nullptr) {
     if (on_gpu) runQueryOnGPU(query, source_geo, target_geo, max_distance, adaptive, scene, nodes_are_drawing);
-    else        runQueryOnCPU(query, source_geo, scene, max_distance, adaptive);
+    else        runQueryOnCPU(query, source_geo, scene, max_distance, adaptive, thread_pool);
 }
 
 #else
@@ -18,8 +18,8 @@ void allocateDeviceScene(Scene &scene) {}
 void uploadScene(Scene &scene) {}
 void uploadMeshes(Scene &scene) {}
 
-void runQueryOnXPU(ClosestPointOnMesh &query, Geometry *source_geo, Geometry *target_geo, f32 max_distance, bool adaptive, Scene &scene, bool nodes_are_drawing, bool on_gpu = false) {
-    runQueryOnCPU(query, source_geo, scene, max_distance, adaptive);
+void runQueryOnXPU(ClosestPointOnMesh &query, Geometry *source_geo, Geometry *target_geo, f32 max_distance, bool adaptive, Scene &scene, bool nodes_are_drawing, bool on_gpu = false, ThreadPool *thread_pool = nullptr) {
+    runQueryOnCPU(query, source_geo, scene, max_distance, adaptive, thread_pool);
 }
 #endif
 
@@ -1,8 +1,10 @@
 #pragma once
 
-#include "../slim.h"
-
-constexpr float ONE_OVER_SQRT2 = 0.70710678118f;
+#ifndef SLIM_SINGLE_HEADER_FILE
+#include "../slim/scene/wide_bvh.h"
+#endif
+// Or using the single-header file:
+//#include "../slim.h"
 
 enum TrianglePointOn {
     TrianglePointOn_None = 0,
@@ -31,9 +33,20 @@ struct ClosestPointOnTriangle {
     INLINE_XPU TrianglePointOn find(const Triangle &triangle, u32 index = (u32)-1) {
         vec3 tangent_space_point = triangle.local_to_tangent * (search_origin - triangle.position);
         f32 u, v;
-        f32 x = tangent_space_point.x;
-        f32 y = tangent_space_point.y;
+        TrianglePointOn found_on = findUV(tangent_space_point.x, tangent_space_point.y, u, v);
+        return update(triangle.position + (triangle.U * u) + (triangle.V * v), u, v, found_on, index);
+    }
+
+    // The same as above for a compact triangle, with its position and edges derived from its vertices:
+    INLINE_XPU TrianglePointOn find(const CompactTriangle &triangle, const vec3 &v1, const vec3 &v2, const vec3 &v3, u32 index = (u32)-1) {
+        vec3 offset{search_origin - v1};
+        f32 u, v;
+        TrianglePointOn found_on = findUV(triangle.tangent_u.dot(offset), triangle.tangent_v.dot(offset), u, v);
+        return update(v1 + ((v3 - v1) * u) + ((v2 - v1) * v), u, v, found_on, index);
+    }
 
+    // Finds the closest point on the triangle in its tangent space, where it is the unit right triangle:
+    INLINE_XPU static TrianglePointOn findUV(f32 x, f32 y, f32 &u, f32 &v) {
         TrianglePointOn found_on;
 
         if (x < 0) { // Point is outside on the left, find the closest point on the left edge:
@@ -69,19 +82,20 @@ struct ClosestPointOnTriangle {
             // Let R be the bottom-right vertex      : R = [1, 0]
             // Let D be a vector from T to R         : D = R - T  = [1, 0] - [0, 1] = [1, -1]
             // Let P be a vector from T to Q         : P = Q - T  = [x, y] - [0, 1] = [x, y - 1]
-            // Let D^ be the norm of D               : D^ = norm(D) = [c, -c]  where: c = 1 / sqrt(2)
-            // Let P` be the projection of P onto D^ : P` = proj(P, D) = D * t where: t = dot(P, D^)
+            // Let P` be the projection of P onto D  : P` = proj(P, D) = D * t where: t = dot(P, D) / dot(D, D)
             // Q` = T + P` = T + D * t = [0, 1] + [1, -1] * t = [u, v]
             // u = 0 + 1 * t = t
             // v = 1 + -1 * t = 1 - t = 1 - u
-            // u = t = dot([x, y - 1], [c, -c]]) = x * c + (y - 1) * (-c) = x * c + (1 - y) * c = c * (x - y + 1)
-            // u = 1 / sqrt(2) * (x - y + 1)
-            u = ONE_OVER_SQRT2 * (x - y + 1);
+            // u = t = dot([x, y - 1], [1, -1]) / dot([1, -1], [1, -1]) = (x - y + 1) / 2
+            u = 0.5f * (x - y + 1);
             v = 1 - u;
             found_on = TrianglePointOn_Edge;
         }
 
-        vec3 current_point{triangle.position + (triangle.U * u) + (triangle.V * v)};
+        return found_on;
+    }
+
+    INLINE_XPU TrianglePointOn update(const vec3 &current_point, f32 u, f32 v, TrianglePointOn found_on, u32 index) {
         f32 current_distance_squared = (current_point - search_origin).squaredLength();
         if (current_distance_squared < squared_distance) {
             squared_distance = current_distance_squared;
@@ -99,4 +113,103 @@ struct ClosestPointOnTriangle {
     INLINE_XPU void find(const Triangle *triangles, u32 start, u32 end) {
         for (u32 i = start; i < end; i++) find(triangles[i], i);
     }
-};
\ No newline at end of file
+
+    INLINE_XPU void find(const Mesh &mesh, u32 start, u32 end) {
+        if (mesh.triangle_layout == TriangleLayout_Compact) {
+            for (u32 i = start; i < end; i++) {
+                const TriangleVertexIndices &indices = mesh.vertex_position_indices[i];
+                find(mesh.compact_triangles[i],
+                     mesh.vertex_positions[indices.v1],
+                     mesh.vertex_positions[indices.v2],
+                     mesh.vertex_positions[indices.v3], i);
+            }
+        } else
+            find(mesh.triangles, start, end);
+    }
+#ifndef __CUDA_ARCH__
+    // The same as finding in each of the packet's triangles in turn, but with all of them evaluated at once:
+    // Every case above is computed for all lanes and then selected by lane-masks, from the last case to the first
+    // (so that earlier cases take precedence as they do above). Only the final pick of the closest lane is scalar.
+    void find(const TrianglePacket &packet) {
+        simd4_f32 zero = simd::set4(0);
+        simd4_f32 one = simd::set4(1);
+        simd4_f32 on_face = simd::set4((f32)TrianglePointOn_Face);
+        simd4_f32 on_edge = simd::set4((f32)TrianglePointOn_Edge);
+        simd4_f32 on_vertex = simd::set4((f32)TrianglePointOn_Vertex);
+
+        simd4_f32 origin_x = simd::set4(search_origin.x);
+        simd4_f32 origin_y = simd::set4(search_origin.y);
+        simd4_f32 origin_z = simd::set4(search_origin.z);
+        simd4_f32 position_x = simd::load4(packet.position_x);
+        simd4_f32 position_y = simd::load4(packet.position_y);
+        simd4_f32 position_z = simd::load4(packet.position_z);
+        simd4_f32 dx = simd::sub(origin_x, position_x);
+        simd4_f32 dy = simd::sub(origin_y, position_y);
+        simd4_f32 dz = simd::sub(origin_z, position_z);
+        simd4_f32 x = simd::add(simd::add(simd::mul(simd::load4(packet.tangent_x_x), dx),
+                                          simd::mul(simd::load4(packet.tangent_x_y), dy)),
+                                          simd::mul(simd::load4(packet.tangent_x_z), dz));
+        simd4_f32 y = simd::add(simd::add(simd::mul(simd::load4(packet.tangent_y_x), dx),
+                                          simd::mul(simd::load4(packet.tangent_y_y), dy)),
+                                          simd::mul(simd::load4(packet.tangent_y_z), dz));
+
+        simd4_f32 is_left = simd::lessThan(x, zero);
+        simd4_f32 is_below = simd::lessThan(y, zero);
+        simd4_f32 is_over = simd::lessOrEqual(simd::add(x, y), one);
+        simd4_f32 is_above = simd::lessOrEqual(x, simd::sub(y, one));
+        simd4_f32 is_right = simd::lessOrEqual(y, simd::sub(x, one));
+
+        // Above and to the right (projected onto the diagonal-edge):
+        simd4_f32 u = simd::mul(simd::set4(0.5f), simd::add(simd::sub(x, y), one));
+        simd4_f32 v = simd::sub(one, u);
+        simd4_f32 found_on = on_edge;
+
+        u = simd::select(is_right, one, u);
+        v = simd::select(is_right, zero, v);
+        found_on = simd::select(is_right, on_vertex, found_on);
+
+        u = simd::select(is_above, zero, u);
+        v = simd::select(is_above, one, v);
+        found_on = simd::select(is_above, on_vertex, found_on);
+
+        u = simd::select(is_over, x, u);
+        v = simd::select(is_over, y, v);
+        found_on = simd::select(is_over, on_face, found_on);
+
+        u = simd::select(is_below, simd::max(simd::min(x, one), zero), u);
+        v = simd::select(is_below, zero, v);
+        found_on = simd::select(is_below, simd::select(simd::lessThan(one, x), on_vertex, on_edge), found_on);
+
+        u = simd::select(is_left, zero, u);
+        v = simd::select(is_left, simd::max(simd::min(y, one), zero), v);
+        found_on = simd::select(is_left, simd::select(simd::maskOr(is_below, simd::lessThan(one, y)), on_vertex, on_edge), found_on);
+
+        simd4_f32 point_x = simd::add(simd::add(position_x, simd::mul(simd::load4(packet.U_x), u)), simd::mul(simd::load4(packet.V_x), v));
+        simd4_f32 point_y = simd::add(simd::add(position_y, simd::mul(simd::load4(packet.U_y), u)), simd::mul(simd::load4(packet.V_y), v));
+        simd4_f32 point_z = simd::add(simd::add(position_z, simd::mul(simd::load4(packet.U_z), u)), simd::mul(simd::load4(packet.V_z), v));
+        dx = simd::sub(point_x, origin_x);
+        dy = simd::sub(point_y, origin_y);
+        dz = simd::sub(point_z, origin_z);
+        simd4_f32 distances_squared = simd::add(simd::add(simd::mul(dx, dx), simd::mul(dy, dy)), simd::mul(dz, dz));
+
+        f32 lane_distances_squared[TRIANGLE_PACKET_WIDTH];
+        simd::store4(lane_distances_squared, distances_squared);
+        i32 closest = -1;
+        for (u8 i = 0; i < packet.count; i++)
+            if (lane_distances_squared[i] < squared_distance) {
+                squared_distance = lane_distances_squared[i];
+                closest = i;
+            }
+        if (closest == -1) return;
+
+        f32 lanes[TRIANGLE_PACKET_WIDTH];
+        simd::store4(lanes, u);         uv.u = lanes[closest];
+        simd::store4(lanes, v);         uv.v = lanes[closest];
+        simd::store4(lanes, point_x);   closest_point.x = lanes[closest];
+        simd::store4(lanes, point_y);   closest_point.y = lanes[closest];
+        simd::store4(lanes, point_z);   closest_point.z = lanes[closest];
+        simd::store4(lanes, found_on);  on = (TrianglePointOn)(u8)lanes[closest];
+        triangle_index = packet.first_index + closest;
+    }
+#endif
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "./ClosestPointOnMesh.hpp"
+
+// The closest points of a search origin on several triangles of a mesh, sorted by distance (nearest first):
+struct ClosestPointsOnTriangles {
+    ClosestPointOnTriangle *points = nullptr;
+    u32 count = 0;
+    bool truncated = false; // Whether the result arena ran out of memory before all triangles were gathered
+};
+
+struct ClosestPointsOnMesh {
+    // Finds either the k nearest triangles to a search origin, or all the triangles within a radius of it.
+    // The k nearest are kept in a max-heap, so that once there are k of them the search radius shrinks down to the
+    // farthest one (which is the one being replaced by any closer triangle found later on).
+    // Results are written into a caller-provided arena (one per thread for batches), to which triangles within
+    // a radius are appended one at a time (so the arena must not be used by anything else during a query).
+    // As with ClosestPointOnMesh, squared distances are in the mesh's space while the closest points are not.
+
+    Mesh *mesh = nullptr;
+    Transform *mesh_transform = nullptr;
+    Transform *search_origin_transform = nullptr;
+    u32 *stack = nullptr;
+    u32 max_stack_size = 0;
+    u32 stack_count = 0;
+
+    u32 findNearest(vec3 search_origin, u32 k, f32 max_distance, ClosestPointsOnTriangles &result, memory::MonotonicAllocator &arena) const {
+        return find(search_origin, max_distance, k, result, arena);
+    }
+
+    u32 findWithinRadius(vec3 search_origin, f32 radius, ClosestPointsOnTriangles &result, memory::MonotonicAllocator &arena) const {
+        return find(search_origin, radius, 0, result, arena);
+    }
+
+    // A k of 0 finds all the triangles within the radius:
+    u32 find(vec3 search_origin, f32 radius, u32 k, ClosestPointsOnTriangles &result, memory::MonotonicAllocator &arena) const {
+        result = ClosestPointsOnTriangles{};
+        if (k) {
+            if (!hasRoomFor(arena, k)) {
+                result.truncated = true;
+                return 0;
+            }
+            result.points = (ClosestPointOnTriangle*)arena.allocate(sizeof(ClosestPointOnTriangle) * k);
+        } else
+            result.points = (ClosestPointOnTriangle*)arena.address;
+
+        if (search_origin_transform) search_origin = search_origin_transform->externPos(search_origin);
+        vec3 origin = mesh_transform ? mesh_transform->internPos(search_origin) : search_origin;
+        f32 squared_radius = radius * radius;
+
+        BVHNode *nodes = mesh->bvh.nodes;
+        i32 stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            BVHNode &node = nodes[stack[--stack_size]];
+            if (!node.aabb.overlapSphere(origin, radius))
+                continue;
+
+            if (!node.isLeaf()) {
+                // Visit the nearer child first (pushing it last), as the radius can then shrink sooner:
+                u32 near_child = node.first_index;
+                u32 far_child = node.first_index + 1;
+                if (k && squaredDistance(nodes[far_child].aabb, origin) < squaredDistance(nodes[near_child].aabb, origin)) {
+                    near_child = far_child;
+                    far_child = node.first_index;
+                }
+                stack[stack_size++] = far_child;
+                stack[stack_size++] = near_child;
+                continue;
+            }
+
+            for (u32 triangle_index = node.first_index; triangle_index < node.first_index + node.leaf_count; triangle_index++) {
+                ClosestPointOnTriangle point{origin, 0};
+                point.squared_distance = squared_radius;
+                point.find(*mesh, triangle_index, triangle_index + 1);
+                if (!point.on) continue;
+
+                if (!k) {
+                    if (!hasRoomFor(arena, 1)) {
+                        result.truncated = true;
+                        continue;
+                    }
+                    *(ClosestPointOnTriangle*)arena.allocate(sizeof(ClosestPointOnTriangle)) = point;
+                    result.count++;
+                } else if (result.count < k) {
+                    // Sift the new point up the heap:
+                    u32 i = result.count++;
+                    for (u32 parent = (i - 1) / 2; i && result.points[parent].squared_distance < point.squared_distance; parent = (i - 1) / 2) {
+                        result.points[i] = result.points[parent];
+                        i = parent;
+                    }
+                    result.points[i] = point;
+                } else {
+                    // Replace the farthest point (which is farther than this one, as it bounds the radius):
+                    result.points[0] = point;
+                    siftDown(result.points, 0, k);
+                }
+
+                if (k && result.count == k) {
+                    squared_radius = result.points[0].squared_distance;
+                    radius = sqrtf(squared_radius);
+                }
+            }
+        }
+
+        sortByDistance(result.points, result.count);
+        for (u32 i = 0; i < result.count; i++) {
+            ClosestPointOnTriangle &point = result.points[i];
+            point.search_origin = search_origin;
+            if (mesh_transform) point.closest_point = mesh_transform->externPos(point.closest_point);
+        }
+
+        return result.count;
+    }
+
+    INLINE static f32 squaredDistance(const AABB &aabb, const vec3 &point) {
+        vec3 delta = maximum(maximum(aabb.min - point, point - aabb.max), vec3{0});
+        return delta.squaredLength();
+    }
+
+    INLINE static bool hasRoomFor(const memory::MonotonicAllocator &arena, u32 point_count) {
+        return arena.address && arena.occupied + sizeof(ClosestPointOnTriangle) * point_count <= arena.capacity;
+    }
+
+    // Restores the max-heap order below a point that might be closer than its children:
+    static void siftDown(ClosestPointOnTriangle *points, u32 i, u32 count) {
+        ClosestPointOnTriangle point = points[i];
+        for (u32 child = i * 2 + 1; child < count; child = i * 2 + 1) {
+            if (child + 1 < count && points[child + 1].squared_distance > points[child].squared_distance) child++;
+            if (points[child].squared_distance <= point.squared_distance) break;
+            points[i] = points[child];
+            i = child;
+        }
+        points[i] = point;
+    }
+
+    // Heap-sorts the points by distance (nearest first):
+    static void sortByDistance(ClosestPointOnTriangle *points, u32 count) {
+        for (u32 i = count / 2; i-- > 0;) siftDown(points, i, count);
+        for (u32 end = count; end > 1;) {
+            end--;
+            ClosestPointOnTriangle farthest = points[0];
+            points[0] = points[end];
+            points[end] = farthest;
+            siftDown(points, 0, end);
+        }
+    }
+
+    struct BatchJob {
+        const ClosestPointsOnMesh *query;
+        const vec3 *search_origins;
+        f32 radius;
+        u32 k;
+        ClosestPointsOnTriangles *results;
+        memory::MonotonicAllocator *arenas;
+    };
+
+    static void findBatchJob(void *data, u32 start, u32 end, u32 thread_index) {
+        BatchJob &job = *(BatchJob*)data;
+        ClosestPointsOnMesh query{*job.query};
+        query.stack += query.max_stack_size * thread_index;
+        for (u32 i = start; i < end; i++)
+            query.find(job.search_origins[i], job.radius, job.k, job.results[i], job.arenas[thread_index]);
+    }
+
+    // Batches run on the thread pool given stacks (see allocate) and arenas for all its threads,
+    // otherwise they run on the calling thread using the first arena:
+    void find(const vec3 *search_origins, u32 search_origins_count, f32 radius, u32 k,
+              ClosestPointsOnTriangles *results, memory::MonotonicAllocator *arenas, ThreadPool *thread_pool = nullptr) const {
+        BatchJob job{this, search_origins, radius, k, results, arenas};
+        if (thread_pool && thread_pool->thread_count > 1 && stack_count >= thread_pool->thread_count)
+            thread_pool->parallelFor(search_origins_count, CLOSEST_POINT_ON_MESH_CHUNK_SIZE, findBatchJob, &job, 0);
+        else
+            findBatchJob(&job, 0, search_origins_count, 0);
+    }
+
+    void findNearest(const vec3 *search_origins, u32 search_origins_count, u32 k, f32 max_distance,
+                     ClosestPointsOnTriangles *results, memory::MonotonicAllocator *arenas, ThreadPool *thread_pool = nullptr) const {
+        if (k) find(search_origins, search_origins_count, max_distance, k, results, arenas, thread_pool);
+    }
+
+    void findWithinRadius(const vec3 *search_origins, u32 search_origins_count, f32 radius,
+                          ClosestPointsOnTriangles *results, memory::MonotonicAllocator *arenas, ThreadPool *thread_pool = nullptr) const {
+        find(search_origins, search_origins_count, radius, 0, results, arenas, thread_pool);
+    }
+
+    void allocate(u32 thread_count = 1, memory::MonotonicAllocator *allocator = nullptr) {
+        if (stack) return;
+
+        // Starting from the root adds no entries (it is popped before its children get pushed):
+        stack_count = thread_count ? thread_count : 1;
+        max_stack_size = ClosestPointOnMesh::getMaxStackSize(mesh->bvh);
+        u64 capacity = sizeof(u32) * max_stack_size * stack_count;
+
+        memory::MonotonicAllocator tmp;
+        if (!allocator || allocator->capacity - allocator->occupied < capacity) {
+            allocator = &tmp;
+            tmp = memory::MonotonicAllocator{capacity};
+        }
+        stack = (u32*)allocator->allocate(capacity);
+    }
+};
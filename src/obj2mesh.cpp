@@ -9,15 +9,17 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <chrono>
 #include <unordered_set>
 
+#ifdef _WIN32
 #include "./slim/platforms/win32_base.h"
+#else
+#include "./slim/platforms/posix_base.h"
+#endif
 #include "./slim/scene/bvh_builder.h"
 #include "./slim/serialization/mesh.h"
 
-// Or using the single-header file:
-// #include "../slim.h"
-
 enum VertexAttributes {
     VertexAttributes_None,
     VertexAttributes_Positions,
@@ -25,7 +27,26 @@ enum VertexAttributes {
     VertexAttributes_PositionsUVsAndNormals
 };
 
-int obj2mesh(char* obj_file_path, char* mesh_file_path, bool invert_winding_order = false, f32 scale = 1, float rotY = 0) {
+void buildBVH(BVHBuilder &builder, Mesh &mesh, BVHBuildMode mode, bool report) {
+    builder.mode = mode;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    builder.buildMesh(mesh);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    if (report) {
+        if (mode == BVHBuildMode_Binned) printf("BVH (binned, %d bins", (int)builder.bin_count);
+        else                             printf("BVH (full sweep");
+        printf(", %d threads): ", builder.thread_pool ? (int)builder.thread_pool->thread_count : 1);
+        printf("%.3f ms, %lu nodes, height %d, SAH cost %.3f\n",
+               std::chrono::duration<double, std::milli>(end - start).count(),
+               (unsigned long)mesh.bvh.node_count, (int)mesh.bvh.height, mesh.bvh.getSAHCost());
+    }
+}
+
+int obj2mesh(char* obj_file_path, char* mesh_file_path, bool invert_winding_order = false, f32 scale = 1, float rotY = 0,
+             BVHBuildMode bvh_build_mode = BVHBuildMode_Binned, u8 bvh_bin_count = BVH_DEFAULT_BIN_COUNT, bool bvh_report = false,
+             u32 bvh_thread_count = 0) {
     const u8 v1_id = 0;
     const u8 v2_id = invert_winding_order ? 2 : 1;
     const u8 v3_id = invert_winding_order ? 1 : 2;
@@ -127,10 +148,11 @@ int obj2mesh(char* obj_file_path, char* mesh_file_path, bool invert_winding_orde
     mesh.bvh.height = (u8)mesh.triangle_count;
 
     u64 memory_capacity = getSizeInBytes(mesh);
-    memory_capacity += BVHBuilder::getSizeInBytes(mesh.triangle_count * 2);
+    ThreadPool thread_pool{bvh_thread_count};
+    memory_capacity += BVHBuilder::getSizeInBytes(mesh.triangle_count * 2, thread_pool.thread_count);
     memory::MonotonicAllocator memory_allocator{memory_capacity};
     allocateMemory(mesh, &memory_allocator);
-    BVHBuilder builder{&mesh, 1, &memory_allocator};
+    BVHBuilder builder{&mesh, 1, &memory_allocator, &thread_pool};
 
     vec3 *vertex_position = mesh.vertex_positions;
     vec3 *vertex_normal = mesh.vertex_normals;
@@ -230,59 +252,61 @@ int obj2mesh(char* obj_file_path, char* mesh_file_path, bool invert_winding_orde
             mesh.vertex_positions[i] -= centroid;
     }
 
-    builder.buildMesh(mesh);
+    builder.bin_count = bvh_bin_count;
+    if (bvh_report) // Build with the other mode first, for comparison:
+        buildBVH(builder, mesh, bvh_build_mode == BVHBuildMode_Binned ? BVHBuildMode_Sweep : BVHBuildMode_Binned, true);
+    buildBVH(builder, mesh, bvh_build_mode, bvh_report);
     save(mesh, mesh_file_path);
 
     return 0;
 }
 
+bool hasPrefix(char *arg, const char *prefix) {
+    while (*prefix) if (*(arg++) != *(prefix++)) return false;
+    return true;
+}
+
 int main(int argc, char *argv[]) {
     if (argc == 2 && !strcmp(argv[1], (char*)"--help")) {
         printf((char*)("Exactly 2 file paths need to be provided: "
                        "An '.obj' file (input) then a '.mesh' file (output), "
                        "an optional flag '-invert_winding_order' for inverting winding order"
                        "an optional flag 'scale:<float>' for scaling the mesh,"
-                       "an optional flag 'rotY:<float> for rotating the mesh around Y"
+                       "an optional flag 'rotY:<float> for rotating the mesh around Y,"
+                       "an optional flag '-sweep' for building a higher quality BVH (slower),"
+                       "an optional flag 'bins:<int>' for the bin count of the default (binned) BVH build,"
+                       "an optional flag 'threads:<int>' for the number of threads building the BVH (default: all cores),"
+                       "an optional flag '-bvh_report' for reporting build times and SAH costs of both BVH builds"
                        ));
         return 0;
-    } else if (argc == 3 || // 2 arguments
-               argc == 4 || // 3 arguments
-               argc == 5 || // 4 arguments
-               argc == 6    // 5 arguments
-            ) {
+    } else if (argc >= 3) {
         char *obj_file_path = argv[1];
         char *mesh_file_path = argv[2];
         if (argc == 3) return obj2mesh(obj_file_path, mesh_file_path);
 
         bool invert_winding_order = false;
+        bool bvh_report = false;
         float scale{1}, rotY{0};
+        BVHBuildMode bvh_build_mode = BVHBuildMode_Binned;
+        u8 bvh_bin_count = BVH_DEFAULT_BIN_COUNT;
+        u32 bvh_thread_count = 0;
         for (u32 i = 3; i < (u32)argc; i++) {
             char *arg = argv[i];
-            if (strcmp(arg, (char *) "-invert_winding_order") == 0)
-                invert_winding_order = true;
-            else {
-                char *scale_arg_prefix = (char *) "scale:";
-                bool is_scale_arg = true;
-                for (u32 c = 0; c < 6; c++)
-                    if (arg[c] != scale_arg_prefix[c]) {
-                        is_scale_arg = false;
-                        break;
-                    }
-                if (is_scale_arg)
-                    scale = (f32)atof(arg + 6);
-                else {
-                    char *rotY_arg_prefix = (char *) "rotY:";
-                    bool is_rotY_arg = true;
-                    for (u32 c = 0; c < 5; c++)
-                        if (arg[c] != rotY_arg_prefix[c]) {
-                            is_rotY_arg = false;
-                            break;
-                        }
-                    if (is_rotY_arg) rotY = (f32)atof(arg + 5);
-                }
+            if (     strcmp(arg, (char*)"-invert_winding_order") == 0) invert_winding_order = true;
+            else if (strcmp(arg, (char*)"-sweep") == 0) bvh_build_mode = BVHBuildMode_Sweep;
+            else if (strcmp(arg, (char*)"-bvh_report") == 0) bvh_report = true;
+            else if (hasPrefix(arg, "scale:")) scale = (f32)atof(arg + 6);
+            else if (hasPrefix(arg, "rotY:")) rotY = (f32)atof(arg + 5);
+            else if (hasPrefix(arg, "bins:")) {
+                int bins = atoi(arg + 5);
+                bvh_bin_count = (u8)(bins < 2 ? 2 : (bins > BVH_MAX_BIN_COUNT ? BVH_MAX_BIN_COUNT : bins));
+            }
+            else if (hasPrefix(arg, "threads:")) {
+                int threads = atoi(arg + 8);
+                bvh_thread_count = threads < 1 ? 1 : (u32)threads;
             }
         }
-        return obj2mesh(obj_file_path, mesh_file_path, invert_winding_order, scale, rotY);
+        return obj2mesh(obj_file_path, mesh_file_path, invert_winding_order, scale, rotY, bvh_build_mode, bvh_bin_count, bvh_report, bvh_thread_count);
     }
 
     printf((char*)("Exactly 2 file paths need to be provided: "
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+#ifdef _WIN32
+#include "./slim/platforms/win32_base.h"
+#else
+#include "./slim/platforms/posix_base.h"
+#endif
+#include "./slim/scene/camera.h"
+#include "./slim/scene/ray_packet.h"
+#include "./slim/scene/scene.h"
+#include "./slim/scene/bvh_builder.h"
+#include "./slim/serialization/mesh.h"
+
+// Packets cover tiles of neighbouring pixels (2x2 for 4 rays, 4x2 for 8 rays), keeping their rays coherent:
+#define RAY_PACKET_TILE_HEIGHT 2
+#define RAY_PACKET_TILE_WIDTH (RAY_PACKET_WIDTH / RAY_PACKET_TILE_HEIGHT)
+
+struct RayBenchResult {
+    f64 seconds;
+    u32 hits;
+    f32 distances_sum;
+};
+
+f64 getSecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<f64>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+RayBenchResult traceSingleRays(const Mesh &mesh, const Camera &camera, u32 width, u32 height, u32 frames) {
+    RayBenchResult result{0, 0, 0};
+    auto start = std::chrono::high_resolution_clock::now();
+    Ray ray;
+    ray.origin = camera.position;
+    for (u32 frame = 0; frame < frames; frame++)
+        for (u32 y = 0; y < height; y++)
+            for (u32 x = 0; x < width; x++) {
+                ray.direction = camera.getRayDirectionAt((f32)x, (f32)y, (f32)width, (f32)height);
+                if (mesh.castRay(ray)) {
+                    result.hits++;
+                    result.distances_sum += ray.hit.distance;
+                }
+            }
+    result.seconds = getSecondsSince(start);
+    return result;
+}
+
+RayBenchResult traceRayPackets(const Mesh &mesh, const Camera &camera, u32 width, u32 height, u32 frames) {
+    RayBenchResult result{0, 0, 0};
+    auto start = std::chrono::high_resolution_clock::now();
+    RayPacket packet;
+    for (u32 frame = 0; frame < frames; frame++)
+        for (u32 tile_y = 0; tile_y < height; tile_y += RAY_PACKET_TILE_HEIGHT)
+            for (u32 tile_x = 0; tile_x < width; tile_x += RAY_PACKET_TILE_WIDTH) {
+                for (u8 lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+                    u32 x = tile_x + lane % RAY_PACKET_TILE_WIDTH;
+                    u32 y = tile_y + lane / RAY_PACKET_TILE_WIDTH;
+                    if (x < width && y < height)
+                        packet.setRay(lane, camera.position, camera.getRayDirectionAt((f32)x, (f32)y, (f32)width, (f32)height));
+                    else
+                        packet.disableRay(lane);
+                }
+
+                u32 hits = packet.castOn(mesh);
+                for (u8 lane = 0; hits; lane++, hits >>= 1)
+                    if (hits & 1) {
+                        result.hits++;
+                        result.distances_sum += packet.distance[lane];
+                    }
+            }
+    result.seconds = getSecondsSince(start);
+    return result;
+}
+
+void report(const char *name, const RayBenchResult &result, u64 ray_count) {
+    printf("%s: %.3f s, %.2f Mrays/s, %u hits (distances sum: %.3f)\n",
+           name, result.seconds, (f64)ray_count / (result.seconds * 1000000.0), result.hits, result.distances_sum);
+}
+
+// Scenes of many instances of the mesh are traced through the scene's TLAS, or through all of its geometries in turn:
+RayBenchResult traceScene(const Scene &scene, const Camera &camera, u32 width, u32 height, RayHit *hits = nullptr) {
+    RayBenchResult result{0, 0, 0};
+    auto start = std::chrono::high_resolution_clock::now();
+    Ray ray;
+    for (u32 y = 0; y < height; y++)
+        for (u32 x = 0; x < width; x++) {
+            ray.origin = camera.position;
+            ray.direction = camera.getRayDirectionAt((f32)x, (f32)y, (f32)width, (f32)height);
+            ray.hit.distance_squared = INFINITY;
+            if (scene.castRay(ray)) {
+                result.hits++;
+                result.distances_sum += ray.hit.distance;
+            } else
+                ray.hit.geo_id = (u32)-1;
+            if (hits) hits[y * width + x] = ray.hit;
+        }
+    result.seconds = getSecondsSince(start);
+    return result;
+}
+
+// Counts the rays for which the TLAS found a different hit than testing all the geometries did:
+u32 countMismatchedHits(Scene &scene, const Camera &camera, u32 width, u32 height, RayHit *tlas_hits, RayHit *linear_hits) {
+    traceScene(scene, camera, width, height, tlas_hits);
+    u32 node_count = scene.tlas.bvh.node_count;
+    scene.tlas.bvh.node_count = 0;
+    traceScene(scene, camera, width, height, linear_hits);
+    scene.tlas.bvh.node_count = node_count;
+
+    u32 mismatches = 0;
+    for (u32 i = 0; i < width * height; i++)
+        if (tlas_hits[i].geo_id != linear_hits[i].geo_id || (tlas_hits[i].geo_id != (u32)-1 &&
+            (tlas_hits[i].triangle_index != linear_hits[i].triangle_index || tlas_hits[i].distance != linear_hits[i].distance)))
+            mismatches++;
+
+    return mismatches;
+}
+
+// Counts the spheres (one around every instance, and one in between every pair of consecutive ones) for which the
+// TLAS gathered a different set of geometries than testing the bounds of all the geometries did:
+u32 countMismatchedOverlaps(const Scene &scene, const Mesh &mesh, u32 *ids) {
+    u32 mismatches = 0;
+    f32 radius = (mesh.aabb.max - mesh.aabb.min).length();
+    for (u32 i = 0; i < scene.counts.geometries * 2; i++) {
+        const vec3 &position = scene.geometries[i / 2].transform.position;
+        vec3 center = i & 1 ? (position + scene.geometries[(i / 2 + 1) % scene.counts.geometries].transform.position) * 0.5f : position;
+        u32 count = scene.tlas.overlapSphere(center, radius, ids, scene.counts.geometries);
+        u32 expected_count = 0;
+        bool matched = true;
+        for (u32 g = 0; g < scene.counts.geometries; g++) {
+            if (!getGeometryBounds(scene.geometries[g], scene.meshes).overlapSphere(center, radius)) continue;
+            expected_count++;
+            bool is_found = false;
+            for (u32 j = 0; j < count && !is_found; j++) is_found = ids[j] == g;
+            matched = matched && is_found;
+        }
+        if (!matched || count != expected_count) mismatches++;
+    }
+
+    return mismatches;
+}
+
+// Moves every other instance (by up to twice the mesh's size):
+void moveInstances(Scene &scene, const Mesh &mesh, u32 seed) {
+    f32 size = (mesh.aabb.max - mesh.aabb.min).length();
+    for (u32 i = seed & 1; i < scene.counts.geometries; i += 2) {
+        Transform &transform = scene.geometries[i].transform;
+        for (u8 axis = 0; axis < 3; axis++) {
+            seed = seed * 1664525u + 1013904223u;
+            transform.position.components[axis] += ((f32)(seed >> 8) / (f32)(1u << 24) - 0.5f) * size * 4;
+        }
+    }
+}
+
+int sceneBench(Mesh &mesh, u32 instance_count, u32 width, u32 height, bool check) {
+    Geometry *geometries = (Geometry*)os::getMemory(sizeof(Geometry) * instance_count);
+    RayHit *tlas_hits = (RayHit*)os::getMemory(sizeof(RayHit) * width * height * 2);
+    RayHit *linear_hits = tlas_hits + width * height;
+    u32 *ids = (u32*)os::getMemory(sizeof(u32) * instance_count);
+    memory::MonotonicAllocator memory_allocator{TLAS::getSizeInBytes(instance_count) + BVHBuilder::getSizeInBytes(instance_count)};
+    if (!geometries || !tlas_hits || !ids || !memory_allocator.address) {
+        printf("Could not allocate memory for %u instances\n", instance_count);
+        return 1;
+    }
+
+    // Lay the instances out on a square grid (in rows along X, facing the camera), spaced by the mesh's size:
+    vec3 extents = mesh.aabb.max - mesh.aabb.min;
+    f32 spacing = extents.length();
+    u32 row_size = 1;
+    while (row_size * row_size < instance_count) row_size++;
+    for (u32 i = 0; i < instance_count; i++) {
+        geometries[i] = Geometry{};
+        geometries[i].type = GeometryType_Mesh;
+        geometries[i].transform = Transform{
+            vec3{(f32)(i % row_size), (f32)(i / row_size), (f32)(i % 3)} * spacing,
+            vec3{0, (f32)(i % 7) * 0.5f, 0}
+        };
+    }
+
+    SceneCounts counts{0, instance_count};
+    Scene scene{counts, nullptr, nullptr, geometries};
+    scene.meshes = &mesh;
+    scene.counts.meshes = 1;
+
+    BVHBuilder builder{instance_count, &memory_allocator};
+    scene.tlas.allocate(instance_count, &memory_allocator);
+    if (!builder.buildTLAS(scene.tlas, geometries, instance_count, &mesh)) {
+        printf("Could not build the TLAS of %u instances\n", instance_count);
+        return 1;
+    }
+
+    Camera camera;
+    f32 grid_size = (f32)row_size * spacing;
+    camera.position = vec3{grid_size * 0.5f, grid_size * 0.5f, -grid_size * camera.focal_length * 0.6f};
+
+    u64 ray_count = (u64)width * height;
+    printf("%u instances of %u triangles, %ux%u pixels = %llu primary rays\n",
+           instance_count, mesh.triangle_count, width, height, (unsigned long long)ray_count);
+    report("Scene through its TLAS", traceScene(scene, camera, width, height), ray_count);
+    u32 node_count = scene.tlas.bvh.node_count;
+    scene.tlas.bvh.node_count = 0;
+    report("Scene through all geometries", traceScene(scene, camera, width, height), ray_count);
+    scene.tlas.bvh.node_count = node_count;
+    if (!check) return 0;
+
+    // Check the TLAS as built, then once refitted and once rebuilt after moving some of the instances:
+    u32 mismatches[3], overlap_mismatches[3];
+    for (u32 step = 0; step < 3; step++) {
+        if (step) {
+            moveInstances(scene, mesh, step);
+            if (step == 1) builder.refitTLAS(scene.tlas, geometries, &mesh);
+            else if (!builder.refitTLAS(scene.tlas, geometries, &mesh, 0.000001f)) {
+                printf("The TLAS was not rebuilt\n");
+                return 1;
+            }
+        }
+        mismatches[step] = countMismatchedHits(scene, camera, width, height, tlas_hits, linear_hits);
+        overlap_mismatches[step] = countMismatchedOverlaps(scene, mesh, ids);
+    }
+    printf("TLAS check (built, refitted, rebuilt): %u, %u, %u mismatched hits and %u, %u, %u mismatched overlaps\n",
+           mismatches[0], mismatches[1], mismatches[2], overlap_mismatches[0], overlap_mismatches[1], overlap_mismatches[2]);
+
+    for (u32 step = 0; step < 3; step++) if (mismatches[step] || overlap_mismatches[step]) return 1;
+    return 0;
+}
+
+int rayBench(char *mesh_file_path, u32 width, u32 height, u32 frames, bool compact, u32 instance_count, bool check) {
+    Mesh mesh;
+    mesh.triangle_layout = compact ? TriangleLayout_Compact : TriangleLayout_Full;
+    if (!loadHeader(mesh, mesh_file_path)) {
+        printf("Could not read %s\n", mesh_file_path);
+        return 1;
+    }
+    memory::MonotonicAllocator memory_allocator{getSizeInBytes(mesh)};
+    if (!load(mesh, mesh_file_path, &memory_allocator)) {
+        printf("Could not load %s%s\n", mesh_file_path, compact ? " (with compact triangles)" : "");
+        return 1;
+    }
+
+    // Look at the mesh from the front (along +Z), from far enough for it to fill most of the view:
+    Camera camera;
+    vec3 center = (mesh.aabb.min + mesh.aabb.max) * 0.5f;
+    vec3 extents = mesh.aabb.max - mesh.aabb.min;
+    f32 size = extents.x > extents.y ? extents.x : extents.y;
+    camera.position = center - vec3{0, 0, extents.z * 0.5f + size * camera.focal_length * 0.6f};
+
+    if (instance_count) return sceneBench(mesh, instance_count, width, height, check);
+
+    u64 ray_count = (u64)width * height * frames;
+    printf("%s: %u triangles (%s layout), %ux%u pixels x %u frames = %llu primary rays, %d-ray packets\n",
+           mesh_file_path, mesh.triangle_count, compact ? "compact" : "full", width, height, frames,
+           (unsigned long long)ray_count, RAY_PACKET_WIDTH);
+
+    report("Single rays", traceSingleRays(mesh, camera, width, height, frames), ray_count);
+    report("Ray packets", traceRayPackets(mesh, camera, width, height, frames), ray_count);
+    return 0;
+}
+
+bool hasPrefix(char *arg, const char *prefix) {
+    while (*prefix) if (*(arg++) != *(prefix++)) return false;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2 || !strcmp(argv[1], (char*)"--help")) {
+        printf((char*)("A '.mesh' file path needs to be provided, "
+                       "an optional flag 'width:<int>' for the horizontal resolution (default: 1024),"
+                       "an optional flag 'height:<int>' for the vertical resolution (default: 1024),"
+                       "an optional flag 'frames:<int>' for the number of frames to trace (default: 4),"
+                       "an optional flag '-compact' for loading the mesh with compact triangles,"
+                       "an optional flag 'instances:<int>' for tracing a scene of that many instances of the mesh instead"
+                       " (through its TLAS and through all of its geometries),"
+                       "an optional flag '-check' for checking (with instances) that the TLAS finds the same hits and"
+                       " overlaps as going through all of the geometries (exits with 1 on mismatches)"
+                       ));
+        return argc < 2;
+    }
+
+    u32 width = 1024;
+    u32 height = 1024;
+    u32 frames = 4;
+    u32 instance_count = 0;
+    bool compact = false;
+    bool check = false;
+    for (u32 i = 2; i < (u32)argc; i++) {
+        char *arg = argv[i];
+        if (strcmp(arg, (char*)"-compact") == 0) compact = true;
+        else if (strcmp(arg, (char*)"-check") == 0) check = true;
+        else if (hasPrefix(arg, "instances:")) instance_count = (u32)atoi(arg + 10);
+        else if (hasPrefix(arg, "width:")) width = (u32)atoi(arg + 6);
+        else if (hasPrefix(arg, "height:")) height = (u32)atoi(arg + 7);
+        else if (hasPrefix(arg, "frames:")) frames = (u32)atoi(arg + 7);
+    }
+    if (!width) width = 1;
+    if (!height) height = 1;
+    if (!frames) frames = 1;
+
+    return rayBench(argv[1], width, height, frames, compact, instance_count, check);
+}
@@ -103,10 +103,15 @@
 
 typedef unsigned char      u8;
 typedef unsigned short     u16;
-typedef unsigned long int  u32;
 typedef unsigned long long u64;
 typedef signed   short     i16;
+#if defined(__LP64__) // A 'long' is 64 bits wide on LP64 platforms (Linux, macOS)
+typedef unsigned int       u32;
+typedef signed   int       i32;
+#else
+typedef unsigned long int  u32;
 typedef signed   long int  i32;
+#endif
 
 typedef float  f32;
 typedef double f64;
@@ -228,7 +233,6 @@ INLINE_XPU void swap(T *a, T *b) {
     *b = t;
 }
 
-
 template <typename T>
 struct RangeOf {
     T first, last;
@@ -357,7 +361,6 @@ enum GeometryType {
     GeometryType_Count
 };
 
-
 enum Axis {
     Axis_X = 1,
     Axis_Y = 2,
@@ -869,6 +872,63 @@ struct Pixel {
     }
 };
 
+// Conversions between single and half precision floats (rounding to the nearest, with infinities and NaNs kept):
+INLINE_XPU u16 toHalf(f32 value) {
+    union { f32 f; u32 u; } bits{value};
+    u32 sign = bits.u & 0x80000000u;
+    bits.u ^= sign;
+
+    u16 half;
+    if (bits.u >= (143u << 23)) // Too large (or already infinite or NaN)
+        half = bits.u > (255u << 23) ? 0x7E00 : 0x7C00;
+    else if (bits.u < (113u << 23)) { // Too small to be normalized (or zero): Let the adder round the mantissa
+        union { u32 u; f32 f; } magic{126u << 23};
+        bits.f += magic.f;
+        half = (u16)(bits.u - magic.u);
+    } else {
+        u32 odd_mantissa = (bits.u >> 13) & 1;
+        bits.u += (((u32)(15 - 127)) << 23) + 0xFFF + odd_mantissa;
+        half = (u16)(bits.u >> 13);
+    }
+
+    return half | (u16)(sign >> 16);
+}
+
+INLINE_XPU f32 fromHalf(u16 half) {
+    union { u32 u; f32 f; } bits{((u32)half & 0x7FFF) << 13};
+    u32 exponent = bits.u & (0x7C00u << 13);
+    bits.u += (127u - 15u) << 23;
+    if (exponent == (0x7C00u << 13)) // Infinite or NaN
+        bits.u += (128u - 16u) << 23;
+    else if (exponent == 0) { // Zero or not normalized
+        union { u32 u; f32 f; } magic{113u << 23};
+        bits.u += 1u << 23;
+        bits.f -= magic.f;
+    }
+    bits.u |= ((u32)half & 0x8000) << 16;
+
+    return bits.f;
+}
+
+// A pixel in half precision (half the size of a Pixel), for canvases that trade precision for memory bandwidth:
+struct HalfPixel {
+    u16 r, g, b, opacity;
+
+    INLINE_XPU HalfPixel(u16 r = 0, u16 g = 0, u16 b = 0, u16 opacity = 0) : r{r}, g{g}, b{b}, opacity{opacity} {}
+    INLINE_XPU HalfPixel(const Pixel &pixel) :
+        r{toHalf(pixel.color.r)},
+        g{toHalf(pixel.color.g)},
+        b{toHalf(pixel.color.b)},
+        opacity{toHalf(pixel.opacity)} {}
+
+    INLINE_XPU Pixel toPixel() const {
+        return {fromHalf(r), fromHalf(g), fromHalf(b), fromHalf(opacity)};
+    }
+};
+
+// For code that reads pixels of either precision:
+INLINE_XPU const Pixel& toPixel(const Pixel &pixel) { return pixel; }
+INLINE_XPU Pixel toPixel(const HalfPixel &pixel) { return pixel.toPixel(); }
 
 struct TiledGridDimensions {
     u32 width = 0;
@@ -1063,6 +1123,7 @@ namespace controls {
 
 namespace os {
     void* getMemory(u64 size, u64 base = 0);
+    void freeMemory(void *address, u64 size);
     void setWindowTitle(char* str);
     void setWindowCapture(bool on);
     void setCursorVisibility(bool on);
@@ -1071,6 +1132,24 @@ namespace os {
     void* openFileForWriting(const char* file_path);
     bool readFromFile(void *out, unsigned long, void *handle);
     bool writeToFile(void *out, unsigned long, void *handle);
+
+    typedef void (*ThreadFunction)(void *data);
+    u32 getProcessorCount();
+    void* createThread(ThreadFunction function, void *data);
+    void joinThread(void *handle);
+    void yieldThread();
+    void* createSemaphore(u32 initial_count = 0);
+    void destroySemaphore(void *handle);
+    void signalSemaphore(void *handle, u32 count = 1);
+    void waitOnSemaphore(void *handle);
+
+    // Atomic operations on values shared across threads (each one is a full memory barrier).
+    // Adding and exchanging return the value from before the operation:
+    u32 atomicLoad(volatile u32 *value);
+    void atomicStore(volatile u32 *value, u32 new_value);
+    u32 atomicAdd(volatile u32 *value, u32 amount);
+    u32 atomicSubtract(volatile u32 *value, u32 amount);
+    u32 atomicExchange(volatile u32 *value, u32 new_value);
 }
 
 namespace timers {
@@ -1490,7 +1569,6 @@ struct NumberString {
     }
 };
 
-
 template <typename T>
 u32 getSizeInBytes(const Image<T> &image) {
     return sizeof(T) * image.size * (image.flags.channel ? (image.flags.alpha ? 4 : 3) : 1);
@@ -1691,7 +1769,6 @@ struct TexturePack {
     }
 };
 
-
 struct HUDLine {
     String title, alternate_value;
     NumberString value;
@@ -1775,9 +1852,201 @@ struct HUD {
     }
 };
 
+#define THREAD_POOL__MAX_THREAD_COUNT 64
+#define THREAD_POOL__QUEUE_CAPACITY 4096 // Must be a power of 2
 
-#define SLIM_VEC2
+// Jobs are given the index of the thread running them, for indexing into per-thread scratch memory.
+// Index 0 is the thread that created the pool, which runs jobs itself while waiting on them.
+// Counters and flags shared across threads are only accessed through the platform's atomic operations.
+typedef void (*JobFunction)(void *data, u32 thread_index);
+typedef void (*RangeJobFunction)(void *data, u32 start, u32 end, u32 thread_index);
+
+struct JobGroup {
+    volatile u32 pending{0};
+};
+
+struct Job {
+    JobFunction function;
+    void *data;
+    JobGroup *group;
+};
+
+// Each thread pushes and pops jobs at the back of its own queue (depth first, so recently touched memory),
+// while idle threads steal from the front of other threads' queues (where the larger, earlier jobs are).
+struct JobQueue {
+    Job *jobs{nullptr};
+    u32 front{0};
+    u32 back{0};
+    volatile u32 lock{0};
+
+    INLINE void acquire() { while (os::atomicExchange(&lock, 1)) {} }
+    INLINE void release() { os::atomicStore(&lock, 0); }
+
+    bool push(const Job &job) {
+        acquire();
+        bool pushed = back - front < THREAD_POOL__QUEUE_CAPACITY;
+        if (pushed) jobs[(back++) & (THREAD_POOL__QUEUE_CAPACITY - 1)] = job;
+        release();
+        return pushed;
+    }
+
+    bool pop(Job &job) {
+        acquire();
+        bool popped = back != front;
+        if (popped) job = jobs[(--back) & (THREAD_POOL__QUEUE_CAPACITY - 1)];
+        release();
+        return popped;
+    }
+
+    bool steal(Job &job) {
+        acquire();
+        bool stolen = back != front;
+        if (stolen) job = jobs[(front++) & (THREAD_POOL__QUEUE_CAPACITY - 1)];
+        release();
+        return stolen;
+    }
+};
+
+struct ThreadPool {
+    struct Worker {
+        ThreadPool *pool;
+        void *thread;
+        u32 thread_index;
+    };
+
+    JobQueue queues[THREAD_POOL__MAX_THREAD_COUNT];
+    Worker workers[THREAD_POOL__MAX_THREAD_COUNT];
+    Job *jobs{nullptr};
+    u64 jobs_size{0};
+    void *semaphore{nullptr};
+    u32 thread_count{1};
+    volatile u32 is_running{0};
+
+    // A thread count of 0 uses one thread per processor (the calling thread counts as one of them):
+    explicit ThreadPool(u32 ThreadCount = 0) {
+        if (!ThreadCount) ThreadCount = os::getProcessorCount();
+        if (ThreadCount > THREAD_POOL__MAX_THREAD_COUNT) ThreadCount = THREAD_POOL__MAX_THREAD_COUNT;
+        if (!ThreadCount) ThreadCount = 1;
+
+        jobs_size = sizeof(Job) * THREAD_POOL__QUEUE_CAPACITY * ThreadCount;
+        jobs = (Job*)os::getMemory(jobs_size);
+        if (!jobs) return;
+        for (u32 i = 0; i < ThreadCount; i++) queues[i].jobs = jobs + THREAD_POOL__QUEUE_CAPACITY * i;
+
+        semaphore = ThreadCount > 1 ? os::createSemaphore() : nullptr;
+        if (ThreadCount > 1 && !semaphore) ThreadCount = 1;
+
+        // A worker that failed to start just leaves its queue empty, as only a thread pushes into its own queue:
+        os::atomicStore(&is_running, 1);
+        thread_count = ThreadCount;
+        for (u32 i = 1; i < thread_count; i++) {
+            Worker &worker = workers[i];
+            worker.pool = this;
+            worker.thread_index = i;
+            worker.thread = os::createThread(runWorker, &worker);
+        }
+    }
+
+    ~ThreadPool() { stop(); }
+
+    // Joins the workers and frees the queues (any jobs submitted afterwards just run on the submitting thread):
+    void stop() {
+        if (os::atomicExchange(&is_running, 0) && thread_count > 1) {
+            os::signalSemaphore(semaphore, thread_count - 1);
+            for (u32 i = 1; i < thread_count; i++) if (workers[i].thread) os::joinThread(workers[i].thread);
+            os::destroySemaphore(semaphore);
+            semaphore = nullptr;
+        }
+        thread_count = 1;
+
+        if (jobs) {
+            for (JobQueue &queue : queues) queue.jobs = nullptr;
+            os::freeMemory(jobs, jobs_size);
+            jobs = nullptr;
+        }
+    }
+
+    void submit(JobFunction function, void *data, JobGroup &group, u32 thread_index) {
+        Job job{function, data, &group};
+        os::atomicAdd(&group.pending, 1);
+        if (queues[thread_index].jobs && queues[thread_index].push(job)) {
+            if (thread_count > 1) os::signalSemaphore(semaphore);
+        } else
+            runJob(job, thread_index); // The queue is full (or unavailable), so just run it right here
+    }
+
+    // Waiting threads keep running pending jobs (their own or stolen) until the whole group is done,
+    // yielding to the threads running the group's last jobs when there is nothing left to pick up:
+    void wait(JobGroup &group, u32 thread_index) {
+        while (os::atomicLoad(&group.pending))
+            if (!runPendingJob(thread_index))
+                os::yieldThread();
+    }
+
+    bool runPendingJob(u32 thread_index) {
+        Job job;
+        bool found = queues[thread_index].jobs && queues[thread_index].pop(job);
+        for (u32 i = 1; !found && i < thread_count; i++) {
+            JobQueue &queue = queues[(thread_index + i) % thread_count];
+            found = queue.jobs && queue.steal(job);
+        }
+        if (found) runJob(job, thread_index);
+        return found;
+    }
+
+    // Splits [0, count) into chunks that are handed out dynamically to as many threads as there are chunks.
+    // The calling thread runs chunks too, under its own thread index (the drawing and building code all calls
+    // this from the thread that created the pool, so passes 0):
+    void parallelFor(u32 count, u32 chunk_size, RangeJobFunction function, void *data, u32 thread_index) {
+        if (!count) return;
+        if (!chunk_size) chunk_size = 1;
+
+        ParallelFor parallel_for{function, data, count, chunk_size};
+        u32 chunk_count = (count + chunk_size - 1) / chunk_size;
+        u32 helper_count = (chunk_count < thread_count ? chunk_count : thread_count) - 1;
+
+        JobGroup group;
+        for (u32 i = 0; i < helper_count; i++) submit(runParallelFor, &parallel_for, group, thread_index);
+        runParallelFor(&parallel_for, thread_index);
+        wait(group, thread_index);
+    }
+
+    struct ParallelFor {
+        RangeJobFunction function;
+        void *data;
+        u32 count, chunk_size;
+        volatile u32 next{0};
+
+        ParallelFor(RangeJobFunction function, void *data, u32 count, u32 chunk_size) :
+            function{function}, data{data}, count{count}, chunk_size{chunk_size} {}
+    };
 
+    static void runParallelFor(void *data, u32 thread_index) {
+        ParallelFor &parallel_for = *(ParallelFor*)data;
+        for (u32 start = os::atomicAdd(&parallel_for.next, parallel_for.chunk_size);
+                 start < parallel_for.count;
+                 start = os::atomicAdd(&parallel_for.next, parallel_for.chunk_size)) {
+            u32 end = start + parallel_for.chunk_size;
+            if (end > parallel_for.count || end < start) end = parallel_for.count;
+            parallel_for.function(parallel_for.data, start, end, thread_index);
+        }
+    }
+
+    static void runJob(const Job &job, u32 thread_index) {
+        job.function(job.data, thread_index);
+        os::atomicSubtract(&job.group->pending, 1);
+    }
+
+    static void runWorker(void *data) {
+        Worker &worker = *(Worker*)data;
+        ThreadPool &pool = *worker.pool;
+        while (os::atomicLoad(&pool.is_running))
+            if (!pool.runPendingJob(worker.thread_index))
+                os::waitOnSemaphore(pool.semaphore);
+    }
+};
+
+#define SLIM_VEC2
 
 struct vec2i {
     i32 x, y;
@@ -2025,7 +2294,6 @@ struct vec2i {
     }
 };
 
-
 struct vec2 {
     union {
         struct {f32 components[2]; };
@@ -2526,7 +2794,6 @@ INLINE_XPU vec2 lerp(const vec2 &from, const vec2 &to, f32 by) {
     return (to - from).scaleAdd(by, from);
 }
 
-
 #define SLIM_VEC3
 
 struct vec3 {
@@ -3457,7 +3724,6 @@ INLINE_XPU vec4 lerp(const vec4 &from, const vec4 &to, f32 by) {
     return (to - from).scaleAdd(by, from);
 }
 
-
 struct quat {
     vec3 axis;
     f32 amount;
@@ -3570,7 +3836,6 @@ struct OrientationUsingQuaternion : Orientation<quat> {
             Orientation<quat>{x_radians, y_radians, z_radians} {}
 };
 
-
 struct mat2 {
     vec2 X, Y;
 
@@ -3770,7 +4035,6 @@ INLINE_XPU mat2 outer(const vec2 &lhs, const vec2 &rhs) {
     };
 }
 
-
 struct mat3 {
     vec3 X, Y, Z;
 
@@ -4071,7 +4335,6 @@ struct OrientationUsing3x3Matrix : Orientation<mat3> {
             Orientation<mat3>{x_radians, y_radians, z_radians} {}
 };
 
-
 struct mat4 {
     vec4 X, Y, Z, W;
 
@@ -4400,7 +4663,6 @@ INLINE_XPU mat4 operator + (f32 lhs, const mat4 &rhs) {
     return rhs + lhs;
 }
 
-
 INLINE_XPU vec4 Vec4(const vec3 &v3, f32 w = 0.0f) {
     return {v3.x, v3.y, v3.z, w};
 }
@@ -4517,6 +4779,139 @@ INLINE_XPU mat4 Mat4(const mat3 &rotation, const vec3 &position) {
     };
 }
 
+// A thin layer over the widest float vectors the target supports (AVX: 8 lanes, SSE: 4 lanes),
+// with a plain scalar fallback of 4 lanes for other targets. Loads and stores are unaligned.
+// A fixed 4-lane vector (simd4_f32) is also available everywhere, for data that comes in fours.
+// Comparisons either return a bit-mask of lanes, or a lane-mask vector for branchless selection.
+// Streaming stores (to 16-byte aligned addresses) bypass the caches, for large buffers that are written but not read
+// back soon after: They should be followed by a stream fence before the buffer is read (i.e: by another thread).
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SIMD4_SSE 1
+    typedef __m128 simd4_f32;
+#else
+    #define SIMD4_SCALAR 1
+    struct simd4_f32 { f32 lanes[4]; };
+#endif
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define SIMD_WIDTH 8
+    #define SIMD_AVX 1
+    typedef __m256 simd_f32;
+#elif defined(SIMD4_SSE)
+    #define SIMD_WIDTH 4
+    #define SIMD_SSE 1
+    typedef simd4_f32 simd_f32;
+#else
+    #define SIMD_WIDTH 4
+    #define SIMD_SCALAR 1
+    typedef simd4_f32 simd_f32;
+#endif
+
+namespace simd {
+#if defined(SIMD4_SSE)
+    INLINE simd4_f32 set4(f32 value) { return _mm_set1_ps(value); }
+    INLINE simd4_f32 load4(const f32 *values) { return _mm_loadu_ps(values); }
+    INLINE void store4(f32 *values, simd4_f32 v) { _mm_storeu_ps(values, v); }
+    INLINE void stream4(f32 *aligned_values, simd4_f32 v) { _mm_stream_ps(aligned_values, v); }
+    INLINE void streamFence() { _mm_sfence(); }
+    INLINE simd4_f32 add(simd4_f32 a, simd4_f32 b) { return _mm_add_ps(a, b); }
+    INLINE simd4_f32 sub(simd4_f32 a, simd4_f32 b) { return _mm_sub_ps(a, b); }
+    INLINE simd4_f32 mul(simd4_f32 a, simd4_f32 b) { return _mm_mul_ps(a, b); }
+    INLINE simd4_f32 div(simd4_f32 a, simd4_f32 b) { return _mm_div_ps(a, b); }
+    INLINE simd4_f32 sqrt(simd4_f32 a) { return _mm_sqrt_ps(a); }
+    INLINE simd4_f32 min(simd4_f32 a, simd4_f32 b) { return _mm_min_ps(a, b); }
+    INLINE simd4_f32 max(simd4_f32 a, simd4_f32 b) { return _mm_max_ps(a, b); }
+    INLINE u32 lessOrEqualMask(simd4_f32 a, simd4_f32 b) { return (u32)_mm_movemask_ps(_mm_cmple_ps(a, b)); }
+    INLINE simd4_f32 lessThan(simd4_f32 a, simd4_f32 b) { return _mm_cmplt_ps(a, b); }
+    INLINE simd4_f32 lessOrEqual(simd4_f32 a, simd4_f32 b) { return _mm_cmple_ps(a, b); }
+    INLINE simd4_f32 maskOr(simd4_f32 a, simd4_f32 b) { return _mm_or_ps(a, b); }
+    INLINE simd4_f32 maskAnd(simd4_f32 a, simd4_f32 b) { return _mm_and_ps(a, b); }
+    INLINE simd4_f32 maskAndNot(simd4_f32 mask, simd4_f32 a) { return _mm_andnot_ps(mask, a); } // a && !mask
+    INLINE simd4_f32 select(simd4_f32 mask, simd4_f32 a, simd4_f32 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    INLINE u32 maskBits(simd4_f32 mask) { return (u32)_mm_movemask_ps(mask); }
+
+    // Lanes truncated (towards zero) to integers:
+    INLINE void storeTruncated4(i32 *values, simd4_f32 v) { _mm_storeu_si128((__m128i*)values, _mm_cvttps_epi32(v)); }
+
+    // Turns 4 vectors (rows) into 4 vectors of their lanes (columns), i.e: from 4 pixels to their 4 channels:
+    INLINE void transpose4(simd4_f32 &a, simd4_f32 &b, simd4_f32 &c, simd4_f32 &d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+#else
+    INLINE simd4_f32 set4(f32 value) { simd4_f32 r; for (u8 i = 0; i < 4; i++) r.lanes[i] = value; return r; }
+    INLINE simd4_f32 load4(const f32 *values) { simd4_f32 r; for (u8 i = 0; i < 4; i++) r.lanes[i] = values[i]; return r; }
+    INLINE void store4(f32 *values, simd4_f32 v) { for (u8 i = 0; i < 4; i++) values[i] = v.lanes[i]; }
+    INLINE void stream4(f32 *aligned_values, simd4_f32 v) { store4(aligned_values, v); }
+    INLINE void streamFence() {}
+    INLINE simd4_f32 add(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] += b.lanes[i]; return a; }
+    INLINE simd4_f32 sub(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] -= b.lanes[i]; return a; }
+    INLINE simd4_f32 mul(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] *= b.lanes[i]; return a; }
+    INLINE simd4_f32 div(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] /= b.lanes[i]; return a; }
+    INLINE simd4_f32 sqrt(simd4_f32 a) { for (u8 i = 0; i < 4; i++) a.lanes[i] = sqrtf(a.lanes[i]); return a; }
+    INLINE simd4_f32 min(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = a.lanes[i] < b.lanes[i] ? a.lanes[i] : b.lanes[i]; return a; }
+    INLINE simd4_f32 max(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = a.lanes[i] > b.lanes[i] ? a.lanes[i] : b.lanes[i]; return a; }
+    INLINE u32 lessOrEqualMask(simd4_f32 a, simd4_f32 b) {
+        u32 mask = 0;
+        for (u8 i = 0; i < 4; i++) if (a.lanes[i] <= b.lanes[i]) mask |= 1u << i;
+        return mask;
+    }
+
+    // Scalar lane-masks are just 1 or 0 per lane:
+    INLINE simd4_f32 lessThan(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = a.lanes[i] < b.lanes[i] ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 lessOrEqual(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = a.lanes[i] <= b.lanes[i] ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 maskOr(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = (a.lanes[i] != 0.0f || b.lanes[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 maskAnd(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = (a.lanes[i] != 0.0f && b.lanes[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 maskAndNot(simd4_f32 mask, simd4_f32 a) { for (u8 i = 0; i < 4; i++) a.lanes[i] = (mask.lanes[i] == 0.0f && a.lanes[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 select(simd4_f32 mask, simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = mask.lanes[i] != 0.0f ? a.lanes[i] : b.lanes[i]; return a; }
+    INLINE u32 maskBits(simd4_f32 mask) {
+        u32 bits = 0;
+        for (u8 i = 0; i < 4; i++) if (mask.lanes[i] != 0.0f) bits |= 1u << i;
+        return bits;
+    }
+
+    INLINE void storeTruncated4(i32 *values, simd4_f32 v) { for (u8 i = 0; i < 4; i++) values[i] = (i32)v.lanes[i]; }
+
+    INLINE void transpose4(simd4_f32 &a, simd4_f32 &b, simd4_f32 &c, simd4_f32 &d) {
+        simd4_f32 rows[4] = {a, b, c, d};
+        for (u8 i = 0; i < 4; i++) {
+            a.lanes[i] = rows[i].lanes[0];
+            b.lanes[i] = rows[i].lanes[1];
+            c.lanes[i] = rows[i].lanes[2];
+            d.lanes[i] = rows[i].lanes[3];
+        }
+    }
+#endif
+
+#if defined(SIMD_AVX)
+    INLINE simd_f32 set1(f32 value) { return _mm256_set1_ps(value); }
+    INLINE simd_f32 load(const f32 *values) { return _mm256_loadu_ps(values); }
+    INLINE void store(f32 *values, simd_f32 v) { _mm256_storeu_ps(values, v); }
+    INLINE simd_f32 add(simd_f32 a, simd_f32 b) { return _mm256_add_ps(a, b); }
+    INLINE simd_f32 sub(simd_f32 a, simd_f32 b) { return _mm256_sub_ps(a, b); }
+    INLINE simd_f32 mul(simd_f32 a, simd_f32 b) { return _mm256_mul_ps(a, b); }
+    INLINE simd_f32 div(simd_f32 a, simd_f32 b) { return _mm256_div_ps(a, b); }
+    INLINE simd_f32 sqrt(simd_f32 a) { return _mm256_sqrt_ps(a); }
+    INLINE simd_f32 min(simd_f32 a, simd_f32 b) { return _mm256_min_ps(a, b); }
+    INLINE simd_f32 max(simd_f32 a, simd_f32 b) { return _mm256_max_ps(a, b); }
+    INLINE u32 lessOrEqualMask(simd_f32 a, simd_f32 b) { return (u32)_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+    INLINE simd_f32 lessThan(simd_f32 a, simd_f32 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    INLINE simd_f32 lessOrEqual(simd_f32 a, simd_f32 b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    INLINE simd_f32 maskOr(simd_f32 a, simd_f32 b) { return _mm256_or_ps(a, b); }
+    INLINE simd_f32 maskAnd(simd_f32 a, simd_f32 b) { return _mm256_and_ps(a, b); }
+    INLINE simd_f32 maskAndNot(simd_f32 mask, simd_f32 a) { return _mm256_andnot_ps(mask, a); } // a && !mask
+    INLINE simd_f32 select(simd_f32 mask, simd_f32 a, simd_f32 b) { return _mm256_blendv_ps(b, a, mask); }
+    INLINE u32 maskBits(simd_f32 mask) { return (u32)_mm256_movemask_ps(mask); }
+
+    INLINE simd_f32 fmadd(simd_f32 a, simd_f32 b, simd_f32 c) { return add(mul(a, b), c); }
+#else
+    INLINE simd_f32 set1(f32 value) { return set4(value); }
+    INLINE simd_f32 load(const f32 *values) { return load4(values); }
+    INLINE void store(f32 *values, simd_f32 v) { store4(values, v); }
+#endif
+
+    INLINE simd4_f32 fmadd(simd4_f32 a, simd4_f32 b, simd4_f32 c) { return add(mul(a, b), c); }
+}
 
 struct Transform : OrientationUsingQuaternion {
     vec3 position{0.0f};
@@ -4582,7 +4977,7 @@ INLINE_XPU AABB operator * (const AABB &aabb, const Transform &transform) {
 
     vec3 pos;
     for (const auto &vertex : vertices) {
-        pos = transform.internPos(vertex);
+        pos = transform.externPos(vertex);
 
         if (pos.x < min.x) min.x = pos.x;
         if (pos.y < min.y) min.y = pos.y;
@@ -4602,10 +4997,17 @@ enum RayIsFacing {
     RayIsFacing_Back = 4
 };
 
+// Nearest-hit finds the closest intersection, while any-hit stops at the first one found (i.e: for visibility):
+enum RayHitMode {
+    RayHitMode_Nearest,
+    RayHitMode_Any
+};
+
 struct RayHit {
     vec3 position, normal;
     f32 distance, distance_squared;
     u32 geo_id;
+    u32 triangle_index = 0;
     enum GeometryType geo_type = GeometryType_None;
     bool from_behind = false;
 };
@@ -4679,6 +5081,64 @@ struct Ray {
         return side;
     }
 
+    // Slab test against an axis-aligned box, given the reciprocal of the direction (shared by all boxes of a traversal).
+    // The distance is where the ray enters the box (0 when it starts inside it):
+    INLINE_XPU bool hitsAABB(const AABB &aabb, const vec3 &RD_rcp, f32 max_distance, f32 &distance) const {
+        vec3 min_t{(aabb.min - origin) * RD_rcp};
+        vec3 max_t{(aabb.max - origin) * RD_rcp};
+        f32 near_t = minimum(min_t, max_t).maximum();
+        f32 far_t  = maximum(min_t, max_t).minimum();
+        distance = near_t > 0 ? near_t : 0;
+        return distance <= far_t && distance < max_distance;
+    }
+
+    // Intersects a triangle through its tangent-space matrix (see Triangle::local_to_tangent), which maps the ray's
+    // origin and direction relative to the triangle's position into (u, v, height above the triangle's plane):
+    INLINE_XPU bool hitsTriangle(const mat3 &local_to_tangent, const vec3 &position, f32 max_distance, f32 &distance) {
+        vec3 tangent_origin = local_to_tangent * (origin - position);
+        vec3 tangent_direction = local_to_tangent * direction;
+        if (tangent_direction.z == 0) // The ray is parallel to the triangle
+            return false;
+
+        f32 t = -tangent_origin.z / tangent_direction.z;
+        if (t <= 0 || t >= max_distance)
+            return false;
+
+        f32 u = tangent_origin.x + t * tangent_direction.x;
+        f32 v = tangent_origin.y + t * tangent_direction.y;
+        if (u < 0 || v < 0 || u + v > 1)
+            return false;
+
+        distance = t;
+        hit.from_behind = tangent_origin.z < 0;
+        return true;
+    }
+
+    // As above for a compact triangle, which only has the rows of the matrix that give u and v:
+    // The distance is then found against the triangle's plane directly.
+    INLINE_XPU bool hitsTriangle(const vec3 &tangent_u, const vec3 &tangent_v, const vec3 &position, const vec3 &normal,
+                                 f32 max_distance, f32 &distance) {
+        f32 NdotRd = normal.dot(direction);
+        if (NdotRd == 0) // The ray is parallel to the triangle
+            return false;
+
+        vec3 RoP = position - origin;
+        f32 NdotRoP = normal.dot(RoP);
+        f32 t = NdotRoP / NdotRd;
+        if (t <= 0 || t >= max_distance)
+            return false;
+
+        vec3 P = direction.scaleAdd(t, -RoP);
+        f32 u = tangent_u.dot(P);
+        f32 v = tangent_v.dot(P);
+        if (u < 0 || v < 0 || u + v > 1)
+            return false;
+
+        distance = t;
+        hit.from_behind = NdotRoP > 0;
+        return true;
+    }
+
     INLINE_XPU bool hitsPlane(const vec3 &P, const vec3 &N) {
         f32 NdotRd = N.dot(direction);
         if (NdotRd == 0) // The ray is parallel to the plane
@@ -4700,7 +5160,6 @@ struct Ray {
     }
 };
 
-
 struct BoxCorners {
     vec3 front_top_left;
     vec3 front_top_right;
@@ -4712,14 +5171,14 @@ struct BoxCorners {
     vec3 back_bottom_right;
 
     BoxCorners() :
-            front_top_left{-1, 1, 1},
-            front_top_right{1, 1, 1},
-            front_bottom_left{-1, -1, 1},
-            front_bottom_right{1, -1, 1},
-            back_top_left{-1, 1, -1},
-            back_top_right{1, 1, -1},
-            back_bottom_left{-1, -1, -1},
-            back_bottom_right{1, -1, -1}
+    front_top_left{-1, 1, 1},
+    front_top_right{1, 1, 1},
+    front_bottom_left{-1, -1, 1},
+    front_bottom_right{1, -1, 1},
+    back_top_left{-1, 1, -1},
+    back_top_right{1, 1, -1},
+    back_bottom_left{-1, -1, -1},
+    back_bottom_right{1, -1, -1}
     {}
 };
 
@@ -4730,17 +5189,17 @@ union BoxVertices {
 
 struct BoxEdgeSides {
     Edge front_top,
-            front_bottom,
-            front_left,
-            front_right,
-            back_top,
-            back_bottom,
-            back_left,
-            back_right,
-            left_bottom,
-            left_top,
-            right_bottom,
-            right_top;
+         front_bottom,
+         front_left,
+         front_right,
+         back_top,
+         back_bottom,
+         back_left,
+         back_right,
+         left_bottom,
+         left_top,
+         right_bottom,
+         right_top;
 
     explicit BoxEdgeSides(const BoxCorners &corners) { setFrom(corners); }
     explicit BoxEdgeSides(const BoxVertices &vertices) : BoxEdgeSides(vertices.corners) {}
@@ -4803,8 +5262,6 @@ struct Box {
     Box() : vertices{}, edges{vertices} {}
 };
 
-
-
 struct GridAxisVertices {
     vec3 from[GRID__MAX_SEGMENTS];
     vec3 to[  GRID__MAX_SEGMENTS];
@@ -4867,9 +5324,9 @@ struct GridEdges {
     GridAxisEdges u, v;
 
     GridEdges(const GridVertices &vertices, u8 u_segments, u8 v_segments) :
-            u{vertices.u, u_segments},
-            v{vertices.v, v_segments}
-    {
+        u{vertices.u, u_segments},
+        v{vertices.v, v_segments}
+   {
         update(vertices, u_segments, v_segments);
     }
 
@@ -4914,8 +5371,6 @@ struct Grid {
     }
 };
 
-
-
 struct Camera : OrientationUsing3x3Matrix {
     vec3 position{0};
     vec3 current_velocity{0};
@@ -4979,7 +5434,9 @@ private:
     INLINE_XPU vec3 _untranslate(const vec3 &pos) const { return pos - position; }
 };
 
-
+// A BVH is at most 256 levels deep (node depths are 8 bit), and a traversal that pushes both children of a node
+// leaves at most one of them on the stack per level:
+#define BVH_TRAVERSAL_STACK_SIZE 258
 
 struct BVHNode {
     AABB aabb;
@@ -4997,8 +5454,26 @@ struct BVH {
     BVHNode *nodes;
     u32 node_count;
     u8 height;
-};
 
+    // The SAH cost the hierarchy had before it was first refitted (reset on every build):
+    f32 refit_base_sah_cost = 0;
+
+    // The Surface Area Heuristic cost of the whole hierarchy (lower is better):
+    // Each node is weighted by the probability of a random ray hitting it given that it hit the root.
+    f32 getSAHCost(f32 traversal_cost = 1.0f, f32 intersection_cost = 1.0f) const {
+        if (!node_count) return 0;
+
+        f32 root_area = nodes[0].aabb.area();
+        if (root_area <= 0) return 0;
+
+        f32 cost = 0;
+        BVHNode *node = nodes;
+        for (u32 i = 0; i < node_count; i++, node++)
+            cost += node->aabb.area() * (node->isLeaf() ? intersection_cost * (f32)node->leaf_count : traversal_cost);
+
+        return cost / root_area;
+    }
+};
 
 u32 getSizeInBytes(const BVH &bvh) {
     return sizeof(BVHNode) * bvh.node_count;
@@ -5083,7 +5558,6 @@ bool load(BVH &bvh, char *file_path, memory::MonotonicAllocator *memory_allocato
     return true;
 }
 
-
 struct EdgeVertexIndices {
     u32 from, to;
 };
@@ -5098,13 +5572,44 @@ union TriangleVertexIndices {
 struct Triangle {
     mat3 local_to_tangent;
     vec3 position, normal, U, V;
+
+    INLINE_XPU void init(const vec3 &v1, const vec3 &v2, const vec3 &v3) {
+        U = v3 - v1;
+        V = v2 - v1;
+        normal = U.cross(V).normalized();
+        position = v1;
+        local_to_tangent.X = U;
+        local_to_tangent.Y = V;
+        local_to_tangent.Z = normal;
+        local_to_tangent = local_to_tangent.inverted();
+    }
 };
 
+// The 2 rows of a triangle's tangent-space matrix that give the u and v of a point relative to its first vertex
+// (24 bytes instead of the 84 of a full Triangle). The rest is derived from the mesh's vertices when needed:
+// The position is the first vertex, U goes from it to the third vertex and V goes from it to the second one.
+struct CompactTriangle {
+    vec3 tangent_u, tangent_v;
+
+    CompactTriangle() = default;
+    INLINE_XPU explicit CompactTriangle(const Triangle &triangle) :
+            tangent_u{triangle.local_to_tangent.X.x, triangle.local_to_tangent.Y.x, triangle.local_to_tangent.Z.x},
+            tangent_v{triangle.local_to_tangent.X.y, triangle.local_to_tangent.Y.y, triangle.local_to_tangent.Z.y} {}
+};
+
+// Full triangles are self-contained, while compact ones rely on Mesh::vertex_position_indices[i] being the
+// vertices of triangle i (as BVHBuilder::buildMesh arranges). Meshes are saved in the full layout either way.
+enum TriangleLayout {
+    TriangleLayout_Full,
+    TriangleLayout_Compact
+};
 
 struct Mesh {
     AABB aabb;
     BVH bvh;
-    Triangle *triangles;
+    Triangle *triangles{nullptr};
+    CompactTriangle *compact_triangles{nullptr};
+    TriangleLayout triangle_layout{TriangleLayout_Full};
 
     vec3 *vertex_positions{nullptr};
     vec3 *vertex_normals{nullptr};
@@ -5158,8 +5663,113 @@ struct Mesh {
             edge_vertex_indices{edge_vertex_indices},
             aabb{aabb}
     {}
-};
 
+    INLINE_XPU u64 getTriangleSizeInBytes() const {
+        return triangle_layout == TriangleLayout_Compact ? sizeof(CompactTriangle) : sizeof(Triangle);
+    }
+
+    INLINE_XPU void setTriangle(u32 index, const vec3 &v1, const vec3 &v2, const vec3 &v3) {
+        Triangle triangle;
+        triangle.init(v1, v2, v3);
+        if (triangle_layout == TriangleLayout_Compact)
+            compact_triangles[index] = CompactTriangle{triangle};
+        else
+            triangles[index] = triangle;
+    }
+
+    INLINE_XPU void getTriangle(u32 index, vec3 &position, vec3 &U, vec3 &V) const {
+        if (triangle_layout == TriangleLayout_Compact) {
+            const TriangleVertexIndices &indices = vertex_position_indices[index];
+            position = vertex_positions[indices.v1];
+            U = vertex_positions[indices.v3] - position;
+            V = vertex_positions[indices.v2] - position;
+        } else {
+            const Triangle &triangle = triangles[index];
+            position = triangle.position;
+            U = triangle.U;
+            V = triangle.V;
+        }
+    }
+
+    INLINE_XPU CompactTriangle getCompactTriangle(u32 index) const {
+        return triangle_layout == TriangleLayout_Compact ? compact_triangles[index] : CompactTriangle{triangles[index]};
+    }
+
+    INLINE_XPU bool hitsTriangle(Ray &ray, u32 index, f32 max_distance, f32 &distance, vec3 &normal) const {
+        if (triangle_layout == TriangleLayout_Compact) {
+            vec3 position, U, V;
+            getTriangle(index, position, U, V);
+            normal = U.cross(V);
+            const CompactTriangle &triangle = compact_triangles[index];
+            return ray.hitsTriangle(triangle.tangent_u, triangle.tangent_v, position, normal, max_distance, distance);
+        }
+
+        const Triangle &triangle = triangles[index];
+        normal = triangle.normal;
+        return ray.hitsTriangle(triangle.local_to_tangent, triangle.position, max_distance, distance);
+    }
+
+    // Intersects a ray (given in the mesh's space) with the mesh's triangles by walking its BVH, nearer child first.
+    // Nodes that are entered beyond the closest hit so far get skipped, and any-hit mode stops at the first hit.
+    // On a hit, the ray's hit has the position, the (unnormalized) triangle normal, the distance and the triangle index.
+    // Traversal can also start from a subtree's node (i.e: for a ray that continues on its own from a ray packet).
+    INLINE_XPU bool castRay(Ray &ray, RayHitMode mode = RayHitMode_Nearest, f32 max_distance = INFINITY, u32 root_node_id = 0) const {
+        if (!bvh.node_count) return false;
+
+        u32 stack[BVH_TRAVERSAL_STACK_SIZE];
+        u32 stack_size = 0;
+        vec3 RD_rcp = 1.0f / ray.direction;
+        f32 distance, left_distance, right_distance;
+        vec3 normal;
+        bool found = false;
+        bool from_behind = false;
+
+        if (ray.hitsAABB(bvh.nodes[root_node_id].aabb, RD_rcp, max_distance, distance))
+            stack[stack_size++] = root_node_id;
+
+        while (stack_size) {
+            const BVHNode &node = bvh.nodes[stack[--stack_size]];
+            if (node.isLeaf()) {
+                for (u32 i = node.first_index; i < node.first_index + node.leaf_count; i++) {
+                    if (hitsTriangle(ray, i, max_distance, distance, normal)) {
+                        max_distance = distance;
+                        from_behind = ray.hit.from_behind;
+                        ray.hit.normal = normal;
+                        ray.hit.triangle_index = i;
+                        found = true;
+                        if (mode == RayHitMode_Any) break;
+                    }
+                }
+                if (found && mode == RayHitMode_Any) break;
+                continue;
+            }
+
+            // Children are only pushed when the ray enters them before the closest hit so far (the nearer one last):
+            u32 left = node.first_index;
+            u32 right = left + 1;
+            bool hits_left  = ray.hitsAABB(bvh.nodes[left ].aabb, RD_rcp, max_distance, left_distance);
+            bool hits_right = ray.hitsAABB(bvh.nodes[right].aabb, RD_rcp, max_distance, right_distance);
+            if (hits_left && hits_right) {
+                if (left_distance < right_distance) {
+                    stack[stack_size++] = right;
+                    stack[stack_size++] = left;
+                } else {
+                    stack[stack_size++] = left;
+                    stack[stack_size++] = right;
+                }
+            } else if (hits_left) stack[stack_size++] = left;
+            else if (hits_right) stack[stack_size++] = right;
+        }
+
+        if (found) {
+            ray.hit.from_behind = from_behind;
+            ray.hit.distance = max_distance;
+            ray.hit.position = ray.at(max_distance);
+        }
+
+        return found;
+    }
+};
 
 struct CubeMesh : Mesh {
     const vec3 CUBE_VERTEX_POSITIONS[CUBE_VERTEX_COUNT] = {
@@ -5254,11 +5864,9 @@ struct CubeMesh : Mesh {
     } {}
 };
 
-
-
 u32 getSizeInBytes(const Mesh &mesh) {
     u32 memory_size = getSizeInBytes(mesh.bvh);
-    memory_size += sizeof(Triangle) * mesh.triangle_count;
+    memory_size += mesh.getTriangleSizeInBytes() * mesh.triangle_count;
     memory_size += sizeof(vec3) * mesh.vertex_count;
     memory_size += sizeof(TriangleVertexIndices) * mesh.triangle_count;
     memory_size += sizeof(EdgeVertexIndices) * mesh.edge_count;
@@ -5278,7 +5886,10 @@ u32 getSizeInBytes(const Mesh &mesh) {
 bool allocateMemory(Mesh &mesh, memory::MonotonicAllocator *memory_allocator) {
     if (getSizeInBytes(mesh) > (memory_allocator->capacity - memory_allocator->occupied)) return false;
     allocateMemory(mesh.bvh, memory_allocator);
-    mesh.triangles               = (Triangle*             )memory_allocator->allocate(sizeof(Triangle)              * mesh.triangle_count);
+    if (mesh.triangle_layout == TriangleLayout_Compact)
+        mesh.compact_triangles   = (CompactTriangle*      )memory_allocator->allocate(sizeof(CompactTriangle)       * mesh.triangle_count);
+    else
+        mesh.triangles           = (Triangle*             )memory_allocator->allocate(sizeof(Triangle)              * mesh.triangle_count);
     mesh.vertex_positions        = (vec3*                 )memory_allocator->allocate(sizeof(vec3)                  * mesh.vertex_count);
     mesh.vertex_position_indices = (TriangleVertexIndices*)memory_allocator->allocate(sizeof(TriangleVertexIndices) * mesh.triangle_count);
     mesh.edge_vertex_indices     = (EdgeVertexIndices*    )memory_allocator->allocate(sizeof(EdgeVertexIndices)     * mesh.edge_count);
@@ -5326,10 +5937,63 @@ bool loadHeader(Mesh &mesh, char *file_path) {
     return true;
 }
 
+// Files always hold full triangles, so compact ones are converted to and from them a chunk at a time:
+#define MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE 256
+
+void readTriangles(Mesh &mesh, void *file) {
+    if (mesh.triangle_layout != TriangleLayout_Compact) {
+        os::readFromFile(mesh.triangles, sizeof(Triangle) * mesh.triangle_count, file);
+        return;
+    }
+
+    Triangle chunk[MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE];
+    for (u32 start = 0; start < mesh.triangle_count; start += MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE) {
+        u32 count = mesh.triangle_count - start;
+        if (count > MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE) count = MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE;
+        os::readFromFile(chunk, sizeof(Triangle) * count, file);
+        for (u32 i = 0; i < count; i++) mesh.compact_triangles[start + i] = CompactTriangle{chunk[i]};
+    }
+}
+
+void writeTriangles(const Mesh &mesh, void *file) {
+    if (mesh.triangle_layout != TriangleLayout_Compact) {
+        os::writeToFile((void*)mesh.triangles, sizeof(Triangle) * mesh.triangle_count, file);
+        return;
+    }
+
+    Triangle chunk[MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE];
+    for (u32 start = 0; start < mesh.triangle_count; start += MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE) {
+        u32 count = mesh.triangle_count - start;
+        if (count > MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE) count = MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE;
+        for (u32 i = 0; i < count; i++) {
+            TriangleVertexIndices &indices = mesh.vertex_position_indices[start + i];
+            chunk[i].init(mesh.vertex_positions[indices.v1],
+                          mesh.vertex_positions[indices.v2],
+                          mesh.vertex_positions[indices.v3]);
+        }
+        os::writeToFile(chunk, sizeof(Triangle) * count, file);
+    }
+}
+
+// Compact triangles take their vertices from the mesh's vertex indices, which older versions of obj2mesh did not
+// store in the order of the triangles. Such meshes are detected by their triangles falling outside of their leaves:
+bool trianglesFitTheirLeaves(const Mesh &mesh) {
+    for (u32 n = 0; n < mesh.bvh.node_count; n++) {
+        const BVHNode &node = mesh.bvh.nodes[n];
+        if (!node.isLeaf()) continue;
+
+        for (u32 t = node.first_index; t < node.first_index + node.leaf_count; t++)
+            for (u32 id : mesh.vertex_position_indices[t].ids)
+                if (!node.aabb.contains(mesh.vertex_positions[id]))
+                    return false;
+    }
+    return true;
+}
+
 void readContent(Mesh &mesh, void *file) {
     os::readFromFile(&mesh.aabb.min,       sizeof(vec3), file);
     os::readFromFile(&mesh.aabb.max,       sizeof(vec3), file);
-    os::readFromFile(mesh.triangles,       sizeof(Triangle) * mesh.triangle_count, file);
+    readTriangles(mesh, file);
     os::readFromFile(mesh.vertex_positions,             sizeof(vec3)                  * mesh.vertex_count,   file);
     os::readFromFile(mesh.vertex_position_indices,      sizeof(TriangleVertexIndices) * mesh.triangle_count, file);
     os::readFromFile(mesh.edge_vertex_indices,          sizeof(EdgeVertexIndices)     * mesh.edge_count,     file);
@@ -5346,7 +6010,7 @@ void readContent(Mesh &mesh, void *file) {
 void writeContent(const Mesh &mesh, void *file) {
     os::writeToFile((void*)&mesh.aabb.min,       sizeof(vec3), file);
     os::writeToFile((void*)&mesh.aabb.max,       sizeof(vec3), file);
-    os::writeToFile((void*)mesh.triangles,               sizeof(Triangle)              * mesh.triangle_count, file);
+    writeTriangles(mesh, file);
     os::writeToFile((void*)mesh.vertex_positions,        sizeof(vec3)                  * mesh.vertex_count,   file);
     os::writeToFile((void*)mesh.vertex_position_indices, sizeof(TriangleVertexIndices) * mesh.triangle_count, file);
     os::writeToFile((void*)mesh.edge_vertex_indices,     sizeof(EdgeVertexIndices)     * mesh.edge_count,     file);
@@ -5386,18 +6050,22 @@ bool save(const Mesh &mesh, char* file_path) {
     return true;
 }
 
+// The mesh's triangle layout is kept (set it before loading to load a mesh with compact triangles).
+// Loading compact triangles fails for meshes converted by older versions of obj2mesh (see trianglesFitTheirLeaves).
 bool load(Mesh &mesh, char *file_path, memory::MonotonicAllocator *memory_allocator = nullptr) {
     void *file = os::openFileForReading(file_path);
     if (!file) return false;
 
     if (memory_allocator) {
+        TriangleLayout triangle_layout = mesh.triangle_layout;
         mesh = Mesh{};
+        mesh.triangle_layout = triangle_layout;
         readHeader(mesh, file);
         if (!allocateMemory(mesh, memory_allocator)) return false;
     } else if (!mesh.vertex_positions) return false;
     readContent(mesh, file);
     os::closeFile(file);
-    return true;
+    return mesh.triangle_layout != TriangleLayout_Compact || trianglesFitTheirLeaves(mesh);
 }
 
 u32 getTotalMemoryForMeshes(String *mesh_files, u32 mesh_count, u8 *max_bvh_height = nullptr, u32 *max_triangle_count = nullptr) {
@@ -5418,6 +6086,67 @@ u32 getTotalMemoryForMeshes(String *mesh_files, u32 mesh_count, u8 *max_bvh_heig
     return memory_size;
 }
 
+// Geometries are bounded in world space by their local bounds transformed by their transform:
+// Meshes by their own bounds, and every other geometry type by the unit cube it is intersected through.
+INLINE_XPU AABB getGeometryBounds(const Geometry &geometry, const Mesh *meshes) {
+    AABB local_bounds = geometry.type == GeometryType_Mesh ? meshes[geometry.id].aabb : AABB{-1, 1};
+    return local_bounds * geometry.transform;
+}
+
+// A top-level acceleration structure: A BVH over the world-space bounds of a scene's geometries (built and refitted
+// by BVHBuilder::buildTLAS and BVHBuilder::refitTLAS). Its leaves index a range of geometry_ids, which refer to the
+// geometries that are then searched through (i.e: through their mesh's own BVH, with the query in the mesh's space).
+// Meshes that are instanced by many geometries are only stored once, as a geometry only bounds its mesh.
+struct TLAS {
+    BVH bvh{nullptr, 0, 0};
+    u32 *geometry_ids{nullptr};
+    u32 geometry_count{0};
+    u32 capacity{0};
+
+    static u64 getSizeInBytes(u32 geometry_count) {
+        return (sizeof(BVHNode) * 2 + sizeof(u32)) * geometry_count;
+    }
+
+    bool allocate(u32 max_geometry_count, memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = getSizeInBytes(max_geometry_count);
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            bvh.nodes = (BVHNode*)memory_allocator->allocate(size);
+        } else
+            bvh.nodes = (BVHNode*)os::getMemory(size);
+
+        capacity = bvh.nodes ? max_geometry_count : 0;
+        geometry_ids = bvh.nodes ? (u32*)(bvh.nodes + capacity * 2) : nullptr;
+        return bvh.nodes != nullptr;
+    }
+
+    // Gathers the ids of the geometries whose world-space bounds overlap a sphere (i.e: for proximity queries).
+    // Returns the number of overlapping geometries, of which only up to max_count ids are written.
+    u32 overlapSphere(const vec3 &center, f32 radius, u32 *ids, u32 max_count) const {
+        if (!bvh.node_count) return 0;
+
+        u32 stack[BVH_TRAVERSAL_STACK_SIZE];
+        u32 stack_size = 0;
+        u32 count = 0;
+        stack[stack_size++] = 0;
+        while (stack_size) {
+            BVHNode &node = bvh.nodes[stack[--stack_size]];
+            if (!node.aabb.overlapSphere(center, radius))
+                continue;
+
+            if (node.isLeaf()) {
+                for (u32 i = node.first_index; i < node.first_index + node.leaf_count; i++, count++)
+                    if (count < max_count) ids[count] = geometry_ids[i];
+            } else {
+                stack[stack_size++] = node.first_index;
+                stack[stack_size++] = node.first_index + 1;
+            }
+        }
+
+        return count;
+    }
+};
+
 struct BVHPartitionSide {
     AABB *aabbs;
     f32 *surface_areas;
@@ -5426,14 +6155,15 @@ struct BVHPartitionSide {
 struct BVHPartition {
     BVHPartitionSide left, right;
     u32 left_node_count, *sorted_node_ids;
+    i32 *sort_stack;
     f32 surface_area;
 
-    void partition(u8 axis, BVHNode *nodes, i32 *stack, u32 N) {
+    void partition(u8 axis, BVHNode *nodes, u32 N) {
         u32 current_index, next_index, left_index, right_index;
         f32 current_surface_area;
         left_index = 0;
         right_index = N - 1;
-
+        i32 *stack = sort_stack;
 
         // Sort nodes by axis:
         {
@@ -5534,92 +6264,459 @@ struct BVHBuildIteration {
     u8 depth;
 };
 
+struct BVHBin {
+    AABB aabb;
+    u32 count;
+};
+
+enum BVHBuildMode {
+    BVHBuildMode_Binned = 0, // Fast: Bins node centroids and sweeps the bin boundaries, O(N) per level
+    BVHBuildMode_Sweep       // High quality: Sorts the nodes and sweeps every split position, O(N log N) per level
+};
+
 constexpr f32 EPS = 0.0001f;
 constexpr i32 MAX_TRIANGLES_PER_MESH_RTREE_NODE = 4;
-
-struct BVHBuilder {
-    BVHNode *nodes;
+constexpr u16 MAX_GEOMETRIES_PER_TLAS_NODE = 1;     // Geometries are costly to search through, so leaves keep one each
+constexpr u8 BVH_MAX_BIN_COUNT = 64;
+constexpr u8 BVH_DEFAULT_BIN_COUNT = 32;
+constexpr u32 BVH_MIN_SUBTREE_SIZE = 1024;   // Smallest range that gets built as a separate (parallel) subtree
+constexpr u32 BVH_SUBTREES_PER_THREAD = 8;   // Enough subtrees per thread for work-stealing to balance the load
+constexpr u32 BVH_PARALLEL_CHUNK_SIZE = 8192; // Nodes (or triangles) per chunk when processing them in parallel
+constexpr u32 BVH_REFIT_CHUNK_SIZE = 256;     // Nodes per chunk when refitting a depth level in parallel
+
+// The scratch memory of a single thread for splitting nodes (sized for the largest range it would split):
+struct BVHBuildScratch {
     BVHPartition partitions[3];
     BVHBuildIteration *iterations;
-    u32 *node_ids, *leaf_ids;
-    i32 *sort_stack;
+    BVHBin bins[3][BVH_MAX_BIN_COUNT];
+    AABB right_aabbs[BVH_MAX_BIN_COUNT];
+    u32 right_counts[BVH_MAX_BIN_COUNT];
+    u8 height;
 
-    static u32 getSizeInBytes(u32 max_leaf_count) {
-        u32 memory_size = sizeof(u32) + sizeof(i32) + 2 * (sizeof(AABB) + sizeof(f32));
+    static u64 getSizeInBytes(u32 max_leaf_count) {
+        u64 memory_size = sizeof(u32) + sizeof(i32) + 2 * (sizeof(AABB) + sizeof(f32));
         memory_size *= 3;
-        memory_size += sizeof(BVHBuildIteration) + sizeof(BVHNode) + sizeof(u32) * 2;
+        memory_size += sizeof(BVHBuildIteration);
         memory_size *= max_leaf_count;
 
         return memory_size;
     }
 
-    BVHBuilder(Mesh *meshes, u32 mesh_count, memory::MonotonicAllocator *memory_allocator) {
-        u32 max_leaf_node_count = 0;
-        if (mesh_count)
-            for (u32 m = 0; m < mesh_count; m++)
-                if (meshes[m].triangle_count > max_leaf_node_count)
-                    max_leaf_node_count = meshes[m].triangle_count;
-
-        iterations = (BVHBuildIteration*)memory_allocator->allocate(sizeof(BVHBuildIteration) * max_leaf_node_count);
-        nodes      = (BVHNode*          )memory_allocator->allocate(sizeof(BVHNode)           * max_leaf_node_count);
-        node_ids   = (u32*                )memory_allocator->allocate(sizeof(u32)                 * max_leaf_node_count);
-        leaf_ids   = (u32*                )memory_allocator->allocate(sizeof(u32)                 * max_leaf_node_count);
-        sort_stack = (i32*                )memory_allocator->allocate(sizeof(i32)                 * max_leaf_node_count);
-
+    void allocate(u32 max_leaf_count, memory::MonotonicAllocator *memory_allocator) {
+        iterations = (BVHBuildIteration*)memory_allocator->allocate(sizeof(BVHBuildIteration) * max_leaf_count);
         for (u8 i = 0; i < 3; i++) {
-            partitions[i].sorted_node_ids     = (u32* )memory_allocator->allocate(sizeof(u32)  * max_leaf_node_count);
-            partitions[i].left.aabbs          = (AABB*)memory_allocator->allocate(sizeof(AABB) * max_leaf_node_count);
-            partitions[i].right.aabbs         = (AABB*)memory_allocator->allocate(sizeof(AABB) * max_leaf_node_count);
-            partitions[i].left.surface_areas  = (f32* )memory_allocator->allocate(sizeof(f32)  * max_leaf_node_count);
-            partitions[i].right.surface_areas = (f32* )memory_allocator->allocate(sizeof(f32)  * max_leaf_node_count);
+            partitions[i].sorted_node_ids     = (u32* )memory_allocator->allocate(sizeof(u32)  * max_leaf_count);
+            partitions[i].sort_stack          = (i32* )memory_allocator->allocate(sizeof(i32)  * max_leaf_count);
+            partitions[i].left.aabbs          = (AABB*)memory_allocator->allocate(sizeof(AABB) * max_leaf_count);
+            partitions[i].right.aabbs         = (AABB*)memory_allocator->allocate(sizeof(AABB) * max_leaf_count);
+            partitions[i].left.surface_areas  = (f32* )memory_allocator->allocate(sizeof(f32)  * max_leaf_count);
+            partitions[i].right.surface_areas = (f32* )memory_allocator->allocate(sizeof(f32)  * max_leaf_count);
         }
     }
+};
 
-    u32 splitNode(BVHNode &node, u32 start, u32 end, BVH &bvh) {
-        u32 N = end - start;
-        u32 *ids = node_ids + start;
+struct BVHBuilder;
 
-        node.first_index = bvh.node_count;
-        BVHNode &left_node  = bvh.nodes[bvh.node_count++];
-        BVHNode &right_node = bvh.nodes[bvh.node_count++];
-        left_node = BVHNode{};
-        right_node = BVHNode{};
+struct BVHSubtreeJob {
+    BVHBuilder *builder;
+    BVH *bvh;
+    BVHBuildIteration iteration;
+    u16 max_leaf_size;
+};
 
-        f32 smallest_surface_area = INFINITY;
-        u8 chosen_axis = 0;
+struct BVHBinningJob {
+    BVHBuilder *builder;
+    const u32 *ids;
+    AABB centroid_bounds;
+    u8 bin_count;
+};
 
-        for (u8 axis = 0; axis < 3; axis++) {
-            BVHPartition &pa = partitions[axis];
-            for (u32 i = 0; i < N; i++) pa.sorted_node_ids[i] = ids[i];
+struct BVHSweepJob {
+    BVHBuilder *builder;
+    BVHPartition *partition;
+    const u32 *ids;
+    u32 N;
+    u8 axis;
+};
 
-            // Partition the nodes for the current partition axis:
-            pa.partition(axis, nodes, sort_stack, N);
+// With a thread pool, the top levels are split by the calling thread with the split itself done in parallel
+// (binning chunks of the range, or sorting the 3 axes, on all threads). Ranges that are small enough are built
+// as independent subtrees by whichever thread picks them up, each using its own scratch memory.
+// Nodes are allocated with an atomic counter, and leaves index their range of the node ids directly,
+// so threads never need to coordinate beyond that.
+struct BVHBuilder {
+    BVHNode *nodes;
+    BVHBuildScratch scratch;
+    u32 *node_ids, *leaf_ids, *depth_sorted_node_ids;
+    TriangleVertexIndices *sorted_triangle_vertex_indices;
 
-            // Choose the current partition axis if it's smallest surface area is smallest so far:
-            if (pa.surface_area < smallest_surface_area) {
-                smallest_surface_area = pa.surface_area;
-                chosen_axis = axis;
-            }
-        }
+    BVHBuildMode mode = BVHBuildMode_Binned;
+    u8 bin_count = BVH_DEFAULT_BIN_COUNT;
 
-        BVHPartition &chosen_partition_axis = partitions[chosen_axis];
-        left_node.aabb  = chosen_partition_axis.left.aabbs[chosen_partition_axis.left_node_count-1];
-        right_node.aabb = chosen_partition_axis.right.aabbs[chosen_partition_axis.left_node_count];
+    ThreadPool *thread_pool = nullptr;
+    BVHBuildScratch *worker_scratches = nullptr;
+    BVHSubtreeJob *subtree_jobs = nullptr;
+    BVHBin (*thread_bins)[3][BVH_MAX_BIN_COUNT] = nullptr;
+    AABB *thread_centroid_bounds = nullptr;
+    u32 subtree_threshold = 0;
+    u32 subtree_job_capacity = 0;
+    u32 max_leaf_node_count = 0;
+    volatile u32 node_count{0};
 
-        for (u32 i = 0; i < N; i++) ids[i] = chosen_partition_axis.sorted_node_ids[i];
+    static u32 getSubtreeThreshold(u32 max_leaf_count, u32 thread_count) {
+        u32 subtree_threshold = max_leaf_count / (thread_count * BVH_SUBTREES_PER_THREAD);
+        return subtree_threshold < BVH_MIN_SUBTREE_SIZE ? BVH_MIN_SUBTREE_SIZE : subtree_threshold;
+    }
 
-        return start + chosen_partition_axis.left_node_count;
+    static u32 getSubtreeJobCapacity(u32 max_leaf_count, u32 thread_count) {
+        return 4 * (max_leaf_count / getSubtreeThreshold(max_leaf_count, thread_count)) + 64;
     }
 
-    void build(BVH &bvh, u32 N, u16 max_leaf_size) {
-        bvh.height = 1;
-        bvh.node_count = 1;
+    static u64 getSizeInBytes(u32 max_leaf_count, u32 thread_count = 1) {
+        u64 memory_size = sizeof(BVHNode) + sizeof(u32) * 4 + sizeof(TriangleVertexIndices);
+        memory_size *= max_leaf_count;
+        memory_size += BVHBuildScratch::getSizeInBytes(max_leaf_count);
 
-        BVHNode &root = bvh.nodes[0];
-        root = BVHNode{};
+        if (thread_count > 1) {
+            u32 subtree_threshold = getSubtreeThreshold(max_leaf_count, thread_count);
+            memory_size += thread_count * (sizeof(BVHBuildScratch) + BVHBuildScratch::getSizeInBytes(subtree_threshold));
+            memory_size += thread_count * (sizeof(BVHBin) * 3 * BVH_MAX_BIN_COUNT + sizeof(AABB));
+            memory_size += getSubtreeJobCapacity(max_leaf_count, thread_count) * sizeof(BVHSubtreeJob);
+        }
 
-        if (N <= max_leaf_size) {
-            root.leaf_count = (u16)N;
+        return memory_size;
+    }
+
+    static u32 getMaxLeafNodeCount(const Mesh *meshes, u32 mesh_count) {
+        u32 max_leaf_node_count = 0;
+        for (u32 m = 0; m < mesh_count; m++)
+            if (meshes[m].triangle_count > max_leaf_node_count)
+                max_leaf_node_count = meshes[m].triangle_count;
+
+        return max_leaf_node_count;
+    }
+
+    BVHBuilder(Mesh *meshes, u32 mesh_count, memory::MonotonicAllocator *memory_allocator, ThreadPool *thread_pool = nullptr) :
+            BVHBuilder{getMaxLeafNodeCount(meshes, mesh_count), memory_allocator, thread_pool} {}
+
+    // A builder can build BVHs of up to max_leaf_node_count leaf nodes (triangles of a mesh, or geometries of a TLAS):
+    BVHBuilder(u32 max_leaf_node_count, memory::MonotonicAllocator *memory_allocator, ThreadPool *thread_pool = nullptr) :
+            thread_pool{thread_pool}, max_leaf_node_count{max_leaf_node_count} {
+        if (thread_pool && thread_pool->thread_count > 1) {
+            u32 thread_count = thread_pool->thread_count;
+            subtree_threshold = getSubtreeThreshold(max_leaf_node_count, thread_count);
+            subtree_job_capacity = getSubtreeJobCapacity(max_leaf_node_count, thread_count);
+
+            worker_scratches = (BVHBuildScratch*)memory_allocator->allocate(sizeof(BVHBuildScratch) * thread_count);
+            subtree_jobs     = (BVHSubtreeJob*  )memory_allocator->allocate(sizeof(BVHSubtreeJob)   * subtree_job_capacity);
+            thread_bins = (BVHBin (*)[3][BVH_MAX_BIN_COUNT])memory_allocator->allocate(sizeof(BVHBin) * 3 * BVH_MAX_BIN_COUNT * thread_count);
+            thread_centroid_bounds = (AABB*)memory_allocator->allocate(sizeof(AABB) * thread_count);
+            for (u32 t = 0; t < thread_count; t++)
+                worker_scratches[t].allocate(subtree_threshold, memory_allocator);
+        }
+
+        nodes    = (BVHNode*)memory_allocator->allocate(sizeof(BVHNode) * max_leaf_node_count);
+        node_ids = (u32*    )memory_allocator->allocate(sizeof(u32)     * max_leaf_node_count);
+        leaf_ids = (u32*    )memory_allocator->allocate(sizeof(u32)     * max_leaf_node_count);
+        depth_sorted_node_ids = (u32*)memory_allocator->allocate(sizeof(u32) * max_leaf_node_count * 2);
+        sorted_triangle_vertex_indices = (TriangleVertexIndices*)memory_allocator->allocate(sizeof(TriangleVertexIndices) * max_leaf_node_count);
+        scratch.allocate(max_leaf_node_count, memory_allocator);
+    }
+
+    INLINE void allocateChildren(BVHNode &node, BVH &bvh) {
+        node.first_index = os::atomicAdd(&node_count, 2);
+        BVHNode &left_node  = bvh.nodes[node.first_index];
+        BVHNode &right_node = bvh.nodes[node.first_index + 1];
+        left_node = BVHNode{};
+        right_node = BVHNode{};
+        left_node.depth = right_node.depth = node.depth + 1;
+    }
+
+    INLINE static u32 getBin(const AABB &aabb, u8 axis, f32 origin, f32 scale, u8 B) {
+        u32 b = (u32)((aabb.min.components[axis] + aabb.max.components[axis] - origin) * scale);
+        return b >= B ? B - 1 : b;
+    }
+
+    INLINE static void resetBins(BVHBin (*bins)[BVH_MAX_BIN_COUNT], u8 B) {
+        for (u8 axis = 0; axis < 3; axis++)
+            for (u8 b = 0; b < B; b++) {
+                bins[axis][b].aabb = {INFINITY, -INFINITY};
+                bins[axis][b].count = 0;
+            }
+    }
+
+    // Bound the centroids (using doubled centers, as only their relative positions matter):
+    void boundCentroids(const u32 *ids, u32 N, AABB &centroid_bounds) const {
+        for (u32 i = 0; i < N; i++) {
+            const AABB &aabb = nodes[ids[i]].aabb;
+            vec3 centroid{aabb.min + aabb.max};
+            centroid_bounds.min = minimum(centroid_bounds.min, centroid);
+            centroid_bounds.max = maximum(centroid_bounds.max, centroid);
+        }
+    }
+
+    // Accumulate the nodes into the bins of all 3 axes in a single pass:
+    void binCentroids(const u32 *ids, u32 N, const AABB &centroid_bounds, u8 B, BVHBin (*bins)[BVH_MAX_BIN_COUNT]) const {
+        vec3 extents{centroid_bounds.max - centroid_bounds.min};
+        f32 scales[3];
+        for (u8 axis = 0; axis < 3; axis++)
+            scales[axis] = extents.components[axis] > 0 ? (f32)B / extents.components[axis] : 0;
+
+        for (u32 i = 0; i < N; i++) {
+            const AABB &aabb = nodes[ids[i]].aabb;
+            for (u8 axis = 0; axis < 3; axis++) {
+                BVHBin &bin = bins[axis][getBin(aabb, axis, centroid_bounds.min.components[axis], scales[axis], B)];
+                bin.aabb += aabb;
+                bin.count++;
+            }
+        }
+    }
+
+    static void boundCentroidsJob(void *data, u32 start, u32 end, u32 thread_index) {
+        BVHBinningJob &job = *(BVHBinningJob*)data;
+        job.builder->boundCentroids(job.ids + start, end - start, job.builder->thread_centroid_bounds[thread_index]);
+    }
+
+    static void binCentroidsJob(void *data, u32 start, u32 end, u32 thread_index) {
+        BVHBinningJob &job = *(BVHBinningJob*)data;
+        job.builder->binCentroids(job.ids + start, end - start, job.centroid_bounds, job.bin_count, job.builder->thread_bins[thread_index]);
+    }
+
+    static void sweepJob(void *data, u32 thread_index) {
+        BVHSweepJob &job = *(BVHSweepJob*)data;
+        job.builder->sweep(*job.partition, job.axis, job.ids, job.N);
+    }
+
+    static void buildSubtreeJob(void *data, u32 thread_index) {
+        BVHSubtreeJob &job = *(BVHSubtreeJob*)data;
+        job.builder->buildSubtree(*job.bvh, job.builder->worker_scratches[thread_index], job.iteration, job.max_leaf_size);
+    }
+
+    u32 splitNode(BVHNode &node, u32 start, u32 end, BVH &bvh, BVHBuildScratch &split_scratch, bool in_parallel = false) {
+        return mode == BVHBuildMode_Binned ?
+            splitNodeBinned(node, start, end, bvh, split_scratch, in_parallel) :
+            splitNodeSweep(node, start, end, bvh, split_scratch, in_parallel);
+    }
+
+    u32 splitNodeBinned(BVHNode &node, u32 start, u32 end, BVH &bvh, BVHBuildScratch &split_scratch, bool in_parallel) {
+        u32 N = end - start;
+        u32 *ids = node_ids + start;
+
+        allocateChildren(node, bvh);
+        BVHNode &left_node  = bvh.nodes[node.first_index];
+        BVHNode &right_node = bvh.nodes[node.first_index + 1];
+
+        u8 B = bin_count < 2 ? 2 : (bin_count > BVH_MAX_BIN_COUNT ? BVH_MAX_BIN_COUNT : bin_count);
+        BVHBin (*bins)[BVH_MAX_BIN_COUNT] = split_scratch.bins;
+        AABB *right_aabbs = split_scratch.right_aabbs;
+        u32 *right_counts = split_scratch.right_counts;
+
+        AABB centroid_bounds{INFINITY, -INFINITY};
+        resetBins(bins, B);
+        if (in_parallel) {
+            u32 thread_count = thread_pool->thread_count;
+            BVHBinningJob job{this, ids, centroid_bounds, B};
+
+            for (u32 t = 0; t < thread_count; t++) thread_centroid_bounds[t] = {INFINITY, -INFINITY};
+            thread_pool->parallelFor(N, BVH_PARALLEL_CHUNK_SIZE, boundCentroidsJob, &job, 0);
+            for (u32 t = 0; t < thread_count; t++) centroid_bounds += thread_centroid_bounds[t];
+
+            job.centroid_bounds = centroid_bounds;
+            for (u32 t = 0; t < thread_count; t++) resetBins(thread_bins[t], B);
+            thread_pool->parallelFor(N, BVH_PARALLEL_CHUNK_SIZE, binCentroidsJob, &job, 0);
+            for (u32 t = 0; t < thread_count; t++)
+                for (u8 axis = 0; axis < 3; axis++)
+                    for (u8 b = 0; b < B; b++) {
+                        bins[axis][b].aabb += thread_bins[t][axis][b].aabb;
+                        bins[axis][b].count += thread_bins[t][axis][b].count;
+                    }
+        } else {
+            boundCentroids(ids, N, centroid_bounds);
+            binCentroids(ids, N, centroid_bounds, B, bins);
+        }
+        vec3 extents{centroid_bounds.max - centroid_bounds.min};
+
+        f32 smallest_cost = INFINITY;
+        u8 chosen_axis = 0;
+        u8 chosen_bin = 0;
+        u32 chosen_left_count = 0;
+
+        for (u8 axis = 0; axis < 3; axis++) {
+            if (extents.components[axis] <= 0) continue;
+
+            // Sweep from the right, accumulating the bounds/counts to the right of each bin boundary:
+            AABB R{INFINITY, -INFINITY};
+            u32 right_count = 0;
+            for (u8 b = B - 1; b > 0; b--) {
+                R += bins[axis][b].aabb;
+                right_count += bins[axis][b].count;
+                right_aabbs[b - 1] = R;
+                right_counts[b - 1] = right_count;
+            }
+
+            // Sweep from the left, evaluating the cost of splitting at each bin boundary:
+            AABB L{INFINITY, -INFINITY};
+            u32 left_count = 0;
+            for (u8 b = 0; b < B - 1; b++) {
+                L += bins[axis][b].aabb;
+                left_count += bins[axis][b].count;
+                if (!left_count || !right_counts[b]) continue;
+
+                f32 cost = L.area() * (f32)left_count + right_aabbs[b].area() * (f32)right_counts[b];
+                if (cost < smallest_cost) {
+                    smallest_cost = cost;
+                    chosen_axis = axis;
+                    chosen_bin = b;
+                    chosen_left_count = left_count;
+                    left_node.aabb = L;
+                    right_node.aabb = right_aabbs[b];
+                }
+            }
+        }
+
+        if (!chosen_left_count) {
+            // All centroids coincide (or fall in a single bin): Split the range in half
+            u32 middle = N / 2;
+            left_node.aabb = right_node.aabb = {INFINITY, -INFINITY};
+            for (u32 i = 0; i < N; i++)
+                (i < middle ? left_node.aabb : right_node.aabb) += nodes[ids[i]].aabb;
+
+            return start + middle;
+        }
+
+        // Partition the ids in-place around the chosen bin boundary:
+        f32 origin = centroid_bounds.min.components[chosen_axis];
+        f32 scale = (f32)B / extents.components[chosen_axis];
+        u32 left_index = 0;
+        u32 right_index = N - 1;
+        while (left_index <= right_index) {
+            if (getBin(nodes[ids[left_index]].aabb, chosen_axis, origin, scale, B) <= chosen_bin)
+                left_index++;
+            else {
+                u32 t = ids[left_index];
+                ids[left_index] = ids[right_index];
+                ids[right_index] = t;
+                right_index--;
+            }
+        }
+
+        return start + chosen_left_count;
+    }
+
+    void sweep(BVHPartition &pa, u8 axis, const u32 *ids, u32 N) {
+        for (u32 i = 0; i < N; i++) pa.sorted_node_ids[i] = ids[i];
+
+        // Partition the nodes for the current partition axis:
+        pa.partition(axis, nodes, N);
+    }
+
+    u32 splitNodeSweep(BVHNode &node, u32 start, u32 end, BVH &bvh, BVHBuildScratch &split_scratch, bool in_parallel) {
+        u32 N = end - start;
+        u32 *ids = node_ids + start;
+
+        allocateChildren(node, bvh);
+        BVHNode &left_node  = bvh.nodes[node.first_index];
+        BVHNode &right_node = bvh.nodes[node.first_index + 1];
+
+        BVHPartition *partitions = split_scratch.partitions;
+        if (in_parallel) {
+            // Sort and sweep the 3 axes concurrently (each partition has its own sorting stack):
+            BVHSweepJob jobs[3];
+            JobGroup group;
+            for (u8 axis = 0; axis < 3; axis++) {
+                jobs[axis] = {this, partitions + axis, ids, N, axis};
+                thread_pool->submit(sweepJob, jobs + axis, group, 0);
+            }
+            thread_pool->wait(group, 0);
+        } else
+            for (u8 axis = 0; axis < 3; axis++)
+                sweep(partitions[axis], axis, ids, N);
+
+        // Choose the partition axis with the smallest surface area:
+        f32 smallest_surface_area = INFINITY;
+        u8 chosen_axis = 0;
+        for (u8 axis = 0; axis < 3; axis++)
+            if (partitions[axis].surface_area < smallest_surface_area) {
+                smallest_surface_area = partitions[axis].surface_area;
+                chosen_axis = axis;
+            }
+
+        BVHPartition &chosen_partition_axis = partitions[chosen_axis];
+        left_node.aabb  = chosen_partition_axis.left.aabbs[chosen_partition_axis.left_node_count-1];
+        right_node.aabb = chosen_partition_axis.right.aabbs[chosen_partition_axis.left_node_count];
+
+        for (u32 i = 0; i < N; i++) ids[i] = chosen_partition_axis.sorted_node_ids[i];
+
+        return start + chosen_partition_axis.left_node_count;
+    }
+
+    void buildSubtree(BVH &bvh, BVHBuildScratch &subtree_scratch, BVHBuildIteration iteration, u16 max_leaf_size) {
+        BVHBuildIteration *stack = subtree_scratch.iterations;
+        stack[0] = iteration;
+        i32 stack_size = 0;
+
+        while (stack_size >= 0) {
+            iteration = stack[stack_size--];
+            BVHNode &node = bvh.nodes[iteration.node_id];
+            u32 N = iteration.end - iteration.start;
+            if (N <= max_leaf_size) {
+                // Leaves index their own range of the (now partitioned) node ids:
+                node.leaf_count = (u16)N;
+                node.first_index = iteration.start;
+                for (u32 i = iteration.start; i < iteration.end; i++)
+                    leaf_ids[i] = nodes[node_ids[i]].first_index;
+            } else {
+                u32 middle = splitNode(node, iteration.start, iteration.end, bvh, subtree_scratch);
+                u8 depth = iteration.depth + 1;
+                stack[++stack_size] = {iteration.start, middle, node.first_index, depth};
+                stack[++stack_size] = {middle, iteration.end, node.first_index + 1, depth};
+                if (depth > subtree_scratch.height) subtree_scratch.height = depth;
+            }
+        }
+    }
+
+    // Runs on the thread that created the thread pool (index 0), which also builds the subtrees while it waits:
+    void buildInParallel(BVH &bvh, u32 N, u16 max_leaf_size) {
+        JobGroup group;
+        u32 subtree_job_count = 0;
+
+        BVHBuildIteration *stack = scratch.iterations;
+        stack[0] = {0, N, 0, 0};
+        i32 stack_size = 0;
+
+        while (stack_size >= 0) {
+            BVHBuildIteration iteration = stack[stack_size--];
+            if (iteration.end - iteration.start <= subtree_threshold) {
+                if (subtree_job_count < subtree_job_capacity) {
+                    BVHSubtreeJob &job = subtree_jobs[subtree_job_count++];
+                    job = {this, &bvh, iteration, max_leaf_size};
+                    thread_pool->submit(buildSubtreeJob, &job, group, 0);
+                } else // Out of job slots (only for extremely unbalanced splits), so build it right here:
+                    buildSubtree(bvh, worker_scratches[0], iteration, max_leaf_size);
+
+                continue;
+            }
+
+            BVHNode &node = bvh.nodes[iteration.node_id];
+            u32 middle = splitNode(node, iteration.start, iteration.end, bvh, scratch, true);
+            u8 depth = iteration.depth + 1;
+            stack[++stack_size] = {iteration.start, middle, node.first_index, depth};
+            stack[++stack_size] = {middle, iteration.end, node.first_index + 1, depth};
+            if (depth > scratch.height) scratch.height = depth;
+        }
+
+        thread_pool->wait(group, 0);
+    }
+
+    void build(BVH &bvh, u32 N, u16 max_leaf_size) {
+        bvh.height = 1;
+        bvh.node_count = 1;
+
+        BVHNode &root = bvh.nodes[0];
+        root = BVHNode{};
+
+        if (N <= max_leaf_size) {
+            root.leaf_count = (u16)N;
             root.aabb.min = INFINITY;
             root.aabb.max = -INFINITY;
 
@@ -5632,113 +6729,653 @@ struct BVHBuilder {
             return;
         }
 
-        u32 middle = splitNode(root, 0, N, bvh);
-        BVHBuildIteration *stack = iterations;
-        u32 *node_id;
+        node_count = 1;
+        scratch.height = 1;
+        bool in_parallel = thread_pool && thread_pool->thread_count > 1 && worker_scratches && N > subtree_threshold;
+        if (in_parallel) {
+            for (u32 t = 0; t < thread_pool->thread_count; t++) worker_scratches[t].height = 1;
+            buildInParallel(bvh, N, max_leaf_size);
+            for (u32 t = 0; t < thread_pool->thread_count; t++)
+                if (worker_scratches[t].height > scratch.height)
+                    scratch.height = worker_scratches[t].height;
+        } else
+            buildSubtree(bvh, scratch, {0, N, 0, 0}, max_leaf_size);
+
+        bvh.node_count = node_count;
+        bvh.height = scratch.height;
+        root.aabb = bvh.nodes[1].aabb + bvh.nodes[2].aabb;
+    }
 
-        BVHBuildIteration left{0, middle, 1, 1};
-        BVHBuildIteration right{middle, N, 2, 1};
+    // Pad the bounds of axis-aligned triangles, so that no node ends up with a zero-thickness box:
+    INLINE static void boundTriangle(const vec3 &v1, const vec3 &v2, const vec3 &v3, AABB &aabb) {
+        vec3 &min = aabb.min;
+        vec3 &max = aabb.max;
 
-        stack[0] = left;
-        stack[1] = right;
+        min = minimum(minimum(v1, v2), v3);
+        max = maximum(maximum(v1, v2), v3);
 
-        i32 stack_size = 1;
-        u32 leaf_count = 0;;
+        f32 diff = max.x - min.x;
+        if (diff < 0) diff = -diff;
+        if (diff < EPS) {
+            min.x -= EPS;
+            max.x += EPS;
+        }
 
-        while (stack_size >= 0) {
-            left = stack[stack_size];
-            BVHNode &node = bvh.nodes[left.node_id];
-            N = left.end - left.start;
-            if (N <= max_leaf_size) {
-                node.depth = left.depth;
-                node.leaf_count = (u16)N;
-                node.first_index = leaf_count;
+        diff = max.y - min.y;
+        if (diff < 0) diff = -diff;
+        if (diff < EPS) {
+            min.y -= EPS;
+            max.y += EPS;
+        }
 
-                node_id = node_ids + left.start;
-                for (u32 i = 0; i < N; i++, node_id++)
-                    leaf_ids[leaf_count + i] = nodes[*node_id].first_index;
-                leaf_count += N;
-                stack_size--;
-            } else {
-                middle = splitNode(node, left.start, left.end, bvh);
-                left.depth++;
-                right.depth = left.depth;
-                right.end = left.end;
-                right.start = left.end = middle;
-                left.node_id  = node.first_index;
-                right.node_id = node.first_index + 1;
-                bvh.nodes[bvh.node_count - 1].depth = left.depth;
-                bvh.nodes[bvh.node_count - 2].depth = right.depth;
-                stack[  stack_size] = left;
-                stack[++stack_size] = right;
-                if (left.depth > bvh.height) bvh.height = left.depth;
-            }
+        diff = max.z - min.z;
+        if (diff < 0) diff = -diff;
+        if (diff < EPS) {
+            min.z -= EPS;
+            max.z += EPS;
         }
+    }
 
-        BVHNode &left_node = bvh.nodes[1];
-        BVHNode &right_node = bvh.nodes[2];
-        left_node.depth = right_node.depth = 1;
-        root.aabb = left_node.aabb + right_node.aabb;
+    void initLeafNodes(Mesh &mesh, u32 start, u32 end) {
+        for (u32 i = start; i < end; i++) {
+            TriangleVertexIndices &indices = mesh.vertex_position_indices[i];
+            BVHNode &node = nodes[i];
+            boundTriangle(mesh.vertex_positions[indices.ids[0]],
+                          mesh.vertex_positions[indices.ids[1]],
+                          mesh.vertex_positions[indices.ids[2]], node.aabb);
+            node.first_index = node_ids[i] = i;
+        }
     }
 
-    void buildMesh(Mesh &mesh) {
-        for (u32 i = 0; i < mesh.triangle_count; i++) {
+    // Gathers the triangles' vertex indices into the order of the BVH's leaves:
+    void sortTriangleVertexIndices(TriangleVertexIndices *indices, u32 start, u32 end) {
+        for (u32 i = start; i < end; i++) sorted_triangle_vertex_indices[i] = indices[leaf_ids[i]];
+    }
+
+    void initTriangles(Mesh &mesh, u32 start, u32 end) {
+        for (u32 i = start; i < end; i++) {
             TriangleVertexIndices &indices = mesh.vertex_position_indices[i];
-            const vec3 &v1 = mesh.vertex_positions[indices.ids[0]];
-            const vec3 &v2 = mesh.vertex_positions[indices.ids[1]];
-            const vec3 &v3 = mesh.vertex_positions[indices.ids[2]];
+            mesh.setTriangle(i,
+                             mesh.vertex_positions[indices.ids[0]],
+                             mesh.vertex_positions[indices.ids[1]],
+                             mesh.vertex_positions[indices.ids[2]]);
+        }
+    }
+
+    // Leaves re-bound (and update) their triangles, while internal nodes merge their (already refitted) children:
+    void refitNodes(Mesh &mesh, const u32 *ids, u32 count) {
+        BVHNode *bvh_nodes = mesh.bvh.nodes;
+        for (u32 i = 0; i < count; i++) {
+            BVHNode &node = bvh_nodes[ids[i]];
+            if (node.isLeaf()) {
+                node.aabb = {INFINITY, -INFINITY};
+                for (u32 t = node.first_index; t < node.first_index + node.leaf_count; t++) {
+                    TriangleVertexIndices &indices = mesh.vertex_position_indices[t];
+                    const vec3 &v1 = mesh.vertex_positions[indices.ids[0]];
+                    const vec3 &v2 = mesh.vertex_positions[indices.ids[1]];
+                    const vec3 &v3 = mesh.vertex_positions[indices.ids[2]];
+                    AABB triangle_aabb;
+                    boundTriangle(v1, v2, v3, triangle_aabb);
+                    mesh.setTriangle(t, v1, v2, v3);
+                    node.aabb += triangle_aabb;
+                }
+            } else
+                node.aabb = bvh_nodes[node.first_index].aabb + bvh_nodes[node.first_index + 1].aabb;
+        }
+    }
+
+    struct MeshJob {
+        BVHBuilder *builder;
+        Mesh *mesh;
+        TriangleVertexIndices *indices;
+        const u32 *node_ids;
+    };
+
+    static void initLeafNodesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        job.builder->initLeafNodes(*job.mesh, start, end);
+    }
+
+    static void sortTriangleVertexIndicesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        job.builder->sortTriangleVertexIndices(job.indices, start, end);
+    }
+
+    static void copySortedTriangleVertexIndicesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        for (u32 i = start; i < end; i++) job.indices[i] = job.builder->sorted_triangle_vertex_indices[i];
+    }
+
+    static void initTrianglesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        job.builder->initTriangles(*job.mesh, start, end);
+    }
+
+    static void refitNodesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        job.builder->refitNodes(*job.mesh, job.node_ids + start, end - start);
+    }
+
+    void forEachTriangle(Mesh &mesh, MeshJob &job, RangeJobFunction function) {
+        if (thread_pool)
+            thread_pool->parallelFor(mesh.triangle_count, BVH_PARALLEL_CHUNK_SIZE, function, &job, 0);
+        else
+            function(&job, 0, mesh.triangle_count, 0);
+    }
+
+    // Builds the mesh's BVH, then reorders its triangle vertex indices (positions, normals and uvs) to match the
+    // triangles (which are stored in the order of the BVH's leaves), so that Mesh::triangles[i] is always the
+    // triangle of Mesh::vertex_position_indices[i] (as is required for refitting and for compact triangles).
+    // The triangles are written in the mesh's triangle layout.
+    void buildMesh(Mesh &mesh) {
+        MeshJob job{this, &mesh};
+        forEachTriangle(mesh, job, initLeafNodesJob);
+
+        build(mesh.bvh, mesh.triangle_count, MAX_TRIANGLES_PER_MESH_RTREE_NODE);
+        mesh.bvh.refit_base_sah_cost = 0;
+
+        TriangleVertexIndices *triangle_vertex_indices[3] = {
+            mesh.vertex_position_indices,
+            mesh.normals_count ? mesh.vertex_normal_indices : nullptr,
+            mesh.uvs_count ? mesh.vertex_uvs_indices : nullptr
+        };
+        for (TriangleVertexIndices *indices : triangle_vertex_indices)
+            if (indices) {
+                job.indices = indices;
+                forEachTriangle(mesh, job, sortTriangleVertexIndicesJob);
+                forEachTriangle(mesh, job, copySortedTriangleVertexIndicesJob);
+            }
+
+        forEachTriangle(mesh, job, initTrianglesJob);
+    }
+
+    // Refits the mesh's BVH (and triangles) to its current vertex positions, keeping its topology as is.
+    // Nodes are refitted bottom-up one depth level at a time, with the nodes of each level done in parallel.
+    // Given a rebuild threshold (say 1.5), the BVH is rebuilt instead once refitting had degraded its SAH cost
+    // by more than that factor (relative to the cost it had before it was first refitted).
+    // Returns whether the BVH got rebuilt.
+    // Note: Meshes converted by older versions of obj2mesh need to be built once (buildMesh) before refitting.
+    bool refitMesh(Mesh &mesh, f32 rebuild_threshold = 0) {
+        BVH &bvh = mesh.bvh;
+        if (rebuild_threshold > 0 && bvh.refit_base_sah_cost == 0)
+            bvh.refit_base_sah_cost = bvh.getSAHCost();
+
+        // Sort the node ids by depth (counting sort):
+        u32 level_offsets[256 + 1] = {};
+        for (u32 i = 0; i < bvh.node_count; i++) level_offsets[bvh.nodes[i].depth + 1]++;
+        for (u32 depth = 1; depth <= 256; depth++) level_offsets[depth] += level_offsets[depth - 1];
+        u32 level_ends[256];
+        for (u32 depth = 0; depth < 256; depth++) level_ends[depth] = level_offsets[depth];
+        for (u32 i = 0; i < bvh.node_count; i++) depth_sorted_node_ids[level_ends[bvh.nodes[i].depth]++] = i;
+
+        MeshJob job{this, &mesh};
+        for (i32 depth = 255; depth >= 0; depth--) {
+            u32 level_start = level_offsets[depth];
+            u32 level_node_count = level_offsets[depth + 1] - level_start;
+            if (!level_node_count) continue;
+
+            job.node_ids = depth_sorted_node_ids + level_start;
+            if (thread_pool)
+                thread_pool->parallelFor(level_node_count, BVH_REFIT_CHUNK_SIZE, refitNodesJob, &job, 0);
+            else
+                refitNodes(mesh, job.node_ids, level_node_count);
+        }
+        mesh.aabb = bvh.nodes[0].aabb;
+
+        if (rebuild_threshold > 0 && bvh.getSAHCost() > bvh.refit_base_sah_cost * rebuild_threshold) {
+            buildMesh(mesh);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Builds the TLAS over the world-space bounds of the geometries. The TLAS's leaves are given the ids of their
+    // geometries. Fails (leaving the TLAS empty) when the geometries outnumber the leaf nodes the builder was made for,
+    // or the TLAS's capacity.
+    bool buildTLAS(TLAS &tlas, const Geometry *geometries, u32 geometry_count, const Mesh *meshes) {
+        tlas.bvh.refit_base_sah_cost = 0;
+        if (geometry_count > tlas.capacity || geometry_count > max_leaf_node_count) geometry_count = 0;
+        tlas.geometry_count = geometry_count;
+        if (!geometry_count) {
+            tlas.bvh.node_count = 0;
+            return false;
+        }
+
+        for (u32 i = 0; i < tlas.geometry_count; i++) {
             BVHNode &node = nodes[i];
-            vec3 &min = node.aabb.min;
-            vec3 &max = node.aabb.max;
+            node.aabb = getGeometryBounds(geometries[i], meshes);
+            node.first_index = node_ids[i] = i;
+        }
+
+        build(tlas.bvh, tlas.geometry_count, MAX_GEOMETRIES_PER_TLAS_NODE);
+        for (u32 i = 0; i < tlas.geometry_count; i++) tlas.geometry_ids[i] = leaf_ids[i];
+        return true;
+    }
+
+    // Refits the TLAS to the current transforms of its geometries (i.e: after some of them moved), keeping its
+    // topology as is. Children are always allocated after their parent, so a single pass over the nodes in
+    // reverse order refits them bottom-up. As with refitMesh, given a rebuild threshold the TLAS is rebuilt
+    // instead once refitting had degraded its SAH cost by more than that factor. Returns whether it got rebuilt.
+    bool refitTLAS(TLAS &tlas, const Geometry *geometries, const Mesh *meshes, f32 rebuild_threshold = 0) {
+        BVH &bvh = tlas.bvh;
+        if (!bvh.node_count) return false;
+        if (rebuild_threshold > 0 && bvh.refit_base_sah_cost == 0)
+            bvh.refit_base_sah_cost = bvh.getSAHCost();
+
+        for (u32 i = bvh.node_count; i-- > 0;) {
+            BVHNode &node = bvh.nodes[i];
+            if (node.isLeaf()) {
+                node.aabb = {INFINITY, -INFINITY};
+                for (u32 g = node.first_index; g < node.first_index + node.leaf_count; g++)
+                    node.aabb += getGeometryBounds(geometries[tlas.geometry_ids[g]], meshes);
+            } else
+                node.aabb = bvh.nodes[node.first_index].aabb + bvh.nodes[node.first_index + 1].aabb;
+        }
+
+        if (rebuild_threshold > 0 && bvh.getSAHCost() > bvh.refit_base_sah_cost * rebuild_threshold) {
+            buildTLAS(tlas, geometries, tlas.geometry_count, meshes);
+            return true;
+        }
+
+        return false;
+    }
+};
+
+#define RAY_PACKET_WIDTH SIMD_WIDTH
+
+// Once a subtree is entered by this few of a packet's rays (or fewer), they continue through it one at a time:
+#define RAY_PACKET_MIN_ACTIVE_RAYS (RAY_PACKET_WIDTH / 4)
+
+// A packet of 4 or 8 rays (matching the SIMD width) as SoA lanes, that traverse a mesh's BVH together:
+// Each node is slab-tested against all the rays at once, and is only descended into if any of them enters it
+// before its closest hit so far. Coherent rays (i.e: primary rays of neighbouring pixels) mostly visit the same
+// nodes, so the traversal is shared among them and the triangles of a leaf are tested against all of them at once.
+// Rays are given in the mesh's space, and unused lanes are disabled by giving them a negative distance.
+struct RayPacket {
+    f32 origin_x[RAY_PACKET_WIDTH], origin_y[RAY_PACKET_WIDTH], origin_z[RAY_PACKET_WIDTH];
+    f32 direction_x[RAY_PACKET_WIDTH], direction_y[RAY_PACKET_WIDTH], direction_z[RAY_PACKET_WIDTH];
+    f32 distance[RAY_PACKET_WIDTH];       // The maximum distance beforehand, and the closest hit's distance after
+    u32 triangle_index[RAY_PACKET_WIDTH]; // Of the closest hit's triangle ((u32)-1 for rays that missed)
+
+    INLINE void setRay(u8 lane, const vec3 &origin, const vec3 &direction, f32 max_distance = INFINITY) {
+        origin_x[lane] = origin.x;
+        origin_y[lane] = origin.y;
+        origin_z[lane] = origin.z;
+        direction_x[lane] = direction.x;
+        direction_y[lane] = direction.y;
+        direction_z[lane] = direction.z;
+        distance[lane] = max_distance;
+        triangle_index[lane] = (u32)-1;
+    }
+
+    INLINE void disableRay(u8 lane) {
+        setRay(lane, vec3{0}, vec3{0, 0, 1}, -1);
+    }
+
+    INLINE void getRay(u8 lane, Ray &ray) const {
+        ray.origin = {origin_x[lane], origin_y[lane], origin_z[lane]};
+        ray.direction = {direction_x[lane], direction_y[lane], direction_z[lane]};
+    }
+
+    // Finds the closest hits of the rays, returning a bit-mask of the rays that hit anything:
+    u32 castOn(const Mesh &mesh) {
+        if (!mesh.bvh.node_count) return 0;
 
-            min = minimum(minimum(v1, v2), v3);
-            max = maximum(maximum(v1, v2), v3);
+        Lanes lanes;
+        lanes.load(*this);
 
-            f32 diff = max.x - min.x;
-            if (diff < 0) diff = -diff;
-            if (diff < EPS) {
-                min.x -= EPS;
-                max.x += EPS;
+        // Nearer children are visited first, as seen along the packet's overall direction:
+        f32 overall_direction[3] = {0, 0, 0};
+        for (u8 i = 0; i < RAY_PACKET_WIDTH; i++) {
+            overall_direction[0] += direction_x[i];
+            overall_direction[1] += direction_y[i];
+            overall_direction[2] += direction_z[i];
+        }
+
+        const BVHNode *nodes = mesh.bvh.nodes;
+        u32 stack[BVH_TRAVERSAL_STACK_SIZE];
+        u32 stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size) {
+            u32 node_id = stack[--stack_size];
+            const BVHNode &node = nodes[node_id];
+            u32 active_rays = lanes.hitAABB(node.aabb);
+            if (!active_rays) continue;
+
+            if (node.isLeaf()) {
+                for (u32 i = node.first_index; i < node.first_index + node.leaf_count; i++) {
+                    u32 hits = lanes.hitTriangle(mesh, i);
+                    for (u8 lane = 0; hits; lane++, hits >>= 1)
+                        if (hits & 1) triangle_index[lane] = i;
+                }
+                continue;
             }
 
-            diff = max.y - min.y;
-            if (diff < 0) diff = -diff;
-            if (diff < EPS) {
-                min.y -= EPS;
-                max.y += EPS;
+            if (countBits(active_rays) <= RAY_PACKET_MIN_ACTIVE_RAYS) {
+                // The packet diverged: Continue through this subtree with each of the active rays on its own
+                simd::store(distance, lanes.distance);
+                castRaysOn(mesh, node_id, active_rays);
+                lanes.distance = simd::load(distance);
+                continue;
             }
 
-            diff = max.z - min.z;
-            if (diff < 0) diff = -diff;
-            if (diff < EPS) {
-                min.z -= EPS;
-                max.z += EPS;
+            const AABB &left  = nodes[node.first_index].aabb;
+            const AABB &right = nodes[node.first_index + 1].aabb;
+            vec3 centers_offset = (right.min + right.max) - (left.min + left.max);
+            u8 axis = 0;
+            for (u8 i = 1; i < 3; i++)
+                if (fabsf(centers_offset.components[i]) > fabsf(centers_offset.components[axis]))
+                    axis = i;
+            bool left_is_nearer = (centers_offset.components[axis] > 0) == (overall_direction[axis] > 0);
+            stack[stack_size++] = node.first_index + (left_is_nearer ? 1 : 0);
+            stack[stack_size++] = node.first_index + (left_is_nearer ? 0 : 1);
+        }
+
+        simd::store(distance, lanes.distance);
+        u32 hits = 0;
+        for (u8 i = 0; i < RAY_PACKET_WIDTH; i++)
+            if (triangle_index[i] != (u32)-1)
+                hits |= 1u << i;
+
+        return hits;
+    }
+
+private:
+    // The packet's rays loaded into SIMD registers for the duration of a traversal:
+    struct Lanes {
+        simd_f32 origin_x, origin_y, origin_z;
+        simd_f32 direction_x, direction_y, direction_z;
+        simd_f32 direction_rcp_x, direction_rcp_y, direction_rcp_z;
+        simd_f32 distance;
+
+        INLINE void load(const RayPacket &packet) {
+            simd_f32 one = simd::set1(1.0f);
+            origin_x = simd::load(packet.origin_x);
+            origin_y = simd::load(packet.origin_y);
+            origin_z = simd::load(packet.origin_z);
+            direction_x = simd::load(packet.direction_x);
+            direction_y = simd::load(packet.direction_y);
+            direction_z = simd::load(packet.direction_z);
+            direction_rcp_x = simd::div(one, direction_x);
+            direction_rcp_y = simd::div(one, direction_y);
+            direction_rcp_z = simd::div(one, direction_z);
+            distance = simd::load(packet.distance);
+        }
+
+        // Slab test of all the rays against a box, returning a bit-mask of the rays entering it before their hits:
+        INLINE u32 hitAABB(const AABB &aabb) const {
+            simd_f32 min_x = simd::mul(simd::sub(simd::set1(aabb.min.x), origin_x), direction_rcp_x);
+            simd_f32 min_y = simd::mul(simd::sub(simd::set1(aabb.min.y), origin_y), direction_rcp_y);
+            simd_f32 min_z = simd::mul(simd::sub(simd::set1(aabb.min.z), origin_z), direction_rcp_z);
+            simd_f32 max_x = simd::mul(simd::sub(simd::set1(aabb.max.x), origin_x), direction_rcp_x);
+            simd_f32 max_y = simd::mul(simd::sub(simd::set1(aabb.max.y), origin_y), direction_rcp_y);
+            simd_f32 max_z = simd::mul(simd::sub(simd::set1(aabb.max.z), origin_z), direction_rcp_z);
+            simd_f32 near_t = simd::max(simd::max(simd::min(min_x, max_x), simd::min(min_y, max_y)),
+                                        simd::max(simd::min(min_z, max_z), simd::set1(0.0f)));
+            simd_f32 far_t = simd::min(simd::min(simd::max(min_x, max_x), simd::max(min_y, max_y)),
+                                       simd::min(simd::max(min_z, max_z), distance));
+            return simd::maskBits(simd::lessOrEqual(near_t, far_t));
+        }
+
+        // Branchless test of all the rays against a triangle (as in Ray::hitsTriangle for either triangle layout).
+        // Rays that hit it before their current hit have their distance updated, and are returned as a bit-mask:
+        INLINE u32 hitTriangle(const Mesh &mesh, u32 index) {
+            simd_f32 zero = simd::set1(0.0f);
+            simd_f32 t, u, v;
+            if (mesh.triangle_layout == TriangleLayout_Compact) {
+                vec3 position, U, V;
+                mesh.getTriangle(index, position, U, V);
+                vec3 N = U.cross(V);
+                const CompactTriangle &triangle = mesh.compact_triangles[index];
+
+                simd_f32 NdotRd = simd::fmadd(simd::set1(N.x), direction_x, simd::fmadd(simd::set1(N.y), direction_y, simd::mul(simd::set1(N.z), direction_z)));
+                simd_f32 NdotRo = simd::fmadd(simd::set1(N.x), origin_x, simd::fmadd(simd::set1(N.y), origin_y, simd::mul(simd::set1(N.z), origin_z)));
+                t = simd::div(simd::sub(simd::set1(N.dot(position)), NdotRo), NdotRd);
+
+                simd_f32 P_x = simd::sub(simd::fmadd(t, direction_x, origin_x), simd::set1(position.x));
+                simd_f32 P_y = simd::sub(simd::fmadd(t, direction_y, origin_y), simd::set1(position.y));
+                simd_f32 P_z = simd::sub(simd::fmadd(t, direction_z, origin_z), simd::set1(position.z));
+                u = simd::fmadd(simd::set1(triangle.tangent_u.x), P_x, simd::fmadd(simd::set1(triangle.tangent_u.y), P_y, simd::mul(simd::set1(triangle.tangent_u.z), P_z)));
+                v = simd::fmadd(simd::set1(triangle.tangent_v.x), P_x, simd::fmadd(simd::set1(triangle.tangent_v.y), P_y, simd::mul(simd::set1(triangle.tangent_v.z), P_z)));
+            } else {
+                const Triangle &triangle = mesh.triangles[index];
+                const mat3 &M = triangle.local_to_tangent;
+                simd_f32 Ro_x = simd::sub(origin_x, simd::set1(triangle.position.x));
+                simd_f32 Ro_y = simd::sub(origin_y, simd::set1(triangle.position.y));
+                simd_f32 Ro_z = simd::sub(origin_z, simd::set1(triangle.position.z));
+
+                // The ray's origin and direction in tangent space (u, v, height above the triangle's plane):
+                simd_f32 X_x = simd::set1(M.X.x), Y_x = simd::set1(M.Y.x), Z_x = simd::set1(M.Z.x);
+                simd_f32 X_y = simd::set1(M.X.y), Y_y = simd::set1(M.Y.y), Z_y = simd::set1(M.Z.y);
+                simd_f32 X_z = simd::set1(M.X.z), Y_z = simd::set1(M.Y.z), Z_z = simd::set1(M.Z.z);
+                simd_f32 tangent_origin_x = simd::fmadd(X_x, Ro_x, simd::fmadd(Y_x, Ro_y, simd::mul(Z_x, Ro_z)));
+                simd_f32 tangent_origin_y = simd::fmadd(X_y, Ro_x, simd::fmadd(Y_y, Ro_y, simd::mul(Z_y, Ro_z)));
+                simd_f32 tangent_origin_z = simd::fmadd(X_z, Ro_x, simd::fmadd(Y_z, Ro_y, simd::mul(Z_z, Ro_z)));
+                simd_f32 tangent_direction_x = simd::fmadd(X_x, direction_x, simd::fmadd(Y_x, direction_y, simd::mul(Z_x, direction_z)));
+                simd_f32 tangent_direction_y = simd::fmadd(X_y, direction_x, simd::fmadd(Y_y, direction_y, simd::mul(Z_y, direction_z)));
+                simd_f32 tangent_direction_z = simd::fmadd(X_z, direction_x, simd::fmadd(Y_z, direction_y, simd::mul(Z_z, direction_z)));
+
+                t = simd::div(simd::sub(zero, tangent_origin_z), tangent_direction_z);
+                u = simd::fmadd(t, tangent_direction_x, tangent_origin_x);
+                v = simd::fmadd(t, tangent_direction_y, tangent_origin_y);
             }
 
-            node.first_index = node_ids[i] = i;
+            // Parallel rays get an infinite (or NaN) t, which fails these comparisons:
+            simd_f32 hit = simd::maskAnd(simd::lessThan(zero, t), simd::lessThan(t, distance));
+            hit = simd::maskAnd(hit, simd::maskAnd(simd::lessOrEqual(zero, u), simd::lessOrEqual(zero, v)));
+            hit = simd::maskAnd(hit, simd::lessOrEqual(simd::add(u, v), simd::set1(1.0f)));
+            distance = simd::select(hit, t, distance);
+            return simd::maskBits(hit);
         }
+    };
 
-        build(mesh.bvh, mesh.triangle_count, MAX_TRIANGLES_PER_MESH_RTREE_NODE);
+    void castRaysOn(const Mesh &mesh, u32 node_id, u32 rays) {
+        Ray ray;
+        for (u8 lane = 0; rays; lane++, rays >>= 1) {
+            if (!(rays & 1)) continue;
+
+            getRay(lane, ray);
+            if (mesh.castRay(ray, RayHitMode_Nearest, distance[lane], node_id)) {
+                distance[lane] = ray.hit.distance;
+                triangle_index[lane] = ray.hit.triangle_index;
+            }
+        }
+    }
 
-        for (u32 i = 0; i < mesh.triangle_count; i++) {
-            Triangle &triangle = mesh.triangles[i];
-            TriangleVertexIndices &indices = mesh.vertex_position_indices[leaf_ids[i]];
-            const vec3 &v1 = mesh.vertex_positions[indices.ids[0]];
-            const vec3 &v2 = mesh.vertex_positions[indices.ids[1]];
-            const vec3 &v3 = mesh.vertex_positions[indices.ids[2]];
+    INLINE static u32 countBits(u32 bits) {
+        u32 count = 0;
+        for (; bits; bits &= bits - 1) count++;
+        return count;
+    }
+};
 
-            triangle.U = v3 - v1;
-            triangle.V = v2 - v1;
-            triangle.normal = triangle.U.cross(triangle.V).normalized();
-            triangle.position = v1;
-            triangle.local_to_tangent.X = triangle.U;
-            triangle.local_to_tangent.Y = triangle.V;
-            triangle.local_to_tangent.Z = triangle.normal;
-            triangle.local_to_tangent = triangle.local_to_tangent.inverted();
+#define WIDE_BVH_WIDTH SIMD_WIDTH
+#define TRIANGLE_PACKET_WIDTH 4 // Matching the maximum triangle count of the BVH builder's leaves
+
+// The triangles of a leaf, packed as SoA lanes so that they can all be tested at once (see ClosestPointOnTriangle).
+// Only what a closest-point query reads is kept: The 2 rows of the tangent-space matrix that give u and v,
+// the position and the U and V edges. Unused lanes repeat the last triangle, so they never win a strict comparison.
+// Leaves with more triangles than a packet can hold span several consecutive packets.
+struct TrianglePacket {
+    f32 tangent_x_x[TRIANGLE_PACKET_WIDTH], tangent_x_y[TRIANGLE_PACKET_WIDTH], tangent_x_z[TRIANGLE_PACKET_WIDTH];
+    f32 tangent_y_x[TRIANGLE_PACKET_WIDTH], tangent_y_y[TRIANGLE_PACKET_WIDTH], tangent_y_z[TRIANGLE_PACKET_WIDTH];
+    f32 position_x[TRIANGLE_PACKET_WIDTH], position_y[TRIANGLE_PACKET_WIDTH], position_z[TRIANGLE_PACKET_WIDTH];
+    f32 U_x[TRIANGLE_PACKET_WIDTH], U_y[TRIANGLE_PACKET_WIDTH], U_z[TRIANGLE_PACKET_WIDTH];
+    f32 V_x[TRIANGLE_PACKET_WIDTH], V_y[TRIANGLE_PACKET_WIDTH], V_z[TRIANGLE_PACKET_WIDTH];
+    u32 first_index; // Of the first triangle in the mesh
+    u32 node_id;     // Of the leaf node in the binary BVH
+    u16 count;
+    u16 has_next;    // Whether the next packet continues the same leaf
+
+    void set(const Mesh &mesh, u32 first, u16 triangle_count, u32 leaf_node_id, bool is_continued) {
+        first_index = first;
+        node_id = leaf_node_id;
+        count = triangle_count;
+        has_next = is_continued;
+        vec3 position, U, V;
+        for (u8 i = 0; i < TRIANGLE_PACKET_WIDTH; i++) {
+            u32 triangle_index = first + (i < triangle_count ? i : triangle_count - 1);
+            CompactTriangle t = mesh.getCompactTriangle(triangle_index);
+            mesh.getTriangle(triangle_index, position, U, V);
+            tangent_x_x[i] = t.tangent_u.x;
+            tangent_x_y[i] = t.tangent_u.y;
+            tangent_x_z[i] = t.tangent_u.z;
+            tangent_y_x[i] = t.tangent_v.x;
+            tangent_y_y[i] = t.tangent_v.y;
+            tangent_y_z[i] = t.tangent_v.z;
+            position_x[i] = position.x;
+            position_y[i] = position.y;
+            position_z[i] = position.z;
+            U_x[i] = U.x;
+            U_y[i] = U.y;
+            U_z[i] = U.z;
+            V_x[i] = V.x;
+            V_y[i] = V.y;
+            V_z[i] = V.z;
         }
     }
 };
 
+// A collapsed (4 or 8 wide, matching the SIMD width) view of a binary BVH, for CPU queries.
+// Each node keeps the bounds of all its children as SoA lanes, so they can all be tested at once.
+// Internal children index other wide nodes, while leaf children index the first triangle packet of their leaf
+// (packets keep the id of their binary leaf node, which holds the flags that queries mark for debug drawing).
+// Unused child slots have inverted (empty) bounds, which are infinitely far from everything.
+struct WideBVHNode {
+    f32 min_x[WIDE_BVH_WIDTH], min_y[WIDE_BVH_WIDTH], min_z[WIDE_BVH_WIDTH];
+    f32 max_x[WIDE_BVH_WIDTH], max_y[WIDE_BVH_WIDTH], max_z[WIDE_BVH_WIDTH];
+    u32 children[WIDE_BVH_WIDTH];
+    u8 leaf_mask;
+    u8 child_count;
+
+    INLINE bool isLeaf(u8 child) const { return leaf_mask & (1u << child); }
+
+    // The squared distances from a point to each child's bounds (0 for children containing the point):
+    INLINE simd_f32 squaredDistances(simd_f32 x, simd_f32 y, simd_f32 z) const {
+        simd_f32 zero = simd::set1(0);
+        simd_f32 dx = simd::max(simd::max(simd::sub(simd::load(min_x), x), simd::sub(x, simd::load(max_x))), zero);
+        simd_f32 dy = simd::max(simd::max(simd::sub(simd::load(min_y), y), simd::sub(y, simd::load(max_y))), zero);
+        simd_f32 dz = simd::max(simd::max(simd::sub(simd::load(min_z), z), simd::sub(z, simd::load(max_z))), zero);
+        return simd::fmadd(dx, dx, simd::fmadd(dy, dy, simd::mul(dz, dz)));
+    }
+};
+
+struct WideBVHStackEntry {
+    u32 node_id;
+    f32 squared_distance;
+};
+
+struct WideBVH {
+    WideBVHNode *nodes = nullptr;
+    TrianglePacket *packets = nullptr;
+    u32 node_count = 0;
+    u32 packet_count = 0;
+    u32 capacity = 0;
+    u32 packet_capacity = 0;
+
+    // Every wide node stems from a distinct internal node of the binary BVH, and there is a packet per leaf
+    // (for leaves of up to TRIANGLE_PACKET_WIDTH triangles, as the builder makes them):
+    static u32 getCapacity(const BVH &bvh) { return (bvh.node_count + 1) / 2; }
+    static u32 getPacketCapacity(const Mesh &mesh) {
+        u32 packet_capacity = 0;
+        for (u32 i = 0; i < mesh.bvh.node_count; i++)
+            if (mesh.bvh.nodes[i].isLeaf())
+                packet_capacity += (mesh.bvh.nodes[i].leaf_count + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH;
+        return packet_capacity;
+    }
+    static u64 getSizeInBytes(const Mesh &mesh) {
+        return sizeof(WideBVHNode) * getCapacity(mesh.bvh) + sizeof(TrianglePacket) * getPacketCapacity(mesh);
+    }
+
+    // Each visited node leaves at most all-but-one of its children on the stack, per level of the binary BVH:
+    static u32 getMaxStackSize(const BVH &bvh) { return (WIDE_BVH_WIDTH - 1) * bvh.height + 1; }
+
+    bool allocate(const Mesh &mesh, memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = getSizeInBytes(mesh);
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            nodes = (WideBVHNode*)memory_allocator->allocate(size);
+        } else
+            nodes = (WideBVHNode*)os::getMemory(size);
+
+        capacity = nodes ? getCapacity(mesh.bvh) : 0;
+        packet_capacity = nodes ? getPacketCapacity(mesh) : 0;
+        packets = nodes ? (TrianglePacket*)(nodes + capacity) : nullptr;
+        return nodes != nullptr;
+    }
+
+    // Collapses the binary BVH top-down (breadth first): Each wide node starts with the 2 children of its
+    // binary node, then keeps opening up its largest internal child until it has a full set of children.
+    void build(const Mesh &mesh) {
+        const BVH &bvh = mesh.bvh;
+        node_count = 0;
+        packet_count = 0;
+        if (!bvh.node_count || bvh.nodes[0].isLeaf() || !capacity) return;
+
+        // Pending wide nodes temporarily hold the id of their binary node in their first child slot:
+        nodes[node_count++].children[0] = 0;
+        for (u32 wide_node_id = 0; wide_node_id < node_count; wide_node_id++) {
+            WideBVHNode &node = nodes[wide_node_id];
+            const BVHNode &binary_node = bvh.nodes[node.children[0]];
+
+            u32 candidates[WIDE_BVH_WIDTH];
+            u8 candidate_count = 2;
+            candidates[0] = binary_node.first_index;
+            candidates[1] = binary_node.first_index + 1;
+            while (candidate_count < WIDE_BVH_WIDTH) {
+                i32 largest = -1;
+                f32 largest_area = -1;
+                for (u8 i = 0; i < candidate_count; i++) {
+                    const BVHNode &candidate = bvh.nodes[candidates[i]];
+                    if (!candidate.isLeaf() && candidate.aabb.area() > largest_area) {
+                        largest_area = candidate.aabb.area();
+                        largest = i;
+                    }
+                }
+                if (largest == -1) break;
+
+                u32 first_child = bvh.nodes[candidates[largest]].first_index;
+                candidates[largest] = first_child;
+                candidates[candidate_count++] = first_child + 1;
+            }
+
+            node.leaf_mask = 0;
+            node.child_count = candidate_count;
+            for (u8 i = 0; i < WIDE_BVH_WIDTH; i++) {
+                if (i < candidate_count) {
+                    const BVHNode &child = bvh.nodes[candidates[i]];
+                    node.min_x[i] = child.aabb.min.x;
+                    node.min_y[i] = child.aabb.min.y;
+                    node.min_z[i] = child.aabb.min.z;
+                    node.max_x[i] = child.aabb.max.x;
+                    node.max_y[i] = child.aabb.max.y;
+                    node.max_z[i] = child.aabb.max.z;
+                    if (child.isLeaf()) {
+                        node.leaf_mask |= (u8)(1u << i);
+                        node.children[i] = packet_count;
+                        addPackets(mesh, child, candidates[i]);
+                    } else {
+                        node.children[i] = node_count;
+                        nodes[node_count++].children[0] = candidates[i];
+                    }
+                } else {
+                    node.min_x[i] = node.min_y[i] = node.min_z[i] = INFINITY;
+                    node.max_x[i] = node.max_y[i] = node.max_z[i] = -INFINITY;
+                    node.children[i] = 0;
+                }
+            }
+        }
+    }
+    void addPackets(const Mesh &mesh, const BVHNode &leaf, u32 leaf_node_id) {
+        u32 end = leaf.first_index + leaf.leaf_count;
+        for (u32 start = leaf.first_index; start < end; start += TRIANGLE_PACKET_WIDTH) {
+            u32 triangle_count = end - start < TRIANGLE_PACKET_WIDTH ? end - start : TRIANGLE_PACKET_WIDTH;
+            packets[packet_count++].set(mesh, start, (u16)triangle_count, leaf_node_id,
+                                        start + TRIANGLE_PACKET_WIDTH < end);
+        }
+    }
+};
 
 struct SceneCounts {
     u32 cameras{1};
@@ -5770,6 +7407,9 @@ struct Scene {
     u32 *mesh_triangle_counts = nullptr;
     u32 *mesh_vertex_counts = nullptr;
 
+    // Optional: Once built (see BVHBuilder::buildTLAS) scene-wide queries go through it instead of all geometries:
+    TLAS tlas;
+
     Scene(SceneCounts counts,
           char *file_path = nullptr,
           Camera *cameras = nullptr,
@@ -5827,33 +7467,60 @@ struct Scene {
                 load(textures[i], texture_files[i].char_ptr, memory_allocator);
     }
 
-    INLINE bool castRay(Ray &ray) const {
-        static Ray local_ray;
-        static Transform xform;
-
+    // Finds the geometry that a ray hits closest to its origin, or in any-hit mode the first one found to be hit
+    // (either way, only hits closer than the ray's current hit distance count). Meshes are intersected exactly
+    // through their BVH, while other geometries are intersected through their bounding cube.
+    // With a TLAS, only the geometries whose world-space bounds the ray enters before the closest hit are tested.
+    INLINE bool castRay(Ray &ray, RayHitMode mode = RayHitMode_Nearest) const {
         bool found{false};
-        bool current_found{false};
-
-        Geometry *geo = geometries;
 
-        for (u32 i = 0; i < counts.geometries; i++, geo++) {
-            xform = geo->transform;
-            if (geo->type == GeometryType_Mesh)
-                xform.scale *= meshes[geo->id].aabb.max;
+        if (tlas.bvh.node_count) {
+            const BVH &bvh = tlas.bvh;
+            u32 stack[BVH_TRAVERSAL_STACK_SIZE];
+            u32 stack_size = 0;
+            vec3 RD_rcp = 1.0f / ray.direction;
+            f32 distance_scale = 1.0f / ray.direction.length(); // From distances to the ray's own t (for the bounds)
+            f32 max_t = ray.hit.distance_squared < INFINITY ? sqrtf(ray.hit.distance_squared) * distance_scale : INFINITY;
+            f32 left_t, right_t;
+
+            if (ray.hitsAABB(bvh.nodes[0].aabb, RD_rcp, max_t, left_t))
+                stack[stack_size++] = 0;
+
+            while (stack_size) {
+                const BVHNode &node = bvh.nodes[stack[--stack_size]];
+                if (node.isLeaf()) {
+                    for (u32 i = node.first_index; i < node.first_index + node.leaf_count; i++)
+                        if (castRayOnGeometry(ray, tlas.geometry_ids[i], mode)) {
+                            found = true;
+                            max_t = sqrtf(ray.hit.distance_squared) * distance_scale;
+                            if (mode == RayHitMode_Any) break;
+                        }
 
-            xform.internPosAndDir(ray.origin, ray.direction, local_ray.origin, local_ray.direction);
+                    if (found && mode == RayHitMode_Any) break;
+                    continue;
+                }
 
-            current_found = local_ray.hitsCube();
-            if (current_found) {
-                local_ray.hit.position         = xform.externPos(local_ray.hit.position);
-                local_ray.hit.distance_squared = (local_ray.hit.position - ray.origin).squaredLength();
-                if (local_ray.hit.distance_squared < ray.hit.distance_squared) {
-                    ray.hit = local_ray.hit;
-                    ray.hit.geo_type = geo->type;
-                    ray.hit.geo_id = i;
+                u32 left = node.first_index;
+                u32 right = left + 1;
+                bool hits_left  = ray.hitsAABB(bvh.nodes[left ].aabb, RD_rcp, max_t, left_t);
+                bool hits_right = ray.hitsAABB(bvh.nodes[right].aabb, RD_rcp, max_t, right_t);
+                if (hits_left && hits_right) {
+                    if (left_t < right_t) {
+                        stack[stack_size++] = right;
+                        stack[stack_size++] = left;
+                    } else {
+                        stack[stack_size++] = left;
+                        stack[stack_size++] = right;
+                    }
+                } else if (hits_left) stack[stack_size++] = left;
+                else if (hits_right) stack[stack_size++] = right;
+            }
+        } else {
+            for (u32 i = 0; i < counts.geometries; i++)
+                if (castRayOnGeometry(ray, i, mode)) {
                     found = true;
+                    if (mode == RayHitMode_Any) break;
                 }
-            }
         }
 
         if (found) {
@@ -5863,18 +7530,50 @@ struct Scene {
 
         return found;
     }
-};
 
+    // Intersects a ray with a single geometry, updating the ray's hit if it is hit closer than the current one:
+    INLINE bool castRayOnGeometry(Ray &ray, u32 geo_id, RayHitMode mode = RayHitMode_Nearest) const {
+        static Ray local_ray;
+        static Transform xform;
 
-void load(Scene &scene, char* scene_file_path = nullptr) {
-    if (scene_file_path)
-        scene.file_path = scene_file_path;
-    else
-        scene_file_path = scene.file_path.char_ptr;
-
-    void *file_handle = os::openFileForReading(scene_file_path);
+        Geometry *geo = geometries + geo_id;
+        xform = geo->transform;
+        xform.internPosAndDir(ray.origin, ray.direction, local_ray.origin, local_ray.direction);
 
-    os::readFromFile(&scene.counts, sizeof(SceneCounts), file_handle);
+        bool found;
+        if (geo->type == GeometryType_Mesh) {
+            // Bound the mesh's traversal by the closest hit so far (its distance being in the mesh's space):
+            f32 max_distance = INFINITY;
+            if (ray.hit.distance_squared < INFINITY)
+                max_distance = (xform.internPos(ray.at(sqrtf(ray.hit.distance_squared) / ray.direction.length())) - local_ray.origin).length();
+
+            found = meshes[geo->id].castRay(local_ray, mode, max_distance);
+        } else
+            found = local_ray.hitsCube();
+        if (!found)
+            return false;
+
+        local_ray.hit.position         = xform.externPos(local_ray.hit.position);
+        local_ray.hit.distance_squared = (local_ray.hit.position - ray.origin).squaredLength();
+        if (local_ray.hit.distance_squared >= ray.hit.distance_squared)
+            return false;
+
+        ray.hit = local_ray.hit;
+        ray.hit.geo_type = geo->type;
+        ray.hit.geo_id = geo_id;
+        return true;
+    }
+};
+
+void load(Scene &scene, char* scene_file_path = nullptr) {
+    if (scene_file_path)
+        scene.file_path = scene_file_path;
+    else
+        scene_file_path = scene.file_path.char_ptr;
+
+    void *file_handle = os::openFileForReading(scene_file_path);
+
+    os::readFromFile(&scene.counts, sizeof(SceneCounts), file_handle);
 
     if (scene.counts.meshes)
         for (u32 i = 0; i < scene.counts.meshes; i++)
@@ -5982,7 +7681,6 @@ void save(Scene &scene, char* scene_file_path = nullptr) {
     os::closeFile(file_handle);
 }
 
-
 struct Frustum {
     enum class ProjectionType {
         Orthographic = 0,
@@ -6002,7 +7700,6 @@ struct Frustum {
         }
         Projection(const Projection &other) : scale{other.scale}, shear{other.shear} {}
 
-
         void update(f32 focal_length, f32 height_over_width, f32 n, f32 f) {
             scale.x = focal_length * height_over_width;
             scale.y = focal_length;
@@ -6034,6 +7731,13 @@ struct Frustum {
             VIEWPORT_DEFAULT__FAR_CLIPPING_PLANE_DISTANCE
     };
 
+    // How the convex hull of some view-space points (i.e: the corners of an object's bounds) relates to the frustum:
+    enum class Containment {
+        Outside = 0,
+        Intersecting,
+        Inside
+    };
+
     f32 near_clipping_plane_distance{VIEWPORT_DEFAULT__NEAR_CLIPPING_PLANE_DISTANCE};
     f32 far_clipping_plane_distance{ VIEWPORT_DEFAULT__FAR_CLIPPING_PLANE_DISTANCE};
     bool flip_z{false}, cull_back_faces{true};
@@ -6120,6 +7824,45 @@ struct Frustum {
         return true;
     }
 
+    // A bit for each of the planes that a view-space point is outside of (near, far, left, right, bottom, top):
+    INLINE u8 getOutsidePlanes(const vec3 &point, f32 focal_length, f32 aspect_ratio) const {
+        f32 x = focal_length * point.x;
+        f32 y = focal_length * point.y;
+        f32 z = aspect_ratio * point.z;
+        return (point.z < near_clipping_plane_distance) |
+               ((point.z > far_clipping_plane_distance) << 1) |
+               ((x + z < 0) << 2) |
+               ((z - x < 0) << 3) |
+               ((y + point.z < 0) << 4) |
+               ((point.z - y < 0) << 5);
+    }
+
+    // The hull is found to be outside only when all of its points are outside of the same plane, so a hull that is
+    // outside of the frustum but across a few of its planes (i.e: near its edges) is conservatively intersecting it.
+    // A hull that is inside has nothing to be clipped, and one that is outside has nothing to be drawn.
+    Containment getContainment(const vec3 *points, u32 point_count, f32 focal_length, f32 aspect_ratio) const {
+        u8 outside_of_all = 0x3F, outside_of_any = 0;
+        for (u32 i = 0; i < point_count; i++) {
+            u8 outside = getOutsidePlanes(points[i], focal_length, aspect_ratio);
+            outside_of_all &= outside;
+            outside_of_any |= outside;
+        }
+
+        if (outside_of_all) return Containment::Outside;
+        return outside_of_any ? Containment::Intersecting : Containment::Inside;
+    }
+
+    // Whether a view-space triangle is entirely outside of one of the planes, or (when culling back faces) is facing
+    // away from the camera. Its front face is the one its vertices wind counter-clockwise around, seen from the camera:
+    bool cullTriangle(const vec3 &A, const vec3 &B, const vec3 &C, f32 focal_length, f32 aspect_ratio) const {
+        if (cull_back_faces && (C - A).cross(B - A).dot(A) >= 0)
+            return true;
+
+        return getOutsidePlanes(A, focal_length, aspect_ratio) &
+               getOutsidePlanes(B, focal_length, aspect_ratio) &
+               getOutsidePlanes(C, focal_length, aspect_ratio);
+    }
+
     INLINE void projectPoint(vec3 &point, const Dimensions &dimensions) const {
         point.x = ((projection.scale.x * point.x / point.z) + 1) * dimensions.h_width;
         point.y = ((projection.scale.y * point.y / point.z) + 1) * dimensions.h_height;
@@ -6132,8 +7875,6 @@ struct Frustum {
     }
 };
 
-
-
 struct Navigation {
     struct {
         struct {
@@ -6222,22 +7963,70 @@ struct Navigation {
     }
 };
 
+// Clearing a canvas whose pixels and depths are at least this large is done with streaming stores (bypassing the
+// caches, which such a canvas would not fit in anyway). Smaller canvases are cleared into the caches instead,
+// where the drawing that follows will find them:
+#ifndef CANVAS_STREAMING_CLEAR_MIN_SIZE
+#define CANVAS_STREAMING_CLEAR_MIN_SIZE Megabytes(4)
+#endif
+
+#define CANVAS_RESOLVE_ROWS_PER_JOB 16
+
 enum AntiAliasing {
     NoAA,
     MSAA,
     SSAA
 };
 
+// Full precision pixels are 4 floats (16 bytes), half precision ones are 4 half floats (8 bytes).
+// Half precision halves the memory traffic of clearing, drawing and resolving, at the cost of some precision
+// (which colors stored in linear space can afford, unlike 8-bit ones that would band in the darks):
+enum PixelPrecision {
+    FullPrecision,
+    HalfPrecision
+};
+
+// Fills a canvas's pixels or depths with a value, 16 bytes at a time (using streaming stores when asked to):
+template <typename T>
+void _fillCanvasMemory(T *values, u32 count, const T &value, bool streaming) {
+    static_assert(16 % sizeof(T) == 0, "Canvas memory is filled 16 bytes at a time");
+    constexpr u32 values_per_store = 16 / sizeof(T);
+
+    while (count && ((size_t)values & 15)) {
+        *values++ = value;
+        count--;
+    }
+
+    T pattern[values_per_store];
+    for (u32 i = 0; i < values_per_store; i++) pattern[i] = value;
+    simd4_f32 pattern_vector = simd::load4((f32*)pattern);
+
+    u32 store_count = count / values_per_store;
+    f32 *out = (f32*)values;
+    if (streaming) {
+        for (u32 i = 0; i < store_count; i++, out += 4) simd::stream4(out, pattern_vector);
+        simd::streamFence();
+    } else
+        for (u32 i = 0; i < store_count; i++, out += 4) simd::store4(out, pattern_vector);
+
+    values += store_count * values_per_store;
+    for (u32 i = store_count * values_per_store; i < count; i++) *values++ = value;
+}
+
 struct Canvas {
     Dimensions dimensions;
     Pixel *pixels{nullptr};
+    HalfPixel *half_pixels{nullptr}; // Instead of pixels, for canvases of half precision
     f32 *depths{nullptr};
 
     AntiAliasing antialias;
 
-    Canvas(u16 width = MAX_WIDTH, u16 height = MAX_HEIGHT, AntiAliasing antialiasing = NoAA) : antialias{antialiasing} {
+    Canvas(u16 width = MAX_WIDTH, u16 height = MAX_HEIGHT, AntiAliasing antialiasing = NoAA, PixelPrecision precision = FullPrecision) : antialias{antialiasing} {
         if (memory::canvas_memory_capacity) {
-            pixels = (Pixel*)memory::canvas_memory;
+            if (precision == HalfPrecision)
+                half_pixels = (HalfPixel*)memory::canvas_memory;
+            else
+                pixels = (Pixel*)memory::canvas_memory;
             memory::canvas_memory += CANVAS_PIXELS_SIZE;
             memory::canvas_memory_capacity -= CANVAS_PIXELS_SIZE;
 
@@ -6250,11 +8039,22 @@ struct Canvas {
             dimensions.update(width, height);
         } else {
             pixels = nullptr;
+            half_pixels = nullptr;
             depths = nullptr;
         }
     }
 
     Canvas(Pixel *pixels, f32 *depths) noexcept : pixels{pixels}, depths{depths} {}
+    Canvas(HalfPixel *half_pixels, f32 *depths) noexcept : half_pixels{half_pixels}, depths{depths} {}
+
+    INLINE bool hasPixels() const { return pixels || half_pixels; }
+
+    // Pixels of either precision, by offset (in canvas samples):
+    INLINE Pixel loadPixel(u32 offset) const { return pixels ? pixels[offset] : half_pixels[offset].toPixel(); }
+    INLINE void storePixel(u32 offset, const Pixel &pixel) const {
+        if (pixels) pixels[offset] = pixel;
+        else half_pixels[offset] = HalfPixel{pixel};
+    }
 
     void clear(f32 red = 0, f32 green = 0, f32 blue = 0, f32 opacity = 1.0f, f32 depth = INFINITY) const {
         i32 pixels_width  = dimensions.width;
@@ -6271,13 +8071,36 @@ struct Canvas {
             }
         }
 
-        i32 pixels_count = pixels_width * pixels_height;
-        i32 depths_count = depths_width * depths_height;
+        u32 pixels_count = (u32)(pixels_width * pixels_height);
+        u32 depths_count = (u32)(depths_width * depths_height);
 
         Pixel pixel{red, green, blue, opacity};
 
-        if (pixels) for (i32 i = 0; i < pixels_count; i++) pixels[i] = pixel;
-        if (depths) for (i32 i = 0; i < depths_count; i++) depths[i] = depth;
+        u64 size = (u64)pixels_count * (half_pixels ? sizeof(HalfPixel) : sizeof(Pixel));
+        if (depths) size += (u64)depths_count * sizeof(f32);
+        bool streaming = size >= CANVAS_STREAMING_CLEAR_MIN_SIZE;
+
+        if (pixels) _fillCanvasMemory(pixels, pixels_count, pixel, streaming);
+        if (half_pixels) _fillCanvasMemory(half_pixels, pixels_count, HalfPixel{pixel}, streaming);
+        if (depths) _fillCanvasMemory(depths, depths_count, depth, streaming);
+    }
+
+    // Clears a rectangle of canvas pixels (inclusive bounds, with all sub-pixels of a pixel cleared with SSAA):
+    void clear(RectI bounds, f32 red = 0, f32 green = 0, f32 blue = 0, f32 opacity = 1.0f, f32 depth = INFINITY) const {
+        bounds -= RectI{0, dimensions.width - 1, 0, dimensions.height - 1};
+        if (!bounds) return;
+
+        Pixel pixel{red, green, blue, opacity};
+        HalfPixel half_pixel{pixel};
+        u32 pixels_per_pixel = antialias == SSAA ? 4 : 1;
+        u32 depths_per_pixel = antialias == NoAA ? 1 : 4;
+        u32 count = (u32)(bounds.right - bounds.left + 1);
+        for (i32 y = bounds.top; y <= bounds.bottom; y++) {
+            u32 offset = dimensions.stride * y + bounds.left;
+            if (pixels) _fillCanvasMemory(pixels + offset * pixels_per_pixel, count * pixels_per_pixel, pixel, false);
+            if (half_pixels) _fillCanvasMemory(half_pixels + offset * pixels_per_pixel, count * pixels_per_pixel, half_pixel, false);
+            if (depths) _fillCanvasMemory(depths + offset * depths_per_pixel, count * depths_per_pixel, depth, false);
+        }
     }
 
     void drawFrom(Canvas& source_canvas, const RectI* source_bounds = nullptr, const RectI* target_bounds = nullptr, f32 opacity = 1.0f, bool blend = true, bool include_depths = false) {
@@ -6319,7 +8142,7 @@ struct Canvas {
                                          source_canvas.dimensions.stride * src_y + src_x
                                  );
 
-                Pixel& pixel{ source_canvas.pixels[src_offset] };
+                Pixel pixel{source_canvas.loadPixel(src_offset)};
                 if ((pixel.opacity == 0.0f) || (
                         (pixel.color.r == 0.0f) &&
                         (pixel.color.g == 0.0f) &&
@@ -6338,7 +8161,7 @@ struct Canvas {
                     ) : (
                                              dimensions.stride * y + x
                                      );
-                    pixels[trg_offset] = source_canvas.pixels[src_offset];
+                    storePixel(trg_offset, pixel);
                     if (include_depths && depth < depths[trg_offset])
                         depths[trg_offset] = depth;
                 }
@@ -6346,19 +8169,12 @@ struct Canvas {
         }
     }
 
-    void drawToWindow() const {
-        u32 *content_value = window::content;
-        Pixel *pixel = pixels;
-        for (u16 y = 0; y < window::height; y++)
-            for (u16 x = 0; x < window::width; x++, content_value++) {
-                *content_value = getPixelContent(pixel);
+    // Resolves the canvas's pixels into the window's content (with the rows split across the pool's threads if given).
+    // Pixels are resolved 4 at a time: SSAA quads are averaged, and colors are converted from linear space and packed.
+    void drawToWindow(ThreadPool *thread_pool = nullptr) const;
 
-                if (antialias == SSAA)
-                    pixel += 4;
-                else
-                    pixel++;
-            }
-    }
+    // Resolves only a rectangle of the canvas's pixels (inclusive bounds) into the window's content:
+    void drawToWindow(RectI bounds) const;
 
     INLINE void setPixel(i32 x, i32 y, const Color &color, f32 opacity = 1.0f, f32 depth = 0, f32 z_top = 0, f32 z_bottom = 0, f32 z_right = 0) const {
         int w = dimensions.width;
@@ -6371,13 +8187,11 @@ struct Canvas {
             return;
 
         opacity = clampedValue(opacity);
-        Pixel pixel{color.clamped(), opacity};
-        pixel.color *= pixel.color;
-        if (opacity != 1.0f)
-            pixel.color *= pixel.opacity;
+        Pixel pixel{toCanvasPixel(color, opacity)};
 
         u32 offset = antialias == SSAA ? ((dimensions.stride * (y >> 1) + (x >> 1)) * 4 + (2 * (y & 1)) + (x & 1)) : (dimensions.stride * y + x);
-        Pixel *out_pixel = pixels + offset;
+        Pixel loaded_pixel{loadPixel(offset)};
+        Pixel *out_pixel = &loaded_pixel;
         f32 *out_depth = depths ? (depths + (antialias == MSAA ? offset * 4 : offset)) : nullptr;
         if (
                 (
@@ -6395,7 +8209,7 @@ struct Canvas {
                         (z_right == 0.0f)
                 )
                 ) {
-            *out_pixel = pixel;
+            storePixel(offset, pixel);
             if (depths) {
                 out_depth[0] = depth;
                 if (antialias == MSAA) out_depth[1] = out_depth[2] = out_depth[3] = 0;
@@ -6415,26 +8229,50 @@ struct Canvas {
                 }
                 accumulated_pixel += fg->opacity == 1 ? *fg : fg->alphaBlendOver(*bg);
             }
-            *out_pixel = accumulated_pixel * 0.25f;
+            storePixel(offset, accumulated_pixel * 0.25f);
         } else {
             if (depths)
                 _sortPixelsByDepth(depth, &pixel, out_depth, out_pixel, &bg, &fg);
-            *out_pixel = fg->opacity == 1 ? *fg : fg->alphaBlendOver(*bg);
+            storePixel(offset, fg->opacity == 1 ? *fg : fg->alphaBlendOver(*bg));
         }
     }
 
+    // Pixels are stored with their colors squared (as blending is done in linear space) and premultiplied by opacity:
+    static INLINE Pixel toCanvasPixel(const Color &color, f32 opacity) {
+        opacity = clampedValue(opacity);
+        Pixel pixel{color.clamped(), opacity};
+        pixel.color *= pixel.color;
+        if (opacity != 1.0f)
+            pixel.color *= pixel.opacity;
+
+        return pixel;
+    }
+
     INLINE u32 getPixelContent(Pixel *pixel) const {
         return antialias == SSAA ? _isTransparentPixelQuad(pixel) ? 0 : _blendPixelQuad(pixel).asContent() :
                pixel->opacity == 0.0f ? 0 : pixel->asContent();
     }
 
+    INLINE u32 getPixelContent(HalfPixel *half_pixel) const {
+        Pixel pixel_quad[4];
+        pixel_quad[0] = half_pixel[0].toPixel();
+        if (antialias == SSAA)
+            for (u8 i = 1; i < 4; i++) pixel_quad[i] = half_pixel[i].toPixel();
+
+        return getPixelContent(pixel_quad);
+    }
+
     INLINE void drawText(char *str, i32 x, i32 y, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
+#ifdef SLIM_VEC2
     INLINE void drawText(char *str, vec2i position, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawText(char *str, vec2 position, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
+#endif
 
     INLINE void drawNumber(i32 number, i32 x, i32 y, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
+#ifdef SLIM_VEC2
     INLINE void drawNumber(i32 number, vec2i position, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawNumber(i32 number, vec2 position, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
+#endif
 
     INLINE void drawHLine(RangeI x_range, i32 y, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawHLine(i32 x_start, i32 x_end, i32 y, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
@@ -6443,9 +8281,13 @@ struct Canvas {
     INLINE void drawLine(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawLine(f32 x1, f32 y1, f32 x2, f32 y2, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) const;
 
+#ifdef SLIM_VEC2
     INLINE void drawLine(vec2 from, vec2 to, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawLine(vec2i from, vec2i to, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) const;
+#endif
+#ifdef SLIM_VEC3
     INLINE void drawLine(vec3 from, vec3 to, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) const;
+#endif
 
     INLINE void drawRect(RectI rect, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawRect(Rect rect, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
@@ -6460,20 +8302,26 @@ struct Canvas {
     INLINE void drawTriangle(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, f32 x3, f32 y3, f32 z3, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) const;
     INLINE void fillTriangle(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, f32 x3, f32 y3, f32 z3, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
 
+#ifdef SLIM_VEC2
     INLINE void drawTriangle(vec2 p1, vec2 p2, vec2 p3, const Color &color = White, f32 opacity = 0.5f, u8 line_width = 0, const RectI *viewport_bounds = nullptr) const;
     INLINE void fillTriangle(vec2 p1, vec2 p2, vec2 p3, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawTriangle(vec2i p1, vec2i p2, vec2i p3, const Color &color = White, f32 opacity = 0.5f, u8 line_width = 0, const RectI *viewport_bounds = nullptr) const;
     INLINE void fillTriangle(vec2i p1, vec2i p2, vec2i p3, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
+#endif
 
+#ifdef SLIM_VEC3
     INLINE void drawTriangle(vec3 p1, vec3 p2, vec3 p3, const Color &color = White, f32 opacity = 0.5f, u8 line_width = 0, const RectI *viewport_bounds = nullptr) const;
     INLINE void fillTriangle(vec3 p1, vec3 p2, vec3 p3, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
+#endif
 
     INLINE void fillCircle(i32 center_x, i32 center_y, i32 radius, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawCircle(i32 center_x, i32 center_y, i32 radius, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
+#ifdef SLIM_VEC2
     INLINE void drawCircle(vec2i center, i32 radius, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void fillCircle(vec2i center, i32 radius, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void drawCircle(vec2 center, i32 radius, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
     INLINE void fillCircle(vec2 center, i32 radius, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
+#endif
 
 private:
     static INLINE bool _isTransparentPixelQuad(Pixel *pixel_quad) {
@@ -6501,181 +8349,276 @@ private:
     }
 };
 
+// Writes pixels of flat (2D) drawing into a canvas the same way that setPixel does, but with the canvas's antialiasing,
+// whether it has depths and whether the pixels are opaque all resolved at compile time (so with no per-pixel checks).
+// Pixels are given as converted by Canvas::toCanvasPixel, at coordinates that are expected to be within the canvas.
+// As with setPixel, flat drawing leaves a depth of 0 behind it.
+template <AntiAliasing AA, bool HasDepths, bool Opaque, typename PixelStorage = Pixel>
+struct CanvasPixelWriter {
+    PixelStorage *pixels;
+    f32 *depths;
+    u32 stride;
+
+    // In canvas samples (sub-pixels with SSAA):
+    INLINE u32 offsetOf(i32 x, i32 y) const {
+        return AA == SSAA ? ((stride * (y >> 1) + (x >> 1)) * 4 + (2 * (y & 1)) + (x & 1)) : (stride * y + x);
+    }
+
+    INLINE void write(u32 offset, const Pixel &pixel) const {
+        PixelStorage *out_pixel = pixels + offset;
+        f32 *out_depth = HasDepths ? (depths + (AA == MSAA ? offset * 4 : offset)) : nullptr;
+
+        // Blend over what is there already, unless the pixel is opaque or there is nothing there yet:
+        if (!Opaque && pixel.opacity != 1.0f) {
+            Pixel background{toPixel(*out_pixel)};
+            if (!((!HasDepths || *out_depth == INFINITY) &&
+                  background.color.r == 0 &&
+                  background.color.g == 0 &&
+                  background.color.b == 0)) {
+                Pixel blended_pixel{pixel.alphaBlendOver(background)};
+                if (AA == MSAA) {
+                    Pixel accumulated_pixel{};
+                    for (u8 i = 0; i < 4; i++) accumulated_pixel += blended_pixel;
+                    *out_pixel = accumulated_pixel * 0.25f;
+                } else
+                    *out_pixel = blended_pixel;
+            } else
+                *out_pixel = pixel;
+        } else
+            *out_pixel = pixel;
 
-void drawImage(const PixelImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
-    if (bounds.right < 0 ||
-        bounds.bottom < 0 ||
-        bounds.left >= canvas.dimensions.width ||
-        bounds.top >= canvas.dimensions.height)
-        return;
+        if (HasDepths) {
+            out_depth[0] = 0;
+            if (AA == MSAA) out_depth[1] = out_depth[2] = out_depth[3] = 0;
+        }
+    }
 
-    i32 image_width = (i32)image.width;
-    i32 image_height = (i32)image.height;
-    i32 width = bounds.right - bounds.left;
-    i32 height = bounds.bottom - bounds.top;
-    if (width > image_width) {
-        width = image_width;
-        bounds.right = bounds.left + width;
+    INLINE void writeSample(i32 x, i32 y, const Pixel &pixel) const {
+        write(offsetOf(x, y), pixel);
     }
-    if (height > image_height) {
-        height = image_height;
-        bounds.bottom = bounds.top + height;
+
+    // In canvas pixels (with SSAA, all 4 sub-pixels of a pixel are written, which are next to each other):
+    INLINE void writeHSpan(i32 first_x, i32 last_x, i32 y, const Pixel &pixel) const {
+        u32 offset = stride * y + first_x;
+        u32 end = offset + (last_x - first_x + 1);
+        if (AA == SSAA) {
+            offset *= 4;
+            end *= 4;
+        }
+        for (; offset < end; offset++) write(offset, pixel);
     }
 
-    Pixel *pixel = image.content;
-    if (image.flags.tile) {
-        TiledGridInfo grid{image};
-        u32 X, Y = 0;
-        for (grid.row = 0; grid.row < grid.rows; grid.row++) {
-            X = 0;
-            u32 tile_height = grid.row == grid.bottom_row ? grid.bottom_row_tile_height : image.tile_height;
-            for (grid.column = 0; grid.column < grid.columns; grid.column++) {
-                u32 tile_width = grid.column == grid.right_column ? grid.right_column_tile_stride : image.tile_width;
+    INLINE void writeVSpan(i32 x, i32 first_y, i32 last_y, const Pixel &pixel) const {
+        u32 offset = stride * first_y + x;
+        for (i32 y = first_y; y <= last_y; y++, offset += stride)
+            if (AA == SSAA)
+                for (u8 i = 0; i < 4; i++) write(offset * 4 + i, pixel);
+            else
+                write(offset, pixel);
+    }
+};
 
-                for (u32 y = 0; y < tile_height; y++)
-                    for (u32 x = 0; x < tile_width; x++, pixel++)
-                        canvas.setPixel(X + x, Y + y, pixel->color, image.flags.alpha ? (pixel->opacity * opacity) : opacity);
+template <AntiAliasing AA, typename PixelStorage, typename Draw>
+INLINE void _drawWithPixelWriter(PixelStorage *pixels, const Canvas &canvas, bool opaque, Draw &draw) {
+    f32 *depths = canvas.depths;
+    u32 stride = canvas.dimensions.stride;
+    if (depths) {
+        if (opaque) draw(CanvasPixelWriter<AA, true, true, PixelStorage>{pixels, depths, stride});
+        else        draw(CanvasPixelWriter<AA, true, false, PixelStorage>{pixels, depths, stride});
+    } else {
+        if (opaque) draw(CanvasPixelWriter<AA, false, true, PixelStorage>{pixels, depths, stride});
+        else        draw(CanvasPixelWriter<AA, false, false, PixelStorage>{pixels, depths, stride});
+    }
+}
 
-                X += image.tile_width;
+template <AntiAliasing AA, typename Draw>
+INLINE void _drawWithPixelWriter(const Canvas &canvas, bool opaque, Draw &draw) {
+    if (canvas.half_pixels)
+        _drawWithPixelWriter<AA>(canvas.half_pixels, canvas, opaque, draw);
+    else
+        _drawWithPixelWriter<AA>(canvas.pixels, canvas, opaque, draw);
+}
+
+// Calls the given drawing function with the pixel writer that matches the canvas (and the opacity of what is drawn).
+// The writer is picked once per drawn primitive, as the drawing function is compiled for each kind of writer.
+template <typename Draw>
+INLINE void drawWithPixelWriter(const Canvas &canvas, bool opaque, Draw &&draw) {
+    switch (canvas.antialias) {
+        case NoAA: _drawWithPixelWriter<NoAA>(canvas, opaque, draw); break;
+        case MSAA: _drawWithPixelWriter<MSAA>(canvas, opaque, draw); break;
+        case SSAA: _drawWithPixelWriter<SSAA>(canvas, opaque, draw); break;
+    }
+}
+
+INLINE simd4_f32 _loadPixelVector(const Pixel *pixel) { return simd::load4(pixel->color.components); }
+INLINE simd4_f32 _loadPixelVector(const HalfPixel *half_pixel) {
+    Pixel pixel{half_pixel->toPixel()};
+    return simd::load4(pixel.color.components);
+}
+
+// Resolves rows of canvas pixels into rows of window content (rows of the window's width, as drawToWindow expects).
+// Each pixel (or SSAA quad) is loaded as a vector of its channels, and the vectors of 4 pixels are transposed into
+// vectors of their reds, greens, blues and opacities so that 4 pixels are converted and packed at once.
+// The last (up to 3) pixels of a row are padded into a batch of their own, so that every pixel is resolved alike.
+template <bool SSAA, typename PixelStorage>
+void _resolveCanvasRows(const PixelStorage *pixels, u32 *content, u32 width, u32 first_row, u32 end_row,
+                        u32 first_column, u32 end_column) {
+    const simd4_f32 zero = simd::set4(0.0f);
+    const simd4_f32 one = simd::set4(1.0f);
+    const simd4_f32 quarter = simd::set4(0.25f);
+    const simd4_f32 to_component = simd::set4(FLOAT_TO_COLOR_COMPONENT);
+    const f32 opacity_lane_mask[4] = {0, 0, 0, 1};
+    const simd4_f32 opacity_lane = simd::lessThan(zero, simd::load4(opacity_lane_mask));
+    const u32 samples_per_pixel = SSAA ? 4 : 1;
+
+    simd4_f32 vectors[4];
+    i32 R[4], G[4], B[4];
+    for (u32 y = first_row; y < end_row; y++) {
+        const PixelStorage *pixel = pixels + ((u64)y * width + first_column) * samples_per_pixel;
+        u32 *content_value = content + (u64)y * width + first_column;
+        for (u32 x = first_column; x < end_column; x += 4, content_value += 4) {
+            u32 batch_size = end_column - x < 4 ? end_column - x : 4;
+            for (u8 i = batch_size; i < 4; i++) vectors[i] = zero;
+            for (u8 i = 0; i < batch_size; i++, pixel += samples_per_pixel) {
+                vectors[i] = _loadPixelVector(pixel);
+                if (SSAA) {
+                    simd4_f32 sample1 = _loadPixelVector(pixel + 1);
+                    simd4_f32 sample2 = _loadPixelVector(pixel + 2);
+                    simd4_f32 sample3 = _loadPixelVector(pixel + 3);
+
+                    // A quad is only transparent when all of its samples are, so its maximal opacity is kept for that:
+                    simd4_f32 max_opacity = simd::max(simd::max(vectors[i], sample1), simd::max(sample2, sample3));
+                    simd4_f32 average = simd::mul(simd::add(simd::add(simd::add(vectors[i], sample1), sample2), sample3), quarter);
+                    vectors[i] = simd::select(opacity_lane, max_opacity, average);
+                }
             }
-            Y += image.tile_height;
+            simd4_f32 &reds = vectors[0], &greens = vectors[1], &blues = vectors[2], &opacities = vectors[3];
+            simd::transpose4(reds, greens, blues, opacities);
+
+            // Colors are stored squared (in linear space) so are square-rooted back, with over-saturated ones clamped:
+            simd::storeTruncated4(R, simd::mul(to_component, simd::sqrt(simd::min(simd::max(reds,   zero), one))));
+            simd::storeTruncated4(G, simd::mul(to_component, simd::sqrt(simd::min(simd::max(greens, zero), one))));
+            simd::storeTruncated4(B, simd::mul(to_component, simd::sqrt(simd::min(simd::max(blues,  zero), one))));
+            u32 transparent = simd::maskBits(simd::maskAnd(simd::lessOrEqual(opacities, zero), simd::lessOrEqual(zero, opacities)));
+            for (u8 i = 0; i < batch_size; i++)
+                content_value[i] = ((u32)R[i] << 16 | (u32)G[i] << 8 | (u32)B[i]) & (((transparent >> i) & 1) - 1);
         }
-    } else {
-        i32 remainder_x = image_width - width;
-        for (i32 y = bounds.top; y <= bounds.bottom; y++) {
-            for (i32 x = bounds.left; x <= bounds.right; x++, pixel++)
-                canvas.setPixel(x, y, pixel->color, image.flags.alpha ? (pixel->opacity * opacity) : opacity);
+    }
+}
 
-            pixel += remainder_x;
-        }
+void _resolveCanvas(const Canvas &canvas, u32 first_row, u32 end_row, u32 first_column, u32 end_column) {
+    u32 *content = window::content;
+    u32 width = window::width;
+    if (canvas.antialias == SSAA) {
+        if (canvas.half_pixels) _resolveCanvasRows<true>(canvas.half_pixels, content, width, first_row, end_row, first_column, end_column);
+        else                    _resolveCanvasRows<true>(canvas.pixels,      content, width, first_row, end_row, first_column, end_column);
+    } else {
+        if (canvas.half_pixels) _resolveCanvasRows<false>(canvas.half_pixels, content, width, first_row, end_row, first_column, end_column);
+        else                    _resolveCanvasRows<false>(canvas.pixels,      content, width, first_row, end_row, first_column, end_column);
     }
 }
 
-void drawImage(const FloatImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
-    if (bounds.right < 0 ||
-        bounds.bottom < 0 ||
-        bounds.left >= canvas.dimensions.width ||
-        bounds.top >= canvas.dimensions.height)
-        return;
+void resolveCanvasRowsJob(void *data, u32 first_row, u32 end_row, u32 thread_index) {
+    _resolveCanvas(*(Canvas*)data, first_row, end_row, 0, window::width);
+}
 
-    i32 image_width = (i32)image.width;
-    i32 image_height = (i32)image.height;
-    i32 width = bounds.right - bounds.left;
-    i32 height = bounds.bottom - bounds.top;
-    if (width > image_width) {
-        width = image_width;
-        bounds.right = bounds.left + width;
-    }
-    if (height > image_height) {
-        height = image_height;
-        bounds.bottom = bounds.top + height;
-    }
+void Canvas::drawToWindow(ThreadPool *thread_pool) const {
+    if (!hasPixels() || !window::content) return;
 
-    bool has_opacity = image.flags.alpha;
-    i32 channels_per_pixel = has_opacity ? 4 : 3;
-    Color color;
-    f32 pixel_opacity;
-    f32 *channel = image.content;
-    if (image.flags.tile) {
-        TiledGridInfo grid{image};
-        u32 X, Y = 0;
-        for (grid.row = 0; grid.row < grid.rows; grid.row++) {
-            X = 0;
-            u32 tile_height = grid.row == grid.bottom_row ? grid.bottom_row_tile_height : image.tile_height;
-            for (grid.column = 0; grid.column < grid.columns; grid.column++) {
-                u32 tile_width = grid.column == grid.right_column ? grid.right_column_tile_stride : image.tile_width;
+    if (thread_pool)
+        thread_pool->parallelFor(window::height, CANVAS_RESOLVE_ROWS_PER_JOB, resolveCanvasRowsJob, (void*)this, 0);
+    else
+        resolveCanvasRowsJob((void*)this, 0, window::height, 0);
+}
 
-                for (u32 y = 0; y < tile_height; y++) {
-                    for (u32 x = 0; x < tile_width; x++) {
-                        color.r = *(channel++);
-                        color.g = *(channel++);
-                        color.b = *(channel++);
-                        if (has_opacity)
-                            pixel_opacity = *(channel++);
-                        else
-                            pixel_opacity = 1.0f;
-
-                        canvas.setPixel(X + x, Y + y, color, pixel_opacity * opacity);
-                    }
-                }
+void Canvas::drawToWindow(RectI bounds) const {
+    if (!hasPixels() || !window::content) return;
 
-                X += image.tile_width;
-            }
-            Y += image.tile_height;
-        }
-    } else {
-        i32 remainder_x = ((i32)image.stride - width) * channels_per_pixel;
-        for (i32 y = bounds.top; y <= bounds.bottom; y++) {
-            for (i32 x = bounds.left; x <= bounds.right; x++) {
-                color.r = *(channel++);
-                color.g = *(channel++);
-                color.b = *(channel++);
-                if (has_opacity)
-                    pixel_opacity = *(channel++);
-                else
-                    pixel_opacity = 1.0f;
-
-                canvas.setPixel(x, y, color, pixel_opacity * opacity);
-            }
+    bounds -= RectI{0, window::width - 1, 0, window::height - 1};
+    if (!bounds) return;
 
-            channel += remainder_x;
-        }
-    }
+    _resolveCanvas(*this, bounds.top, bounds.bottom + 1, bounds.left, bounds.right + 1);
 }
 
-void drawImage(const ByteColorImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
+// Reads a pixel of image content, moving on to the next one (float content has 3 or 4 channels per pixel):
+INLINE Pixel _readImagePixel(const Pixel *&content, bool alpha) { return *(content++); }
+INLINE Pixel _readImagePixel(const ByteColor *&content, bool alpha) { return Pixel{*(content++)}; }
+INLINE Pixel _readImagePixel(const f32 *&content, bool alpha) {
+    Pixel pixel{content[0], content[1], content[2], alpha ? content[3] : 1.0f};
+    content += alpha ? 4 : 3;
+    return pixel;
+}
+
+// Draws the content of an image (of any pixel format) at canvas samples, through the pixel writer matching the canvas
+// and the image. Pixels that would fall outside of the canvas are skipped over rather than drawn.
+// The content of untiled images is read in rows of row_stride pixels, each of pixel_size elements.
+template <typename T>
+void _drawImage(const Image<T> &image, const Canvas &canvas, RectI bounds, f32 opacity, u32 row_stride, u32 pixel_size = 1) {
     if (bounds.right < 0 ||
         bounds.bottom < 0 ||
         bounds.left >= canvas.dimensions.width ||
         bounds.top >= canvas.dimensions.height)
         return;
 
-    i32 image_width = (i32)image.width;
-    i32 image_height = (i32)image.height;
-    i32 width = bounds.right - bounds.left;
-    i32 height = bounds.bottom - bounds.top;
-    if (width > image_width) {
-        width = image_width;
-        bounds.right = bounds.left + width;
-    }
-    if (height > image_height) {
-        height = image_height;
-        bounds.bottom = bounds.top + height;
-    }
-
-    Pixel pixel;;
-    ByteColor *byte_color = image.content;
-    if (image.flags.tile) {
-        TiledGridInfo grid{image};
-        u32 X, Y = 0;
-        for (grid.row = 0; grid.row < grid.rows; grid.row++) {
-            X = 0;
-            u32 tile_height = grid.row == grid.bottom_row ? grid.bottom_row_tile_height : image.tile_height;
-            for (grid.column = 0; grid.column < grid.columns; grid.column++) {
-                u32 tile_width = grid.column == grid.right_column ? grid.right_column_tile_stride : image.tile_width;
-
-                for (u32 y = 0; y < tile_height; y++) {
-                    for (u32 x = 0; x < tile_width; x++, byte_color++) {
-                        pixel = *byte_color;
-                        canvas.setPixel(X + x, Y + y, pixel.color, image.flags.alpha ? (pixel.opacity * opacity) : opacity);
+    // Bounds are inclusive, and are cropped to the size of the image:
+    if (bounds.right - bounds.left >= (i32)image.width) bounds.right = bounds.left + (i32)image.width - 1;
+    if (bounds.bottom - bounds.top >= (i32)image.height) bounds.bottom = bounds.top + (i32)image.height - 1;
+
+    const bool alpha = image.flags.alpha;
+    const i32 canvas_width  = canvas.antialias == SSAA ? canvas.dimensions.width  * 2 : canvas.dimensions.width;
+    const i32 canvas_height = canvas.antialias == SSAA ? canvas.dimensions.height * 2 : canvas.dimensions.height;
+    drawWithPixelWriter(canvas, !alpha && clampedValue(opacity) == 1.0f, [&](const auto &writer) {
+        Pixel pixel;
+        const T *content = image.content;
+        if (image.flags.tile) {
+            TiledGridInfo grid{image};
+            i32 X, Y = 0;
+            for (grid.row = 0; grid.row < grid.rows; grid.row++) {
+                X = 0;
+                i32 tile_height = (i32)(grid.row == grid.bottom_row ? grid.bottom_row_tile_height : image.tile_height);
+                for (grid.column = 0; grid.column < grid.columns; grid.column++) {
+                    i32 tile_width = (i32)(grid.column == grid.right_column ? grid.right_column_tile_stride : image.tile_width);
+                    i32 last_x = X + tile_width  > canvas_width  ? canvas_width  - 1 - X : tile_width  - 1;
+                    i32 last_y = Y + tile_height > canvas_height ? canvas_height - 1 - Y : tile_height - 1;
+                    for (i32 y = 0; y <= last_y; y++) {
+                        const T *row = content + y * tile_width * pixel_size;
+                        for (i32 x = 0; x <= last_x; x++) {
+                            pixel = _readImagePixel(row, alpha);
+                            writer.writeSample(X + x, Y + y, Canvas::toCanvasPixel(pixel.color, alpha ? (pixel.opacity * opacity) : opacity));
+                        }
                     }
-                }
 
-                X += image.tile_width;
+                    content += tile_width * tile_height * pixel_size;
+                    X += (i32)image.tile_width;
+                }
+                Y += (i32)image.tile_height;
             }
-            Y += image.tile_height;
-        }
-    } else {
-        i32 remainder_x = (i32)image.stride - width;
-        for (i32 y = bounds.top; y <= bounds.bottom; y++) {
-            for (i32 x = bounds.left; x <= bounds.right; x++, byte_color++) {
-                pixel = *byte_color;
-                canvas.setPixel(x, y, pixel.color, image.flags.alpha ? (pixel.opacity * opacity) : opacity);
+        } else {
+            i32 first_x = bounds.left < 0 ? 0 : bounds.left;
+            i32 first_y = bounds.top  < 0 ? 0 : bounds.top;
+            i32 last_x = bounds.right  < canvas_width  ? bounds.right  : canvas_width  - 1;
+            i32 last_y = bounds.bottom < canvas_height ? bounds.bottom : canvas_height - 1;
+            for (i32 y = first_y; y <= last_y; y++) {
+                const T *row = content + ((y - bounds.top) * (i32)row_stride + (first_x - bounds.left)) * (i32)pixel_size;
+                for (i32 x = first_x; x <= last_x; x++) {
+                    pixel = _readImagePixel(row, alpha);
+                    writer.writeSample(x, y, Canvas::toCanvasPixel(pixel.color, alpha ? (pixel.opacity * opacity) : opacity));
+                }
             }
-
-            byte_color += remainder_x;
         }
-    }
+    });
+}
+
+void drawImage(const PixelImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
+    _drawImage(image, canvas, bounds, opacity, image.width);
+}
+
+void drawImage(const FloatImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
+    _drawImage(image, canvas, bounds, opacity, image.stride, image.flags.alpha ? 4 : 3);
+}
+
+void drawImage(const ByteColorImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
+    _drawImage(image, canvas, bounds, opacity, image.stride);
 }
 
 void drawImageToWindow(const ByteColorImage &image, RectI bounds, f32 opacity = 1.0f) {
@@ -6794,18 +8737,10 @@ void _drawHLine(RangeI x_range, i32 y, const Canvas &canvas, const Color &color,
     if (!x_range || !y_range[y])
         return;
 
-    if (canvas.antialias == SSAA) {
-        y *= 2;
-        x_range *= 2;
-        for (i32 x = x_range.first; x <= x_range.last; x += 2) {
-            canvas.setPixel(x, y, color, opacity);
-            canvas.setPixel(x+1, y, color, opacity);
-            canvas.setPixel(x, y+1, color, opacity);
-            canvas.setPixel(x+1, y+1, color, opacity);
-        }
-    } else
-        for (i32 x = x_range.first; x <= x_range.last; x += 1)
-            canvas.setPixel(x, y, color, opacity);
+    Pixel pixel{Canvas::toCanvasPixel(color, opacity)};
+    drawWithPixelWriter(canvas, pixel.opacity == 1.0f, [&](const auto &writer) {
+        writer.writeHSpan(x_range.first, x_range.last, y, pixel);
+    });
 }
 
 void _drawVLine(RangeI y_range, i32 x, const Canvas &canvas, const Color &color, f32 opacity, const RectI *viewport_bounds) {
@@ -6822,22 +8757,16 @@ void _drawVLine(RangeI y_range, i32 x, const Canvas &canvas, const Color &color,
     if (!y_range || !x_range[x])
         return;
 
-    if (canvas.antialias == SSAA) {
-        x *= 2;
-        y_range *= 2;
-        for (i32 y = y_range.first; y <= y_range.last; y += 2) {
-            canvas.setPixel(x, y, color, opacity);
-            canvas.setPixel(x+1, y, color, opacity);
-            canvas.setPixel(x, y+1, color, opacity);
-            canvas.setPixel(x+1, y+1, color, opacity);
-        }
-    } else
-        for (i32 y = y_range.first; y <= y_range.last; y += 1)
-            canvas.setPixel(x, y, color, opacity);
+    Pixel pixel{Canvas::toCanvasPixel(color, opacity)};
+    drawWithPixelWriter(canvas, pixel.opacity == 1.0f, [&](const auto &writer) {
+        writer.writeVSpan(x, y_range.first, y_range.last, pixel);
+    });
 }
 
+// Lines only ever cover pixels within the (rounded out) bounds of their end points, clipped to the viewport's bounds
+// and to the optional clip bounds (in canvas pixels, i.e: a tile of the canvas that is being drawn to on its own).
 void _drawLine(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, const Canvas &canvas,
-               const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) {
+               const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds, const RectI *clip_bounds = nullptr) {
     Range float_x_range{x1 <= x2 ? x1 : x2, x1 <= x2 ? x2 : x1};
     Range float_y_range{y1 <= y2 ? y1 : y2, y1 <= y2 ? y2 : y1};
     if (viewport_bounds) {
@@ -6863,6 +8792,12 @@ void _drawLine(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, const Canvas &can
     RangeI y_range{(i32)float_y_range.first, (i32)(ceilf(float_y_range.last))};
     if (x_range.last == (i32)canvas.dimensions.width) x_range.last--;
     if (y_range.last == (i32)canvas.dimensions.height) y_range.last--;
+    if (clip_bounds) { // Clipped once rounded out, so that clip bounds that tile the canvas cover every pixel once
+        x_range.sub(clip_bounds->left, clip_bounds->right);
+        y_range.sub(clip_bounds->top, clip_bounds->bottom);
+        if (!x_range || !y_range)
+            return;
+    }
 
     i32 x, y;
     if (canvas.antialias == SSAA) {
@@ -6872,8 +8807,8 @@ void _drawLine(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, const Canvas &can
         y2 += y2;
         x_range.first <<= 1;
         y_range.first <<= 1;
-        x_range.last <<= 1;
-        y_range.last <<= 1;
+        x_range.last = (x_range.last << 1) + 1; // The last pixel's second sub-pixel
+        y_range.last = (y_range.last << 1) + 1;
         line_width <<= 1;
         line_width++;
     }
@@ -7028,7 +8963,6 @@ void _drawLine(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, const Canvas &can
     }
 }
 
-
 INLINE void Canvas::drawHLine(RangeI x_range, i32 y, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _drawHLine(x_range, y, *this, color, opacity, viewport_bounds);
 }
@@ -7052,13 +8986,14 @@ INLINE void Canvas::drawLine(f32 x1, f32 y1, f32 x2, f32 y2, const Color &color,
     _drawLine(x1, y1, 0, x2, y2, 0, *this, color, opacity, line_width, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 INLINE void Canvas::drawLine(vec2 from, vec2 to, const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) const {
     _drawLine(from.x, from.y, 0, to.x, to.y, 0, *this, color, opacity, line_width, viewport_bounds);
 }
 INLINE void Canvas::drawLine(vec2i from, vec2i to, const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) const {
     _drawLine((f32)from.x, (f32)from.y, 0, (f32)to.x, (f32)to.y, 0, *this, color, opacity, line_width, viewport_bounds);
 }
-
+#endif
 
 INLINE void drawHLine(RangeI x_range, i32 y, const Canvas &canvas, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _drawHLine(x_range, y, canvas, color, opacity, viewport_bounds);
@@ -7083,13 +9018,17 @@ INLINE void drawLine(f32 x1, f32 y1, f32 x2, f32 y2, const Canvas &canvas, const
     _drawLine(x1, y1, 0, x2, y2, 0, canvas, color, opacity, line_width, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 void drawLine(vec2 from, vec2 to, const Canvas &canvas, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) {
     _drawLine(from.x, from.y, 0, to.x, to.y, 0, canvas, color, opacity, line_width, viewport_bounds);
 }
+#endif
+
+#ifdef SLIM_VEC3
 void drawLine(const vec3 &from, const vec3 &to, const Canvas &canvas, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) {
     _drawLine(from.x, from.y, from.z, to.x, to.y, to.z, canvas, color, opacity, line_width, viewport_bounds);
 }
-
+#endif
 
 void _drawRect(RectI rect, const Canvas &canvas, const Color &color, f32 opacity, const RectI *viewport_bounds) {
     RectI bounds{0, canvas.dimensions.width - 1, 0, canvas.dimensions.height - 1};
@@ -7115,57 +9054,13 @@ void _drawRect(RectI rect, const Canvas &canvas, const Color &color, f32 opacity
     if (!rect)
         return;
 
-    if (canvas.antialias == SSAA) {
-        rect *= 2;
-
-        if (draw_horizontal) {
-            for (i32 x = rect.left; x <= rect.right; x += 2) {
-                if (draw_bottom) {
-                    canvas.setPixel(x, rect.bottom, color, opacity);
-                    canvas.setPixel(x+1, rect.bottom, color, opacity);
-                    canvas.setPixel(x, rect.bottom+1, color, opacity);
-                    canvas.setPixel(x+1, rect.bottom+1, color, opacity);
-                }
-                if (draw_top) {
-                    canvas.setPixel(x, rect.top, color, opacity);
-                    canvas.setPixel(x+1, rect.top, color, opacity);
-                    canvas.setPixel(x, rect.top+1, color, opacity);
-                    canvas.setPixel(x+1, rect.top+1, color, opacity);
-                }
-            }
-        }
-
-        if (draw_vertical) {
-            for (i32 y = rect.top; y <= rect.bottom; y += 2) {
-                if (draw_left) {
-                    canvas.setPixel(rect.left, y, color, opacity);
-                    canvas.setPixel(rect.left+1, y, color, opacity);
-                    canvas.setPixel(rect.left, y+1, color, opacity);
-                    canvas.setPixel(rect.left+1, y+1, color, opacity);
-                }
-                if (draw_right) {
-                    canvas.setPixel(rect.right, y, color, opacity);
-                    canvas.setPixel(rect.right+1, y, color, opacity);
-                    canvas.setPixel(rect.right, y+1, color, opacity);
-                    canvas.setPixel(rect.right+1, y+1, color, opacity);
-                }
-            }
-        }
-    } else {
-        if (draw_horizontal) {
-            for (i32 x = rect.left; x <= rect.right; x++) {
-                if (draw_bottom) canvas.setPixel(x, rect.bottom, color, opacity);
-                if (draw_top) canvas.setPixel(x, rect.top, color, opacity);
-            }
-        }
-
-        if (draw_vertical) {
-            for (i32 y = rect.top; y <= rect.bottom; y++) {
-                if (draw_right) canvas.setPixel(rect.right, y, color, opacity);
-                if (draw_left) canvas.setPixel(rect.left, y, color, opacity);
-            }
-        }
-    }
+    Pixel pixel{Canvas::toCanvasPixel(color, opacity)};
+    drawWithPixelWriter(canvas, pixel.opacity == 1.0f, [&](const auto &writer) {
+        if (draw_bottom) writer.writeHSpan(rect.left, rect.right, rect.bottom, pixel);
+        if (draw_top) writer.writeHSpan(rect.left, rect.right, rect.top, pixel);
+        if (draw_right) writer.writeVSpan(rect.right, rect.top, rect.bottom, pixel);
+        if (draw_left) writer.writeVSpan(rect.left, rect.top, rect.bottom, pixel);
+    });
 }
 
 void _fillRect(RectI rect, const Canvas &canvas, const Color &color, f32 opacity, const RectI *viewport_bounds) {
@@ -7182,21 +9077,11 @@ void _fillRect(RectI rect, const Canvas &canvas, const Color &color, f32 opacity
     if (!rect)
         return;
 
-    if (canvas.antialias == SSAA) {
-        rect *= 2;
-
-        for (i32 y = rect.top; y <= rect.bottom; y += 2) {
-            for (i32 x = rect.left; x <= rect.right; x += 2) {
-                canvas.setPixel(x, y, color, opacity);
-                canvas.setPixel(x+1, y, color, opacity);
-                canvas.setPixel(x, y+1, color, opacity);
-                canvas.setPixel(x+1, y+1, color, opacity);
-            }
-        }
-    } else
+    Pixel pixel{Canvas::toCanvasPixel(color, opacity)};
+    drawWithPixelWriter(canvas, pixel.opacity == 1.0f, [&](const auto &writer) {
         for (i32 y = rect.top; y <= rect.bottom; y++)
-            for (i32 x = rect.left; x <= rect.right; x++)
-                canvas.setPixel(x, y, color, opacity);
+            writer.writeHSpan(rect.left, rect.right, y, pixel);
+    });
 }
 
 INLINE void Canvas::drawRect(RectI rect, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
@@ -7226,7 +9111,6 @@ INLINE void drawRect(Rect rect, const Canvas &canvas, Color color = White, f32 o
     _drawRect(rectI, canvas, color, opacity, viewport_bounds);
 }
 
-
 INLINE void fillRect(RectI rect, const Canvas &canvas, Color color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _fillRect(rect, canvas, color, opacity, viewport_bounds);
 }
@@ -7236,10 +9120,8 @@ INLINE void fillRect(Rect rect, const Canvas &canvas, Color color = White, f32 o
     _fillRect(rectI, canvas, color, opacity, viewport_bounds);
 }
 
-
-
 void _drawCircle(bool fill, i32 center_x, i32 center_y, i32 radius, const Canvas &canvas,
-                 const Color &color, f32 opacity, const RectI *viewport_bounds) {
+                  const Color &color, f32 opacity, const RectI *viewport_bounds) {
     RectI bounds{0, canvas.dimensions.width - 1, 0, canvas.dimensions.height - 1};
     RectI rect{center_x - radius,
                center_x + radius,
@@ -7345,6 +9227,7 @@ INLINE void Canvas::drawCircle(i32 center_x, i32 center_y, i32 radius, const Col
     _drawCircle(false, center_x, center_y, radius, *this, color, opacity, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 INLINE void Canvas::drawCircle(vec2i center, i32 radius, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _drawCircle(false, center.x, center.y, radius, *this, color, opacity, viewport_bounds);
 }
@@ -7358,8 +9241,7 @@ INLINE void Canvas::drawCircle(vec2 center, i32 radius, const Color &color, f32
 INLINE void Canvas::fillCircle(vec2 center, i32 radius, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _drawCircle(true, (i32)center.x, (i32)center.y, radius, *this, color, opacity, viewport_bounds);
 }
-
-
+#endif
 
 INLINE void fillCircle(i32 center_x, i32 center_y, i32 radius, const Canvas &canvas,
                        Color color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
@@ -7371,6 +9253,7 @@ INLINE void drawCircle(i32 center_x, i32 center_y, i32 radius, const Canvas &can
     _drawCircle(false, center_x, center_y, radius, canvas, color, opacity, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 INLINE void drawCircle(vec2i center, i32 radius, const Canvas &canvas,
                        Color color = White, f32 opacity = 1.0f,
                        const RectI *viewport_bounds = nullptr) {
@@ -7395,16 +9278,21 @@ INLINE void fillCircle(vec2 center, i32 radius,
                        const RectI *viewport_bounds = nullptr) {
     _drawCircle(true, (i32)center.x, (i32)center.y, radius, canvas, color, opacity, viewport_bounds);
 }
+#endif
 
 INLINE void _drawTriangle(f32 x1, f32 y1, f32 z1,
                           f32 x2, f32 y2, f32 z2,
                           f32 x3, f32 y3, f32 z3,
-                          const Canvas &canvas, const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) {
+                         const Canvas &canvas, const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) {
     drawLine(x1, y1, z1, x2, y2, z3, canvas, color, opacity, line_width, viewport_bounds);
     drawLine(x2, y2, z2, x3, y3, z3, canvas, color, opacity, line_width, viewport_bounds);
     drawLine(x3, y3, z3, x1, y1, z3, canvas, color, opacity, line_width, viewport_bounds);
 }
 
+// Triangles are filled in tiles of samples (pixels, or sub-pixels with SSAA), each scanned in blocks of SIMD lanes.
+// Without antialiasing a block is a span of SIMD_WIDTH pixels of a row, and with SSAA it is the 2x2 sub-pixels of
+// SIMD_WIDTH/4 neighbouring pixels, so that either way a block's samples are laid out contiguously in the canvas.
+#define TRIANGLE_FILL_TILE_SIZE 8
 
 void _fillTriangle(f32 x1, f32 y1, f32 z1,
                    f32 x2, f32 y2, f32 z2,
@@ -7413,10 +9301,10 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
     // Cull this triangle against the edges of the viewport:
     Rect bounds{0, canvas.dimensions.f_width - 1.0f, 0, canvas.dimensions.f_height - 1.0f};
     Rect rect{
-            x1 < x2 ? x1 : x2,
-            x1 > x2 ? x1 : x2,
-            y1 < y2 ? y1 : y2,
-            y1 > y2 ? y1 : y2,
+        x1 < x2 ? x1 : x2,
+        x1 > x2 ? x1 : x2,
+        y1 < y2 ? y1 : y2,
+        y1 > y2 ? y1 : y2,
     };
     if (x3 < rect.left) rect.left = x3;
     if (x3 > rect.right) rect.right = x3;
@@ -7424,10 +9312,10 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
     if (y3 > rect.bottom) rect.bottom = y3;
     if (viewport_bounds) {
         Rect float_bounds{
-                (f32)viewport_bounds->left,
-                (f32)viewport_bounds->right,
-                (f32)viewport_bounds->top,
-                (f32)viewport_bounds->bottom,
+            (f32)viewport_bounds->left,
+            (f32)viewport_bounds->right,
+            (f32)viewport_bounds->top,
+            (f32)viewport_bounds->bottom,
         };
         x1 += float_bounds.left;
         x2 += float_bounds.left;
@@ -7444,14 +9332,19 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
     if (!rect)
         return;
 
-    if (canvas.antialias == SSAA) {
+    bool ssaa = canvas.antialias == SSAA;
+    if (ssaa) {
         x1 *= 2.0f;
         x2 *= 2.0f;
         x3 *= 2.0f;
         y1 *= 2.0f;
         y2 *= 2.0f;
         y3 *= 2.0f;
-        rect *= 2.0f;;
+        rect *= 2.0f;
+
+        // Include the last pixels' second sub-pixels:
+        rect.right += 1.0f;
+        rect.bottom += 1.0f;
     }
 
     // Compute area components:
@@ -7473,6 +9366,10 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
         y3 = y2;
         y2 = tmp;
 
+        tmp = z3;
+        z3 = z2;
+        z2 = tmp;
+
         ABx = x2 - x1;
         ABy = y2 - y1;
 
@@ -7483,20 +9380,15 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
         return;
 
     // Floor bounds coordinates down to their integral component:
-    u32 first_x = (u32)rect.left;
-    u32 first_y = (u32)rect.top;
-    u32 last_x  = (u32)rect.right;
-    u32 last_y  = (u32)rect.bottom;
-
-    rect.left   = (f32)first_x;
-    rect.top    = (f32)first_y;
-    rect.right  = (f32)last_x;
-    rect.bottom = (f32)last_y;
+    i32 first_x = (i32)rect.left;
+    i32 first_y = (i32)rect.top;
+    i32 last_x  = (i32)rect.right;
+    i32 last_y  = (i32)rect.bottom;
 
     // Drawing: Top-down
     // Origin: Top-left
 
-    // Compute weight constants:
+    // Compute weight constants (the areal coordinates of a sample center at x, y are then B = Bdx*x + Bdy*y + B0):
     f32 one_over_ABC = 1.0f / ABC;
 
     f32 Cdx =  ABy * one_over_ABC;
@@ -7505,41 +9397,127 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
     f32 Cdy = -ABx * one_over_ABC;
     f32 Bdy =  ACx * one_over_ABC;
 
-    // Compute initial areal coordinates for the first pixel center:
-    rect.left += 0.5f;
-    rect.top += 0.5f;
-    f32 C_start = Cdx*rect.left + Cdy*rect.top + (y1*x2 - x1*y2) * one_over_ABC;
-    f32 B_start = Bdx*rect.left + Bdy*rect.top + (y3*x1 - x3*y1) * one_over_ABC;
-
-    f32 A, B, C;
+    f32 C0 = (y1*x2 - x1*y2) * one_over_ABC;
+    f32 B0 = (y3*x1 - x3*y1) * one_over_ABC;
 
-    // Scan the bounds:
     bool depth_provided = z1 != 0 || z2 != 0 || z3 != 0;
-    f32 depth = 0;
-    for (u32 y = first_y; y <= last_y; y++, C_start += Cdy, B_start += Bdy) {
-        B = B_start;
-        C = C_start;
-
-        for (u32 x = first_x; x <= last_x; x++, B += Bdx, C += Cdx) {
-            if (((Bdx < 0) && (B < 0)) ||
-                ((Cdx < 0) && (C < 0)))
-                break;
-
-            A = 1 - B - C;
 
-            // Skip the pixel if it's outside:
-            if (A < 0 || B < 0 || C < 0)
+    // Opaque samples can be written directly (as setPixel would), rather than going through setPixel one by one:
+    opacity = clampedValue(opacity);
+    bool direct_writes = opacity == 1.0f && canvas.antialias != MSAA;
+    Pixel pixel{color.clamped(), 1.0f};
+    pixel.color *= pixel.color;
+    HalfPixel half_pixel{pixel};
+
+    // The offsets of the samples of a block from its top-left sample (at even coordinates with SSAA):
+    const i32 block_width  = ssaa ? SIMD_WIDTH / 2 : SIMD_WIDTH;
+    const i32 block_height = ssaa ? 2 : 1;
+    f32 lane_x_offsets[SIMD_WIDTH], lane_y_offsets[SIMD_WIDTH];
+    for (u8 lane = 0; lane < SIMD_WIDTH; lane++) {
+        lane_x_offsets[lane] = (f32)(ssaa ? ((lane >> 1) & ~1) + (lane & 1) : lane);
+        lane_y_offsets[lane] = (f32)(ssaa ? (lane >> 1) & 1 : 0);
+    }
+    const simd_f32 lane_xs = simd::load(lane_x_offsets);
+    const simd_f32 lane_ys = simd::load(lane_y_offsets);
+    const simd_f32 zero = simd::set1(0.0f);
+    const simd_f32 one = simd::set1(1.0f);
+    const simd_f32 half = simd::set1(0.5f);
+    const simd_f32 first_xs = simd::set1((f32)first_x), last_xs = simd::set1((f32)last_x);
+    const simd_f32 first_ys = simd::set1((f32)first_y), last_ys = simd::set1((f32)last_y);
+    const simd_f32 Bdxs = simd::set1(Bdx), Bdys = simd::set1(Bdy), B0s = simd::set1(B0);
+    const simd_f32 Cdxs = simd::set1(Cdx), Cdys = simd::set1(Cdy), C0s = simd::set1(C0);
+    const simd_f32 z1s = simd::set1(z1), z2s = simd::set1(z2), z3s = simd::set1(z3);
+    f32 depths[SIMD_WIDTH];
+
+    const i32 sample_width  = ssaa ? canvas.dimensions.width  * 2 : canvas.dimensions.width;
+    const i32 sample_height = ssaa ? canvas.dimensions.height * 2 : canvas.dimensions.height;
+    const i32 tile_last = TRIANGLE_FILL_TILE_SIZE - 1;
+    for (i32 tile_y = first_y & ~tile_last; tile_y <= last_y; tile_y += TRIANGLE_FILL_TILE_SIZE) {
+        for (i32 tile_x = first_x & ~tile_last; tile_x <= last_x; tile_x += TRIANGLE_FILL_TILE_SIZE) {
+            // Reject the tile when all of its corner samples are outside of the same edge (as the areal coordinates
+            // vary linearly across it). The corners are evaluated exactly as the samples are, and tiles are never
+            // accepted whole, so that every drawn sample passes the same per-sample test (the fill rule):
+            f32 left = (f32)tile_x + 0.5f, right = left + (f32)tile_last;
+            f32 top  = (f32)tile_y + 0.5f, bottom = top + (f32)tile_last;
+            f32 corner_xs[4] = {left, right, left, right};
+            f32 corner_ys[4] = {top, top, bottom, bottom};
+            simd4_f32 corner_X = simd::load4(corner_xs);
+            simd4_f32 corner_Y = simd::load4(corner_ys);
+            simd4_f32 corner_B = simd::fmadd(simd::set4(Bdx), corner_X, simd::fmadd(simd::set4(Bdy), corner_Y, simd::set4(B0)));
+            simd4_f32 corner_C = simd::fmadd(simd::set4(Cdx), corner_X, simd::fmadd(simd::set4(Cdy), corner_Y, simd::set4(C0)));
+            simd4_f32 corner_A = simd::sub(simd::sub(simd::set4(1.0f), corner_B), corner_C);
+            simd4_f32 corners_zero = simd::set4(0.0f);
+            if (!simd::lessOrEqualMask(corners_zero, corner_A) ||
+                !simd::lessOrEqualMask(corners_zero, corner_B) ||
+                !simd::lessOrEqualMask(corners_zero, corner_C))
                 continue;
 
-            if (depth_provided)
-                depth = A*z1 + B*z2 + C*z3;
-
-            canvas.setPixel(x, y, color, opacity, depth);
+            for (i32 y = tile_y; y < tile_y + TRIANGLE_FILL_TILE_SIZE; y += block_height) {
+                if (y > last_y || y + block_height - 1 < first_y) continue;
+
+                for (i32 x = tile_x; x < tile_x + TRIANGLE_FILL_TILE_SIZE; x += block_width) {
+                    if (x > last_x || x + block_width - 1 < first_x) continue;
+
+                    simd_f32 X = simd::add(simd::set1((f32)x), lane_xs);
+                    simd_f32 Y = simd::add(simd::set1((f32)y), lane_ys);
+                    simd_f32 mask = simd::maskAnd(
+                        simd::maskAnd(simd::lessOrEqual(first_xs, X), simd::lessOrEqual(X, last_xs)),
+                        simd::maskAnd(simd::lessOrEqual(first_ys, Y), simd::lessOrEqual(Y, last_ys)));
+
+                    // Areal coordinates at the sample centers:
+                    X = simd::add(X, half);
+                    Y = simd::add(Y, half);
+                    simd_f32 B = simd::fmadd(Bdxs, X, simd::fmadd(Bdys, Y, B0s));
+                    simd_f32 C = simd::fmadd(Cdxs, X, simd::fmadd(Cdys, Y, C0s));
+                    simd_f32 A = simd::sub(simd::sub(one, B), C);
+                    mask = simd::maskAnd(mask, simd::maskAnd(simd::lessOrEqual(zero, A),
+                                               simd::maskAnd(simd::lessOrEqual(zero, B),
+                                                             simd::lessOrEqual(zero, C))));
+                    u32 covered = simd::maskBits(mask);
+                    if (!covered)
+                        continue;
+
+                    simd_f32 depth = zero;
+                    if (depth_provided)
+                        depth = simd::fmadd(A, z1s, simd::fmadd(B, z2s, simd::mul(C, z3s)));
+                    simd::store(depths, depth);
+
+                    if (direct_writes && x + block_width <= sample_width && y + block_height <= sample_height) {
+                        u32 offset = ssaa ? (canvas.dimensions.stride * (y >> 1) + (x >> 1)) * 4 : (canvas.dimensions.stride * y + x);
+                        u32 written = covered;
+                        if (canvas.depths) {
+                            f32 *out_depths = canvas.depths + offset;
+                            simd_f32 out_depth = simd::load(out_depths);
+
+                            // Samples that are not in front stay as they are when opaque (otherwise they get blended):
+                            if (depth_provided) {
+                                simd_f32 in_front = simd::maskAnd(mask, simd::lessThan(depth, out_depth));
+                                written = simd::maskBits(in_front);
+                                mask = in_front;
+                                for (u32 behind = covered & ~written, lane = 0; behind; behind >>= 1, lane++)
+                                    if ((behind & 1) && canvas.loadPixel(offset + lane).opacity != 1.0f)
+                                        canvas.setPixel(x + (i32)lane_x_offsets[lane], y + (i32)lane_y_offsets[lane], color, opacity, depths[lane]);
+                            }
+                            simd::store(out_depths, simd::select(mask, depth, out_depth));
+                        }
+                        if (canvas.half_pixels) {
+                            for (u32 lane = 0; written; written >>= 1, lane++)
+                                if (written & 1)
+                                    canvas.half_pixels[offset + lane] = half_pixel;
+                        } else
+                            for (u32 lane = 0; written; written >>= 1, lane++)
+                                if (written & 1)
+                                    canvas.pixels[offset + lane] = pixel;
+                    } else
+                        for (u32 lane = 0; covered; covered >>= 1, lane++)
+                            if (covered & 1)
+                                canvas.setPixel(x + (i32)lane_x_offsets[lane], y + (i32)lane_y_offsets[lane], color, opacity, depths[lane]);
+                }
+            }
         }
     }
 }
 
-
 INLINE void Canvas::drawTriangle(f32 x1, f32 y1, f32 x2, f32 y2, f32 x3, f32 y3, const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) const {
     _drawTriangle(x1, y1, 0, x2, y2, 0, x3, y3, 0, *this, color, opacity, line_width, viewport_bounds);
 }
@@ -7564,6 +9542,7 @@ INLINE void Canvas::fillTriangle(i32 x1, i32 y1, i32 x2, i32 y2, i32 x3, i32 y3,
     _fillTriangle((f32)x1, (f32)y1, 0, (f32)x2, (f32)y2, 0, (f32)x3, (f32)y3, 0, *this, color, opacity, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 INLINE void Canvas::drawTriangle(vec2 p1, vec2 p2, vec2 p3, const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) const {
     _drawTriangle(p1.x, p1.y,0,  p2.x, p2.y, 0, p3.x, p3.y, 0, *this, color, opacity, line_width, viewport_bounds);
 }
@@ -7579,7 +9558,9 @@ INLINE void Canvas::drawTriangle(vec2i p1, vec2i p2, vec2i p3, const Color &colo
 INLINE void Canvas::fillTriangle(vec2i p1, vec2i p2, vec2i p3, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _fillTriangle((f32)p1.x, (f32)p1.y, 0, (f32)p2.x, (f32)p2.y, 0, (f32)p3.x, (f32)p3.y, 0, *this, color, opacity, viewport_bounds);
 }
+#endif
 
+#ifdef SLIM_VEC3
 INLINE void Canvas::drawTriangle(vec3 p1, vec3 p2, vec3 p3, const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) const {
     _drawTriangle(p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z, *this, color, opacity, line_width, viewport_bounds);
 }
@@ -7587,6 +9568,7 @@ INLINE void Canvas::drawTriangle(vec3 p1, vec3 p2, vec3 p3, const Color &color,
 INLINE void Canvas::fillTriangle(vec3 p1, vec3 p2, vec3 p3, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _fillTriangle(p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z, *this, color, opacity, viewport_bounds);
 }
+#endif
 
 INLINE void drawTriangle(f32 x1, f32 y1, f32 x2, f32 y2, f32 x3, f32 y3, const Canvas &canvas,
                          Color color = White, f32 opacity = 1.0f, u8 line_width = 1, const RectI *viewport_bounds = nullptr) {
@@ -7602,7 +9584,6 @@ INLINE void drawTriangle(i32 x1, i32 y1,
     _drawTriangle((f32)x1, (f32)y1, 0, (f32)x2, (f32)y2, 0, (f32)x3, (f32)y3, 0, canvas, color, opacity, line_width, viewport_bounds);
 }
 
-
 INLINE void fillTriangle(f32 x1, f32 y1,
                          f32 x2, f32 y2,
                          f32 x3, f32 y3,
@@ -7619,6 +9600,7 @@ INLINE void fillTriangle(i32 x1, i32 y1,
     _fillTriangle((f32)x1, (f32)y1, 0, (f32)x2, (f32)y2, 0, (f32)x3, (f32)y3, 0, canvas, color, opacity, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 void drawTriangle(vec2 p1, vec2 p2, vec2 p3, const Canvas &canvas,
                   Color color = White, f32 opacity = 0.5f, u8 line_width = 0, const RectI *viewport_bounds = nullptr) {
     _drawTriangle(p1.x, p1.y, 0, p2.x, p2.y, 0, p3.x, p3.y, 0, canvas, color, opacity, line_width, viewport_bounds);
@@ -7641,7 +9623,9 @@ void fillTriangle(vec2i p1, vec2i p2, vec2i p3,
                   const RectI *viewport_bounds = nullptr) {
     _fillTriangle((f32)p1.x, (f32)p1.y, 0, (f32)p2.x, (f32)p2.y, 0, (f32)p3.x, (f32)p3.y, 0, canvas, color, opacity, viewport_bounds);
 }
+#endif
 
+#ifdef SLIM_VEC3
 void drawTriangle(vec3 p1, vec3 p2, vec3 p3, const Canvas &canvas,
                   Color color = White, f32 opacity = 0.5f, u8 line_width = 0, const RectI *viewport_bounds = nullptr) {
     _drawTriangle(p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z, canvas, color, opacity, line_width, viewport_bounds);
@@ -7651,8 +9635,7 @@ void fillTriangle(vec3 p1, vec3 p2, vec3 p3, const Canvas &canvas,
                   Color color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _fillTriangle(p1.x, p1.y, p1.z, p2.x, p2.y, p2.z, p3.x, p3.y, p3.z, canvas, color, opacity, viewport_bounds);
 }
-
-
+#endif
 
 #define LINE_HEIGHT 14
 #define FIRST_CHARACTER_CODE 32
@@ -7761,12 +9744,10 @@ u8 bitmap_125[] = {0,0,0,0,0,0,255,255,128,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,252,255
 u8 bitmap_126[] = {0,0,0,128,128,128,128,0,0,0,0,0,128,128,0,0,0,0,0,0,15,15,1,1,3,7,14,12,12,14,15,3,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0};
 u8 *char_addr[] = {bitmap_32,bitmap_33,bitmap_34,bitmap_35,bitmap_36,bitmap_37,bitmap_38,bitmap_39,bitmap_40,bitmap_41,bitmap_42,bitmap_43,bitmap_44,bitmap_45,bitmap_46,bitmap_47,bitmap_48,bitmap_49,bitmap_50,bitmap_51,bitmap_52,bitmap_53,bitmap_54,bitmap_55,bitmap_56,bitmap_57,bitmap_58,bitmap_59,bitmap_60,bitmap_61,bitmap_62,bitmap_63,bitmap_64,bitmap_65,bitmap_66,bitmap_67,bitmap_68,bitmap_69,bitmap_70,bitmap_71,bitmap_72,bitmap_73,bitmap_74,bitmap_75,bitmap_76,bitmap_77,bitmap_78,bitmap_79,bitmap_80,bitmap_81,bitmap_82,bitmap_83,bitmap_84,bitmap_85,bitmap_86,bitmap_87,bitmap_88,bitmap_89,bitmap_90,bitmap_91,bitmap_92,bitmap_93,bitmap_94,bitmap_95,bitmap_96,bitmap_97,bitmap_98,bitmap_99,bitmap_100,bitmap_101,bitmap_102,bitmap_103,bitmap_104,bitmap_105,bitmap_106,bitmap_107,bitmap_108,bitmap_109,bitmap_110,bitmap_111,bitmap_112,bitmap_113,bitmap_114,bitmap_115,bitmap_116,bitmap_117,bitmap_118,bitmap_119,bitmap_120,bitmap_121,bitmap_122,bitmap_123,bitmap_124,bitmap_125,bitmap_126};
 
-
-
 void _drawText(char *str, i32 x, i32 y, const Canvas &canvas, const Color &color, f32 opacity, const RectI *viewport_bounds) {
     RectI bounds{
-            0, canvas.dimensions.width - 1,
-            0, canvas.dimensions.height - 1
+        0, canvas.dimensions.width - 1,
+        0, canvas.dimensions.height - 1
     };
     if (viewport_bounds) {
         x += viewport_bounds->left;
@@ -7856,25 +9837,27 @@ void _drawText(char *str, i32 x, i32 y, const Canvas &canvas, const Color &color
 INLINE void Canvas::drawText(char *str, i32 x, i32 y, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _drawText(str, x, y, *this, color, opacity, viewport_bounds);
 }
-
+#ifdef SLIM_VEC2
 INLINE void Canvas::drawText(char *str, vec2i position, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _drawText(str, position.x, position.y, *this, color, opacity, viewport_bounds);
 }
 INLINE void Canvas::drawText(char *str, vec2 position, const Color &color, f32 opacity, const RectI *viewport_bounds) const  {
     _drawText(str, (i32)position.x, (i32)position.y, *this, color, opacity, viewport_bounds);
 }
+#endif
 
 INLINE void drawText(char *str, i32 x, i32 y, const Canvas &canvas, Color color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _drawText(str, x, y, canvas, color, opacity, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 INLINE void drawText(char *str, vec2i position, const Canvas &canvas, Color color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _drawText(str, position.x, position.y, canvas, color, opacity, viewport_bounds);
 }
 INLINE void drawText(char *str, vec2 position, const Canvas &canvas, Color color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _drawText(str, (i32)position.x, (i32)position.y, canvas, color, opacity, viewport_bounds);
 }
-
+#endif
 
 void _drawNumber(i32 number, i32 x, i32 y, const Canvas &canvas, const Color &color, f32 opacity, const RectI *viewport_bounds) {
     static NumberString number_string;
@@ -7886,23 +9869,27 @@ INLINE void Canvas::drawNumber(i32 number, i32 x, i32 y, const Color &color, f32
     _drawNumber(number, x, y, *this, color, opacity, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 INLINE void Canvas::drawNumber(i32 number, vec2i position, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _drawNumber(number, position.x, position.y, *this, color, opacity, viewport_bounds);
 }
 INLINE void Canvas::drawNumber(i32 number, vec2 position, const Color &color, f32 opacity, const RectI *viewport_bounds) const {
     _drawNumber(number, (i32)position.x, (i32)position.y, *this, color, opacity, viewport_bounds);
 }
+#endif
 
 INLINE void drawNumber(i32 number, i32 x, i32 y, const Canvas &canvas, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _drawNumber(number, x, y, canvas, color, opacity, viewport_bounds);
 }
 
+#ifdef SLIM_VEC2
 INLINE void drawNumber(i32 number, vec2i position, const Canvas &canvas, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _drawNumber(number, position.x, position.y, canvas, color, opacity, viewport_bounds);
 }
 INLINE void drawNumber(i32 number, vec2 position, const Canvas &canvas, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) {
     _drawNumber(number, (i32)position.x, (i32)position.y, canvas, color, opacity, viewport_bounds);
 }
+#endif
 
 void drawHUD(const HUD &hud, const Canvas &canvas, const RectI *viewport_bounds = nullptr) {
     i32 x = hud.left;
@@ -7926,6 +9913,27 @@ void drawHUD(const HUD &hud, const Canvas &canvas, const RectI *viewport_bounds
     }
 }
 
+// The canvas pixels that the HUD is drawn over (as drawHUD would draw it now):
+RectI getHUDBounds(const HUD &hud) {
+    u32 max_length = 0;
+    HUDLine *line = hud.lines;
+    for (u32 i = 0; i < hud.settings.line_count; i++, line++) {
+        u32 value_length = line->value.string.length > line->alternate_value.length ? line->value.string.length : line->alternate_value.length;
+        if (max_length < line->title.length + value_length)
+            max_length = line->title.length + value_length;
+    }
+
+    return {
+        hud.left,
+        hud.left + (i32)(max_length * FONT_WIDTH),
+        hud.top,
+        hud.top + (i32)((f32)hud.settings.line_count * hud.settings.line_height * (f32)FONT_HEIGHT)
+    };
+}
+
+struct TileRasterizer;
+struct DepthPyramid;
+
 struct Viewport {
     Canvas &canvas;
     Camera *camera{nullptr};
@@ -7933,6 +9941,8 @@ struct Viewport {
     Dimensions dimensions;
     Navigation navigation;
     RectI bounds{};
+    TileRasterizer *rasterizer{nullptr}; // When set, drawing into the viewport is recorded by it (see TileRasterizer)
+    DepthPyramid *depth_pyramid{nullptr}; // When set, meshes and BVHs drawn as lines skip what it hides (see DepthPyramid)
 
     Viewport(Canvas &canvas, Camera *camera) : canvas{canvas} {
         dimensions = canvas.dimensions;
@@ -7977,23 +9987,32 @@ struct Viewport {
     INLINE bool cullAndClipEdge(Edge &edge) const {
         return frustum.cullAndClipEdge(edge, camera->focal_length, dimensions.width_over_height);
     }
+
+    INLINE Frustum::Containment getContainment(const vec3 *view_space_points, u32 point_count) const {
+        return frustum.getContainment(view_space_points, point_count, camera->focal_length, dimensions.width_over_height);
+    }
+
+    INLINE bool cullTriangle(const vec3 &A, const vec3 &B, const vec3 &C) const {
+        return frustum.cullTriangle(A, B, C, camera->focal_length, dimensions.width_over_height);
+    }
 };
 
 struct Selection {
     Transform xform;
     quat object_rotation;
     vec3 transformation_plane_origin,
-            transformation_plane_normal,
-            transformation_plane_center,
-            object_scale,
-            world_offset,
-            *world_position{nullptr};
+         transformation_plane_normal,
+         transformation_plane_center,
+         object_scale,
+         world_offset,
+         *world_position{nullptr};
     Geometry *geometry{nullptr};
     f32 object_distance = 0;
     u32 geo_id = 0;
     GeometryType geo_type = GeometryType_None;
     BoxSide box_side = BoxSide_None;
     bool changed = false;
+    bool transformed = false; // Whether the selected geometry got moved, scaled or rotated by the last manipulation
     bool left_mouse_button_was_pressed = false;
 
     void manipulate(const Viewport &viewport, const Scene &scene) {
@@ -8007,6 +10026,7 @@ struct Selection {
         ray.origin = camera.position;
         ray.direction = camera.getRayDirectionAt(x, y, dimensions.f_width, dimensions.f_height);
         ray.hit.distance_squared = INFINITY;
+        transformed = false;
 
         if (mouse::left_button.is_pressed && !left_mouse_button_was_pressed) {
             // This is the first frame after the left mouse button went down:
@@ -8014,8 +10034,8 @@ struct Selection {
             if (scene.castRay(ray)) {
                 // Detect if object scene->selection has changed:
                 changed = (
-                        geo_type != ray.hit.geo_type ||
-                        geo_id != ray.hit.geo_id
+                    geo_type != ray.hit.geo_type ||
+                    geo_id != ray.hit.geo_id
                 );
 
                 // Track the object that is now selected:
@@ -8072,6 +10092,7 @@ struct Selection {
                                 if (geometry->type == GeometryType_Mesh)
                                     xform.scale *= scene.meshes[geometry->id].aabb.max;
 
+                                transformed = true;
                                 if (mouse::left_button.is_pressed) {
                                     *world_position = ray.hit.position - world_offset;
                                 } else if (mouse::middle_button.is_pressed) {
@@ -8103,16 +10124,601 @@ struct Selection {
 
                     // View -> World (BoxSide_Back-track by the world offset from the hit position back to the selected-object's center):
                     *world_position = camera.rotation * vec3{x, -y, object_distance} + camera.position - world_offset;
+                    transformed = true;
                 }
             }
         }
     }
 };
 
-void drawEdge(Edge edge, const Viewport &viewport, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
-    if (!viewport.cullAndClipEdge(edge)) return;
+#define TILE_RASTERIZER_TILE_SIZE 64 // In canvas pixels (of 4 sub-pixels each with SSAA)
+
+// Commands that overlap more tiles than this are not binned, and are gone through by every tile instead:
+#define TILE_RASTERIZER_MAX_TILES_PER_COMMAND 16
+
+#define TILE_RASTERIZER_MAX_TILES_PER_ROW ((MAX_WIDTH + TILE_RASTERIZER_TILE_SIZE - 1) / TILE_RASTERIZER_TILE_SIZE)
+#define TILE_RASTERIZER_MAX_TILES_PER_COLUMN ((MAX_HEIGHT + TILE_RASTERIZER_TILE_SIZE - 1) / TILE_RASTERIZER_TILE_SIZE)
+#define TILE_RASTERIZER_MAX_TILE_COUNT (TILE_RASTERIZER_MAX_TILES_PER_ROW * TILE_RASTERIZER_MAX_TILES_PER_COLUMN)
+
+// A vertex of a projected triangle: Its position is in viewport pixels (with its view-space depth), and its uv is
+// only used when the triangle is textured.
+struct RasterVertex {
+    vec3 position;
+    vec2 uv;
+};
+
+// Fills a projected triangle, interpolating one-over-depth (and texture coordinates over depth) so that both depth
+// and texturing are perspective-correct. The depth is the view-space one, as is the case for lines.
+// Both windings are filled. Like lines, the filled pixels can be clipped to clip bounds (in canvas pixels).
+void _fillPerspectiveTriangle(const RasterVertex &v1, const RasterVertex &v2, const RasterVertex &v3,
+                              const Canvas &canvas, const Color &color, f32 opacity, const Texture *texture,
+                              const RectI *viewport_bounds, const RectI *clip_bounds = nullptr) {
+    f32 x1 = v1.position.x, y1 = v1.position.y;
+    f32 x2 = v2.position.x, y2 = v2.position.y;
+    f32 x3 = v3.position.x, y3 = v3.position.y;
+
+    // Cull this triangle against the edges of the viewport:
+    Rect bounds{0, canvas.dimensions.f_width - 1.0f, 0, canvas.dimensions.f_height - 1.0f};
+    Rect rect{
+        x1 < x2 ? x1 : x2,
+        x1 > x2 ? x1 : x2,
+        y1 < y2 ? y1 : y2,
+        y1 > y2 ? y1 : y2,
+    };
+    if (x3 < rect.left) rect.left = x3;
+    if (x3 > rect.right) rect.right = x3;
+    if (y3 < rect.top) rect.top = y3;
+    if (y3 > rect.bottom) rect.bottom = y3;
+    if (viewport_bounds) {
+        Rect float_bounds{
+            (f32)viewport_bounds->left,
+            (f32)viewport_bounds->right,
+            (f32)viewport_bounds->top,
+            (f32)viewport_bounds->bottom,
+        };
+        x1 += float_bounds.left;
+        x2 += float_bounds.left;
+        x3 += float_bounds.left;
+        y1 += float_bounds.top;
+        y2 += float_bounds.top;
+        y3 += float_bounds.top;
+        rect.x_range += float_bounds.left;
+        rect.y_range += float_bounds.top;
+        rect -= float_bounds;
+    }
+    rect -= bounds;
+    if (!rect)
+        return;
+
+    if (canvas.antialias == SSAA) {
+        x1 *= 2.0f;
+        x2 *= 2.0f;
+        x3 *= 2.0f;
+        y1 *= 2.0f;
+        y2 *= 2.0f;
+        y3 *= 2.0f;
+        rect *= 2.0f;
+
+        // Include the last pixels' second sub-pixels:
+        rect.right += 1.0f;
+        rect.bottom += 1.0f;
+    }
+
+    // Compute area components:
+    f32 ABx = x2 - x1;
+    f32 ABy = y2 - y1;
+
+    f32 ACx = x3 - x1;
+    f32 ACy = y3 - y1;
+
+    f32 ABC = ACx*ABy - ACy*ABx;
+    if (ABC == 0)
+        return;
+
+    // Floor bounds coordinates down to their integral component:
+    u32 first_x = (u32)rect.left;
+    u32 first_y = (u32)rect.top;
+    u32 last_x  = (u32)rect.right;
+    u32 last_y  = (u32)rect.bottom;
+
+    // Clip the scanned samples (the weights are still computed from the first ones, so are the same either way):
+    u32 scan_first_x = first_x, scan_last_x = last_x;
+    u32 scan_first_y = first_y, scan_last_y = last_y;
+    if (clip_bounds) {
+        RectI clip{*clip_bounds};
+        if (canvas.antialias == SSAA) {
+            clip *= 2;
+            clip.right += 1;
+            clip.bottom += 1;
+        }
+        if ((i32)scan_first_x < clip.left) scan_first_x = (u32)clip.left;
+        if ((i32)scan_first_y < clip.top) scan_first_y = (u32)clip.top;
+        if ((i32)scan_last_x > clip.right) scan_last_x = (u32)clip.right;
+        if ((i32)scan_last_y > clip.bottom) scan_last_y = (u32)clip.bottom;
+        if (scan_first_x > scan_last_x || scan_first_y > scan_last_y)
+            return;
+    }
+
+    // Compute weight constants (for either winding, as the weights are then all positive inside):
+    f32 one_over_ABC = 1.0f / ABC;
+
+    f32 Cdx =  ABy * one_over_ABC;
+    f32 Bdx = -ACy * one_over_ABC;
+
+    f32 Cdy = -ABx * one_over_ABC;
+    f32 Bdy =  ACx * one_over_ABC;
+
+    // Compute initial areal coordinates for the first pixel center:
+    f32 start_x = (f32)first_x + 0.5f;
+    f32 start_y = (f32)first_y + 0.5f;
+    f32 C_start = Cdx*start_x + Cdy*start_y + (y1*x2 - x1*y2) * one_over_ABC;
+    f32 B_start = Bdx*start_x + Bdy*start_y + (y3*x1 - x3*y1) * one_over_ABC;
+
+    // Attributes are interpolated over depth:
+    f32 w1 = 1.0f / v1.position.z;
+    f32 w2 = 1.0f / v2.position.z;
+    f32 w3 = 1.0f / v3.position.z;
+
+    const TextureMip *texture_mip = nullptr;
+    vec2 uv1, uv2, uv3;
+    if (texture) {
+        // Select the mip level by how much of the texture each sample covers (as drawTexture does):
+        vec2 uv_AB{v2.uv.x - v1.uv.x, v2.uv.y - v1.uv.y};
+        vec2 uv_AC{v3.uv.x - v1.uv.x, v3.uv.y - v1.uv.y};
+        f32 uv_area = fabsf(uv_AC.x*uv_AB.y - uv_AC.y*uv_AB.x) / fabsf(ABC);
+        texture_mip = texture->mips + (texture->flags.mipmap ? Texture::GetMipLevel(*texture, uv_area) : 0);
+
+        uv1 = v1.uv * w1;
+        uv2 = v2.uv * w2;
+        uv3 = v3.uv * w3;
+    }
+
+    f32 A, B, C, W, depth;
+    Color pixel_color = color;
+
+    // Scan the bounds:
+    f32 B_row, C_row;
+    for (u32 y = scan_first_y; y <= scan_last_y; y++) {
+        B_row = B_start + Bdy * (f32)(y - first_y);
+        C_row = C_start + Cdy * (f32)(y - first_y);
+
+        for (u32 x = scan_first_x; x <= scan_last_x; x++) {
+            B = B_row + Bdx * (f32)(x - first_x);
+            C = C_row + Cdx * (f32)(x - first_x);
+            if (((Bdx < 0) && (B < 0)) ||
+                ((Cdx < 0) && (C < 0)))
+                break;
+
+            A = 1 - B - C;
+
+            // Skip the pixel if it's outside:
+            if (A < 0 || B < 0 || C < 0)
+                continue;
+
+            W = A*w1 + B*w2 + C*w3;
+            depth = 1.0f / W;
+            if (texture_mip) {
+                vec2 uv{(uv1 * A + uv2 * B + uv3 * C) * depth};
+                pixel_color = texture_mip->sample(uv.x, uv.y).color * color;
+            }
+
+            canvas.setPixel((i32)x, (i32)y, pixel_color, opacity, depth, depth, depth, depth);
+        }
+    }
+}
+
+enum RasterCommandType : u8 {
+    RasterCommand_Line,
+    RasterCommand_Triangle
+};
+
+struct RasterCommand {
+    RasterVertex vertices[3]; // Projected (in viewport pixels), with view-space depths. Lines only use the first 2.
+    const Texture *texture;
+    Color color;
+    f32 opacity;
+    RasterCommandType type;
+    u8 line_width;
+    u8 first_tile_x, first_tile_y, last_tile_x, last_tile_y;
+    u64 signature; // A hash of what the command draws (see TileRasterizer::track_damage)
+};
+
+// Like FNV-1a, though a word at a time (with the high half of the hash folded back in, to spread the words' bits):
+INLINE u64 _hashRasterValue(u64 hash, u32 bits) {
+    hash = (hash ^ bits) * 0x100000001B3ULL;
+    return hash ^ (hash >> 32);
+}
+
+INLINE u64 _hashRasterValue(u64 hash, f32 value) {
+    union { f32 f; u32 u; } bits{value};
+    return _hashRasterValue(hash, bits.u);
+}
+
+u64 _getRasterCommandSignature(const RasterCommand &command) {
+    u64 hash = 0xCBF29CE484222325ULL;
+    hash = _hashRasterValue(hash, (u32)command.type | (u32)command.line_width << 8);
+    u8 vertex_count = command.type == RasterCommand_Line ? 2 : 3;
+    for (u8 i = 0; i < vertex_count; i++) {
+        const RasterVertex &vertex = command.vertices[i];
+        hash = _hashRasterValue(hash, vertex.position.x);
+        hash = _hashRasterValue(hash, vertex.position.y);
+        hash = _hashRasterValue(hash, vertex.position.z);
+        if (command.texture) {
+            hash = _hashRasterValue(hash, vertex.uv.x);
+            hash = _hashRasterValue(hash, vertex.uv.y);
+        }
+    }
+    hash = _hashRasterValue(hash, (u32)(u64)command.texture);
+    hash = _hashRasterValue(hash, (u32)((u64)command.texture >> 32));
+    hash = _hashRasterValue(hash, command.color.r);
+    hash = _hashRasterValue(hash, command.color.g);
+    hash = _hashRasterValue(hash, command.color.b);
+    return _hashRasterValue(hash, command.opacity);
+}
+
+// Draws lines and triangles into a viewport's canvas in parallel, tile by tile.
+// While attached to a viewport (between begin and end), drawing into the viewport is recorded as commands instead of
+// being drawn: Edges (so any 3D lines, i.e: of grids, boxes, curves and mesh wireframes) and filled meshes.
+// On flushing, the commands are binned into the tiles that they overlap, and the tiles are then drawn on the thread
+// pool. A tile's pixels (and depths) are only written to by the thread drawing it, so no locking is needed.
+// As each tile draws its commands in the order that they were recorded, the result is the same as drawing directly.
+// Commands are flushed when they run out (before recording any more), and when detaching from the viewport.
+//
+// When tracking damage, only the tiles that changed since the last frame are cleared, drawn and resolved to the window
+// (so a static scene costs little more than recording its commands). A tile changed when the commands overlapping it
+// differ (by their signatures), or when it is invalidated, for drawing that is done directly into the canvas in it
+// (i.e: a HUD). Tiles invalidated in a frame are redrawn in the next frame too, erasing what was drawn directly.
+// Everything drawn into the canvas outside of invalidated tiles must then be recorded, so the canvas is not cleared
+// by the caller (the rasterizer clears the tiles that it draws). Textures are assumed not to change in place.
+// The whole canvas is redrawn when its dimensions, antialiasing or the viewport's bounds change, and on any frame
+// whose commands do not all fit at once.
+struct TileRasterizer {
+    RasterCommand *commands{nullptr};
+    u32 *binned_command_ids{nullptr}; // Tile after tile, the ids of the commands overlapping the tile
+    u32 *shared_command_ids{nullptr}; // The ids of the commands that every tile goes through
+    u32 command_count{0};
+    u32 shared_command_count{0};
+    u32 capacity{0};
+
+    u32 tile_offsets[TILE_RASTERIZER_MAX_TILE_COUNT + 1]; // Where each tile's command ids start (and end)
+    u32 tiles_per_row{0};
+    u32 tiles_per_column{0};
+
+    Viewport *viewport{nullptr};
+    ThreadPool *thread_pool{nullptr};
+
+    bool track_damage{false};
+    bool signatures_are_valid{false}; // Whether tile_signatures are those of a whole previous frame (of the same layout)
+    bool damage_is_checked{false};    // Whether this frame's changed tiles were found already (on its first flush)
+    bool frame_is_partial{false};     // Whether this frame's commands are flushed in more than one go
+    bool invalidated_tiles[TILE_RASTERIZER_MAX_TILE_COUNT]{};
+    bool previously_invalidated_tiles[TILE_RASTERIZER_MAX_TILE_COUNT]{};
+    bool changed_tiles[TILE_RASTERIZER_MAX_TILE_COUNT]{};
+    u64 tile_signatures[TILE_RASTERIZER_MAX_TILE_COUNT]{};
+    u16 last_width{0}, last_height{0};
+    AntiAliasing last_antialias{NoAA};
+    RectI last_bounds{};
+
+    static u64 getSizeInBytes(u32 max_command_count) {
+        return (sizeof(RasterCommand) + sizeof(u32) * (TILE_RASTERIZER_MAX_TILES_PER_COMMAND + 1)) * max_command_count;
+    }
+
+    bool allocate(u32 max_command_count, memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = getSizeInBytes(max_command_count);
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            commands = (RasterCommand*)memory_allocator->allocate(size);
+        } else
+            commands = (RasterCommand*)os::getMemory(size);
+
+        capacity = commands ? max_command_count : 0;
+        binned_command_ids = commands ? (u32*)(commands + capacity) : nullptr;
+        shared_command_ids = commands ? binned_command_ids + capacity * TILE_RASTERIZER_MAX_TILES_PER_COMMAND : nullptr;
+        return commands != nullptr;
+    }
+
+    void begin(Viewport &target_viewport, ThreadPool *pool = nullptr) {
+        if (viewport) end();
+        if (!commands) return;
+
+        viewport = &target_viewport;
+        viewport->rasterizer = this;
+        thread_pool = pool;
+        command_count = shared_command_count = 0;
+        tiles_per_row    = (viewport->canvas.dimensions.width  + TILE_RASTERIZER_TILE_SIZE - 1) / TILE_RASTERIZER_TILE_SIZE;
+        tiles_per_column = (viewport->canvas.dimensions.height + TILE_RASTERIZER_TILE_SIZE - 1) / TILE_RASTERIZER_TILE_SIZE;
+
+        const Canvas &canvas = viewport->canvas;
+        const RectI &bounds = viewport->bounds;
+        if (last_width != canvas.dimensions.width || last_height != canvas.dimensions.height ||
+            last_antialias != canvas.antialias ||
+            last_bounds.left != bounds.left || last_bounds.right != bounds.right ||
+            last_bounds.top != bounds.top || last_bounds.bottom != bounds.bottom) {
+            last_width = canvas.dimensions.width;
+            last_height = canvas.dimensions.height;
+            last_antialias = canvas.antialias;
+            last_bounds = bounds;
+            signatures_are_valid = false;
+        }
+        if (!track_damage) signatures_are_valid = false;
+
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        for (u32 tile = 0; tile < tile_count; tile++) {
+            previously_invalidated_tiles[tile] = invalidated_tiles[tile];
+            invalidated_tiles[tile] = changed_tiles[tile] = false;
+        }
+        damage_is_checked = frame_is_partial = false;
+    }
+
+    void end() {
+        if (!viewport) return;
+
+        flush();
+        if (track_damage) {
+            // Even with no commands at all, tiles that had any before (or that are invalidated) need clearing:
+            if (!damage_is_checked) drawTiles();
+            signatures_are_valid = !frame_is_partial;
+        }
+        viewport->rasterizer = nullptr;
+        viewport = nullptr;
+    }
+
+    // Marks the tiles overlapped by a rectangle of canvas pixels as changed in this frame (and the next one).
+    // Invalidation should be done before the rasterizer is ended, for the tiles to be cleared and redrawn.
+    void invalidate(RectI bounds) {
+        bounds -= RectI{0, (i32)(tiles_per_row * TILE_RASTERIZER_TILE_SIZE) - 1, 0, (i32)(tiles_per_column * TILE_RASTERIZER_TILE_SIZE) - 1};
+        if (!bounds) return;
+
+        for (i32 y = bounds.top / TILE_RASTERIZER_TILE_SIZE; y <= bounds.bottom / TILE_RASTERIZER_TILE_SIZE; y++)
+            for (i32 x = bounds.left / TILE_RASTERIZER_TILE_SIZE; x <= bounds.right / TILE_RASTERIZER_TILE_SIZE; x++)
+                invalidated_tiles[y * tiles_per_row + x] = true;
+    }
+
+    void invalidate() {
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        for (u32 tile = 0; tile < tile_count; tile++) invalidated_tiles[tile] = true;
+    }
+
+    // Resolves the canvas into the window: When tracking damage, only the tiles that changed in the last frame are.
+    void drawToWindow(const Canvas &canvas) const {
+        if (!track_damage) {
+            canvas.drawToWindow(thread_pool);
+            return;
+        }
+
+        TileResolveJob job{this, &canvas};
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        if (thread_pool && thread_pool->thread_count > 1)
+            thread_pool->parallelFor(tile_count, 1, resolveTilesJob, &job, 0);
+        else
+            resolveTilesJob(&job, 0, tile_count, 0);
+    }
+
+    void addLine(const vec3 &from, const vec3 &to, const Color &color, f32 opacity, u8 line_width) {
+        RasterCommand command;
+        command.type = RasterCommand_Line;
+        command.vertices[0].position = from;
+        command.vertices[1].position = to;
+        command.texture = nullptr;
+        command.color = color;
+        command.opacity = opacity;
+        command.line_width = line_width;
+        add(command, Rect{
+            from.x < to.x ? from.x : to.x,
+            from.x < to.x ? to.x : from.x,
+            from.y < to.y ? from.y : to.y,
+            from.y < to.y ? to.y : from.y
+        });
+    }
+
+    void addTriangle(const RasterVertex &v1, const RasterVertex &v2, const RasterVertex &v3,
+                     const Color &color, f32 opacity, const Texture *texture = nullptr) {
+        RasterCommand command;
+        command.type = RasterCommand_Triangle;
+        command.vertices[0] = v1;
+        command.vertices[1] = v2;
+        command.vertices[2] = v3;
+        command.texture = texture;
+        command.color = color;
+        command.opacity = opacity;
+        command.line_width = 0;
+
+        const vec3 &A = v1.position;
+        const vec3 &B = v2.position;
+        Rect bounds{
+            A.x < B.x ? A.x : B.x,
+            A.x < B.x ? B.x : A.x,
+            A.y < B.y ? A.y : B.y,
+            A.y < B.y ? B.y : A.y
+        };
+        if (v3.position.x < bounds.left) bounds.left = v3.position.x;
+        if (v3.position.x > bounds.right) bounds.right = v3.position.x;
+        if (v3.position.y < bounds.top) bounds.top = v3.position.y;
+        if (v3.position.y > bounds.bottom) bounds.bottom = v3.position.y;
+        add(command, bounds);
+    }
+
+    void flush() {
+        if (!viewport || !command_count) return;
+        if (track_damage && !damage_is_checked && command_count == capacity) {
+            // Commands that are yet to be recorded might overlap any tile, so all tiles are changed in this frame:
+            frame_is_partial = true;
+            invalidate();
+        }
+
+        // Bin the commands: Count the commands of each tile, turn the counts into offsets, then scatter the ids.
+        // The offsets of the tiles end up one tile ahead (at the end of each tile), and are shifted back after:
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        for (u32 tile = 0; tile <= tile_count; tile++) tile_offsets[tile] = 0;
+
+        RasterCommand *command = commands;
+        for (u32 id = 0; id < command_count; id++, command++)
+            if (isBinned(*command))
+                for (u32 y = command->first_tile_y; y <= command->last_tile_y; y++)
+                    for (u32 x = command->first_tile_x; x <= command->last_tile_x; x++)
+                        tile_offsets[y * tiles_per_row + x + 1]++;
+
+        for (u32 tile = 1; tile <= tile_count; tile++) tile_offsets[tile] += tile_offsets[tile - 1];
+
+        command = commands;
+        for (u32 id = 0; id < command_count; id++, command++)
+            if (isBinned(*command))
+                for (u32 y = command->first_tile_y; y <= command->last_tile_y; y++)
+                    for (u32 x = command->first_tile_x; x <= command->last_tile_x; x++)
+                        binned_command_ids[tile_offsets[y * tiles_per_row + x]++] = id;
+
+        for (u32 tile = tile_count; tile > 0; tile--) tile_offsets[tile] = tile_offsets[tile - 1];
+        tile_offsets[0] = 0;
+
+        drawTiles();
+        command_count = shared_command_count = 0;
+    }
+
+private:
+    void add(RasterCommand &command, Rect bounds) {
+        // Find the tiles overlapped by the command's pixels (in canvas pixels, clipped to the viewport):
+        const RectI &viewport_bounds = viewport->bounds;
+        bounds.x_range += (f32)viewport_bounds.left;
+        bounds.y_range += (f32)viewport_bounds.top;
+        bounds -= Rect{(f32)viewport_bounds.left, (f32)viewport_bounds.right, (f32)viewport_bounds.top, (f32)viewport_bounds.bottom};
+        bounds -= Rect{0, viewport->canvas.dimensions.f_width - 1.0f, 0, viewport->canvas.dimensions.f_height - 1.0f};
+        if (!bounds)
+            return;
+
+        command.first_tile_x = (u8)((u32)bounds.left / TILE_RASTERIZER_TILE_SIZE);
+        command.first_tile_y = (u8)((u32)bounds.top  / TILE_RASTERIZER_TILE_SIZE);
+        command.last_tile_x  = (u8)((u32)ceilf(bounds.right)  / TILE_RASTERIZER_TILE_SIZE);
+        command.last_tile_y  = (u8)((u32)ceilf(bounds.bottom) / TILE_RASTERIZER_TILE_SIZE);
+        if (command.last_tile_x >= tiles_per_row) command.last_tile_x = (u8)(tiles_per_row - 1);
+        if (command.last_tile_y >= tiles_per_column) command.last_tile_y = (u8)(tiles_per_column - 1);
+
+        if (command_count == capacity) flush();
+        if (track_damage) command.signature = _getRasterCommandSignature(command);
+        if (!isBinned(command)) shared_command_ids[shared_command_count++] = command_count;
+        commands[command_count++] = command;
+    }
+
+    void drawTiles() {
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        if (thread_pool && thread_pool->thread_count > 1)
+            thread_pool->parallelFor(tile_count, 1, drawTilesJob, this, 0);
+        else
+            drawTilesJob(this, 0, tile_count, 0);
+        damage_is_checked = true;
+    }
+
+    // In canvas pixels (inclusive, and not clipped to the canvas):
+    RectI getTileBounds(u32 tile) const {
+        u32 tile_x = tile % tiles_per_row;
+        u32 tile_y = tile / tiles_per_row;
+        return {
+            (i32)(tile_x * TILE_RASTERIZER_TILE_SIZE),
+            (i32)(tile_x * TILE_RASTERIZER_TILE_SIZE + TILE_RASTERIZER_TILE_SIZE - 1),
+            (i32)(tile_y * TILE_RASTERIZER_TILE_SIZE),
+            (i32)(tile_y * TILE_RASTERIZER_TILE_SIZE + TILE_RASTERIZER_TILE_SIZE - 1)
+        };
+    }
+
+    // Calls the given function with the id of each command overlapping the tile, in the order they were recorded
+    // (merging the tile's own commands with the shared ones):
+    template <typename Function>
+    INLINE void forEachCommandOfTile(u32 tile, Function &&function) const {
+        u32 tile_x = tile % tiles_per_row;
+        u32 tile_y = tile / tiles_per_row;
+        const u32 *binned = binned_command_ids + tile_offsets[tile];
+        const u32 *binned_end = binned_command_ids + tile_offsets[tile + 1];
+        const u32 *shared = shared_command_ids;
+        const u32 *shared_end = shared + shared_command_count;
+        while (binned != binned_end || shared != shared_end) {
+            u32 id;
+            if (shared == shared_end || (binned != binned_end && *binned < *shared))
+                id = *(binned++);
+            else {
+                id = *(shared++);
+                const RasterCommand &command = commands[id];
+                if (tile_x < command.first_tile_x || tile_x > command.last_tile_x ||
+                    tile_y < command.first_tile_y || tile_y > command.last_tile_y)
+                    continue;
+            }
+
+            function(id);
+        }
+    }
+
+    // Whether a tile is to be drawn in this flush. On the first flush of a frame that tracks damage, the tile's
+    // signature is updated and compared against the one it had in the last frame, and a changed tile is cleared:
+    bool prepareTile(u32 tile) {
+        if (!track_damage) return true;
+        if (damage_is_checked) return changed_tiles[tile];
+
+        u64 signature = 0xCBF29CE484222325ULL;
+        if (command_count)
+            forEachCommandOfTile(tile, [&](u32 id) {
+                signature = _hashRasterValue(_hashRasterValue(signature, (u32)commands[id].signature), (u32)(commands[id].signature >> 32));
+            });
+
+        bool changed = !signatures_are_valid || signature != tile_signatures[tile] ||
+                       invalidated_tiles[tile] || previously_invalidated_tiles[tile];
+        tile_signatures[tile] = signature;
+        changed_tiles[tile] = changed;
+        if (changed) viewport->canvas.clear(getTileBounds(tile));
+
+        return changed;
+    }
+
+    static INLINE bool isBinned(const RasterCommand &command) {
+        return (u32)(command.last_tile_x - command.first_tile_x + 1) *
+               (u32)(command.last_tile_y - command.first_tile_y + 1) <= TILE_RASTERIZER_MAX_TILES_PER_COMMAND;
+    }
+
+    void draw(const RasterCommand &command, const RectI &tile_bounds) const {
+        const RasterVertex *v = command.vertices;
+        if (command.type == RasterCommand_Line)
+            _drawLine(v[0].position.x, v[0].position.y, v[0].position.z,
+                      v[1].position.x, v[1].position.y, v[1].position.z,
+                      viewport->canvas, command.color, command.opacity, command.line_width, &viewport->bounds, &tile_bounds);
+        else
+            _fillPerspectiveTriangle(v[0], v[1], v[2], viewport->canvas, command.color, command.opacity, command.texture,
+                                     &viewport->bounds, &tile_bounds);
+    }
+
+    struct TileResolveJob {
+        const TileRasterizer *rasterizer;
+        const Canvas *canvas;
+    };
+
+    static void resolveTilesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        TileResolveJob &job = *(TileResolveJob*)data;
+        for (u32 tile = start; tile < end; tile++)
+            if (job.rasterizer->changed_tiles[tile])
+                job.canvas->drawToWindow(job.rasterizer->getTileBounds(tile));
+    }
+
+    static void drawTilesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        TileRasterizer &rasterizer = *(TileRasterizer*)data;
+        for (u32 tile = start; tile < end; tile++) {
+            if (!rasterizer.prepareTile(tile) || !rasterizer.command_count) continue;
+
+            RectI tile_bounds{rasterizer.getTileBounds(tile)};
+            rasterizer.forEachCommandOfTile(tile, [&](u32 id) {
+                rasterizer.draw(rasterizer.commands[id], tile_bounds);
+            });
+        }
+    }
+};
+
+// An edge that is known to be within the viewport's frustum (i.e: of an object that was found to be inside of it as
+// a whole, see Viewport::getContainment) skips being culled and clipped against it.
+void drawEdge(Edge edge, const Viewport &viewport, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1,
+              bool is_within_frustum = false) {
+    if (!is_within_frustum && !viewport.cullAndClipEdge(edge)) return;
 
     viewport.projectEdge(edge);
+    if (viewport.rasterizer) {
+        viewport.rasterizer->addLine(edge.from, edge.to, color, opacity, line_width);
+        return;
+    }
+
     drawLine(edge.from.x,
              edge.from.y,
              edge.from.z,
@@ -8122,6 +10728,7 @@ void drawEdge(Edge edge, const Viewport &viewport, const Color &color = White, f
              viewport.canvas, color, opacity, line_width, &viewport.bounds);
 }
 
+// A box that is outside of the viewport's frustum is skipped, and the edges of one that is inside of it skip being clipped.
 void drawBox(const Box &box, const Transform &transform, const Viewport &viewport,
              const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1, u8 sides = BOX__ALL_SIDES) {
 
@@ -8131,25 +10738,29 @@ void drawBox(const Box &box, const Transform &transform, const Viewport &viewpor
     for (u8 i = 0; i < BOX__VERTEX_COUNT; i++)
         view_space_box.vertices.buffer[i] = viewport.camera->internPos(transform.externPos(box.vertices.buffer[i]));
 
+    Frustum::Containment containment = viewport.getContainment(view_space_box.vertices.buffer, BOX__VERTEX_COUNT);
+    if (containment == Frustum::Containment::Outside) return;
+    bool is_inside = containment == Frustum::Containment::Inside;
+
     // Distribute transformed vertices positions to edges:
     view_space_box.edges.setFrom(view_space_box.vertices);
 
     if (sides == BOX__ALL_SIDES) for (const auto &edge : view_space_box.edges.buffer)
-            drawEdge(edge, viewport, color, opacity, line_width);
+        drawEdge(edge, viewport, color, opacity, line_width, is_inside);
     else {
         BoxEdgeSides &box_edges = view_space_box.edges.sides;
-        if (sides & BoxSide_Front | sides & BoxSide_Top   ) drawEdge(box_edges.front_top,    viewport, color, opacity, line_width);
-        if (sides & BoxSide_Front | sides & BoxSide_Bottom) drawEdge(box_edges.front_bottom, viewport, color, opacity, line_width);
-        if (sides & BoxSide_Front | sides & BoxSide_Left  ) drawEdge(box_edges.front_left,   viewport, color, opacity, line_width);
-        if (sides & BoxSide_Front | sides & BoxSide_Right ) drawEdge(box_edges.front_right,  viewport, color, opacity, line_width);
-        if (sides & BoxSide_Back  | sides & BoxSide_Top   ) drawEdge(box_edges.back_top,     viewport, color, opacity, line_width);
-        if (sides & BoxSide_Back  | sides & BoxSide_Bottom) drawEdge(box_edges.back_bottom,  viewport, color, opacity, line_width);
-        if (sides & BoxSide_Back  | sides & BoxSide_Left  ) drawEdge(box_edges.back_left,    viewport, color, opacity, line_width);
-        if (sides & BoxSide_Back  | sides & BoxSide_Right ) drawEdge(box_edges.back_right,   viewport, color, opacity, line_width);
-        if (sides & BoxSide_Left  | sides & BoxSide_Top   ) drawEdge(box_edges.left_top,     viewport, color, opacity, line_width);
-        if (sides & BoxSide_Left  | sides & BoxSide_Bottom) drawEdge(box_edges.left_bottom,  viewport, color, opacity, line_width);
-        if (sides & BoxSide_Right | sides & BoxSide_Top   ) drawEdge(box_edges.right_top,    viewport, color, opacity, line_width);
-        if (sides & BoxSide_Right | sides & BoxSide_Bottom) drawEdge(box_edges.right_bottom, viewport, color, opacity, line_width);
+        if (sides & BoxSide_Front | sides & BoxSide_Top   ) drawEdge(box_edges.front_top,    viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Front | sides & BoxSide_Bottom) drawEdge(box_edges.front_bottom, viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Front | sides & BoxSide_Left  ) drawEdge(box_edges.front_left,   viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Front | sides & BoxSide_Right ) drawEdge(box_edges.front_right,  viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Back  | sides & BoxSide_Top   ) drawEdge(box_edges.back_top,     viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Back  | sides & BoxSide_Bottom) drawEdge(box_edges.back_bottom,  viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Back  | sides & BoxSide_Left  ) drawEdge(box_edges.back_left,    viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Back  | sides & BoxSide_Right ) drawEdge(box_edges.back_right,   viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Left  | sides & BoxSide_Top   ) drawEdge(box_edges.left_top,     viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Left  | sides & BoxSide_Bottom) drawEdge(box_edges.left_bottom,  viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Right | sides & BoxSide_Top   ) drawEdge(box_edges.right_top,    viewport, color, opacity, line_width, is_inside);
+        if (sides & BoxSide_Right | sides & BoxSide_Bottom) drawEdge(box_edges.right_bottom, viewport, color, opacity, line_width, is_inside);
     }
 }
 
@@ -8173,223 +10784,1241 @@ void drawCamera(const Camera &camera, const Viewport &viewport, const Color &col
     box.vertices.corners.front_top_left     *= 2.0f;
     box.vertices.corners.front_top_right    *= 2.0f;
 
-    for (auto &vertex : box.vertices.buffer)
-        vertex.z += 1.5f;
+    for (auto &vertex : box.vertices.buffer)
+        vertex.z += 1.5f;
+
+    drawBox(box, transform, viewport, color, opacity, line_width, BOX__ALL_SIDES);
+}
+
+// A curve that is outside of the viewport's frustum is skipped before any of its steps get computed, and the edges of
+// one that is inside of it skip being clipped.
+void drawCurve(const Curve &curve, const Transform &transform, const Viewport &viewport,
+               const Color &color = White, f32 opacity = 1.0f, u8 line_width = 0, u32 step_count = CURVE_STEPS) {
+    const Camera &cam = *viewport.camera;
+
+    // Curves stay within a unit's distance of their center, and a coil's also within its thickness from there:
+    f32 extent = 1.0f + (curve.type == CurveType_Coil ? fabsf(curve.thickness) : 0.0f);
+    vec3 corners[8];
+    for (u8 i = 0; i < 8; i++)
+        corners[i] = cam.internPos(transform.externPos({i & 1 ? extent : -extent,
+                                                        i & 2 ? extent : -extent,
+                                                        i & 4 ? extent : -extent}));
+    Frustum::Containment containment = viewport.getContainment(corners, 8);
+    if (containment == Frustum::Containment::Outside) return;
+    bool is_inside = containment == Frustum::Containment::Inside;
+
+    f32 rotation_step = 1.0f / (f32)step_count;
+    f32 helix_center_to_orbit_y_inc = rotation_step * 2;
+
+    rotation_step *= TAU;
+    f32 rotation_step_times_rev_count = rotation_step * (f32)curve.revolution_count;
+
+    if (curve.type == CurveType_Helix)
+        rotation_step = rotation_step_times_rev_count;
+
+    vec3 center_to_orbit{1, 0, 0};
+    vec3 orbit_to_curve{curve.thickness, 0, 0};
+    mat3 rotation{mat3::RotationAroundY(rotation_step)};
+    mat3 orbit_to_curve_rotation{mat3::RotationAroundZ(rotation_step_times_rev_count)};
+
+    // Transform vertices positions of edges from view-space to screen-space (w/ culling and clipping):
+    mat3 accumulated_orbit_rotation = rotation;
+    vec3 local_position, local_previous_position, current_position, previous_position;
+    Edge edge;
+
+    for (u32 i = 0; i < step_count; i++) {
+        local_position = center_to_orbit = rotation * center_to_orbit;
+
+        switch (curve.type) {
+            case CurveType_Helix: local_position.y -= 1; break;
+            case CurveType_Coil:
+                orbit_to_curve  = orbit_to_curve_rotation * orbit_to_curve;
+                local_position += accumulated_orbit_rotation * orbit_to_curve;
+                break;
+            default: break;
+        }
+
+        current_position = cam.internPos(transform.externPos(local_position));
+
+        if (i) {
+            edge.from = previous_position;
+            edge.to   = current_position;
+            drawEdge(edge, viewport, color, opacity, line_width, is_inside);
+            if (curve.type == CurveType_Sphere) {
+                edge.from.x = local_previous_position.x;
+                edge.from.y = local_previous_position.z;
+                edge.from.z = 0;
+
+                edge.to.x = local_position.x;
+                edge.to.y = local_position.z;
+                edge.to.z = 0;
+
+                edge.from = cam.internPos(transform.externPos(edge.from));
+                edge.to   = cam.internPos(transform.externPos(edge.to));
+                drawEdge(edge, viewport, color, opacity, line_width, is_inside);
+
+                edge.from.x = 0;
+                edge.from.y = local_previous_position.x;
+                edge.from.z = local_previous_position.z;
+
+                edge.to.x = 0;
+                edge.to.y = local_position.x;
+                edge.to.z = local_position.z;
+
+                edge.from = cam.internPos(transform.externPos(edge.from));
+                edge.to   = cam.internPos(transform.externPos(edge.to));
+                drawEdge(edge, viewport, color, opacity, line_width, is_inside);
+            }
+        }
+
+        switch (curve.type) {
+            case CurveType_Helix: center_to_orbit.y += helix_center_to_orbit_y_inc; break;
+            case CurveType_Coil:  accumulated_orbit_rotation *= rotation; break;
+            default: break;
+        }
+
+        previous_position = current_position;
+        local_previous_position = local_position;
+    }
+}
+
+// A grid that is outside of the viewport's frustum is skipped before its vertices get transformed, and the edges of one
+// that is inside of it skip being clipped.
+void drawGrid(const Grid &grid, const Transform &transform, const Viewport &viewport, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
+    static Grid view_space_grid;
+
+    // The grid's edges span a square (on the local XZ plane), so they are all within the hull of its 4 corners:
+    vec3 corners[4];
+    for (u8 i = 0; i < 4; i++)
+        corners[i] = viewport.camera->internPos(transform.externPos({i & 1 ? 1.0f : -1.0f, 0, i & 2 ? 1.0f : -1.0f}));
+    Frustum::Containment containment = viewport.getContainment(corners, 4);
+    if (containment == Frustum::Containment::Outside) return;
+    bool is_inside = containment == Frustum::Containment::Inside;
+
+    // Transform vertices positions from local-space to world-space and then to view-space:
+    for (u8 segment = 0; segment < grid.u_segments; segment++) {
+        view_space_grid.vertices.u.from[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.u.from[segment])));
+        view_space_grid.vertices.u.to[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.u.to[segment])));
+    }
+    for (u8 segment = 0; segment < grid.v_segments; segment++) {
+        view_space_grid.vertices.v.from[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.v.from[segment])));
+        view_space_grid.vertices.v.to[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.v.to[segment])));
+    }
+
+    // Distribute transformed vertices positions to edges:
+    view_space_grid.edges.update(view_space_grid.vertices, grid.u_segments, grid.v_segments);
+
+    for (u8 u = 0; u < grid.u_segments; u++) drawEdge(view_space_grid.edges.u.edges[u], viewport, color, opacity, line_width, is_inside);
+    for (u8 v = 0; v < grid.v_segments; v++) drawEdge(view_space_grid.edges.v.edges[v], viewport, color, opacity, line_width, is_inside);
+}
+
+#define DEPTH_PYRAMID_CELL_SIZE 8 // In canvas pixels (of 4 sub-pixels each with SSAA), at the finest level
+#define DEPTH_PYRAMID_MAX_LEVEL_COUNT 12
+
+#define DEPTH_PYRAMID_MAX_CELLS_PER_ROW ((MAX_WIDTH + DEPTH_PYRAMID_CELL_SIZE - 1) / DEPTH_PYRAMID_CELL_SIZE)
+#define DEPTH_PYRAMID_MAX_CELLS_PER_COLUMN ((MAX_HEIGHT + DEPTH_PYRAMID_CELL_SIZE - 1) / DEPTH_PYRAMID_CELL_SIZE)
+#define DEPTH_PYRAMID_MAX_CELL_COUNT (DEPTH_PYRAMID_MAX_CELLS_PER_ROW * DEPTH_PYRAMID_MAX_CELLS_PER_COLUMN)
+
+INLINE bool _isOpaqueSample(const Pixel &pixel) { return pixel.opacity == 1.0f; }
+INLINE bool _isOpaqueSample(const HalfPixel &pixel) { return pixel.opacity == 0x3C00; } // 1 at half precision
+
+// A hierarchy of coarse depths of a canvas, for skipping (line) drawing that would end up entirely hidden.
+// A cell holds the farthest depth of the opaque samples in it, or infinity when any of its samples is not opaque
+// (only opaque samples hide what is drawn behind them, see Canvas::setPixel). Each level has cells of twice the
+// size of the level below it, holding the farthest depth of the 4 cells that they cover.
+// Drawing whose nearest depth is behind the farthest depth of all the cells that it covers would not change any pixel,
+// so it can be skipped. The pyramid is built from the canvas as it is at the time (i.e: after filled meshes have
+// been drawn into it), and is then used for the (line) drawing that follows.
+// With MSAA, lines are not depth-tested on all sub-samples, so nothing is ever considered as hidden.
+struct DepthPyramid {
+    f32 *levels[DEPTH_PYRAMID_MAX_LEVEL_COUNT]{};
+    u16 widths[DEPTH_PYRAMID_MAX_LEVEL_COUNT]{};
+    u16 heights[DEPTH_PYRAMID_MAX_LEVEL_COUNT]{};
+    u8 level_count{0}; // 0 until built (and when built from a canvas that hides nothing)
+
+    const Canvas *canvas{nullptr};
+
+    static u64 getSizeInBytes() {
+        return sizeof(f32) * DEPTH_PYRAMID_MAX_CELL_COUNT * 2; // Every level has at most a quarter of the one below it
+    }
+
+    bool allocate(memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = getSizeInBytes();
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            levels[0] = (f32*)memory_allocator->allocate(size);
+        } else
+            levels[0] = (f32*)os::getMemory(size);
+
+        return levels[0] != nullptr;
+    }
+
+    void build(const Canvas &target_canvas, ThreadPool *thread_pool = nullptr) {
+        level_count = 0;
+        canvas = &target_canvas;
+        if (!levels[0] || !canvas->depths || !canvas->hasPixels() || canvas->antialias == MSAA) return;
+
+        widths[0]  = (u16)((canvas->dimensions.width  + DEPTH_PYRAMID_CELL_SIZE - 1) / DEPTH_PYRAMID_CELL_SIZE);
+        heights[0] = (u16)((canvas->dimensions.height + DEPTH_PYRAMID_CELL_SIZE - 1) / DEPTH_PYRAMID_CELL_SIZE);
+        if (thread_pool && thread_pool->thread_count > 1)
+            thread_pool->parallelFor(heights[0], 4, buildRowsJob, this, 0);
+        else
+            buildRowsJob(this, 0, heights[0], 0);
+
+        level_count = 1;
+        while (level_count < DEPTH_PYRAMID_MAX_LEVEL_COUNT && (widths[level_count - 1] > 1 || heights[level_count - 1] > 1)) {
+            u8 level = level_count++;
+            const f32 *below = levels[level - 1];
+            u32 below_width = widths[level - 1];
+            u32 below_height = heights[level - 1];
+            widths[level]  = (u16)((below_width  + 1) / 2);
+            heights[level] = (u16)((below_height + 1) / 2);
+            levels[level] = levels[level - 1] + below_width * below_height;
+
+            f32 *cell = levels[level];
+            for (u32 y = 0; y < heights[level]; y++)
+                for (u32 x = 0; x < widths[level]; x++, cell++) {
+                    u32 below_x = x * 2, below_y = y * 2;
+                    const f32 *row = below + below_y * below_width + below_x;
+                    bool has_right = below_x + 1 < below_width;
+                    f32 farthest = row[0];
+                    if (has_right && row[1] > farthest) farthest = row[1];
+                    if (below_y + 1 < below_height) {
+                        row += below_width;
+                        if (row[0] > farthest) farthest = row[0];
+                        if (has_right && row[1] > farthest) farthest = row[1];
+                    }
+                    *cell = farthest;
+                }
+        }
+    }
+
+    // Whether drawing within the convex hull of the given view-space points would be entirely hidden, with a margin
+    // (in canvas pixels) around the hull's projection for what is drawn beyond it (for lines, their width plus one,
+    // as a line covers that many pixel rows/columns past its position).
+    // Points in front of the near clipping plane are never considered hidden (as they can not be projected as is).
+    bool isOccluded(const vec3 *view_space_points, u32 point_count, const Viewport &viewport, f32 margin = 0) const {
+        if (!level_count || canvas != &viewport.canvas || !point_count) return false;
+
+        f32 nearest = INFINITY;
+        f32 left = INFINITY, right = -INFINITY, top = INFINITY, bottom = -INFINITY;
+        for (u32 i = 0; i < point_count; i++) {
+            vec3 point{view_space_points[i]};
+            if (point.z < viewport.frustum.near_clipping_plane_distance) return false;
+            if (point.z < nearest) nearest = point.z;
+
+            viewport.projectPoint(point);
+            if (point.x < left) left = point.x;
+            if (point.x > right) right = point.x;
+            if (point.y < top) top = point.y;
+            if (point.y > bottom) bottom = point.y;
+        }
+
+        // Find the cells covered by the projection (in canvas pixels, clipped to the viewport):
+        const RectI &viewport_bounds = viewport.bounds;
+        Rect bounds{
+            left   + (f32)viewport_bounds.left - margin,
+            right  + (f32)viewport_bounds.left + margin,
+            top    + (f32)viewport_bounds.top  - margin,
+            bottom + (f32)viewport_bounds.top  + margin
+        };
+        bounds -= Rect{(f32)viewport_bounds.left, (f32)viewport_bounds.right, (f32)viewport_bounds.top, (f32)viewport_bounds.bottom};
+        bounds -= Rect{0, canvas->dimensions.f_width - 1.0f, 0, canvas->dimensions.f_height - 1.0f};
+        if (!bounds) return true; // Nothing would be drawn
+
+        i32 first_x = (i32)bounds.left / DEPTH_PYRAMID_CELL_SIZE;
+        i32 first_y = (i32)bounds.top  / DEPTH_PYRAMID_CELL_SIZE;
+        i32 last_x  = (i32)ceilf(bounds.right)  / DEPTH_PYRAMID_CELL_SIZE;
+        i32 last_y  = (i32)ceilf(bounds.bottom) / DEPTH_PYRAMID_CELL_SIZE;
+
+        // Go up to the level at which the projection covers at most 2x2 cells:
+        u8 level = 0;
+        while ((last_x - first_x > 1 || last_y - first_y > 1) && level + 1 < level_count) {
+            first_x >>= 1;
+            first_y >>= 1;
+            last_x >>= 1;
+            last_y >>= 1;
+            level++;
+        }
+        if (last_x >= widths[level]) last_x = widths[level] - 1;
+        if (last_y >= heights[level]) last_y = heights[level] - 1;
+
+        for (i32 y = first_y; y <= last_y; y++)
+            for (i32 x = first_x; x <= last_x; x++)
+                if (levels[level][y * widths[level] + x] > nearest)
+                    return false;
+
+        return true;
+    }
+
+private:
+    template <typename PixelStorage>
+    void buildCell(const PixelStorage *pixels, u32 cell_x, u32 cell_y, f32 *cell) const {
+        const Dimensions &dimensions = canvas->dimensions;
+        u32 first_x = cell_x * DEPTH_PYRAMID_CELL_SIZE;
+        u32 first_y = cell_y * DEPTH_PYRAMID_CELL_SIZE;
+        u32 end_x = first_x + DEPTH_PYRAMID_CELL_SIZE < dimensions.width  ? first_x + DEPTH_PYRAMID_CELL_SIZE : dimensions.width;
+        u32 end_y = first_y + DEPTH_PYRAMID_CELL_SIZE < dimensions.height ? first_y + DEPTH_PYRAMID_CELL_SIZE : dimensions.height;
+        u32 samples_per_pixel = canvas->antialias == SSAA ? 4 : 1;
+        u32 sample_count = (end_x - first_x) * samples_per_pixel;
+
+        f32 farthest = 0;
+        for (u32 y = first_y; y < end_y; y++) {
+            // The samples of a row of the cell are next to each other (with SSAA, being the sub-pixels of its pixels):
+            u32 offset = (dimensions.stride * y + first_x) * samples_per_pixel;
+            const PixelStorage *pixel = pixels + offset;
+            const f32 *depth = canvas->depths + offset;
+            for (u32 i = 0; i < sample_count; i++) {
+                if (!_isOpaqueSample(pixel[i])) {
+                    *cell = INFINITY;
+                    return;
+                }
+                if (depth[i] > farthest) farthest = depth[i];
+            }
+        }
+        *cell = farthest;
+    }
+
+    static void buildRowsJob(void *data, u32 start, u32 end, u32 thread_index) {
+        const DepthPyramid &pyramid = *(DepthPyramid*)data;
+        const Canvas &canvas = *pyramid.canvas;
+        u32 width = pyramid.widths[0];
+        for (u32 y = start; y < end; y++) {
+            f32 *cell = pyramid.levels[0] + y * width;
+            for (u32 x = 0; x < width; x++, cell++)
+                if (canvas.half_pixels) pyramid.buildCell(canvas.half_pixels, x, y, cell);
+                else                    pyramid.buildCell(canvas.pixels,      x, y, cell);
+        }
+    }
+};
+
+// How much of a surface's color is kept when facing away from the camera (the rest is lit by a head light):
+#define MESH_FILL_AMBIENT_LIGHT 0.2f
+
+// The view-space positions of a mesh's vertices, transformed once per draw (rather than once for every edge or
+// triangle that shares them). It is sized for the largest mesh to be drawn through it, and can be reused across meshes.
+// The mesh's transform and the camera's are combined into a single affine transformation from the mesh's space to
+// view space, which is applied to batches of vertices at once (with their coordinates gathered into SIMD lanes).
+struct MeshVertexCache {
+    vec3 *positions{nullptr};
+    u32 capacity{0};
+
+    mat3 local_to_view;
+    vec3 local_to_view_offset;
+
+    bool allocate(u32 max_vertex_count, memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = sizeof(vec3) * max_vertex_count;
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            positions = (vec3*)memory_allocator->allocate(size);
+        } else
+            positions = (vec3*)os::getMemory(size);
+
+        capacity = positions ? max_vertex_count : 0;
+        return positions != nullptr;
+    }
+
+    INLINE vec3 toViewPos(const vec3 &pos) const { return local_to_view * pos + local_to_view_offset; }
+    INLINE vec3 toViewDir(const vec3 &dir) const { return local_to_view * dir; }
+
+    void updateTransform(const Transform &transform, const Camera &camera) {
+        local_to_view_offset = camera.internPos(transform.position);
+        local_to_view.X = camera.internDir(transform.rotation * vec3{transform.scale.x, 0, 0});
+        local_to_view.Y = camera.internDir(transform.rotation * vec3{0, transform.scale.y, 0});
+        local_to_view.Z = camera.internDir(transform.rotation * vec3{0, 0, transform.scale.z});
+    }
+
+    // The view-space positions of the 8 corners of some (mesh-space) bounds:
+    void toViewCorners(const AABB &aabb, vec3 *corners) const {
+        for (u8 i = 0; i < 8; i++)
+            corners[i] = toViewPos({i & 1 ? aabb.max.x : aabb.min.x,
+                                    i & 2 ? aabb.max.y : aabb.min.y,
+                                    i & 4 ? aabb.max.z : aabb.min.z});
+    }
+
+    bool updateVertices(const Mesh &mesh) {
+        if (mesh.vertex_count > capacity) return false;
+
+        const mat3 &M = local_to_view;
+        const vec3 &O = local_to_view_offset;
+        simd_f32 Xx = simd::set1(M.X.x), Yx = simd::set1(M.Y.x), Zx = simd::set1(M.Z.x), Ox = simd::set1(O.x);
+        simd_f32 Xy = simd::set1(M.X.y), Yy = simd::set1(M.Y.y), Zy = simd::set1(M.Z.y), Oy = simd::set1(O.y);
+        simd_f32 Xz = simd::set1(M.X.z), Yz = simd::set1(M.Y.z), Zz = simd::set1(M.Z.z), Oz = simd::set1(O.z);
+        f32 xs[SIMD_WIDTH], ys[SIMD_WIDTH], zs[SIMD_WIDTH];
+
+        u32 batched_count = mesh.vertex_count - mesh.vertex_count % SIMD_WIDTH;
+        const vec3 *in = mesh.vertex_positions;
+        vec3 *out = positions;
+        for (u32 i = 0; i < batched_count; i += SIMD_WIDTH, in += SIMD_WIDTH, out += SIMD_WIDTH) {
+            for (u8 lane = 0; lane < SIMD_WIDTH; lane++) {
+                xs[lane] = in[lane].x;
+                ys[lane] = in[lane].y;
+                zs[lane] = in[lane].z;
+            }
+            simd_f32 x = simd::load(xs);
+            simd_f32 y = simd::load(ys);
+            simd_f32 z = simd::load(zs);
+            simd::store(xs, simd::fmadd(Xx, x, simd::fmadd(Yx, y, simd::fmadd(Zx, z, Ox))));
+            simd::store(ys, simd::fmadd(Xy, x, simd::fmadd(Yy, y, simd::fmadd(Zy, z, Oy))));
+            simd::store(zs, simd::fmadd(Xz, x, simd::fmadd(Yz, y, simd::fmadd(Zz, z, Oz))));
+            for (u8 lane = 0; lane < SIMD_WIDTH; lane++)
+                out[lane] = {xs[lane], ys[lane], zs[lane]};
+        }
+        for (u32 i = batched_count; i < mesh.vertex_count; i++, in++, out++)
+            *out = toViewPos(*in);
+
+        return true;
+    }
+};
+
+// Clips a convex polygon of view-space vertices against a plane of constant depth, keeping the side nearer to
+// the camera (or the farther side when keep_far is set). Returns the number of vertices written to out_vertices.
+u8 _clipPolygonAtDepth(const RasterVertex *vertices, u8 vertex_count, f32 depth, bool keep_far, RasterVertex *out_vertices) {
+    u8 out_count = 0;
+    for (u8 i = 0; i < vertex_count; i++) {
+        const RasterVertex &from = vertices[i];
+        const RasterVertex &to = vertices[(i + 1) % vertex_count];
+        bool from_inside = keep_far ? from.position.z >= depth : from.position.z <= depth;
+        bool to_inside   = keep_far ?   to.position.z >= depth :   to.position.z <= depth;
+        if (from_inside) out_vertices[out_count++] = from;
+        if (from_inside != to_inside) {
+            f32 t = (depth - from.position.z) / (to.position.z - from.position.z);
+            RasterVertex &clipped = out_vertices[out_count++];
+            clipped.position = from.position.lerpTo(to.position, t);
+            clipped.position.z = depth;
+            clipped.uv.x = from.uv.x + (to.uv.x - from.uv.x) * t;
+            clipped.uv.y = from.uv.y + (to.uv.y - from.uv.y) * t;
+        }
+    }
+
+    return out_count;
+}
+
+// Draws a mesh as filled, depth-tested triangles (lit by a head light), optionally textured by its uvs.
+// Vertices are transformed once into the vertex cache, triangles are culled against the frustum (and when facing
+// away from the camera) and clipped against the near and far clipping planes, before being projected and filled.
+// A mesh whose bounds are outside of the frustum is skipped before any of its vertices get transformed, and the
+// triangles of one whose bounds are inside of it skip being clipped.
+void drawMeshFilled(const Mesh &mesh, const Transform &transform, const Viewport &viewport, MeshVertexCache &vertex_cache,
+                    const Color &color = White, f32 opacity = 1.0f, const Texture *texture = nullptr) {
+    if (!viewport.canvas.hasPixels() || mesh.vertex_count > vertex_cache.capacity) return;
+    vertex_cache.updateTransform(transform, *viewport.camera);
+
+    vec3 corners[8];
+    vertex_cache.toViewCorners(mesh.aabb, corners);
+    Frustum::Containment containment = viewport.getContainment(corners, 8);
+    if (containment == Frustum::Containment::Outside || !vertex_cache.updateVertices(mesh)) return;
+    if (texture && !(mesh.uvs_count && mesh.vertex_uvs && mesh.vertex_uvs_indices && texture->mips)) texture = nullptr;
+
+    const Frustum &frustum = viewport.frustum;
+    // The uvs stay zeroed when not textured (clipping still interpolates them):
+    RasterVertex vertices[3]{}, near_clipped[4]{}, far_clipped[5]{};
+    TriangleVertexIndices *position_index = mesh.vertex_position_indices;
+    TriangleVertexIndices *uvs_index = mesh.vertex_uvs_indices;
+    for (u32 t = 0; t < mesh.triangle_count; t++, position_index++) {
+        for (u8 i = 0; i < 3; i++) vertices[i].position = vertex_cache.positions[position_index->ids[i]];
+        vec3 &A = vertices[0].position;
+        vec3 &B = vertices[1].position;
+        vec3 &C = vertices[2].position;
+        if (viewport.cullTriangle(A, B, C)) continue;
+
+        // The head light's intensity is how directly the triangle faces the camera:
+        vec3 normal = (C - A).cross(B - A).normalized();
+        f32 facing = fabsf(normal.dot(A.normalized()));
+        Color shaded_color = color * (MESH_FILL_AMBIENT_LIGHT + (1.0f - MESH_FILL_AMBIENT_LIGHT) * facing);
+
+        if (texture) {
+            for (u8 i = 0; i < 3; i++) vertices[i].uv = mesh.vertex_uvs[uvs_index[t].ids[i]];
+        }
+
+        u8 vertex_count = 3;
+        RasterVertex *polygon = vertices;
+        if (containment != Frustum::Containment::Inside) {
+            vertex_count = _clipPolygonAtDepth(vertices, 3, frustum.near_clipping_plane_distance, true, near_clipped);
+            vertex_count = _clipPolygonAtDepth(near_clipped, vertex_count, frustum.far_clipping_plane_distance, false, far_clipped);
+            if (vertex_count < 3) continue;
+            polygon = far_clipped;
+        }
+
+        for (u8 i = 0; i < vertex_count; i++) viewport.projectPoint(polygon[i].position);
+        for (u8 i = 2; i < vertex_count; i++)
+            if (viewport.rasterizer)
+                viewport.rasterizer->addTriangle(polygon[0], polygon[i - 1], polygon[i], shaded_color, opacity, texture);
+            else
+                _fillPerspectiveTriangle(polygon[0], polygon[i - 1], polygon[i],
+                                         viewport.canvas, shaded_color, opacity, texture, &viewport.bounds);
+    }
+}
+
+// Draws a mesh's edges (and optionally its vertex normals) as lines, from the view-space positions of its vertices.
+// A mesh whose bounds are outside of the frustum (or hidden behind the viewport's depth pyramid) is skipped before any
+// of its vertices get transformed, and the edges of one whose bounds are inside of the frustum skip being clipped.
+// The vertex cache's transformation is updated either way, for drawing the mesh's BVH through it. A mesh with more
+// vertices than the cache can hold is still drawn, by transforming each edge's endpoints on their own instead.
+void drawMesh(const Mesh &mesh, const Transform &transform, bool draw_normals, const Viewport &viewport,
+              MeshVertexCache &vertex_cache, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
+    vertex_cache.updateTransform(transform, *viewport.camera);
+
+    AABB bounds{mesh.aabb};
+    if (draw_normals) { // Normals are drawn a tenth of a unit beyond their vertices
+        bounds.min -= 0.1f;
+        bounds.max += 0.1f;
+    }
+    vec3 corners[8];
+    vertex_cache.toViewCorners(bounds, corners);
+    Frustum::Containment containment = viewport.getContainment(corners, 8);
+    if (containment == Frustum::Containment::Outside) return;
+    if (viewport.depth_pyramid && viewport.depth_pyramid->isOccluded(corners, 8, viewport, line_width + 1)) return;
+
+    bool is_inside = containment == Frustum::Containment::Inside;
+    bool is_cached = vertex_cache.updateVertices(mesh);
+    auto viewPos = [&](u32 vertex_index) -> vec3 {
+        return is_cached ? vertex_cache.positions[vertex_index] :
+                           vertex_cache.toViewPos(mesh.vertex_positions[vertex_index]);
+    };
+
+    Edge edge;
+    EdgeVertexIndices *edge_index = mesh.edge_vertex_indices;
+    for (u32 i = 0; i < mesh.edge_count; i++, edge_index++) {
+        edge.from = viewPos(edge_index->from);
+        edge.to   = viewPos(edge_index->to);
+        drawEdge(edge, viewport, color, opacity, line_width, is_inside);
+    }
+
+    if (draw_normals && mesh.normals_count && mesh.vertex_normals && mesh.vertex_normal_indices) {
+        TriangleVertexIndices *normal_index = mesh.vertex_normal_indices;
+        TriangleVertexIndices *position_index = mesh.vertex_position_indices;
+        for (u32 t = 0; t < mesh.triangle_count; t++, normal_index++, position_index++) {
+            for (u8 i = 0; i < 3; i++) {
+                edge.from = viewPos(position_index->ids[i]);
+                edge.to = edge.from + vertex_cache.toViewDir(mesh.vertex_normals[normal_index->ids[i]] * 0.1f);
+                drawEdge(edge, viewport, Red, opacity * 0.5f, line_width, is_inside);
+            }
+        }
+    }
+}
+
+// Draws the bounds of a BVH's nodes within a range of depths, as boxes. Nodes that are outside of the frustum or hidden
+// behind the viewport's depth pyramid (when set) are skipped. Each node is tested on its own, so that the drawing order
+// stays the same.
+void drawBVH(const BVH &bvh, const Transform &transform, const Viewport &viewport,
+               u16 min_depth = 0, u16 max_depth = 5, f32 opacity = 0.25f, u8 line_width = 1) {
+    static Box box;
+    static Transform box_transform;
+
+    for (u32 node_id = 0; node_id < bvh.node_count; node_id++) {
+        BVHNode &node = bvh.nodes[node_id];
+        if (node.depth < min_depth || node.depth > max_depth)
+            continue;
+
+        if (viewport.depth_pyramid) {
+            vec3 corners[8];
+            for (u8 i = 0; i < 8; i++)
+                corners[i] = viewport.camera->internPos(transform.externPos({i & 1 ? node.aabb.max.x : node.aabb.min.x,
+                                                                             i & 2 ? node.aabb.max.y : node.aabb.min.y,
+                                                                             i & 4 ? node.aabb.max.z : node.aabb.min.z}));
+            if (viewport.depth_pyramid->isOccluded(corners, 8, viewport, line_width + 1)) continue;
+        }
+
+        box_transform = transform;
+        box_transform.scale *= (node.aabb.max - node.aabb.min) * 0.5f;
+        box_transform.position = transform.externPos((node.aabb.min + node.aabb.max) * 0.5f);
+
+        drawBox(box, box_transform, viewport, node.leaf_count ? BrightMagenta : (node_id ? BrightGreen : BrightCyan),
+                opacity, line_width);
+    }
+}
+
+// Draws a mesh's BVH through the local-to-view transformation of its vertex cache (as last updated for the mesh),
+// so that the corners of the nodes' bounds skip the transform's and the camera's rotations.
+void drawBVH(const BVH &bvh, const MeshVertexCache &vertex_cache, const Viewport &viewport,
+             u16 min_depth = 0, u16 max_depth = 5, f32 opacity = 0.25f, u8 line_width = 1) {
+    static Box box;
+    static Box view_space_box;
+
+    for (u32 node_id = 0; node_id < bvh.node_count; node_id++) {
+        BVHNode &node = bvh.nodes[node_id];
+        if (node.depth < min_depth || node.depth > max_depth)
+            continue;
+
+        vec3 center = (node.aabb.min + node.aabb.max) * 0.5f;
+        vec3 half_size = (node.aabb.max - node.aabb.min) * 0.5f;
+        vec3 *corners = view_space_box.vertices.buffer;
+        for (u8 i = 0; i < BOX__VERTEX_COUNT; i++)
+            corners[i] = vertex_cache.toViewPos(center + half_size * box.vertices.buffer[i]);
+
+        Frustum::Containment containment = viewport.getContainment(corners, BOX__VERTEX_COUNT);
+        if (containment == Frustum::Containment::Outside) continue;
+        if (viewport.depth_pyramid && viewport.depth_pyramid->isOccluded(corners, BOX__VERTEX_COUNT, viewport, line_width + 1)) continue;
+
+        view_space_box.edges.setFrom(view_space_box.vertices);
+        Color color = node.leaf_count ? BrightMagenta : (node_id ? BrightGreen : BrightCyan);
+        for (const auto &edge : view_space_box.edges.buffer)
+            drawEdge(edge, viewport, color, opacity, line_width, containment == Frustum::Containment::Inside);
+    }
+}
+
+#define TRACE_TILE_SIZE 32 // In canvas samples (pixels, or sub-pixels with SSAA)
+
+// Packets cover blocks of neighbouring samples (2x2 for 4 rays, 4x2 for 8 rays), keeping their rays coherent:
+#define TRACE_PACKET_HEIGHT 2
+#define TRACE_PACKET_WIDTH (RAY_PACKET_WIDTH / TRACE_PACKET_HEIGHT)
+
+// How much of a surface's color is kept when facing away from the camera (the rest is lit by a head light):
+#define TRACE_AMBIENT_LIGHT 0.2f
+
+struct TraceJob {
+    const Scene *scene;
+    const Viewport *viewport;
+    u32 width, height;  // The viewport's sample counts
+    u32 tiles_per_row;
+};
+
+// Traces a packet of primary rays (each lane is one sample) against the meshes of the scene, and shades the hits.
+// A geometry's rays are given in its mesh's space with directions that are not re-normalized, so that distances
+// along them remain those of the camera's rays, and the closest hit can carry over from one geometry to the next.
+void traceSamplePacket(const TraceJob &job, u32 start_x, u32 start_y) {
+    const Scene &scene = *job.scene;
+    const Viewport &viewport = *job.viewport;
+    const Camera &camera = *viewport.camera;
+    Canvas &canvas = viewport.canvas;
+
+    vec3 directions[RAY_PACKET_WIDTH];
+    u32 geometry_ids[RAY_PACKET_WIDTH];
+    u32 triangle_ids[RAY_PACKET_WIDTH];
+    f32 distances[RAY_PACKET_WIDTH];
+    bool any_ray = false;
+    for (u8 lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+        u32 x = start_x + lane % TRACE_PACKET_WIDTH;
+        u32 y = start_y + lane / TRACE_PACKET_WIDTH;
+        geometry_ids[lane] = (u32)-1;
+        distances[lane] = -1;
+        if (x < job.width && y < job.height) {
+            directions[lane] = camera.getRayDirectionAt((f32)x, (f32)y, (f32)job.width, (f32)job.height);
+            distances[lane] = INFINITY;
+            any_ray = true;
+        }
+    }
+    if (!any_ray) return;
+
+    RayPacket packet;
+    const Geometry *geometry = scene.geometries;
+    for (u32 g = 0; g < scene.counts.geometries; g++, geometry++) {
+        if (geometry->type != GeometryType_Mesh) continue;
+
+        const Transform &transform = geometry->transform;
+        quat inv_rotation = transform.rotation.conjugate();
+        vec3 inv_scale = 1.0f / transform.scale;
+        vec3 origin = transform.internPos(camera.position);
+        for (u8 lane = 0; lane < RAY_PACKET_WIDTH; lane++)
+            if (distances[lane] < 0)
+                packet.disableRay(lane);
+            else
+                packet.setRay(lane, origin, inv_scale * (inv_rotation * directions[lane]), distances[lane]);
+
+        u32 hits = packet.castOn(scene.meshes[geometry->id]);
+        for (u8 lane = 0; hits; lane++, hits >>= 1)
+            if (hits & 1) {
+                distances[lane] = packet.distance[lane];
+                geometry_ids[lane] = g;
+                triangle_ids[lane] = packet.triangle_index[lane];
+            }
+    }
+
+    vec3 normal, position, U, V;
+    for (u8 lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+        if (geometry_ids[lane] == (u32)-1) continue;
+
+        const Geometry &hit_geometry = scene.geometries[geometry_ids[lane]];
+        const Mesh &mesh = scene.meshes[hit_geometry.id];
+        if (mesh.triangle_layout == TriangleLayout_Compact) {
+            mesh.getTriangle(triangle_ids[lane], position, U, V);
+            normal = U.cross(V);
+        } else
+            normal = mesh.triangles[triangle_ids[lane]].normal;
+
+        // Normals are transformed by the inverse-transpose (so by the inverse of the scale):
+        normal = (hit_geometry.transform.rotation * (normal / hit_geometry.transform.scale)).normalized();
+        f32 facing = fabsf(normal.dot(directions[lane]));
+        Color color = Color(hit_geometry.color) * (TRACE_AMBIENT_LIGHT + (1.0f - TRACE_AMBIENT_LIGHT) * facing);
+        color *= color;
+
+        i32 x = (i32)(start_x + lane % TRACE_PACKET_WIDTH);
+        i32 y = (i32)(start_y + lane / TRACE_PACKET_WIDTH);
+        f32 depth = distances[lane] * directions[lane].dot(camera.forward);
+        if (canvas.antialias == SSAA) {
+            x += viewport.bounds.left * 2;
+            y += viewport.bounds.top * 2;
+        } else {
+            x += viewport.bounds.left;
+            y += viewport.bounds.top;
+        }
+        u32 offset = canvas.antialias == SSAA ?
+                     ((canvas.dimensions.stride * (y >> 1) + (x >> 1)) * 4 + (2 * (y & 1)) + (x & 1)) :
+                     (canvas.dimensions.stride * y + x);
+        canvas.storePixel(offset, Pixel{color, 1.0f});
+        if (canvas.depths) {
+            if (canvas.antialias == MSAA) {
+                f32 *depths = canvas.depths + offset * 4;
+                depths[0] = depths[1] = depths[2] = depths[3] = depth;
+            } else
+                canvas.depths[offset] = depth;
+        }
+    }
+}
+
+void traceTilesJob(void *data, u32 start, u32 end, u32 thread_index) {
+    TraceJob &job = *(TraceJob*)data;
+    for (u32 tile = start; tile < end; tile++) {
+        u32 tile_x = (tile % job.tiles_per_row) * TRACE_TILE_SIZE;
+        u32 tile_y = (tile / job.tiles_per_row) * TRACE_TILE_SIZE;
+        u32 end_x = tile_x + TRACE_TILE_SIZE < job.width ? tile_x + TRACE_TILE_SIZE : job.width;
+        u32 end_y = tile_y + TRACE_TILE_SIZE < job.height ? tile_y + TRACE_TILE_SIZE : job.height;
+        for (u32 y = tile_y; y < end_y; y += TRACE_PACKET_HEIGHT)
+            for (u32 x = tile_x; x < end_x; x += TRACE_PACKET_WIDTH)
+                traceSamplePacket(job, x, y);
+    }
+}
+
+// A shaded (ray traced) render of the scene's meshes into the viewport's canvas, with a primary ray per sample.
+// Hit samples get their geometry's color (lit by a head light) and their view-space depth, so that other drawing
+// (i.e: wireframes) can still be depth-tested against them. Missed samples are left as they were.
+// The viewport is split into tiles, which the thread pool's threads pick up (and steal from one another) as they go.
+void traceScene(const Scene &scene, const Viewport &viewport, ThreadPool *thread_pool = nullptr) {
+    if (!viewport.canvas.hasPixels()) return;
+
+    TraceJob job{&scene, &viewport, viewport.dimensions.width, viewport.dimensions.height};
+    if (viewport.canvas.antialias == SSAA) {
+        job.width *= 2;
+        job.height *= 2;
+    }
+    job.tiles_per_row = (job.width + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE;
+    u32 tile_count = job.tiles_per_row * ((job.height + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE);
+    if (thread_pool && thread_pool->thread_count > 1)
+        thread_pool->parallelFor(tile_count, 1, traceTilesJob, &job, 0);
+    else
+        traceTilesJob(&job, 0, tile_count, 0);
+}
+
+void drawSelection(Selection &selection, const Viewport &viewport, const Scene &scene) {
+    static Box box;
+
+    if (controls::is_pressed::alt && !mouse::is_captured && selection.geo_type && selection.geometry) {
+        selection.xform = selection.geometry->transform;
+        if (selection.geometry->type == GeometryType_Mesh)
+            selection.xform.scale *= scene.meshes[selection.geometry->id].aabb.max;
+
+        drawBox(box, selection.xform, viewport, Yellow, 0.5f, 0);
+        if (selection.box_side) {
+            ColorID color = White;
+            switch (selection.box_side) {
+                case BoxSide_Left:  case BoxSide_Right: color = Red;   break;
+                case BoxSide_Top:   case BoxSide_Bottom: color = Green; break;
+                case BoxSide_Front: case BoxSide_Back: color = Blue;  break;
+                case BoxSide_None: break;
+            }
+
+            drawBox(box, selection.xform, viewport, color, 0.5f, 1, selection.box_side);
+        }
+    }
+}
+
+struct SlimApp {
+    timers::Timer update_timer, render_timer;
+    bool is_running{true};
+
+    virtual void OnWindowResize(u16 width, u16 height) {};
+    virtual void OnKeyChanged(  u8 key, bool pressed) {};
+    virtual void OnMouseButtonUp(  mouse::Button &mouse_button) {};
+    virtual void OnMouseButtonDown(mouse::Button &mouse_button) {};
+    virtual void OnMouseButtonDoubleClicked(mouse::Button &mouse_button) {};
+    virtual void OnMouseWheelScrolled(f32 amount) {};
+    virtual void OnMousePositionSet(i32 x, i32 y) {};
+    virtual void OnMouseMovementSet(i32 x, i32 y) {};
+    virtual void OnMouseRawMovementSet(i32 x, i32 y) {};
+    virtual void OnRender() {};
+    virtual void OnUpdate(f32 delta_time) {};
+    virtual void OnWindowRedraw() {
+        update_timer.beginFrame();
+        OnUpdate(update_timer.delta_time);
+        update_timer.endFrame();
+
+        render_timer.beginFrame();
+        OnRender();
+        render_timer.endFrame();
+    };
+
+    void resize(u16 width, u16 height) {
+        window::width = width;
+        window::height = height;
+        OnWindowResize(width, height);
+        OnWindowRedraw();
+    }
+};
+
+SlimApp* createApp();
+
+#if defined(SLIM_HEADLESS) || !defined(_WIN32)
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+
+#ifndef NDEBUG
+#include <tchar.h>
+#include <stdio.h>
+#include <strsafe.h>
+#include <new.h>
+
+void DisplayError(LPTSTR lpszFunction) {
+    LPVOID lpMsgBuf;
+    LPVOID lpDisplayBuf;
+    unsigned int last_error = GetLastError();
+
+    FormatMessage(
+            FORMAT_MESSAGE_ALLOCATE_BUFFER |
+            FORMAT_MESSAGE_FROM_SYSTEM |
+            FORMAT_MESSAGE_IGNORE_INSERTS,
+            nullptr, last_error,
+            MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+            (LPTSTR) &lpMsgBuf, 0, nullptr);
+
+    lpDisplayBuf = (LPVOID)LocalAlloc(LMEM_ZEROINIT, (lstrlen((LPCTSTR)lpMsgBuf) + lstrlen((LPCTSTR)lpszFunction) + 40) * sizeof(TCHAR));
+
+    if (FAILED( StringCchPrintf((LPTSTR)lpDisplayBuf, LocalSize(lpDisplayBuf) / sizeof(TCHAR),
+                                TEXT("%s failed with error code %d as follows:\n%s"), lpszFunction, last_error, lpMsgBuf)))
+        printf("FATAL ERROR: Unable to output error code.\n");
+
+    _tprintf((LPTSTR)"ERROR: %s\n", (LPCTSTR)lpDisplayBuf);
+
+    LocalFree(lpMsgBuf);
+    LocalFree(lpDisplayBuf);
+}
+#endif
+
+void win32_closeFile(void *handle) {
+    CloseHandle(handle);
+}
+
+void* win32_openFileForReading(const char* path) {
+    HANDLE handle = CreateFileA(path,           // file to open
+                                GENERIC_READ,          // open for reading
+                                FILE_SHARE_READ,       // share for reading
+                                nullptr,                  // default security
+                                OPEN_EXISTING,         // existing file only
+                                FILE_ATTRIBUTE_NORMAL, // normal file
+                                nullptr);                 // no attr. template
+#ifndef NDEBUG
+    if (handle == INVALID_HANDLE_VALUE) {
+        DisplayError((LPTSTR)"CreateFile");
+        _tprintf((LPTSTR)"Terminal failure: unable to open file \"%s\" for read.\n", path);
+        return nullptr;
+    }
+#endif
+    return handle;
+}
+
+void* win32_openFileForWriting(const char* path) {
+    HANDLE handle = CreateFileA(path,           // file to open
+                                GENERIC_WRITE,          // open for writing
+                                0,                      // do not share
+                                nullptr,                   // default security
+                                OPEN_ALWAYS,            // create new or open existing
+                                FILE_ATTRIBUTE_NORMAL,  // normal file
+                                nullptr);
+#ifndef NDEBUG
+    if (handle == INVALID_HANDLE_VALUE) {
+        DisplayError((LPTSTR)"CreateFile");
+        _tprintf((LPTSTR)"Terminal failure: unable to open file \"%s\" for write.\n", path);
+        return nullptr;
+    }
+#endif
+    return handle;
+}
+
+bool win32_readFromFile(LPVOID out, DWORD size, HANDLE handle) {
+    DWORD bytes_read = 0;
+    BOOL result = ReadFile(handle, out, size, &bytes_read, nullptr);
+#ifndef NDEBUG
+    if (result == FALSE) {
+        DisplayError((LPTSTR)"ReadFile");
+        printf("Terminal failure: Unable to read from file.\n GetLastError=%08x\n", (unsigned int)GetLastError());
+        CloseHandle(handle);
+    }
+#endif
+    return result != FALSE;
+}
+
+bool win32_writeToFile(LPVOID out, DWORD size, HANDLE handle) {
+    DWORD bytes_written = 0;
+    BOOL result = WriteFile(handle, out, size, &bytes_written, nullptr);
+#ifndef NDEBUG
+    if (result == FALSE) {
+        DisplayError((LPTSTR)"WriteFile");
+        printf("Terminal failure: Unable to write to file.\n GetLastError=%08x\n", (unsigned int)GetLastError());
+        CloseHandle(handle);
+    }
+#endif
+    return result != FALSE;
+}
+
+HWND window_handle;
+LARGE_INTEGER performance_counter;
+
+void os::setWindowTitle(char* str) {
+    window::title = str;
+    SetWindowTextA(window_handle, str);
+}
+
+void os::setCursorVisibility(bool on) {
+    ShowCursor(on);
+}
+
+void os::setWindowCapture(bool on) {
+    if (on) SetCapture(window_handle);
+    else ReleaseCapture();
+}
+
+u64 timers::getTicks() {
+    QueryPerformanceCounter(&performance_counter);
+    return (u64)performance_counter.QuadPart;
+}
+
+void* os::getMemory(u64 size, u64 base) {
+    return VirtualAlloc((LPVOID)base, (SIZE_T)size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
+}
+
+void os::freeMemory(void *address, u64 size) { VirtualFree(address, 0, MEM_RELEASE); }
+
+void os::closeFile(void *handle) { return win32_closeFile(handle); }
+void* os::openFileForReading(const char* path) { return win32_openFileForReading(path); }
+void* os::openFileForWriting(const char* path) { return win32_openFileForWriting(path); }
+bool os::readFromFile(LPVOID out, DWORD size, HANDLE handle) { return win32_readFromFile(out, size, handle); }
+bool os::writeToFile(LPVOID out, DWORD size, HANDLE handle) { return win32_writeToFile(out, size, handle); }
+
+struct Win32Thread {
+    os::ThreadFunction function;
+    void *data;
+};
 
-    drawBox(box, transform, viewport, color, opacity, line_width, BOX__ALL_SIDES);
+DWORD WINAPI win32_runThread(LPVOID param) {
+    Win32Thread *thread = (Win32Thread*)param;
+    thread->function(thread->data);
+    HeapFree(GetProcessHeap(), 0, thread);
+    return 0;
 }
 
+u32 os::getProcessorCount() {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return (u32)system_info.dwNumberOfProcessors;
+}
 
-void drawCurve(const Curve &curve, const Transform &transform, const Viewport &viewport,
-               const Color &color = White, f32 opacity = 1.0f, u8 line_width = 0, u32 step_count = CURVE_STEPS) {
-    const Camera &cam = *viewport.camera;
+void* os::createThread(ThreadFunction function, void *data) {
+    Win32Thread *thread = (Win32Thread*)HeapAlloc(GetProcessHeap(), 0, sizeof(Win32Thread));
+    if (!thread) return nullptr;
+    thread->function = function;
+    thread->data = data;
+    HANDLE handle = CreateThread(nullptr, 0, win32_runThread, thread, 0, nullptr);
+    if (!handle) HeapFree(GetProcessHeap(), 0, thread);
+    return handle;
+}
 
-    f32 rotation_step = 1.0f / (f32)step_count;
-    f32 helix_center_to_orbit_y_inc = rotation_step * 2;
+void os::joinThread(void *handle) {
+    WaitForSingleObject((HANDLE)handle, INFINITE);
+    CloseHandle((HANDLE)handle);
+}
 
-    rotation_step *= TAU;
-    f32 rotation_step_times_rev_count = rotation_step * (f32)curve.revolution_count;
+void os::yieldThread() { SwitchToThread(); }
 
-    if (curve.type == CurveType_Helix)
-        rotation_step = rotation_step_times_rev_count;
+void* os::createSemaphore(u32 initial_count) { return CreateSemaphoreA(nullptr, (LONG)initial_count, 0x7FFFFFFF, nullptr); }
+void os::destroySemaphore(void *handle) { CloseHandle((HANDLE)handle); }
+void os::signalSemaphore(void *handle, u32 count) { ReleaseSemaphore((HANDLE)handle, (LONG)count, nullptr); }
+void os::waitOnSemaphore(void *handle) { WaitForSingleObject((HANDLE)handle, INFINITE); }
 
-    vec3 center_to_orbit{1, 0, 0};
-    vec3 orbit_to_curve{curve.thickness, 0, 0};
-    mat3 rotation{mat3::RotationAroundY(rotation_step)};
-    mat3 orbit_to_curve_rotation{mat3::RotationAroundZ(rotation_step_times_rev_count)};
+u32 os::atomicLoad(volatile u32 *value) { return (u32)InterlockedCompareExchange((volatile LONG*)value, 0, 0); }
+void os::atomicStore(volatile u32 *value, u32 new_value) { InterlockedExchange((volatile LONG*)value, (LONG)new_value); }
+u32 os::atomicAdd(volatile u32 *value, u32 amount) { return (u32)InterlockedExchangeAdd((volatile LONG*)value, (LONG)amount); }
+u32 os::atomicSubtract(volatile u32 *value, u32 amount) { return (u32)InterlockedExchangeAdd((volatile LONG*)value, -(LONG)amount); }
+u32 os::atomicExchange(volatile u32 *value, u32 new_value) { return (u32)InterlockedExchange((volatile LONG*)value, (LONG)new_value); }
 
-    // Transform vertices positions of edges from view-space to screen-space (w/ culling and clipping):
-    mat3 accumulated_orbit_rotation = rotation;
-    vec3 local_position, local_previous_position, current_position, previous_position;
-    Edge edge;
+#else
 
-    for (u32 i = 0; i < step_count; i++) {
-        local_position = center_to_orbit = rotation * center_to_orbit;
+#include <new>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
 
-        switch (curve.type) {
-            case CurveType_Helix: local_position.y -= 1; break;
-            case CurveType_Coil:
-                orbit_to_curve  = orbit_to_curve_rotation * orbit_to_curve;
-                local_position += accumulated_orbit_rotation * orbit_to_curve;
-                break;
-            default: break;
-        }
+#ifndef NDEBUG
+#include <stdio.h>
+#include <string.h>
 
-        current_position = cam.internPos(transform.externPos(local_position));
+void DisplayError(const char *function_name) {
+    int last_error = errno;
+    printf("ERROR: %s failed with error code %d as follows:\n%s\n", function_name, last_error, strerror(last_error));
+}
+#endif
 
-        if (i) {
-            edge.from = previous_position;
-            edge.to   = current_position;
-            drawEdge(edge, viewport, color, opacity, line_width);
-            if (curve.type == CurveType_Sphere) {
-                edge.from.x = local_previous_position.x;
-                edge.from.y = local_previous_position.z;
-                edge.from.z = 0;
+// File handles are file descriptors offset by one, so that a null handle can still signal a failure:
+INLINE void* posix_fileHandle(int file_descriptor) { return (void*)(intptr_t)(file_descriptor + 1); }
+INLINE int posix_fileDescriptor(void *handle) { return (int)((intptr_t)handle - 1); }
 
-                edge.to.x = local_position.x;
-                edge.to.y = local_position.z;
-                edge.to.z = 0;
+void posix_closeFile(void *handle) {
+    close(posix_fileDescriptor(handle));
+}
 
-                edge.from = cam.internPos(transform.externPos(edge.from));
-                edge.to   = cam.internPos(transform.externPos(edge.to));
-                drawEdge(edge, viewport, color, opacity, line_width);
+void* posix_openFileForReading(const char* path) {
+    int file_descriptor = open(path, O_RDONLY);
+    if (file_descriptor == -1) {
+#ifndef NDEBUG
+        DisplayError("open");
+        printf("Terminal failure: unable to open file \"%s\" for read.\n", path);
+#endif
+        return nullptr;
+    }
+    return posix_fileHandle(file_descriptor);
+}
 
-                edge.from.x = 0;
-                edge.from.y = local_previous_position.x;
-                edge.from.z = local_previous_position.z;
+void* posix_openFileForWriting(const char* path) {
+    int file_descriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor == -1) {
+#ifndef NDEBUG
+        DisplayError("open");
+        printf("Terminal failure: unable to open file \"%s\" for write.\n", path);
+#endif
+        return nullptr;
+    }
+    return posix_fileHandle(file_descriptor);
+}
 
-                edge.to.x = 0;
-                edge.to.y = local_position.x;
-                edge.to.z = local_position.z;
+bool posix_readFromFile(void *out, unsigned long size, void *handle) {
+    int file_descriptor = posix_fileDescriptor(handle);
+    u8 *bytes = (u8*)out;
+    ssize_t bytes_read;
 
-                edge.from = cam.internPos(transform.externPos(edge.from));
-                edge.to   = cam.internPos(transform.externPos(edge.to));
-                drawEdge(edge, viewport, color, opacity, line_width);
-            }
+    // A read may return less than requested, so keep reading until the whole size arrived:
+    while (size) {
+        bytes_read = read(file_descriptor, bytes, size);
+        if (bytes_read <= 0) {
+#ifndef NDEBUG
+            DisplayError("read");
+            printf("Terminal failure: Unable to read from file.\n");
+#endif
+            return false;
         }
+        bytes += bytes_read;
+        size -= (unsigned long)bytes_read;
+    }
+    return true;
+}
 
-        switch (curve.type) {
-            case CurveType_Helix: center_to_orbit.y += helix_center_to_orbit_y_inc; break;
-            case CurveType_Coil:  accumulated_orbit_rotation *= rotation; break;
-            default: break;
-        }
+bool posix_writeToFile(void *out, unsigned long size, void *handle) {
+    int file_descriptor = posix_fileDescriptor(handle);
+    u8 *bytes = (u8*)out;
+    ssize_t bytes_written;
 
-        previous_position = current_position;
-        local_previous_position = local_position;
+    while (size) {
+        bytes_written = write(file_descriptor, bytes, size);
+        if (bytes_written <= 0) {
+#ifndef NDEBUG
+            DisplayError("write");
+            printf("Terminal failure: Unable to write to file.\n");
+#endif
+            return false;
+        }
+        bytes += bytes_written;
+        size -= (unsigned long)bytes_written;
     }
+    return true;
 }
 
+timespec monotonic_time;
 
-void drawGrid(const Grid &grid, const Transform &transform, const Viewport &viewport, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
-    static Grid view_space_grid;
+void os::setWindowTitle(char* str) {
+    window::title = str;
+}
 
-    // Transform vertices positions from local-space to world-space and then to view-space:
-    for (u8 segment = 0; segment < grid.u_segments; segment++) {
-        view_space_grid.vertices.u.from[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.u.from[segment])));
-        view_space_grid.vertices.u.to[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.u.to[segment])));
-    }
-    for (u8 segment = 0; segment < grid.v_segments; segment++) {
-        view_space_grid.vertices.v.from[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.v.from[segment])));
-        view_space_grid.vertices.v.to[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.v.to[segment])));
-    }
+void os::setCursorVisibility(bool on) {}
+void os::setWindowCapture(bool on) {}
 
-    // Distribute transformed vertices positions to edges:
-    view_space_grid.edges.update(view_space_grid.vertices, grid.u_segments, grid.v_segments);
+u64 timers::getTicks() {
+    clock_gettime(CLOCK_MONOTONIC, &monotonic_time);
+    return (u64)monotonic_time.tv_sec * 1000000000ULL + (u64)monotonic_time.tv_nsec;
+}
 
-    for (u8 u = 0; u < grid.u_segments; u++) drawEdge(view_space_grid.edges.u.edges[u], viewport, color, opacity, line_width);
-    for (u8 v = 0; v < grid.v_segments; v++) drawEdge(view_space_grid.edges.v.edges[v], viewport, color, opacity, line_width);
+void* os::getMemory(u64 size, u64 base) {
+    // The base address is only a hint (as with VirtualAlloc, the mapping may not be placed there):
+    void *address = mmap((void*)base, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return address == MAP_FAILED ? nullptr : address;
 }
 
+void os::freeMemory(void *address, u64 size) { munmap(address, (size_t)size); }
 
+void os::closeFile(void *handle) { return posix_closeFile(handle); }
+void* os::openFileForReading(const char* path) { return posix_openFileForReading(path); }
+void* os::openFileForWriting(const char* path) { return posix_openFileForWriting(path); }
+bool os::readFromFile(void *out, unsigned long size, void *handle) { return posix_readFromFile(out, size, handle); }
+bool os::writeToFile(void *out, unsigned long size, void *handle) { return posix_writeToFile(out, size, handle); }
 
-void drawMesh(const Mesh &mesh, const Transform &transform, bool draw_normals, const Viewport &viewport,
-              const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
-    const Camera &cam = *viewport.camera;
-    vec3 pos;
-    Edge edge;
-    EdgeVertexIndices *edge_index = mesh.edge_vertex_indices;
-    for (u32 i = 0; i < mesh.edge_count; i++, edge_index++) {
-        edge.from = cam.internPos(transform.externPos(mesh.vertex_positions[edge_index->from]));
-        edge.to   = cam.internPos(transform.externPos(mesh.vertex_positions[edge_index->to]));
-        drawEdge(edge, viewport, color, opacity, line_width);
-    }
+struct PosixThread {
+    os::ThreadFunction function;
+    void *data;
+};
 
-    if (draw_normals && mesh.normals_count && mesh.vertex_normals && mesh.vertex_normal_indices) {
-        TriangleVertexIndices *normal_index = mesh.vertex_normal_indices;
-        TriangleVertexIndices *position_index = mesh.vertex_position_indices;
-        for (u32 t = 0; t < mesh.triangle_count; t++, normal_index++, position_index++) {
-            for (u8 i = 0; i < 3; i++) {
-                pos = mesh.vertex_positions[position_index->ids[i]];
-                edge.to = mesh.vertex_normals[normal_index->ids[i]] * 0.1f + pos;
-                edge.from = cam.internPos(transform.externPos(pos));
-                edge.to = cam.internPos(transform.externPos(edge.to));
-                drawEdge(edge, viewport, Red, opacity * 0.5f, line_width);
-            }
-        }
+void* posix_runThread(void *param) {
+    PosixThread thread = *(PosixThread*)param;
+    free(param);
+    thread.function(thread.data);
+    return nullptr;
+}
+
+u32 os::getProcessorCount() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+void* os::createThread(ThreadFunction function, void *data) {
+    PosixThread *thread = (PosixThread*)malloc(sizeof(PosixThread));
+    pthread_t *handle = (pthread_t*)malloc(sizeof(pthread_t));
+    if (!thread || !handle) {
+        free(thread);
+        free(handle);
+        return nullptr;
+    }
+    thread->function = function;
+    thread->data = data;
+    if (pthread_create(handle, nullptr, posix_runThread, thread)) {
+        free(thread);
+        free(handle);
+        return nullptr;
     }
+    return handle;
 }
-void drawBVH(const BVH &bvh, const Transform &transform, const Viewport &viewport,
-               u16 min_depth = 0, u16 max_depth = 5, f32 opacity = 0.25f, u8 line_width = 1) {
-    static Box box;
-    static Transform box_transform;
 
-    for (u32 node_id = 0; node_id < bvh.node_count; node_id++) {
-        BVHNode &node = bvh.nodes[node_id];
-        if (node.depth < min_depth || node.depth > max_depth)
-            continue;
+void os::joinThread(void *handle) {
+    pthread_join(*(pthread_t*)handle, nullptr);
+    free(handle);
+}
 
-        box_transform = transform;
-        box_transform.scale *= (node.aabb.max - node.aabb.min) * 0.5f;
-        box_transform.position = transform.externPos((node.aabb.min + node.aabb.max) * 0.5f);
+void os::yieldThread() { sched_yield(); }
 
-        drawBox(box, box_transform, viewport, node.leaf_count ? BrightMagenta : (node_id ? BrightGreen : BrightCyan),
-                opacity, line_width);
+void* os::createSemaphore(u32 initial_count) {
+    sem_t *semaphore = (sem_t*)malloc(sizeof(sem_t));
+    if (semaphore && sem_init(semaphore, 0, (unsigned int)initial_count)) {
+        free(semaphore);
+        return nullptr;
     }
+    return semaphore;
 }
 
-void drawSelection(Selection &selection, const Viewport &viewport, const Scene &scene) {
-    static Box box;
+void os::destroySemaphore(void *handle) {
+    sem_destroy((sem_t*)handle);
+    free(handle);
+}
 
-    if (controls::is_pressed::alt && !mouse::is_captured && selection.geo_type && selection.geometry) {
-        selection.xform = selection.geometry->transform;
-        if (selection.geometry->type == GeometryType_Mesh)
-            selection.xform.scale *= scene.meshes[selection.geometry->id].aabb.max;
+void os::signalSemaphore(void *handle, u32 count) {
+    for (u32 i = 0; i < count; i++) sem_post((sem_t*)handle);
+}
 
-        drawBox(box, selection.xform, viewport, Yellow, 0.5f, 0);
-        if (selection.box_side) {
-            ColorID color = White;
-            switch (selection.box_side) {
-                case BoxSide_Left:  case BoxSide_Right: color = Red;   break;
-                case BoxSide_Top:   case BoxSide_Bottom: color = Green; break;
-                case BoxSide_Front: case BoxSide_Back: color = Blue;  break;
-                case BoxSide_None: break;
-            }
+void os::waitOnSemaphore(void *handle) {
+    while (sem_wait((sem_t*)handle) == -1 && errno == EINTR) {}
+}
 
-            drawBox(box, selection.xform, viewport, color, 0.5f, 1, selection.box_side);
-        }
-    }
+u32 os::atomicLoad(volatile u32 *value) { return __atomic_load_n(value, __ATOMIC_SEQ_CST); }
+void os::atomicStore(volatile u32 *value, u32 new_value) { __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST); }
+u32 os::atomicAdd(volatile u32 *value, u32 amount) { return __atomic_fetch_add(value, amount, __ATOMIC_SEQ_CST); }
+u32 os::atomicSubtract(volatile u32 *value, u32 amount) { return __atomic_fetch_sub(value, amount, __ATOMIC_SEQ_CST); }
+u32 os::atomicExchange(volatile u32 *value, u32 new_value) { return __atomic_exchange_n(value, new_value, __ATOMIC_SEQ_CST); }
+
+#endif
+
+#include <stdio.h>
+
+#ifndef HEADLESS_DEFAULT_FRAME_COUNT
+#define HEADLESS_DEFAULT_FRAME_COUNT 100
+#endif
+
+// A window-less driver: Runs the app's update/render loop for a fixed number of frames,
+// rendering into the off-screen window content, then reports the average timings.
+// Usage: <app> [--frames=N] [--width=W] [--height=H]
+
+SlimApp *CURRENT_APP;
+
+bool parseArgument(const char *arg, const char *prefix, u32 &value) {
+    const char *c = arg;
+    while (*prefix) if (*(c++) != *(prefix++)) return false;
+    if (*c < '0' || *c > '9') return false;
+
+    value = 0;
+    while (*c >= '0' && *c <= '9') value = value * 10 + (u32)(*(c++) - '0');
+    return true;
 }
 
+int main(int argc, char *argv[]) {
+    void* window_content_and_canvas_memory = os::getMemory(WINDOW_CONTENT_SIZE + (CANVAS_SIZE * CANVAS_COUNT));
+    if (!window_content_and_canvas_memory)
+        return -1;
 
-struct SlimApp {
-    timers::Timer update_timer, render_timer;
-    bool is_running{true};
+    window::content = (u32*)window_content_and_canvas_memory;
+    memory::canvas_memory = (u8*)window_content_and_canvas_memory + WINDOW_CONTENT_SIZE;
 
-    virtual void OnWindowResize(u16 width, u16 height) {};
-    virtual void OnKeyChanged(  u8 key, bool pressed) {};
-    virtual void OnMouseButtonUp(  mouse::Button &mouse_button) {};
-    virtual void OnMouseButtonDown(mouse::Button &mouse_button) {};
-    virtual void OnMouseButtonDoubleClicked(mouse::Button &mouse_button) {};
-    virtual void OnMouseWheelScrolled(f32 amount) {};
-    virtual void OnMousePositionSet(i32 x, i32 y) {};
-    virtual void OnMouseMovementSet(i32 x, i32 y) {};
-    virtual void OnMouseRawMovementSet(i32 x, i32 y) {};
-    virtual void OnRender() {};
-    virtual void OnUpdate(f32 delta_time) {};
-    virtual void OnWindowRedraw() {
-        update_timer.beginFrame();
-        OnUpdate(update_timer.delta_time);
-        update_timer.endFrame();
+    timers::ticks_per_second = 1000000000;
+    timers::seconds_per_tick = 1.0 / (f64)(timers::ticks_per_second);
+    timers::milliseconds_per_tick = 1000.0 * timers::seconds_per_tick;
+    timers::microseconds_per_tick = 1000.0 * timers::milliseconds_per_tick;
+    timers::nanoseconds_per_tick  = 1000.0 * timers::microseconds_per_tick;
 
-        render_timer.beginFrame();
-        OnRender();
-        render_timer.endFrame();
-    };
+    u32 frame_count = HEADLESS_DEFAULT_FRAME_COUNT;
+    u32 width = 0;
+    u32 height = 0;
+    for (int i = 1; i < argc; i++)
+        if (!parseArgument(argv[i], "--frames=", frame_count) &&
+            !parseArgument(argv[i], "--width=", width) &&
+            !parseArgument(argv[i], "--height=", height)) {
+            printf("Unknown argument: %s\nUsage: %s [--frames=N] [--width=W] [--height=H]\n", argv[i], argv[0]);
+            return 1;
+        }
 
-    void resize(u16 width, u16 height) {
-        window::width = width;
-        window::height = height;
-        OnWindowResize(width, height);
-        OnWindowRedraw();
+    CURRENT_APP = createApp();
+    if (!CURRENT_APP->is_running)
+        return -1;
+
+    if (width) window::width = (u16)(width < MAX_WIDTH ? width : MAX_WIDTH);
+    if (height) window::height = (u16)(height < MAX_HEIGHT ? height : MAX_HEIGHT);
+    CURRENT_APP->resize(window::width, window::height);
+
+    u64 update_ticks = 0;
+    u64 render_ticks = 0;
+    u64 start_ticks = timers::getTicks();
+    u32 frame = 0;
+    for (; frame < frame_count && CURRENT_APP->is_running; frame++) {
+        CURRENT_APP->OnWindowRedraw();
+        mouse::resetChanges();
+
+        update_ticks += CURRENT_APP->update_timer.ticks_after - CURRENT_APP->update_timer.ticks_before;
+        render_ticks += CURRENT_APP->render_timer.ticks_after - CURRENT_APP->render_timer.ticks_before;
     }
-};
+    u64 total_ticks = timers::getTicks() - start_ticks;
 
-SlimApp* createApp();
+    if (frame) {
+        f64 frames = (f64)frame;
+        printf("%s: %lux%lu, %lu frames in %.3f ms\n", argv[0], (unsigned long)window::width, (unsigned long)window::height,
+               (unsigned long)frame, (f64)total_ticks * timers::milliseconds_per_tick);
+        printf("Update: %.3f us/frame\n", (f64)update_ticks * timers::microseconds_per_tick / frames);
+        printf("Render: %.3f us/frame\n", (f64)render_ticks * timers::microseconds_per_tick / frames);
+    }
 
+    return 0;
+}
 
-#ifdef __linux__
-//linux code goes here
-#elif _WIN32
+#else
 
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
@@ -8492,7 +12121,6 @@ bool win32_writeToFile(LPVOID out, DWORD size, HANDLE handle) {
     return result != FALSE;
 }
 
-
 HWND window_handle;
 LARGE_INTEGER performance_counter;
 
@@ -8519,12 +12147,59 @@ void* os::getMemory(u64 size, u64 base) {
     return VirtualAlloc((LPVOID)base, (SIZE_T)size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
 }
 
+void os::freeMemory(void *address, u64 size) { VirtualFree(address, 0, MEM_RELEASE); }
+
 void os::closeFile(void *handle) { return win32_closeFile(handle); }
 void* os::openFileForReading(const char* path) { return win32_openFileForReading(path); }
 void* os::openFileForWriting(const char* path) { return win32_openFileForWriting(path); }
 bool os::readFromFile(LPVOID out, DWORD size, HANDLE handle) { return win32_readFromFile(out, size, handle); }
 bool os::writeToFile(LPVOID out, DWORD size, HANDLE handle) { return win32_writeToFile(out, size, handle); }
 
+struct Win32Thread {
+    os::ThreadFunction function;
+    void *data;
+};
+
+DWORD WINAPI win32_runThread(LPVOID param) {
+    Win32Thread *thread = (Win32Thread*)param;
+    thread->function(thread->data);
+    HeapFree(GetProcessHeap(), 0, thread);
+    return 0;
+}
+
+u32 os::getProcessorCount() {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return (u32)system_info.dwNumberOfProcessors;
+}
+
+void* os::createThread(ThreadFunction function, void *data) {
+    Win32Thread *thread = (Win32Thread*)HeapAlloc(GetProcessHeap(), 0, sizeof(Win32Thread));
+    if (!thread) return nullptr;
+    thread->function = function;
+    thread->data = data;
+    HANDLE handle = CreateThread(nullptr, 0, win32_runThread, thread, 0, nullptr);
+    if (!handle) HeapFree(GetProcessHeap(), 0, thread);
+    return handle;
+}
+
+void os::joinThread(void *handle) {
+    WaitForSingleObject((HANDLE)handle, INFINITE);
+    CloseHandle((HANDLE)handle);
+}
+
+void os::yieldThread() { SwitchToThread(); }
+
+void* os::createSemaphore(u32 initial_count) { return CreateSemaphoreA(nullptr, (LONG)initial_count, 0x7FFFFFFF, nullptr); }
+void os::destroySemaphore(void *handle) { CloseHandle((HANDLE)handle); }
+void os::signalSemaphore(void *handle, u32 count) { ReleaseSemaphore((HANDLE)handle, (LONG)count, nullptr); }
+void os::waitOnSemaphore(void *handle) { WaitForSingleObject((HANDLE)handle, INFINITE); }
+
+u32 os::atomicLoad(volatile u32 *value) { return (u32)InterlockedCompareExchange((volatile LONG*)value, 0, 0); }
+void os::atomicStore(volatile u32 *value, u32 new_value) { InterlockedExchange((volatile LONG*)value, (LONG)new_value); }
+u32 os::atomicAdd(volatile u32 *value, u32 amount) { return (u32)InterlockedExchangeAdd((volatile LONG*)value, (LONG)amount); }
+u32 os::atomicSubtract(volatile u32 *value, u32 amount) { return (u32)InterlockedExchangeAdd((volatile LONG*)value, -(LONG)amount); }
+u32 os::atomicExchange(volatile u32 *value, u32 new_value) { return (u32)InterlockedExchange((volatile LONG*)value, (LONG)new_value); }
 
 #define GET_X_LPARAM(lp)                        ((int)(short)LOWORD(lp))
 #define GET_Y_LPARAM(lp)                        ((int)(short)HIWORD(lp))
@@ -8555,8 +12230,6 @@ inline bool hasRawMouseInput(LPARAM lParam) {
     );
 }
 
-
-
 SlimApp *CURRENT_APP;
 
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
@@ -8783,4 +12456,4 @@ int APIENTRY WinMain(HINSTANCE hInstance,
     return 0;
 }
 
-#endif
\ No newline at end of file
+#endif
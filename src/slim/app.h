@@ -38,4 +38,8 @@ struct SlimApp {
 
 SlimApp* createApp();
 
-#include "./platforms/win32.h"
\ No newline at end of file
+#if defined(SLIM_HEADLESS) || !defined(_WIN32)
+#include "./platforms/headless.h"
+#else
+#include "./platforms/win32.h"
+#endif
\ No newline at end of file
@@ -101,10 +101,15 @@
 
 typedef unsigned char      u8;
 typedef unsigned short     u16;
-typedef unsigned long int  u32;
 typedef unsigned long long u64;
 typedef signed   short     i16;
+#if defined(__LP64__) // A 'long' is 64 bits wide on LP64 platforms (Linux, macOS)
+typedef unsigned int       u32;
+typedef signed   int       i32;
+#else
+typedef unsigned long int  u32;
 typedef signed   long int  i32;
+#endif
 
 typedef float  f32;
 typedef double f64;
@@ -867,6 +872,64 @@ struct Pixel {
     }
 };
 
+// Conversions between single and half precision floats (rounding to the nearest, with infinities and NaNs kept):
+INLINE_XPU u16 toHalf(f32 value) {
+    union { f32 f; u32 u; } bits{value};
+    u32 sign = bits.u & 0x80000000u;
+    bits.u ^= sign;
+
+    u16 half;
+    if (bits.u >= (143u << 23)) // Too large (or already infinite or NaN)
+        half = bits.u > (255u << 23) ? 0x7E00 : 0x7C00;
+    else if (bits.u < (113u << 23)) { // Too small to be normalized (or zero): Let the adder round the mantissa
+        union { u32 u; f32 f; } magic{126u << 23};
+        bits.f += magic.f;
+        half = (u16)(bits.u - magic.u);
+    } else {
+        u32 odd_mantissa = (bits.u >> 13) & 1;
+        bits.u += (((u32)(15 - 127)) << 23) + 0xFFF + odd_mantissa;
+        half = (u16)(bits.u >> 13);
+    }
+
+    return half | (u16)(sign >> 16);
+}
+
+INLINE_XPU f32 fromHalf(u16 half) {
+    union { u32 u; f32 f; } bits{((u32)half & 0x7FFF) << 13};
+    u32 exponent = bits.u & (0x7C00u << 13);
+    bits.u += (127u - 15u) << 23;
+    if (exponent == (0x7C00u << 13)) // Infinite or NaN
+        bits.u += (128u - 16u) << 23;
+    else if (exponent == 0) { // Zero or not normalized
+        union { u32 u; f32 f; } magic{113u << 23};
+        bits.u += 1u << 23;
+        bits.f -= magic.f;
+    }
+    bits.u |= ((u32)half & 0x8000) << 16;
+
+    return bits.f;
+}
+
+// A pixel in half precision (half the size of a Pixel), for canvases that trade precision for memory bandwidth:
+struct HalfPixel {
+    u16 r, g, b, opacity;
+
+    INLINE_XPU HalfPixel(u16 r = 0, u16 g = 0, u16 b = 0, u16 opacity = 0) : r{r}, g{g}, b{b}, opacity{opacity} {}
+    INLINE_XPU HalfPixel(const Pixel &pixel) :
+        r{toHalf(pixel.color.r)},
+        g{toHalf(pixel.color.g)},
+        b{toHalf(pixel.color.b)},
+        opacity{toHalf(pixel.opacity)} {}
+
+    INLINE_XPU Pixel toPixel() const {
+        return {fromHalf(r), fromHalf(g), fromHalf(b), fromHalf(opacity)};
+    }
+};
+
+// For code that reads pixels of either precision:
+INLINE_XPU const Pixel& toPixel(const Pixel &pixel) { return pixel; }
+INLINE_XPU Pixel toPixel(const HalfPixel &pixel) { return pixel.toPixel(); }
+
 struct TiledGridDimensions {
     u32 width = 0;
     u32 height = 0;
@@ -1061,6 +1124,7 @@ namespace controls {
 
 namespace os {
     void* getMemory(u64 size, u64 base = 0);
+    void freeMemory(void *address, u64 size);
     void setWindowTitle(char* str);
     void setWindowCapture(bool on);
     void setCursorVisibility(bool on);
@@ -1069,6 +1133,24 @@ namespace os {
     void* openFileForWriting(const char* file_path);
     bool readFromFile(void *out, unsigned long, void *handle);
     bool writeToFile(void *out, unsigned long, void *handle);
+
+    typedef void (*ThreadFunction)(void *data);
+    u32 getProcessorCount();
+    void* createThread(ThreadFunction function, void *data);
+    void joinThread(void *handle);
+    void yieldThread();
+    void* createSemaphore(u32 initial_count = 0);
+    void destroySemaphore(void *handle);
+    void signalSemaphore(void *handle, u32 count = 1);
+    void waitOnSemaphore(void *handle);
+
+    // Atomic operations on values shared across threads (each one is a full memory barrier).
+    // Adding and exchanging return the value from before the operation:
+    u32 atomicLoad(volatile u32 *value);
+    void atomicStore(volatile u32 *value, u32 new_value);
+    u32 atomicAdd(volatile u32 *value, u32 amount);
+    u32 atomicSubtract(volatile u32 *value, u32 amount);
+    u32 atomicExchange(volatile u32 *value, u32 new_value);
 }
 
 namespace timers {
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "../math/vec3.h"
+#include "../math/mat3.h"
 
 enum RayIsFacing {
     RayIsFacing_Left = 1,
@@ -8,10 +8,17 @@ enum RayIsFacing {
     RayIsFacing_Back = 4
 };
 
+// Nearest-hit finds the closest intersection, while any-hit stops at the first one found (i.e: for visibility):
+enum RayHitMode {
+    RayHitMode_Nearest,
+    RayHitMode_Any
+};
+
 struct RayHit {
     vec3 position, normal;
     f32 distance, distance_squared;
     u32 geo_id;
+    u32 triangle_index = 0;
     enum GeometryType geo_type = GeometryType_None;
     bool from_behind = false;
 };
@@ -85,6 +92,64 @@ struct Ray {
         return side;
     }
 
+    // Slab test against an axis-aligned box, given the reciprocal of the direction (shared by all boxes of a traversal).
+    // The distance is where the ray enters the box (0 when it starts inside it):
+    INLINE_XPU bool hitsAABB(const AABB &aabb, const vec3 &RD_rcp, f32 max_distance, f32 &distance) const {
+        vec3 min_t{(aabb.min - origin) * RD_rcp};
+        vec3 max_t{(aabb.max - origin) * RD_rcp};
+        f32 near_t = minimum(min_t, max_t).maximum();
+        f32 far_t  = maximum(min_t, max_t).minimum();
+        distance = near_t > 0 ? near_t : 0;
+        return distance <= far_t && distance < max_distance;
+    }
+
+    // Intersects a triangle through its tangent-space matrix (see Triangle::local_to_tangent), which maps the ray's
+    // origin and direction relative to the triangle's position into (u, v, height above the triangle's plane):
+    INLINE_XPU bool hitsTriangle(const mat3 &local_to_tangent, const vec3 &position, f32 max_distance, f32 &distance) {
+        vec3 tangent_origin = local_to_tangent * (origin - position);
+        vec3 tangent_direction = local_to_tangent * direction;
+        if (tangent_direction.z == 0) // The ray is parallel to the triangle
+            return false;
+
+        f32 t = -tangent_origin.z / tangent_direction.z;
+        if (t <= 0 || t >= max_distance)
+            return false;
+
+        f32 u = tangent_origin.x + t * tangent_direction.x;
+        f32 v = tangent_origin.y + t * tangent_direction.y;
+        if (u < 0 || v < 0 || u + v > 1)
+            return false;
+
+        distance = t;
+        hit.from_behind = tangent_origin.z < 0;
+        return true;
+    }
+
+    // As above for a compact triangle, which only has the rows of the matrix that give u and v:
+    // The distance is then found against the triangle's plane directly.
+    INLINE_XPU bool hitsTriangle(const vec3 &tangent_u, const vec3 &tangent_v, const vec3 &position, const vec3 &normal,
+                                 f32 max_distance, f32 &distance) {
+        f32 NdotRd = normal.dot(direction);
+        if (NdotRd == 0) // The ray is parallel to the triangle
+            return false;
+
+        vec3 RoP = position - origin;
+        f32 NdotRoP = normal.dot(RoP);
+        f32 t = NdotRoP / NdotRd;
+        if (t <= 0 || t >= max_distance)
+            return false;
+
+        vec3 P = direction.scaleAdd(t, -RoP);
+        f32 u = tangent_u.dot(P);
+        f32 v = tangent_v.dot(P);
+        if (u < 0 || v < 0 || u + v > 1)
+            return false;
+
+        distance = t;
+        hit.from_behind = NdotRoP > 0;
+        return true;
+    }
+
     INLINE_XPU bool hitsPlane(const vec3 &P, const vec3 &N) {
         f32 NdotRd = N.dot(direction);
         if (NdotRd == 0) // The ray is parallel to the plane
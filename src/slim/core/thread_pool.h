@@ -0,0 +1,197 @@
+#pragma once
+
+#include "./base.h"
+
+#define THREAD_POOL__MAX_THREAD_COUNT 64
+#define THREAD_POOL__QUEUE_CAPACITY 4096 // Must be a power of 2
+
+// Jobs are given the index of the thread running them, for indexing into per-thread scratch memory.
+// Index 0 is the thread that created the pool, which runs jobs itself while waiting on them.
+// Counters and flags shared across threads are only accessed through the platform's atomic operations.
+typedef void (*JobFunction)(void *data, u32 thread_index);
+typedef void (*RangeJobFunction)(void *data, u32 start, u32 end, u32 thread_index);
+
+struct JobGroup {
+    volatile u32 pending{0};
+};
+
+struct Job {
+    JobFunction function;
+    void *data;
+    JobGroup *group;
+};
+
+// Each thread pushes and pops jobs at the back of its own queue (depth first, so recently touched memory),
+// while idle threads steal from the front of other threads' queues (where the larger, earlier jobs are).
+struct JobQueue {
+    Job *jobs{nullptr};
+    u32 front{0};
+    u32 back{0};
+    volatile u32 lock{0};
+
+    INLINE void acquire() { while (os::atomicExchange(&lock, 1)) {} }
+    INLINE void release() { os::atomicStore(&lock, 0); }
+
+    bool push(const Job &job) {
+        acquire();
+        bool pushed = back - front < THREAD_POOL__QUEUE_CAPACITY;
+        if (pushed) jobs[(back++) & (THREAD_POOL__QUEUE_CAPACITY - 1)] = job;
+        release();
+        return pushed;
+    }
+
+    bool pop(Job &job) {
+        acquire();
+        bool popped = back != front;
+        if (popped) job = jobs[(--back) & (THREAD_POOL__QUEUE_CAPACITY - 1)];
+        release();
+        return popped;
+    }
+
+    bool steal(Job &job) {
+        acquire();
+        bool stolen = back != front;
+        if (stolen) job = jobs[(front++) & (THREAD_POOL__QUEUE_CAPACITY - 1)];
+        release();
+        return stolen;
+    }
+};
+
+struct ThreadPool {
+    struct Worker {
+        ThreadPool *pool;
+        void *thread;
+        u32 thread_index;
+    };
+
+    JobQueue queues[THREAD_POOL__MAX_THREAD_COUNT];
+    Worker workers[THREAD_POOL__MAX_THREAD_COUNT];
+    Job *jobs{nullptr};
+    u64 jobs_size{0};
+    void *semaphore{nullptr};
+    u32 thread_count{1};
+    volatile u32 is_running{0};
+
+    // A thread count of 0 uses one thread per processor (the calling thread counts as one of them):
+    explicit ThreadPool(u32 ThreadCount = 0) {
+        if (!ThreadCount) ThreadCount = os::getProcessorCount();
+        if (ThreadCount > THREAD_POOL__MAX_THREAD_COUNT) ThreadCount = THREAD_POOL__MAX_THREAD_COUNT;
+        if (!ThreadCount) ThreadCount = 1;
+
+        jobs_size = sizeof(Job) * THREAD_POOL__QUEUE_CAPACITY * ThreadCount;
+        jobs = (Job*)os::getMemory(jobs_size);
+        if (!jobs) return;
+        for (u32 i = 0; i < ThreadCount; i++) queues[i].jobs = jobs + THREAD_POOL__QUEUE_CAPACITY * i;
+
+        semaphore = ThreadCount > 1 ? os::createSemaphore() : nullptr;
+        if (ThreadCount > 1 && !semaphore) ThreadCount = 1;
+
+        // A worker that failed to start just leaves its queue empty, as only a thread pushes into its own queue:
+        os::atomicStore(&is_running, 1);
+        thread_count = ThreadCount;
+        for (u32 i = 1; i < thread_count; i++) {
+            Worker &worker = workers[i];
+            worker.pool = this;
+            worker.thread_index = i;
+            worker.thread = os::createThread(runWorker, &worker);
+        }
+    }
+
+    ~ThreadPool() { stop(); }
+
+    // Joins the workers and frees the queues (any jobs submitted afterwards just run on the submitting thread):
+    void stop() {
+        if (os::atomicExchange(&is_running, 0) && thread_count > 1) {
+            os::signalSemaphore(semaphore, thread_count - 1);
+            for (u32 i = 1; i < thread_count; i++) if (workers[i].thread) os::joinThread(workers[i].thread);
+            os::destroySemaphore(semaphore);
+            semaphore = nullptr;
+        }
+        thread_count = 1;
+
+        if (jobs) {
+            for (JobQueue &queue : queues) queue.jobs = nullptr;
+            os::freeMemory(jobs, jobs_size);
+            jobs = nullptr;
+        }
+    }
+
+    void submit(JobFunction function, void *data, JobGroup &group, u32 thread_index) {
+        Job job{function, data, &group};
+        os::atomicAdd(&group.pending, 1);
+        if (queues[thread_index].jobs && queues[thread_index].push(job)) {
+            if (thread_count > 1) os::signalSemaphore(semaphore);
+        } else
+            runJob(job, thread_index); // The queue is full (or unavailable), so just run it right here
+    }
+
+    // Waiting threads keep running pending jobs (their own or stolen) until the whole group is done,
+    // yielding to the threads running the group's last jobs when there is nothing left to pick up:
+    void wait(JobGroup &group, u32 thread_index) {
+        while (os::atomicLoad(&group.pending))
+            if (!runPendingJob(thread_index))
+                os::yieldThread();
+    }
+
+    bool runPendingJob(u32 thread_index) {
+        Job job;
+        bool found = queues[thread_index].jobs && queues[thread_index].pop(job);
+        for (u32 i = 1; !found && i < thread_count; i++) {
+            JobQueue &queue = queues[(thread_index + i) % thread_count];
+            found = queue.jobs && queue.steal(job);
+        }
+        if (found) runJob(job, thread_index);
+        return found;
+    }
+
+    // Splits [0, count) into chunks that are handed out dynamically to as many threads as there are chunks.
+    // The calling thread runs chunks too, under its own thread index (the drawing and building code all calls
+    // this from the thread that created the pool, so passes 0):
+    void parallelFor(u32 count, u32 chunk_size, RangeJobFunction function, void *data, u32 thread_index) {
+        if (!count) return;
+        if (!chunk_size) chunk_size = 1;
+
+        ParallelFor parallel_for{function, data, count, chunk_size};
+        u32 chunk_count = (count + chunk_size - 1) / chunk_size;
+        u32 helper_count = (chunk_count < thread_count ? chunk_count : thread_count) - 1;
+
+        JobGroup group;
+        for (u32 i = 0; i < helper_count; i++) submit(runParallelFor, &parallel_for, group, thread_index);
+        runParallelFor(&parallel_for, thread_index);
+        wait(group, thread_index);
+    }
+
+    struct ParallelFor {
+        RangeJobFunction function;
+        void *data;
+        u32 count, chunk_size;
+        volatile u32 next{0};
+
+        ParallelFor(RangeJobFunction function, void *data, u32 count, u32 chunk_size) :
+            function{function}, data{data}, count{count}, chunk_size{chunk_size} {}
+    };
+
+    static void runParallelFor(void *data, u32 thread_index) {
+        ParallelFor &parallel_for = *(ParallelFor*)data;
+        for (u32 start = os::atomicAdd(&parallel_for.next, parallel_for.chunk_size);
+                 start < parallel_for.count;
+                 start = os::atomicAdd(&parallel_for.next, parallel_for.chunk_size)) {
+            u32 end = start + parallel_for.chunk_size;
+            if (end > parallel_for.count || end < start) end = parallel_for.count;
+            parallel_for.function(parallel_for.data, start, end, thread_index);
+        }
+    }
+
+    static void runJob(const Job &job, u32 thread_index) {
+        job.function(job.data, thread_index);
+        os::atomicSubtract(&job.group->pending, 1);
+    }
+
+    static void runWorker(void *data) {
+        Worker &worker = *(Worker*)data;
+        ThreadPool &pool = *worker.pool;
+        while (os::atomicLoad(&pool.is_running))
+            if (!pool.runPendingJob(worker.thread_index))
+                os::waitOnSemaphore(pool.semaphore);
+    }
+};
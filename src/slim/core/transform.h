@@ -66,7 +66,7 @@ INLINE_XPU AABB operator * (const AABB &aabb, const Transform &transform) {
 
     vec3 pos;
     for (const auto &vertex : vertices) {
-        pos = transform.internPos(vertex);
+        pos = transform.externPos(vertex);
 
         if (pos.x < min.x) min.x = pos.x;
         if (pos.y < min.y) min.y = pos.y;
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "./edge.h"
-#include "../scene/mesh.h"
+#include "./mesh.h"
 #include "../core/transform.h"
 #include "./box.h"
 
+// Draws the bounds of a BVH's nodes within a range of depths, as boxes. Nodes that are outside of the frustum or hidden
+// behind the viewport's depth pyramid (when set) are skipped. Each node is tested on its own, so that the drawing order
+// stays the same.
 void drawBVH(const BVH &bvh, const Transform &transform, const Viewport &viewport,
                u16 min_depth = 0, u16 max_depth = 5, f32 opacity = 0.25f, u8 line_width = 1) {
     static Box box;
@@ -15,6 +18,15 @@ void drawBVH(const BVH &bvh, const Transform &transform, const Viewport &viewpor
         if (node.depth < min_depth || node.depth > max_depth)
             continue;
 
+        if (viewport.depth_pyramid) {
+            vec3 corners[8];
+            for (u8 i = 0; i < 8; i++)
+                corners[i] = viewport.camera->internPos(transform.externPos({i & 1 ? node.aabb.max.x : node.aabb.min.x,
+                                                                             i & 2 ? node.aabb.max.y : node.aabb.min.y,
+                                                                             i & 4 ? node.aabb.max.z : node.aabb.min.z}));
+            if (viewport.depth_pyramid->isOccluded(corners, 8, viewport, line_width + 1)) continue;
+        }
+
         box_transform = transform;
         box_transform.scale *= (node.aabb.max - node.aabb.min) * 0.5f;
         box_transform.position = transform.externPos((node.aabb.min + node.aabb.max) * 0.5f);
@@ -22,4 +34,33 @@ void drawBVH(const BVH &bvh, const Transform &transform, const Viewport &viewpor
         drawBox(box, box_transform, viewport, node.leaf_count ? BrightMagenta : (node_id ? BrightGreen : BrightCyan),
                 opacity, line_width);
     }
-}
\ No newline at end of file
+}
+
+// Draws a mesh's BVH through the local-to-view transformation of its vertex cache (as last updated for the mesh),
+// so that the corners of the nodes' bounds skip the transform's and the camera's rotations.
+void drawBVH(const BVH &bvh, const MeshVertexCache &vertex_cache, const Viewport &viewport,
+             u16 min_depth = 0, u16 max_depth = 5, f32 opacity = 0.25f, u8 line_width = 1) {
+    static Box box;
+    static Box view_space_box;
+
+    for (u32 node_id = 0; node_id < bvh.node_count; node_id++) {
+        BVHNode &node = bvh.nodes[node_id];
+        if (node.depth < min_depth || node.depth > max_depth)
+            continue;
+
+        vec3 center = (node.aabb.min + node.aabb.max) * 0.5f;
+        vec3 half_size = (node.aabb.max - node.aabb.min) * 0.5f;
+        vec3 *corners = view_space_box.vertices.buffer;
+        for (u8 i = 0; i < BOX__VERTEX_COUNT; i++)
+            corners[i] = vertex_cache.toViewPos(center + half_size * box.vertices.buffer[i]);
+
+        Frustum::Containment containment = viewport.getContainment(corners, BOX__VERTEX_COUNT);
+        if (containment == Frustum::Containment::Outside) continue;
+        if (viewport.depth_pyramid && viewport.depth_pyramid->isOccluded(corners, BOX__VERTEX_COUNT, viewport, line_width + 1)) continue;
+
+        view_space_box.edges.setFrom(view_space_box.vertices);
+        Color color = node.leaf_count ? BrightMagenta : (node_id ? BrightGreen : BrightCyan);
+        for (const auto &edge : view_space_box.edges.buffer)
+            drawEdge(edge, viewport, color, opacity, line_width, containment == Frustum::Containment::Inside);
+    }
+}
@@ -1,6 +1,17 @@
 #pragma once
 
 #include "../core/base.h"
+#include "../math/simd.h"
+#include "../core/thread_pool.h"
+
+// Clearing a canvas whose pixels and depths are at least this large is done with streaming stores (bypassing the
+// caches, which such a canvas would not fit in anyway). Smaller canvases are cleared into the caches instead,
+// where the drawing that follows will find them:
+#ifndef CANVAS_STREAMING_CLEAR_MIN_SIZE
+#define CANVAS_STREAMING_CLEAR_MIN_SIZE Megabytes(4)
+#endif
+
+#define CANVAS_RESOLVE_ROWS_PER_JOB 16
 
 enum AntiAliasing {
     NoAA,
@@ -8,16 +19,55 @@ enum AntiAliasing {
     SSAA
 };
 
+// Full precision pixels are 4 floats (16 bytes), half precision ones are 4 half floats (8 bytes).
+// Half precision halves the memory traffic of clearing, drawing and resolving, at the cost of some precision
+// (which colors stored in linear space can afford, unlike 8-bit ones that would band in the darks):
+enum PixelPrecision {
+    FullPrecision,
+    HalfPrecision
+};
+
+// Fills a canvas's pixels or depths with a value, 16 bytes at a time (using streaming stores when asked to):
+template <typename T>
+void _fillCanvasMemory(T *values, u32 count, const T &value, bool streaming) {
+    static_assert(16 % sizeof(T) == 0, "Canvas memory is filled 16 bytes at a time");
+    constexpr u32 values_per_store = 16 / sizeof(T);
+
+    while (count && ((size_t)values & 15)) {
+        *values++ = value;
+        count--;
+    }
+
+    T pattern[values_per_store];
+    for (u32 i = 0; i < values_per_store; i++) pattern[i] = value;
+    simd4_f32 pattern_vector = simd::load4((f32*)pattern);
+
+    u32 store_count = count / values_per_store;
+    f32 *out = (f32*)values;
+    if (streaming) {
+        for (u32 i = 0; i < store_count; i++, out += 4) simd::stream4(out, pattern_vector);
+        simd::streamFence();
+    } else
+        for (u32 i = 0; i < store_count; i++, out += 4) simd::store4(out, pattern_vector);
+
+    values += store_count * values_per_store;
+    for (u32 i = store_count * values_per_store; i < count; i++) *values++ = value;
+}
+
 struct Canvas {
     Dimensions dimensions;
     Pixel *pixels{nullptr};
+    HalfPixel *half_pixels{nullptr}; // Instead of pixels, for canvases of half precision
     f32 *depths{nullptr};
 
     AntiAliasing antialias;
 
-    Canvas(u16 width = MAX_WIDTH, u16 height = MAX_HEIGHT, AntiAliasing antialiasing = NoAA) : antialias{antialiasing} {
+    Canvas(u16 width = MAX_WIDTH, u16 height = MAX_HEIGHT, AntiAliasing antialiasing = NoAA, PixelPrecision precision = FullPrecision) : antialias{antialiasing} {
         if (memory::canvas_memory_capacity) {
-            pixels = (Pixel*)memory::canvas_memory;
+            if (precision == HalfPrecision)
+                half_pixels = (HalfPixel*)memory::canvas_memory;
+            else
+                pixels = (Pixel*)memory::canvas_memory;
             memory::canvas_memory += CANVAS_PIXELS_SIZE;
             memory::canvas_memory_capacity -= CANVAS_PIXELS_SIZE;
 
@@ -30,11 +80,22 @@ struct Canvas {
             dimensions.update(width, height);
         } else {
             pixels = nullptr;
+            half_pixels = nullptr;
             depths = nullptr;
         }
     }
 
     Canvas(Pixel *pixels, f32 *depths) noexcept : pixels{pixels}, depths{depths} {}
+    Canvas(HalfPixel *half_pixels, f32 *depths) noexcept : half_pixels{half_pixels}, depths{depths} {}
+
+    INLINE bool hasPixels() const { return pixels || half_pixels; }
+
+    // Pixels of either precision, by offset (in canvas samples):
+    INLINE Pixel loadPixel(u32 offset) const { return pixels ? pixels[offset] : half_pixels[offset].toPixel(); }
+    INLINE void storePixel(u32 offset, const Pixel &pixel) const {
+        if (pixels) pixels[offset] = pixel;
+        else half_pixels[offset] = HalfPixel{pixel};
+    }
 
     void clear(f32 red = 0, f32 green = 0, f32 blue = 0, f32 opacity = 1.0f, f32 depth = INFINITY) const {
         i32 pixels_width  = dimensions.width;
@@ -51,13 +112,36 @@ struct Canvas {
             }
         }
 
-        i32 pixels_count = pixels_width * pixels_height;
-        i32 depths_count = depths_width * depths_height;
+        u32 pixels_count = (u32)(pixels_width * pixels_height);
+        u32 depths_count = (u32)(depths_width * depths_height);
 
         Pixel pixel{red, green, blue, opacity};
 
-        if (pixels) for (i32 i = 0; i < pixels_count; i++) pixels[i] = pixel;
-        if (depths) for (i32 i = 0; i < depths_count; i++) depths[i] = depth;
+        u64 size = (u64)pixels_count * (half_pixels ? sizeof(HalfPixel) : sizeof(Pixel));
+        if (depths) size += (u64)depths_count * sizeof(f32);
+        bool streaming = size >= CANVAS_STREAMING_CLEAR_MIN_SIZE;
+
+        if (pixels) _fillCanvasMemory(pixels, pixels_count, pixel, streaming);
+        if (half_pixels) _fillCanvasMemory(half_pixels, pixels_count, HalfPixel{pixel}, streaming);
+        if (depths) _fillCanvasMemory(depths, depths_count, depth, streaming);
+    }
+
+    // Clears a rectangle of canvas pixels (inclusive bounds, with all sub-pixels of a pixel cleared with SSAA):
+    void clear(RectI bounds, f32 red = 0, f32 green = 0, f32 blue = 0, f32 opacity = 1.0f, f32 depth = INFINITY) const {
+        bounds -= RectI{0, dimensions.width - 1, 0, dimensions.height - 1};
+        if (!bounds) return;
+
+        Pixel pixel{red, green, blue, opacity};
+        HalfPixel half_pixel{pixel};
+        u32 pixels_per_pixel = antialias == SSAA ? 4 : 1;
+        u32 depths_per_pixel = antialias == NoAA ? 1 : 4;
+        u32 count = (u32)(bounds.right - bounds.left + 1);
+        for (i32 y = bounds.top; y <= bounds.bottom; y++) {
+            u32 offset = dimensions.stride * y + bounds.left;
+            if (pixels) _fillCanvasMemory(pixels + offset * pixels_per_pixel, count * pixels_per_pixel, pixel, false);
+            if (half_pixels) _fillCanvasMemory(half_pixels + offset * pixels_per_pixel, count * pixels_per_pixel, half_pixel, false);
+            if (depths) _fillCanvasMemory(depths + offset * depths_per_pixel, count * depths_per_pixel, depth, false);
+        }
     }
 
     void drawFrom(Canvas& source_canvas, const RectI* source_bounds = nullptr, const RectI* target_bounds = nullptr, f32 opacity = 1.0f, bool blend = true, bool include_depths = false) {
@@ -99,7 +183,7 @@ struct Canvas {
                                          source_canvas.dimensions.stride * src_y + src_x
                                  );
 
-                Pixel& pixel{ source_canvas.pixels[src_offset] };
+                Pixel pixel{source_canvas.loadPixel(src_offset)};
                 if ((pixel.opacity == 0.0f) || (
                         (pixel.color.r == 0.0f) &&
                         (pixel.color.g == 0.0f) &&
@@ -118,7 +202,7 @@ struct Canvas {
                     ) : (
                                              dimensions.stride * y + x
                                      );
-                    pixels[trg_offset] = source_canvas.pixels[src_offset];
+                    storePixel(trg_offset, pixel);
                     if (include_depths && depth < depths[trg_offset])
                         depths[trg_offset] = depth;
                 }
@@ -126,19 +210,12 @@ struct Canvas {
         }
     }
 
-    void drawToWindow() const {
-        u32 *content_value = window::content;
-        Pixel *pixel = pixels;
-        for (u16 y = 0; y < window::height; y++)
-            for (u16 x = 0; x < window::width; x++, content_value++) {
-                *content_value = getPixelContent(pixel);
-
-                if (antialias == SSAA)
-                    pixel += 4;
-                else
-                    pixel++;
-            }
-    }
+    // Resolves the canvas's pixels into the window's content (with the rows split across the pool's threads if given).
+    // Pixels are resolved 4 at a time: SSAA quads are averaged, and colors are converted from linear space and packed.
+    void drawToWindow(ThreadPool *thread_pool = nullptr) const;
+
+    // Resolves only a rectangle of the canvas's pixels (inclusive bounds) into the window's content:
+    void drawToWindow(RectI bounds) const;
 
     INLINE void setPixel(i32 x, i32 y, const Color &color, f32 opacity = 1.0f, f32 depth = 0, f32 z_top = 0, f32 z_bottom = 0, f32 z_right = 0) const {
         int w = dimensions.width;
@@ -151,13 +228,11 @@ struct Canvas {
             return;
 
         opacity = clampedValue(opacity);
-        Pixel pixel{color.clamped(), opacity};
-        pixel.color *= pixel.color;
-        if (opacity != 1.0f)
-            pixel.color *= pixel.opacity;
+        Pixel pixel{toCanvasPixel(color, opacity)};
 
         u32 offset = antialias == SSAA ? ((dimensions.stride * (y >> 1) + (x >> 1)) * 4 + (2 * (y & 1)) + (x & 1)) : (dimensions.stride * y + x);
-        Pixel *out_pixel = pixels + offset;
+        Pixel loaded_pixel{loadPixel(offset)};
+        Pixel *out_pixel = &loaded_pixel;
         f32 *out_depth = depths ? (depths + (antialias == MSAA ? offset * 4 : offset)) : nullptr;
         if (
                 (
@@ -175,7 +250,7 @@ struct Canvas {
                         (z_right == 0.0f)
                 )
                 ) {
-            *out_pixel = pixel;
+            storePixel(offset, pixel);
             if (depths) {
                 out_depth[0] = depth;
                 if (antialias == MSAA) out_depth[1] = out_depth[2] = out_depth[3] = 0;
@@ -195,19 +270,39 @@ struct Canvas {
                 }
                 accumulated_pixel += fg->opacity == 1 ? *fg : fg->alphaBlendOver(*bg);
             }
-            *out_pixel = accumulated_pixel * 0.25f;
+            storePixel(offset, accumulated_pixel * 0.25f);
         } else {
             if (depths)
                 _sortPixelsByDepth(depth, &pixel, out_depth, out_pixel, &bg, &fg);
-            *out_pixel = fg->opacity == 1 ? *fg : fg->alphaBlendOver(*bg);
+            storePixel(offset, fg->opacity == 1 ? *fg : fg->alphaBlendOver(*bg));
         }
     }
 
+    // Pixels are stored with their colors squared (as blending is done in linear space) and premultiplied by opacity:
+    static INLINE Pixel toCanvasPixel(const Color &color, f32 opacity) {
+        opacity = clampedValue(opacity);
+        Pixel pixel{color.clamped(), opacity};
+        pixel.color *= pixel.color;
+        if (opacity != 1.0f)
+            pixel.color *= pixel.opacity;
+
+        return pixel;
+    }
+
     INLINE u32 getPixelContent(Pixel *pixel) const {
         return antialias == SSAA ? _isTransparentPixelQuad(pixel) ? 0 : _blendPixelQuad(pixel).asContent() :
                pixel->opacity == 0.0f ? 0 : pixel->asContent();
     }
 
+    INLINE u32 getPixelContent(HalfPixel *half_pixel) const {
+        Pixel pixel_quad[4];
+        pixel_quad[0] = half_pixel[0].toPixel();
+        if (antialias == SSAA)
+            for (u8 i = 1; i < 4; i++) pixel_quad[i] = half_pixel[i].toPixel();
+
+        return getPixelContent(pixel_quad);
+    }
+
     INLINE void drawText(char *str, i32 x, i32 y, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
 #ifdef SLIM_VEC2
     INLINE void drawText(char *str, vec2i position, const Color &color = White, f32 opacity = 1.0f, const RectI *viewport_bounds = nullptr) const;
@@ -293,4 +388,197 @@ private:
             *foreground = out_pixel;
         }
     }
-};
\ No newline at end of file
+};
+
+
+// Writes pixels of flat (2D) drawing into a canvas the same way that setPixel does, but with the canvas's antialiasing,
+// whether it has depths and whether the pixels are opaque all resolved at compile time (so with no per-pixel checks).
+// Pixels are given as converted by Canvas::toCanvasPixel, at coordinates that are expected to be within the canvas.
+// As with setPixel, flat drawing leaves a depth of 0 behind it.
+template <AntiAliasing AA, bool HasDepths, bool Opaque, typename PixelStorage = Pixel>
+struct CanvasPixelWriter {
+    PixelStorage *pixels;
+    f32 *depths;
+    u32 stride;
+
+    // In canvas samples (sub-pixels with SSAA):
+    INLINE u32 offsetOf(i32 x, i32 y) const {
+        return AA == SSAA ? ((stride * (y >> 1) + (x >> 1)) * 4 + (2 * (y & 1)) + (x & 1)) : (stride * y + x);
+    }
+
+    INLINE void write(u32 offset, const Pixel &pixel) const {
+        PixelStorage *out_pixel = pixels + offset;
+        f32 *out_depth = HasDepths ? (depths + (AA == MSAA ? offset * 4 : offset)) : nullptr;
+
+        // Blend over what is there already, unless the pixel is opaque or there is nothing there yet:
+        if (!Opaque && pixel.opacity != 1.0f) {
+            Pixel background{toPixel(*out_pixel)};
+            if (!((!HasDepths || *out_depth == INFINITY) &&
+                  background.color.r == 0 &&
+                  background.color.g == 0 &&
+                  background.color.b == 0)) {
+                Pixel blended_pixel{pixel.alphaBlendOver(background)};
+                if (AA == MSAA) {
+                    Pixel accumulated_pixel{};
+                    for (u8 i = 0; i < 4; i++) accumulated_pixel += blended_pixel;
+                    *out_pixel = accumulated_pixel * 0.25f;
+                } else
+                    *out_pixel = blended_pixel;
+            } else
+                *out_pixel = pixel;
+        } else
+            *out_pixel = pixel;
+
+        if (HasDepths) {
+            out_depth[0] = 0;
+            if (AA == MSAA) out_depth[1] = out_depth[2] = out_depth[3] = 0;
+        }
+    }
+
+    INLINE void writeSample(i32 x, i32 y, const Pixel &pixel) const {
+        write(offsetOf(x, y), pixel);
+    }
+
+    // In canvas pixels (with SSAA, all 4 sub-pixels of a pixel are written, which are next to each other):
+    INLINE void writeHSpan(i32 first_x, i32 last_x, i32 y, const Pixel &pixel) const {
+        u32 offset = stride * y + first_x;
+        u32 end = offset + (last_x - first_x + 1);
+        if (AA == SSAA) {
+            offset *= 4;
+            end *= 4;
+        }
+        for (; offset < end; offset++) write(offset, pixel);
+    }
+
+    INLINE void writeVSpan(i32 x, i32 first_y, i32 last_y, const Pixel &pixel) const {
+        u32 offset = stride * first_y + x;
+        for (i32 y = first_y; y <= last_y; y++, offset += stride)
+            if (AA == SSAA)
+                for (u8 i = 0; i < 4; i++) write(offset * 4 + i, pixel);
+            else
+                write(offset, pixel);
+    }
+};
+
+template <AntiAliasing AA, typename PixelStorage, typename Draw>
+INLINE void _drawWithPixelWriter(PixelStorage *pixels, const Canvas &canvas, bool opaque, Draw &draw) {
+    f32 *depths = canvas.depths;
+    u32 stride = canvas.dimensions.stride;
+    if (depths) {
+        if (opaque) draw(CanvasPixelWriter<AA, true, true, PixelStorage>{pixels, depths, stride});
+        else        draw(CanvasPixelWriter<AA, true, false, PixelStorage>{pixels, depths, stride});
+    } else {
+        if (opaque) draw(CanvasPixelWriter<AA, false, true, PixelStorage>{pixels, depths, stride});
+        else        draw(CanvasPixelWriter<AA, false, false, PixelStorage>{pixels, depths, stride});
+    }
+}
+
+template <AntiAliasing AA, typename Draw>
+INLINE void _drawWithPixelWriter(const Canvas &canvas, bool opaque, Draw &draw) {
+    if (canvas.half_pixels)
+        _drawWithPixelWriter<AA>(canvas.half_pixels, canvas, opaque, draw);
+    else
+        _drawWithPixelWriter<AA>(canvas.pixels, canvas, opaque, draw);
+}
+
+// Calls the given drawing function with the pixel writer that matches the canvas (and the opacity of what is drawn).
+// The writer is picked once per drawn primitive, as the drawing function is compiled for each kind of writer.
+template <typename Draw>
+INLINE void drawWithPixelWriter(const Canvas &canvas, bool opaque, Draw &&draw) {
+    switch (canvas.antialias) {
+        case NoAA: _drawWithPixelWriter<NoAA>(canvas, opaque, draw); break;
+        case MSAA: _drawWithPixelWriter<MSAA>(canvas, opaque, draw); break;
+        case SSAA: _drawWithPixelWriter<SSAA>(canvas, opaque, draw); break;
+    }
+}
+
+
+INLINE simd4_f32 _loadPixelVector(const Pixel *pixel) { return simd::load4(pixel->color.components); }
+INLINE simd4_f32 _loadPixelVector(const HalfPixel *half_pixel) {
+    Pixel pixel{half_pixel->toPixel()};
+    return simd::load4(pixel.color.components);
+}
+
+// Resolves rows of canvas pixels into rows of window content (rows of the window's width, as drawToWindow expects).
+// Each pixel (or SSAA quad) is loaded as a vector of its channels, and the vectors of 4 pixels are transposed into
+// vectors of their reds, greens, blues and opacities so that 4 pixels are converted and packed at once.
+// The last (up to 3) pixels of a row are padded into a batch of their own, so that every pixel is resolved alike.
+template <bool SSAA, typename PixelStorage>
+void _resolveCanvasRows(const PixelStorage *pixels, u32 *content, u32 width, u32 first_row, u32 end_row,
+                        u32 first_column, u32 end_column) {
+    const simd4_f32 zero = simd::set4(0.0f);
+    const simd4_f32 one = simd::set4(1.0f);
+    const simd4_f32 quarter = simd::set4(0.25f);
+    const simd4_f32 to_component = simd::set4(FLOAT_TO_COLOR_COMPONENT);
+    const f32 opacity_lane_mask[4] = {0, 0, 0, 1};
+    const simd4_f32 opacity_lane = simd::lessThan(zero, simd::load4(opacity_lane_mask));
+    const u32 samples_per_pixel = SSAA ? 4 : 1;
+
+    simd4_f32 vectors[4];
+    i32 R[4], G[4], B[4];
+    for (u32 y = first_row; y < end_row; y++) {
+        const PixelStorage *pixel = pixels + ((u64)y * width + first_column) * samples_per_pixel;
+        u32 *content_value = content + (u64)y * width + first_column;
+        for (u32 x = first_column; x < end_column; x += 4, content_value += 4) {
+            u32 batch_size = end_column - x < 4 ? end_column - x : 4;
+            for (u8 i = batch_size; i < 4; i++) vectors[i] = zero;
+            for (u8 i = 0; i < batch_size; i++, pixel += samples_per_pixel) {
+                vectors[i] = _loadPixelVector(pixel);
+                if (SSAA) {
+                    simd4_f32 sample1 = _loadPixelVector(pixel + 1);
+                    simd4_f32 sample2 = _loadPixelVector(pixel + 2);
+                    simd4_f32 sample3 = _loadPixelVector(pixel + 3);
+
+                    // A quad is only transparent when all of its samples are, so its maximal opacity is kept for that:
+                    simd4_f32 max_opacity = simd::max(simd::max(vectors[i], sample1), simd::max(sample2, sample3));
+                    simd4_f32 average = simd::mul(simd::add(simd::add(simd::add(vectors[i], sample1), sample2), sample3), quarter);
+                    vectors[i] = simd::select(opacity_lane, max_opacity, average);
+                }
+            }
+            simd4_f32 &reds = vectors[0], &greens = vectors[1], &blues = vectors[2], &opacities = vectors[3];
+            simd::transpose4(reds, greens, blues, opacities);
+
+            // Colors are stored squared (in linear space) so are square-rooted back, with over-saturated ones clamped:
+            simd::storeTruncated4(R, simd::mul(to_component, simd::sqrt(simd::min(simd::max(reds,   zero), one))));
+            simd::storeTruncated4(G, simd::mul(to_component, simd::sqrt(simd::min(simd::max(greens, zero), one))));
+            simd::storeTruncated4(B, simd::mul(to_component, simd::sqrt(simd::min(simd::max(blues,  zero), one))));
+            u32 transparent = simd::maskBits(simd::maskAnd(simd::lessOrEqual(opacities, zero), simd::lessOrEqual(zero, opacities)));
+            for (u8 i = 0; i < batch_size; i++)
+                content_value[i] = ((u32)R[i] << 16 | (u32)G[i] << 8 | (u32)B[i]) & (((transparent >> i) & 1) - 1);
+        }
+    }
+}
+
+void _resolveCanvas(const Canvas &canvas, u32 first_row, u32 end_row, u32 first_column, u32 end_column) {
+    u32 *content = window::content;
+    u32 width = window::width;
+    if (canvas.antialias == SSAA) {
+        if (canvas.half_pixels) _resolveCanvasRows<true>(canvas.half_pixels, content, width, first_row, end_row, first_column, end_column);
+        else                    _resolveCanvasRows<true>(canvas.pixels,      content, width, first_row, end_row, first_column, end_column);
+    } else {
+        if (canvas.half_pixels) _resolveCanvasRows<false>(canvas.half_pixels, content, width, first_row, end_row, first_column, end_column);
+        else                    _resolveCanvasRows<false>(canvas.pixels,      content, width, first_row, end_row, first_column, end_column);
+    }
+}
+
+void resolveCanvasRowsJob(void *data, u32 first_row, u32 end_row, u32 thread_index) {
+    _resolveCanvas(*(Canvas*)data, first_row, end_row, 0, window::width);
+}
+
+void Canvas::drawToWindow(ThreadPool *thread_pool) const {
+    if (!hasPixels() || !window::content) return;
+
+    if (thread_pool)
+        thread_pool->parallelFor(window::height, CANVAS_RESOLVE_ROWS_PER_JOB, resolveCanvasRowsJob, (void*)this, 0);
+    else
+        resolveCanvasRowsJob((void*)this, 0, window::height, 0);
+}
+
+void Canvas::drawToWindow(RectI bounds) const {
+    if (!hasPixels() || !window::content) return;
+
+    bounds -= RectI{0, window::width - 1, 0, window::height - 1};
+    if (!bounds) return;
+
+    _resolveCanvas(*this, bounds.top, bounds.bottom + 1, bounds.left, bounds.right + 1);
+}
@@ -3,10 +3,23 @@
 #include "../draw/edge.h"
 #include "../core/transform.h"
 
+// A curve that is outside of the viewport's frustum is skipped before any of its steps get computed, and the edges of
+// one that is inside of it skip being clipped.
 void drawCurve(const Curve &curve, const Transform &transform, const Viewport &viewport,
                const Color &color = White, f32 opacity = 1.0f, u8 line_width = 0, u32 step_count = CURVE_STEPS) {
     const Camera &cam = *viewport.camera;
 
+    // Curves stay within a unit's distance of their center, and a coil's also within its thickness from there:
+    f32 extent = 1.0f + (curve.type == CurveType_Coil ? fabsf(curve.thickness) : 0.0f);
+    vec3 corners[8];
+    for (u8 i = 0; i < 8; i++)
+        corners[i] = cam.internPos(transform.externPos({i & 1 ? extent : -extent,
+                                                        i & 2 ? extent : -extent,
+                                                        i & 4 ? extent : -extent}));
+    Frustum::Containment containment = viewport.getContainment(corners, 8);
+    if (containment == Frustum::Containment::Outside) return;
+    bool is_inside = containment == Frustum::Containment::Inside;
+
     f32 rotation_step = 1.0f / (f32)step_count;
     f32 helix_center_to_orbit_y_inc = rotation_step * 2;
 
@@ -43,7 +56,7 @@ void drawCurve(const Curve &curve, const Transform &transform, const Viewport &v
         if (i) {
             edge.from = previous_position;
             edge.to   = current_position;
-            drawEdge(edge, viewport, color, opacity, line_width);
+            drawEdge(edge, viewport, color, opacity, line_width, is_inside);
             if (curve.type == CurveType_Sphere) {
                 edge.from.x = local_previous_position.x;
                 edge.from.y = local_previous_position.z;
@@ -55,7 +68,7 @@ void drawCurve(const Curve &curve, const Transform &transform, const Viewport &v
 
                 edge.from = cam.internPos(transform.externPos(edge.from));
                 edge.to   = cam.internPos(transform.externPos(edge.to));
-                drawEdge(edge, viewport, color, opacity, line_width);
+                drawEdge(edge, viewport, color, opacity, line_width, is_inside);
 
                 edge.from.x = 0;
                 edge.from.y = local_previous_position.x;
@@ -67,7 +80,7 @@ void drawCurve(const Curve &curve, const Transform &transform, const Viewport &v
 
                 edge.from = cam.internPos(transform.externPos(edge.from));
                 edge.to   = cam.internPos(transform.externPos(edge.to));
-                drawEdge(edge, viewport, color, opacity, line_width);
+                drawEdge(edge, viewport, color, opacity, line_width, is_inside);
             }
         }
 
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "../viewport/viewport.h"
+#include "../core/thread_pool.h"
+
+#define DEPTH_PYRAMID_CELL_SIZE 8 // In canvas pixels (of 4 sub-pixels each with SSAA), at the finest level
+#define DEPTH_PYRAMID_MAX_LEVEL_COUNT 12
+
+#define DEPTH_PYRAMID_MAX_CELLS_PER_ROW ((MAX_WIDTH + DEPTH_PYRAMID_CELL_SIZE - 1) / DEPTH_PYRAMID_CELL_SIZE)
+#define DEPTH_PYRAMID_MAX_CELLS_PER_COLUMN ((MAX_HEIGHT + DEPTH_PYRAMID_CELL_SIZE - 1) / DEPTH_PYRAMID_CELL_SIZE)
+#define DEPTH_PYRAMID_MAX_CELL_COUNT (DEPTH_PYRAMID_MAX_CELLS_PER_ROW * DEPTH_PYRAMID_MAX_CELLS_PER_COLUMN)
+
+INLINE bool _isOpaqueSample(const Pixel &pixel) { return pixel.opacity == 1.0f; }
+INLINE bool _isOpaqueSample(const HalfPixel &pixel) { return pixel.opacity == 0x3C00; } // 1 at half precision
+
+// A hierarchy of coarse depths of a canvas, for skipping (line) drawing that would end up entirely hidden.
+// A cell holds the farthest depth of the opaque samples in it, or infinity when any of its samples is not opaque
+// (only opaque samples hide what is drawn behind them, see Canvas::setPixel). Each level has cells of twice the
+// size of the level below it, holding the farthest depth of the 4 cells that they cover.
+// Drawing whose nearest depth is behind the farthest depth of all the cells that it covers would not change any pixel,
+// so it can be skipped. The pyramid is built from the canvas as it is at the time (i.e: after filled meshes have
+// been drawn into it), and is then used for the (line) drawing that follows.
+// With MSAA, lines are not depth-tested on all sub-samples, so nothing is ever considered as hidden.
+struct DepthPyramid {
+    f32 *levels[DEPTH_PYRAMID_MAX_LEVEL_COUNT]{};
+    u16 widths[DEPTH_PYRAMID_MAX_LEVEL_COUNT]{};
+    u16 heights[DEPTH_PYRAMID_MAX_LEVEL_COUNT]{};
+    u8 level_count{0}; // 0 until built (and when built from a canvas that hides nothing)
+
+    const Canvas *canvas{nullptr};
+
+    static u64 getSizeInBytes() {
+        return sizeof(f32) * DEPTH_PYRAMID_MAX_CELL_COUNT * 2; // Every level has at most a quarter of the one below it
+    }
+
+    bool allocate(memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = getSizeInBytes();
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            levels[0] = (f32*)memory_allocator->allocate(size);
+        } else
+            levels[0] = (f32*)os::getMemory(size);
+
+        return levels[0] != nullptr;
+    }
+
+    void build(const Canvas &target_canvas, ThreadPool *thread_pool = nullptr) {
+        level_count = 0;
+        canvas = &target_canvas;
+        if (!levels[0] || !canvas->depths || !canvas->hasPixels() || canvas->antialias == MSAA) return;
+
+        widths[0]  = (u16)((canvas->dimensions.width  + DEPTH_PYRAMID_CELL_SIZE - 1) / DEPTH_PYRAMID_CELL_SIZE);
+        heights[0] = (u16)((canvas->dimensions.height + DEPTH_PYRAMID_CELL_SIZE - 1) / DEPTH_PYRAMID_CELL_SIZE);
+        if (thread_pool && thread_pool->thread_count > 1)
+            thread_pool->parallelFor(heights[0], 4, buildRowsJob, this, 0);
+        else
+            buildRowsJob(this, 0, heights[0], 0);
+
+        level_count = 1;
+        while (level_count < DEPTH_PYRAMID_MAX_LEVEL_COUNT && (widths[level_count - 1] > 1 || heights[level_count - 1] > 1)) {
+            u8 level = level_count++;
+            const f32 *below = levels[level - 1];
+            u32 below_width = widths[level - 1];
+            u32 below_height = heights[level - 1];
+            widths[level]  = (u16)((below_width  + 1) / 2);
+            heights[level] = (u16)((below_height + 1) / 2);
+            levels[level] = levels[level - 1] + below_width * below_height;
+
+            f32 *cell = levels[level];
+            for (u32 y = 0; y < heights[level]; y++)
+                for (u32 x = 0; x < widths[level]; x++, cell++) {
+                    u32 below_x = x * 2, below_y = y * 2;
+                    const f32 *row = below + below_y * below_width + below_x;
+                    bool has_right = below_x + 1 < below_width;
+                    f32 farthest = row[0];
+                    if (has_right && row[1] > farthest) farthest = row[1];
+                    if (below_y + 1 < below_height) {
+                        row += below_width;
+                        if (row[0] > farthest) farthest = row[0];
+                        if (has_right && row[1] > farthest) farthest = row[1];
+                    }
+                    *cell = farthest;
+                }
+        }
+    }
+
+    // Whether drawing within the convex hull of the given view-space points would be entirely hidden, with a margin
+    // (in canvas pixels) around the hull's projection for what is drawn beyond it (for lines, their width plus one,
+    // as a line covers that many pixel rows/columns past its position).
+    // Points in front of the near clipping plane are never considered hidden (as they can not be projected as is).
+    bool isOccluded(const vec3 *view_space_points, u32 point_count, const Viewport &viewport, f32 margin = 0) const {
+        if (!level_count || canvas != &viewport.canvas || !point_count) return false;
+
+        f32 nearest = INFINITY;
+        f32 left = INFINITY, right = -INFINITY, top = INFINITY, bottom = -INFINITY;
+        for (u32 i = 0; i < point_count; i++) {
+            vec3 point{view_space_points[i]};
+            if (point.z < viewport.frustum.near_clipping_plane_distance) return false;
+            if (point.z < nearest) nearest = point.z;
+
+            viewport.projectPoint(point);
+            if (point.x < left) left = point.x;
+            if (point.x > right) right = point.x;
+            if (point.y < top) top = point.y;
+            if (point.y > bottom) bottom = point.y;
+        }
+
+        // Find the cells covered by the projection (in canvas pixels, clipped to the viewport):
+        const RectI &viewport_bounds = viewport.bounds;
+        Rect bounds{
+            left   + (f32)viewport_bounds.left - margin,
+            right  + (f32)viewport_bounds.left + margin,
+            top    + (f32)viewport_bounds.top  - margin,
+            bottom + (f32)viewport_bounds.top  + margin
+        };
+        bounds -= Rect{(f32)viewport_bounds.left, (f32)viewport_bounds.right, (f32)viewport_bounds.top, (f32)viewport_bounds.bottom};
+        bounds -= Rect{0, canvas->dimensions.f_width - 1.0f, 0, canvas->dimensions.f_height - 1.0f};
+        if (!bounds) return true; // Nothing would be drawn
+
+        i32 first_x = (i32)bounds.left / DEPTH_PYRAMID_CELL_SIZE;
+        i32 first_y = (i32)bounds.top  / DEPTH_PYRAMID_CELL_SIZE;
+        i32 last_x  = (i32)ceilf(bounds.right)  / DEPTH_PYRAMID_CELL_SIZE;
+        i32 last_y  = (i32)ceilf(bounds.bottom) / DEPTH_PYRAMID_CELL_SIZE;
+
+        // Go up to the level at which the projection covers at most 2x2 cells:
+        u8 level = 0;
+        while ((last_x - first_x > 1 || last_y - first_y > 1) && level + 1 < level_count) {
+            first_x >>= 1;
+            first_y >>= 1;
+            last_x >>= 1;
+            last_y >>= 1;
+            level++;
+        }
+        if (last_x >= widths[level]) last_x = widths[level] - 1;
+        if (last_y >= heights[level]) last_y = heights[level] - 1;
+
+        for (i32 y = first_y; y <= last_y; y++)
+            for (i32 x = first_x; x <= last_x; x++)
+                if (levels[level][y * widths[level] + x] > nearest)
+                    return false;
+
+        return true;
+    }
+
+private:
+    template <typename PixelStorage>
+    void buildCell(const PixelStorage *pixels, u32 cell_x, u32 cell_y, f32 *cell) const {
+        const Dimensions &dimensions = canvas->dimensions;
+        u32 first_x = cell_x * DEPTH_PYRAMID_CELL_SIZE;
+        u32 first_y = cell_y * DEPTH_PYRAMID_CELL_SIZE;
+        u32 end_x = first_x + DEPTH_PYRAMID_CELL_SIZE < dimensions.width  ? first_x + DEPTH_PYRAMID_CELL_SIZE : dimensions.width;
+        u32 end_y = first_y + DEPTH_PYRAMID_CELL_SIZE < dimensions.height ? first_y + DEPTH_PYRAMID_CELL_SIZE : dimensions.height;
+        u32 samples_per_pixel = canvas->antialias == SSAA ? 4 : 1;
+        u32 sample_count = (end_x - first_x) * samples_per_pixel;
+
+        f32 farthest = 0;
+        for (u32 y = first_y; y < end_y; y++) {
+            // The samples of a row of the cell are next to each other (with SSAA, being the sub-pixels of its pixels):
+            u32 offset = (dimensions.stride * y + first_x) * samples_per_pixel;
+            const PixelStorage *pixel = pixels + offset;
+            const f32 *depth = canvas->depths + offset;
+            for (u32 i = 0; i < sample_count; i++) {
+                if (!_isOpaqueSample(pixel[i])) {
+                    *cell = INFINITY;
+                    return;
+                }
+                if (depth[i] > farthest) farthest = depth[i];
+            }
+        }
+        *cell = farthest;
+    }
+
+    static void buildRowsJob(void *data, u32 start, u32 end, u32 thread_index) {
+        const DepthPyramid &pyramid = *(DepthPyramid*)data;
+        const Canvas &canvas = *pyramid.canvas;
+        u32 width = pyramid.widths[0];
+        for (u32 y = start; y < end; y++) {
+            f32 *cell = pyramid.levels[0] + y * width;
+            for (u32 x = 0; x < width; x++, cell++)
+                if (canvas.half_pixels) pyramid.buildCell(canvas.half_pixels, x, y, cell);
+                else                    pyramid.buildCell(canvas.pixels,      x, y, cell);
+        }
+    }
+};
@@ -1,13 +1,19 @@
 #pragma once
 
-#include "./line.h"
-#include "../viewport/viewport.h"
+#include "./rasterizer.h"
 
-
-void drawEdge(Edge edge, const Viewport &viewport, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
-    if (!viewport.cullAndClipEdge(edge)) return;
+// An edge that is known to be within the viewport's frustum (i.e: of an object that was found to be inside of it as
+// a whole, see Viewport::getContainment) skips being culled and clipped against it.
+void drawEdge(Edge edge, const Viewport &viewport, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1,
+              bool is_within_frustum = false) {
+    if (!is_within_frustum && !viewport.cullAndClipEdge(edge)) return;
 
     viewport.projectEdge(edge);
+    if (viewport.rasterizer) {
+        viewport.rasterizer->addLine(edge.from, edge.to, color, opacity, line_width);
+        return;
+    }
+
     drawLine(edge.from.x,
              edge.from.y,
              edge.from.z,
@@ -5,9 +5,19 @@
 #include "../scene/grid.h"
 #include "../viewport/viewport.h"
 
+// A grid that is outside of the viewport's frustum is skipped before its vertices get transformed, and the edges of one
+// that is inside of it skip being clipped.
 void drawGrid(const Grid &grid, const Transform &transform, const Viewport &viewport, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
     static Grid view_space_grid;
 
+    // The grid's edges span a square (on the local XZ plane), so they are all within the hull of its 4 corners:
+    vec3 corners[4];
+    for (u8 i = 0; i < 4; i++)
+        corners[i] = viewport.camera->internPos(transform.externPos({i & 1 ? 1.0f : -1.0f, 0, i & 2 ? 1.0f : -1.0f}));
+    Frustum::Containment containment = viewport.getContainment(corners, 4);
+    if (containment == Frustum::Containment::Outside) return;
+    bool is_inside = containment == Frustum::Containment::Inside;
+
     // Transform vertices positions from local-space to world-space and then to view-space:
     for (u8 segment = 0; segment < grid.u_segments; segment++) {
         view_space_grid.vertices.u.from[segment] = (viewport.camera->internPos(transform.externPos(grid.vertices.u.from[segment])));
@@ -21,6 +31,6 @@ void drawGrid(const Grid &grid, const Transform &transform, const Viewport &view
     // Distribute transformed vertices positions to edges:
     view_space_grid.edges.update(view_space_grid.vertices, grid.u_segments, grid.v_segments);
 
-    for (u8 u = 0; u < grid.u_segments; u++) drawEdge(view_space_grid.edges.u.edges[u], viewport, color, opacity, line_width);
-    for (u8 v = 0; v < grid.v_segments; v++) drawEdge(view_space_grid.edges.v.edges[v], viewport, color, opacity, line_width);
+    for (u8 u = 0; u < grid.u_segments; u++) drawEdge(view_space_grid.edges.u.edges[u], viewport, color, opacity, line_width, is_inside);
+    for (u8 v = 0; v < grid.v_segments; v++) drawEdge(view_space_grid.edges.v.edges[v], viewport, color, opacity, line_width, is_inside);
 }
\ No newline at end of file
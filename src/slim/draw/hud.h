@@ -23,4 +23,22 @@ void drawHUD(const HUD &hud, const Canvas &canvas, const RectI *viewport_bounds
         _drawText(text, x + (i32)line->title.length * FONT_WIDTH, y, canvas, color, 1.0f, viewport_bounds);
         y += (i32)(hud.settings.line_height * (f32)FONT_HEIGHT);
     }
-}
\ No newline at end of file
+}
+
+// The canvas pixels that the HUD is drawn over (as drawHUD would draw it now):
+RectI getHUDBounds(const HUD &hud) {
+    u32 max_length = 0;
+    HUDLine *line = hud.lines;
+    for (u32 i = 0; i < hud.settings.line_count; i++, line++) {
+        u32 value_length = line->value.string.length > line->alternate_value.length ? line->value.string.length : line->alternate_value.length;
+        if (max_length < line->title.length + value_length)
+            max_length = line->title.length + value_length;
+    }
+
+    return {
+        hud.left,
+        hud.left + (i32)(max_length * FONT_WIDTH),
+        hud.top,
+        hud.top + (i32)((f32)hud.settings.line_count * hud.settings.line_height * (f32)FONT_HEIGHT)
+    };
+}
@@ -2,180 +2,85 @@
 
 #include "./canvas.h"
 
-void drawImage(const PixelImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
-    if (bounds.right < 0 ||
-        bounds.bottom < 0 ||
-        bounds.left >= canvas.dimensions.width ||
-        bounds.top >= canvas.dimensions.height)
-        return;
-
-    i32 image_width = (i32)image.width;
-    i32 image_height = (i32)image.height;
-    i32 width = bounds.right - bounds.left;
-    i32 height = bounds.bottom - bounds.top;
-    if (width > image_width) {
-        width = image_width;
-        bounds.right = bounds.left + width;
-    }
-    if (height > image_height) {
-        height = image_height;
-        bounds.bottom = bounds.top + height;
-    }
-
-    Pixel *pixel = image.content;
-    if (image.flags.tile) {
-        TiledGridInfo grid{image};
-        u32 X, Y = 0;
-        for (grid.row = 0; grid.row < grid.rows; grid.row++) {
-            X = 0;
-            u32 tile_height = grid.row == grid.bottom_row ? grid.bottom_row_tile_height : image.tile_height;
-            for (grid.column = 0; grid.column < grid.columns; grid.column++) {
-                u32 tile_width = grid.column == grid.right_column ? grid.right_column_tile_stride : image.tile_width;
-
-                for (u32 y = 0; y < tile_height; y++)
-                    for (u32 x = 0; x < tile_width; x++, pixel++)
-                        canvas.setPixel(X + x, Y + y, pixel->color, image.flags.alpha ? (pixel->opacity * opacity) : opacity);
-
-                X += image.tile_width;
-            }
-            Y += image.tile_height;
-        }
-    } else {
-        i32 remainder_x = image_width - width;
-        for (i32 y = bounds.top; y <= bounds.bottom; y++) {
-            for (i32 x = bounds.left; x <= bounds.right; x++, pixel++)
-                canvas.setPixel(x, y, pixel->color, image.flags.alpha ? (pixel->opacity * opacity) : opacity);
-
-            pixel += remainder_x;
-        }
-    }
+// Reads a pixel of image content, moving on to the next one (float content has 3 or 4 channels per pixel):
+INLINE Pixel _readImagePixel(const Pixel *&content, bool alpha) { return *(content++); }
+INLINE Pixel _readImagePixel(const ByteColor *&content, bool alpha) { return Pixel{*(content++)}; }
+INLINE Pixel _readImagePixel(const f32 *&content, bool alpha) {
+    Pixel pixel{content[0], content[1], content[2], alpha ? content[3] : 1.0f};
+    content += alpha ? 4 : 3;
+    return pixel;
 }
 
-void drawImage(const FloatImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
+// Draws the content of an image (of any pixel format) at canvas samples, through the pixel writer matching the canvas
+// and the image. Pixels that would fall outside of the canvas are skipped over rather than drawn.
+// The content of untiled images is read in rows of row_stride pixels, each of pixel_size elements.
+template <typename T>
+void _drawImage(const Image<T> &image, const Canvas &canvas, RectI bounds, f32 opacity, u32 row_stride, u32 pixel_size = 1) {
     if (bounds.right < 0 ||
         bounds.bottom < 0 ||
         bounds.left >= canvas.dimensions.width ||
         bounds.top >= canvas.dimensions.height)
         return;
 
-    i32 image_width = (i32)image.width;
-    i32 image_height = (i32)image.height;
-    i32 width = bounds.right - bounds.left;
-    i32 height = bounds.bottom - bounds.top;
-    if (width > image_width) {
-        width = image_width;
-        bounds.right = bounds.left + width;
-    }
-    if (height > image_height) {
-        height = image_height;
-        bounds.bottom = bounds.top + height;
-    }
-
-    bool has_opacity = image.flags.alpha;
-    i32 channels_per_pixel = has_opacity ? 4 : 3;
-    Color color;
-    f32 pixel_opacity;
-    f32 *channel = image.content;
-    if (image.flags.tile) {
-        TiledGridInfo grid{image};
-        u32 X, Y = 0;
-        for (grid.row = 0; grid.row < grid.rows; grid.row++) {
-            X = 0;
-            u32 tile_height = grid.row == grid.bottom_row ? grid.bottom_row_tile_height : image.tile_height;
-            for (grid.column = 0; grid.column < grid.columns; grid.column++) {
-                u32 tile_width = grid.column == grid.right_column ? grid.right_column_tile_stride : image.tile_width;
-
-                for (u32 y = 0; y < tile_height; y++) {
-                    for (u32 x = 0; x < tile_width; x++) {
-                        color.r = *(channel++);
-                        color.g = *(channel++);
-                        color.b = *(channel++);
-                        if (has_opacity)
-                            pixel_opacity = *(channel++);
-                        else
-                            pixel_opacity = 1.0f;
-
-                        canvas.setPixel(X + x, Y + y, color, pixel_opacity * opacity);
+    // Bounds are inclusive, and are cropped to the size of the image:
+    if (bounds.right - bounds.left >= (i32)image.width) bounds.right = bounds.left + (i32)image.width - 1;
+    if (bounds.bottom - bounds.top >= (i32)image.height) bounds.bottom = bounds.top + (i32)image.height - 1;
+
+    const bool alpha = image.flags.alpha;
+    const i32 canvas_width  = canvas.antialias == SSAA ? canvas.dimensions.width  * 2 : canvas.dimensions.width;
+    const i32 canvas_height = canvas.antialias == SSAA ? canvas.dimensions.height * 2 : canvas.dimensions.height;
+    drawWithPixelWriter(canvas, !alpha && clampedValue(opacity) == 1.0f, [&](const auto &writer) {
+        Pixel pixel;
+        const T *content = image.content;
+        if (image.flags.tile) {
+            TiledGridInfo grid{image};
+            i32 X, Y = 0;
+            for (grid.row = 0; grid.row < grid.rows; grid.row++) {
+                X = 0;
+                i32 tile_height = (i32)(grid.row == grid.bottom_row ? grid.bottom_row_tile_height : image.tile_height);
+                for (grid.column = 0; grid.column < grid.columns; grid.column++) {
+                    i32 tile_width = (i32)(grid.column == grid.right_column ? grid.right_column_tile_stride : image.tile_width);
+                    i32 last_x = X + tile_width  > canvas_width  ? canvas_width  - 1 - X : tile_width  - 1;
+                    i32 last_y = Y + tile_height > canvas_height ? canvas_height - 1 - Y : tile_height - 1;
+                    for (i32 y = 0; y <= last_y; y++) {
+                        const T *row = content + y * tile_width * pixel_size;
+                        for (i32 x = 0; x <= last_x; x++) {
+                            pixel = _readImagePixel(row, alpha);
+                            writer.writeSample(X + x, Y + y, Canvas::toCanvasPixel(pixel.color, alpha ? (pixel.opacity * opacity) : opacity));
+                        }
                     }
-                }
 
-                X += image.tile_width;
+                    content += tile_width * tile_height * pixel_size;
+                    X += (i32)image.tile_width;
+                }
+                Y += (i32)image.tile_height;
             }
-            Y += image.tile_height;
-        }
-    } else {
-        i32 remainder_x = ((i32)image.stride - width) * channels_per_pixel;
-        for (i32 y = bounds.top; y <= bounds.bottom; y++) {
-            for (i32 x = bounds.left; x <= bounds.right; x++) {
-                color.r = *(channel++);
-                color.g = *(channel++);
-                color.b = *(channel++);
-                if (has_opacity)
-                    pixel_opacity = *(channel++);
-                else
-                    pixel_opacity = 1.0f;
-
-                canvas.setPixel(x, y, color, pixel_opacity * opacity);
+        } else {
+            i32 first_x = bounds.left < 0 ? 0 : bounds.left;
+            i32 first_y = bounds.top  < 0 ? 0 : bounds.top;
+            i32 last_x = bounds.right  < canvas_width  ? bounds.right  : canvas_width  - 1;
+            i32 last_y = bounds.bottom < canvas_height ? bounds.bottom : canvas_height - 1;
+            for (i32 y = first_y; y <= last_y; y++) {
+                const T *row = content + ((y - bounds.top) * (i32)row_stride + (first_x - bounds.left)) * (i32)pixel_size;
+                for (i32 x = first_x; x <= last_x; x++) {
+                    pixel = _readImagePixel(row, alpha);
+                    writer.writeSample(x, y, Canvas::toCanvasPixel(pixel.color, alpha ? (pixel.opacity * opacity) : opacity));
+                }
             }
-
-            channel += remainder_x;
         }
-    }
+    });
 }
 
-void drawImage(const ByteColorImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
-    if (bounds.right < 0 ||
-        bounds.bottom < 0 ||
-        bounds.left >= canvas.dimensions.width ||
-        bounds.top >= canvas.dimensions.height)
-        return;
-
-    i32 image_width = (i32)image.width;
-    i32 image_height = (i32)image.height;
-    i32 width = bounds.right - bounds.left;
-    i32 height = bounds.bottom - bounds.top;
-    if (width > image_width) {
-        width = image_width;
-        bounds.right = bounds.left + width;
-    }
-    if (height > image_height) {
-        height = image_height;
-        bounds.bottom = bounds.top + height;
-    }
-
-    Pixel pixel;;
-    ByteColor *byte_color = image.content;
-    if (image.flags.tile) {
-        TiledGridInfo grid{image};
-        u32 X, Y = 0;
-        for (grid.row = 0; grid.row < grid.rows; grid.row++) {
-            X = 0;
-            u32 tile_height = grid.row == grid.bottom_row ? grid.bottom_row_tile_height : image.tile_height;
-            for (grid.column = 0; grid.column < grid.columns; grid.column++) {
-                u32 tile_width = grid.column == grid.right_column ? grid.right_column_tile_stride : image.tile_width;
-
-                for (u32 y = 0; y < tile_height; y++) {
-                    for (u32 x = 0; x < tile_width; x++, byte_color++) {
-                        pixel = *byte_color;
-                        canvas.setPixel(X + x, Y + y, pixel.color, image.flags.alpha ? (pixel.opacity * opacity) : opacity);
-                    }
-                }
+void drawImage(const PixelImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
+    _drawImage(image, canvas, bounds, opacity, image.width);
+}
 
-                X += image.tile_width;
-            }
-            Y += image.tile_height;
-        }
-    } else {
-        i32 remainder_x = (i32)image.stride - width;
-        for (i32 y = bounds.top; y <= bounds.bottom; y++) {
-            for (i32 x = bounds.left; x <= bounds.right; x++, byte_color++) {
-                pixel = *byte_color;
-                canvas.setPixel(x, y, pixel.color, image.flags.alpha ? (pixel.opacity * opacity) : opacity);
-            }
+void drawImage(const FloatImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
+    _drawImage(image, canvas, bounds, opacity, image.stride, image.flags.alpha ? 4 : 3);
+}
 
-            byte_color += remainder_x;
-        }
-    }
+void drawImage(const ByteColorImage &image, const Canvas &canvas, RectI bounds, f32 opacity = 1.0f) {
+    _drawImage(image, canvas, bounds, opacity, image.stride);
 }
 
 void drawImageToWindow(const ByteColorImage &image, RectI bounds, f32 opacity = 1.0f) {
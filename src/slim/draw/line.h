@@ -16,18 +16,10 @@ void _drawHLine(RangeI x_range, i32 y, const Canvas &canvas, const Color &color,
     if (!x_range || !y_range[y])
         return;
 
-    if (canvas.antialias == SSAA) {
-        y *= 2;
-        x_range *= 2;
-        for (i32 x = x_range.first; x <= x_range.last; x += 2) {
-            canvas.setPixel(x, y, color, opacity);
-            canvas.setPixel(x+1, y, color, opacity);
-            canvas.setPixel(x, y+1, color, opacity);
-            canvas.setPixel(x+1, y+1, color, opacity);
-        }
-    } else
-        for (i32 x = x_range.first; x <= x_range.last; x += 1)
-            canvas.setPixel(x, y, color, opacity);
+    Pixel pixel{Canvas::toCanvasPixel(color, opacity)};
+    drawWithPixelWriter(canvas, pixel.opacity == 1.0f, [&](const auto &writer) {
+        writer.writeHSpan(x_range.first, x_range.last, y, pixel);
+    });
 }
 
 void _drawVLine(RangeI y_range, i32 x, const Canvas &canvas, const Color &color, f32 opacity, const RectI *viewport_bounds) {
@@ -44,22 +36,16 @@ void _drawVLine(RangeI y_range, i32 x, const Canvas &canvas, const Color &color,
     if (!y_range || !x_range[x])
         return;
 
-    if (canvas.antialias == SSAA) {
-        x *= 2;
-        y_range *= 2;
-        for (i32 y = y_range.first; y <= y_range.last; y += 2) {
-            canvas.setPixel(x, y, color, opacity);
-            canvas.setPixel(x+1, y, color, opacity);
-            canvas.setPixel(x, y+1, color, opacity);
-            canvas.setPixel(x+1, y+1, color, opacity);
-        }
-    } else
-        for (i32 y = y_range.first; y <= y_range.last; y += 1)
-            canvas.setPixel(x, y, color, opacity);
+    Pixel pixel{Canvas::toCanvasPixel(color, opacity)};
+    drawWithPixelWriter(canvas, pixel.opacity == 1.0f, [&](const auto &writer) {
+        writer.writeVSpan(x, y_range.first, y_range.last, pixel);
+    });
 }
 
+// Lines only ever cover pixels within the (rounded out) bounds of their end points, clipped to the viewport's bounds
+// and to the optional clip bounds (in canvas pixels, i.e: a tile of the canvas that is being drawn to on its own).
 void _drawLine(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, const Canvas &canvas,
-               const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds) {
+               const Color &color, f32 opacity, u8 line_width, const RectI *viewport_bounds, const RectI *clip_bounds = nullptr) {
     Range float_x_range{x1 <= x2 ? x1 : x2, x1 <= x2 ? x2 : x1};
     Range float_y_range{y1 <= y2 ? y1 : y2, y1 <= y2 ? y2 : y1};
     if (viewport_bounds) {
@@ -85,6 +71,12 @@ void _drawLine(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, const Canvas &can
     RangeI y_range{(i32)float_y_range.first, (i32)(ceilf(float_y_range.last))};
     if (x_range.last == (i32)canvas.dimensions.width) x_range.last--;
     if (y_range.last == (i32)canvas.dimensions.height) y_range.last--;
+    if (clip_bounds) { // Clipped once rounded out, so that clip bounds that tile the canvas cover every pixel once
+        x_range.sub(clip_bounds->left, clip_bounds->right);
+        y_range.sub(clip_bounds->top, clip_bounds->bottom);
+        if (!x_range || !y_range)
+            return;
+    }
 
     i32 x, y;
     if (canvas.antialias == SSAA) {
@@ -94,8 +86,8 @@ void _drawLine(f32 x1, f32 y1, f32 z1, f32 x2, f32 y2, f32 z2, const Canvas &can
         y2 += y2;
         x_range.first <<= 1;
         y_range.first <<= 1;
-        x_range.last <<= 1;
-        y_range.last <<= 1;
+        x_range.last = (x_range.last << 1) + 1; // The last pixel's second sub-pixel
+        y_range.last = (y_range.last << 1) + 1;
         line_width <<= 1;
         line_width++;
     }
@@ -1,19 +1,202 @@
 #pragma once
 
 #include "./edge.h"
+#include "./depth_pyramid.h"
 #include "../scene/mesh.h"
+#include "../core/transform.h"
+#include "../math/simd.h"
 
+// How much of a surface's color is kept when facing away from the camera (the rest is lit by a head light):
+#define MESH_FILL_AMBIENT_LIGHT 0.2f
 
+// The view-space positions of a mesh's vertices, transformed once per draw (rather than once for every edge or
+// triangle that shares them). It is sized for the largest mesh to be drawn through it, and can be reused across meshes.
+// The mesh's transform and the camera's are combined into a single affine transformation from the mesh's space to
+// view space, which is applied to batches of vertices at once (with their coordinates gathered into SIMD lanes).
+struct MeshVertexCache {
+    vec3 *positions{nullptr};
+    u32 capacity{0};
+
+    mat3 local_to_view;
+    vec3 local_to_view_offset;
+
+    bool allocate(u32 max_vertex_count, memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = sizeof(vec3) * max_vertex_count;
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            positions = (vec3*)memory_allocator->allocate(size);
+        } else
+            positions = (vec3*)os::getMemory(size);
+
+        capacity = positions ? max_vertex_count : 0;
+        return positions != nullptr;
+    }
+
+    INLINE vec3 toViewPos(const vec3 &pos) const { return local_to_view * pos + local_to_view_offset; }
+    INLINE vec3 toViewDir(const vec3 &dir) const { return local_to_view * dir; }
+
+    void updateTransform(const Transform &transform, const Camera &camera) {
+        local_to_view_offset = camera.internPos(transform.position);
+        local_to_view.X = camera.internDir(transform.rotation * vec3{transform.scale.x, 0, 0});
+        local_to_view.Y = camera.internDir(transform.rotation * vec3{0, transform.scale.y, 0});
+        local_to_view.Z = camera.internDir(transform.rotation * vec3{0, 0, transform.scale.z});
+    }
+
+    // The view-space positions of the 8 corners of some (mesh-space) bounds:
+    void toViewCorners(const AABB &aabb, vec3 *corners) const {
+        for (u8 i = 0; i < 8; i++)
+            corners[i] = toViewPos({i & 1 ? aabb.max.x : aabb.min.x,
+                                    i & 2 ? aabb.max.y : aabb.min.y,
+                                    i & 4 ? aabb.max.z : aabb.min.z});
+    }
+
+    bool updateVertices(const Mesh &mesh) {
+        if (mesh.vertex_count > capacity) return false;
+
+        const mat3 &M = local_to_view;
+        const vec3 &O = local_to_view_offset;
+        simd_f32 Xx = simd::set1(M.X.x), Yx = simd::set1(M.Y.x), Zx = simd::set1(M.Z.x), Ox = simd::set1(O.x);
+        simd_f32 Xy = simd::set1(M.X.y), Yy = simd::set1(M.Y.y), Zy = simd::set1(M.Z.y), Oy = simd::set1(O.y);
+        simd_f32 Xz = simd::set1(M.X.z), Yz = simd::set1(M.Y.z), Zz = simd::set1(M.Z.z), Oz = simd::set1(O.z);
+        f32 xs[SIMD_WIDTH], ys[SIMD_WIDTH], zs[SIMD_WIDTH];
+
+        u32 batched_count = mesh.vertex_count - mesh.vertex_count % SIMD_WIDTH;
+        const vec3 *in = mesh.vertex_positions;
+        vec3 *out = positions;
+        for (u32 i = 0; i < batched_count; i += SIMD_WIDTH, in += SIMD_WIDTH, out += SIMD_WIDTH) {
+            for (u8 lane = 0; lane < SIMD_WIDTH; lane++) {
+                xs[lane] = in[lane].x;
+                ys[lane] = in[lane].y;
+                zs[lane] = in[lane].z;
+            }
+            simd_f32 x = simd::load(xs);
+            simd_f32 y = simd::load(ys);
+            simd_f32 z = simd::load(zs);
+            simd::store(xs, simd::fmadd(Xx, x, simd::fmadd(Yx, y, simd::fmadd(Zx, z, Ox))));
+            simd::store(ys, simd::fmadd(Xy, x, simd::fmadd(Yy, y, simd::fmadd(Zy, z, Oy))));
+            simd::store(zs, simd::fmadd(Xz, x, simd::fmadd(Yz, y, simd::fmadd(Zz, z, Oz))));
+            for (u8 lane = 0; lane < SIMD_WIDTH; lane++)
+                out[lane] = {xs[lane], ys[lane], zs[lane]};
+        }
+        for (u32 i = batched_count; i < mesh.vertex_count; i++, in++, out++)
+            *out = toViewPos(*in);
+
+        return true;
+    }
+};
+
+// Clips a convex polygon of view-space vertices against a plane of constant depth, keeping the side nearer to
+// the camera (or the farther side when keep_far is set). Returns the number of vertices written to out_vertices.
+u8 _clipPolygonAtDepth(const RasterVertex *vertices, u8 vertex_count, f32 depth, bool keep_far, RasterVertex *out_vertices) {
+    u8 out_count = 0;
+    for (u8 i = 0; i < vertex_count; i++) {
+        const RasterVertex &from = vertices[i];
+        const RasterVertex &to = vertices[(i + 1) % vertex_count];
+        bool from_inside = keep_far ? from.position.z >= depth : from.position.z <= depth;
+        bool to_inside   = keep_far ?   to.position.z >= depth :   to.position.z <= depth;
+        if (from_inside) out_vertices[out_count++] = from;
+        if (from_inside != to_inside) {
+            f32 t = (depth - from.position.z) / (to.position.z - from.position.z);
+            RasterVertex &clipped = out_vertices[out_count++];
+            clipped.position = from.position.lerpTo(to.position, t);
+            clipped.position.z = depth;
+            clipped.uv.x = from.uv.x + (to.uv.x - from.uv.x) * t;
+            clipped.uv.y = from.uv.y + (to.uv.y - from.uv.y) * t;
+        }
+    }
+
+    return out_count;
+}
+
+// Draws a mesh as filled, depth-tested triangles (lit by a head light), optionally textured by its uvs.
+// Vertices are transformed once into the vertex cache, triangles are culled against the frustum (and when facing
+// away from the camera) and clipped against the near and far clipping planes, before being projected and filled.
+// A mesh whose bounds are outside of the frustum is skipped before any of its vertices get transformed, and the
+// triangles of one whose bounds are inside of it skip being clipped.
+void drawMeshFilled(const Mesh &mesh, const Transform &transform, const Viewport &viewport, MeshVertexCache &vertex_cache,
+                    const Color &color = White, f32 opacity = 1.0f, const Texture *texture = nullptr) {
+    if (!viewport.canvas.hasPixels() || mesh.vertex_count > vertex_cache.capacity) return;
+    vertex_cache.updateTransform(transform, *viewport.camera);
+
+    vec3 corners[8];
+    vertex_cache.toViewCorners(mesh.aabb, corners);
+    Frustum::Containment containment = viewport.getContainment(corners, 8);
+    if (containment == Frustum::Containment::Outside || !vertex_cache.updateVertices(mesh)) return;
+    if (texture && !(mesh.uvs_count && mesh.vertex_uvs && mesh.vertex_uvs_indices && texture->mips)) texture = nullptr;
+
+    const Frustum &frustum = viewport.frustum;
+    // The uvs stay zeroed when not textured (clipping still interpolates them):
+    RasterVertex vertices[3]{}, near_clipped[4]{}, far_clipped[5]{};
+    TriangleVertexIndices *position_index = mesh.vertex_position_indices;
+    TriangleVertexIndices *uvs_index = mesh.vertex_uvs_indices;
+    for (u32 t = 0; t < mesh.triangle_count; t++, position_index++) {
+        for (u8 i = 0; i < 3; i++) vertices[i].position = vertex_cache.positions[position_index->ids[i]];
+        vec3 &A = vertices[0].position;
+        vec3 &B = vertices[1].position;
+        vec3 &C = vertices[2].position;
+        if (viewport.cullTriangle(A, B, C)) continue;
+
+        // The head light's intensity is how directly the triangle faces the camera:
+        vec3 normal = (C - A).cross(B - A).normalized();
+        f32 facing = fabsf(normal.dot(A.normalized()));
+        Color shaded_color = color * (MESH_FILL_AMBIENT_LIGHT + (1.0f - MESH_FILL_AMBIENT_LIGHT) * facing);
+
+        if (texture) {
+            for (u8 i = 0; i < 3; i++) vertices[i].uv = mesh.vertex_uvs[uvs_index[t].ids[i]];
+        }
+
+        u8 vertex_count = 3;
+        RasterVertex *polygon = vertices;
+        if (containment != Frustum::Containment::Inside) {
+            vertex_count = _clipPolygonAtDepth(vertices, 3, frustum.near_clipping_plane_distance, true, near_clipped);
+            vertex_count = _clipPolygonAtDepth(near_clipped, vertex_count, frustum.far_clipping_plane_distance, false, far_clipped);
+            if (vertex_count < 3) continue;
+            polygon = far_clipped;
+        }
+
+        for (u8 i = 0; i < vertex_count; i++) viewport.projectPoint(polygon[i].position);
+        for (u8 i = 2; i < vertex_count; i++)
+            if (viewport.rasterizer)
+                viewport.rasterizer->addTriangle(polygon[0], polygon[i - 1], polygon[i], shaded_color, opacity, texture);
+            else
+                _fillPerspectiveTriangle(polygon[0], polygon[i - 1], polygon[i],
+                                         viewport.canvas, shaded_color, opacity, texture, &viewport.bounds);
+    }
+}
+
+// Draws a mesh's edges (and optionally its vertex normals) as lines, from the view-space positions of its vertices.
+// A mesh whose bounds are outside of the frustum (or hidden behind the viewport's depth pyramid) is skipped before any
+// of its vertices get transformed, and the edges of one whose bounds are inside of the frustum skip being clipped.
+// The vertex cache's transformation is updated either way, for drawing the mesh's BVH through it. A mesh with more
+// vertices than the cache can hold is still drawn, by transforming each edge's endpoints on their own instead.
 void drawMesh(const Mesh &mesh, const Transform &transform, bool draw_normals, const Viewport &viewport,
-              const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
-    const Camera &cam = *viewport.camera;
-    vec3 pos;
+              MeshVertexCache &vertex_cache, const Color &color = White, f32 opacity = 1.0f, u8 line_width = 1) {
+    vertex_cache.updateTransform(transform, *viewport.camera);
+
+    AABB bounds{mesh.aabb};
+    if (draw_normals) { // Normals are drawn a tenth of a unit beyond their vertices
+        bounds.min -= 0.1f;
+        bounds.max += 0.1f;
+    }
+    vec3 corners[8];
+    vertex_cache.toViewCorners(bounds, corners);
+    Frustum::Containment containment = viewport.getContainment(corners, 8);
+    if (containment == Frustum::Containment::Outside) return;
+    if (viewport.depth_pyramid && viewport.depth_pyramid->isOccluded(corners, 8, viewport, line_width + 1)) return;
+
+    bool is_inside = containment == Frustum::Containment::Inside;
+    bool is_cached = vertex_cache.updateVertices(mesh);
+    auto viewPos = [&](u32 vertex_index) -> vec3 {
+        return is_cached ? vertex_cache.positions[vertex_index] :
+                           vertex_cache.toViewPos(mesh.vertex_positions[vertex_index]);
+    };
+
     Edge edge;
     EdgeVertexIndices *edge_index = mesh.edge_vertex_indices;
     for (u32 i = 0; i < mesh.edge_count; i++, edge_index++) {
-        edge.from = cam.internPos(transform.externPos(mesh.vertex_positions[edge_index->from]));
-        edge.to   = cam.internPos(transform.externPos(mesh.vertex_positions[edge_index->to]));
-        drawEdge(edge, viewport, color, opacity, line_width);
+        edge.from = viewPos(edge_index->from);
+        edge.to   = viewPos(edge_index->to);
+        drawEdge(edge, viewport, color, opacity, line_width, is_inside);
     }
 
     if (draw_normals && mesh.normals_count && mesh.vertex_normals && mesh.vertex_normal_indices) {
@@ -21,12 +204,10 @@ void drawMesh(const Mesh &mesh, const Transform &transform, bool draw_normals, c
         TriangleVertexIndices *position_index = mesh.vertex_position_indices;
         for (u32 t = 0; t < mesh.triangle_count; t++, normal_index++, position_index++) {
             for (u8 i = 0; i < 3; i++) {
-                pos = mesh.vertex_positions[position_index->ids[i]];
-                edge.to = mesh.vertex_normals[normal_index->ids[i]] * 0.1f + pos;
-                edge.from = cam.internPos(transform.externPos(pos));
-                edge.to = cam.internPos(transform.externPos(edge.to));
-                drawEdge(edge, viewport, Red, opacity * 0.5f, line_width);
+                edge.from = viewPos(position_index->ids[i]);
+                edge.to = edge.from + vertex_cache.toViewDir(mesh.vertex_normals[normal_index->ids[i]] * 0.1f);
+                drawEdge(edge, viewport, Red, opacity * 0.5f, line_width, is_inside);
             }
         }
     }
-}
\ No newline at end of file
+}
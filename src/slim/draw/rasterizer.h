@@ -0,0 +1,585 @@
+#pragma once
+
+#include "./line.h"
+#include "../viewport/viewport.h"
+#include "../core/texture.h"
+#include "../core/thread_pool.h"
+#include "../math/vec2.h"
+
+#define TILE_RASTERIZER_TILE_SIZE 64 // In canvas pixels (of 4 sub-pixels each with SSAA)
+
+// Commands that overlap more tiles than this are not binned, and are gone through by every tile instead:
+#define TILE_RASTERIZER_MAX_TILES_PER_COMMAND 16
+
+#define TILE_RASTERIZER_MAX_TILES_PER_ROW ((MAX_WIDTH + TILE_RASTERIZER_TILE_SIZE - 1) / TILE_RASTERIZER_TILE_SIZE)
+#define TILE_RASTERIZER_MAX_TILES_PER_COLUMN ((MAX_HEIGHT + TILE_RASTERIZER_TILE_SIZE - 1) / TILE_RASTERIZER_TILE_SIZE)
+#define TILE_RASTERIZER_MAX_TILE_COUNT (TILE_RASTERIZER_MAX_TILES_PER_ROW * TILE_RASTERIZER_MAX_TILES_PER_COLUMN)
+
+
+// A vertex of a projected triangle: Its position is in viewport pixels (with its view-space depth), and its uv is
+// only used when the triangle is textured.
+struct RasterVertex {
+    vec3 position;
+    vec2 uv;
+};
+
+// Fills a projected triangle, interpolating one-over-depth (and texture coordinates over depth) so that both depth
+// and texturing are perspective-correct. The depth is the view-space one, as is the case for lines.
+// Both windings are filled. Like lines, the filled pixels can be clipped to clip bounds (in canvas pixels).
+void _fillPerspectiveTriangle(const RasterVertex &v1, const RasterVertex &v2, const RasterVertex &v3,
+                              const Canvas &canvas, const Color &color, f32 opacity, const Texture *texture,
+                              const RectI *viewport_bounds, const RectI *clip_bounds = nullptr) {
+    f32 x1 = v1.position.x, y1 = v1.position.y;
+    f32 x2 = v2.position.x, y2 = v2.position.y;
+    f32 x3 = v3.position.x, y3 = v3.position.y;
+
+    // Cull this triangle against the edges of the viewport:
+    Rect bounds{0, canvas.dimensions.f_width - 1.0f, 0, canvas.dimensions.f_height - 1.0f};
+    Rect rect{
+        x1 < x2 ? x1 : x2,
+        x1 > x2 ? x1 : x2,
+        y1 < y2 ? y1 : y2,
+        y1 > y2 ? y1 : y2,
+    };
+    if (x3 < rect.left) rect.left = x3;
+    if (x3 > rect.right) rect.right = x3;
+    if (y3 < rect.top) rect.top = y3;
+    if (y3 > rect.bottom) rect.bottom = y3;
+    if (viewport_bounds) {
+        Rect float_bounds{
+            (f32)viewport_bounds->left,
+            (f32)viewport_bounds->right,
+            (f32)viewport_bounds->top,
+            (f32)viewport_bounds->bottom,
+        };
+        x1 += float_bounds.left;
+        x2 += float_bounds.left;
+        x3 += float_bounds.left;
+        y1 += float_bounds.top;
+        y2 += float_bounds.top;
+        y3 += float_bounds.top;
+        rect.x_range += float_bounds.left;
+        rect.y_range += float_bounds.top;
+        rect -= float_bounds;
+    }
+    rect -= bounds;
+    if (!rect)
+        return;
+
+    if (canvas.antialias == SSAA) {
+        x1 *= 2.0f;
+        x2 *= 2.0f;
+        x3 *= 2.0f;
+        y1 *= 2.0f;
+        y2 *= 2.0f;
+        y3 *= 2.0f;
+        rect *= 2.0f;
+
+        // Include the last pixels' second sub-pixels:
+        rect.right += 1.0f;
+        rect.bottom += 1.0f;
+    }
+
+    // Compute area components:
+    f32 ABx = x2 - x1;
+    f32 ABy = y2 - y1;
+
+    f32 ACx = x3 - x1;
+    f32 ACy = y3 - y1;
+
+    f32 ABC = ACx*ABy - ACy*ABx;
+    if (ABC == 0)
+        return;
+
+    // Floor bounds coordinates down to their integral component:
+    u32 first_x = (u32)rect.left;
+    u32 first_y = (u32)rect.top;
+    u32 last_x  = (u32)rect.right;
+    u32 last_y  = (u32)rect.bottom;
+
+    // Clip the scanned samples (the weights are still computed from the first ones, so are the same either way):
+    u32 scan_first_x = first_x, scan_last_x = last_x;
+    u32 scan_first_y = first_y, scan_last_y = last_y;
+    if (clip_bounds) {
+        RectI clip{*clip_bounds};
+        if (canvas.antialias == SSAA) {
+            clip *= 2;
+            clip.right += 1;
+            clip.bottom += 1;
+        }
+        if ((i32)scan_first_x < clip.left) scan_first_x = (u32)clip.left;
+        if ((i32)scan_first_y < clip.top) scan_first_y = (u32)clip.top;
+        if ((i32)scan_last_x > clip.right) scan_last_x = (u32)clip.right;
+        if ((i32)scan_last_y > clip.bottom) scan_last_y = (u32)clip.bottom;
+        if (scan_first_x > scan_last_x || scan_first_y > scan_last_y)
+            return;
+    }
+
+    // Compute weight constants (for either winding, as the weights are then all positive inside):
+    f32 one_over_ABC = 1.0f / ABC;
+
+    f32 Cdx =  ABy * one_over_ABC;
+    f32 Bdx = -ACy * one_over_ABC;
+
+    f32 Cdy = -ABx * one_over_ABC;
+    f32 Bdy =  ACx * one_over_ABC;
+
+    // Compute initial areal coordinates for the first pixel center:
+    f32 start_x = (f32)first_x + 0.5f;
+    f32 start_y = (f32)first_y + 0.5f;
+    f32 C_start = Cdx*start_x + Cdy*start_y + (y1*x2 - x1*y2) * one_over_ABC;
+    f32 B_start = Bdx*start_x + Bdy*start_y + (y3*x1 - x3*y1) * one_over_ABC;
+
+    // Attributes are interpolated over depth:
+    f32 w1 = 1.0f / v1.position.z;
+    f32 w2 = 1.0f / v2.position.z;
+    f32 w3 = 1.0f / v3.position.z;
+
+    const TextureMip *texture_mip = nullptr;
+    vec2 uv1, uv2, uv3;
+    if (texture) {
+        // Select the mip level by how much of the texture each sample covers (as drawTexture does):
+        vec2 uv_AB{v2.uv.x - v1.uv.x, v2.uv.y - v1.uv.y};
+        vec2 uv_AC{v3.uv.x - v1.uv.x, v3.uv.y - v1.uv.y};
+        f32 uv_area = fabsf(uv_AC.x*uv_AB.y - uv_AC.y*uv_AB.x) / fabsf(ABC);
+        texture_mip = texture->mips + (texture->flags.mipmap ? Texture::GetMipLevel(*texture, uv_area) : 0);
+
+        uv1 = v1.uv * w1;
+        uv2 = v2.uv * w2;
+        uv3 = v3.uv * w3;
+    }
+
+    f32 A, B, C, W, depth;
+    Color pixel_color = color;
+
+    // Scan the bounds:
+    f32 B_row, C_row;
+    for (u32 y = scan_first_y; y <= scan_last_y; y++) {
+        B_row = B_start + Bdy * (f32)(y - first_y);
+        C_row = C_start + Cdy * (f32)(y - first_y);
+
+        for (u32 x = scan_first_x; x <= scan_last_x; x++) {
+            B = B_row + Bdx * (f32)(x - first_x);
+            C = C_row + Cdx * (f32)(x - first_x);
+            if (((Bdx < 0) && (B < 0)) ||
+                ((Cdx < 0) && (C < 0)))
+                break;
+
+            A = 1 - B - C;
+
+            // Skip the pixel if it's outside:
+            if (A < 0 || B < 0 || C < 0)
+                continue;
+
+            W = A*w1 + B*w2 + C*w3;
+            depth = 1.0f / W;
+            if (texture_mip) {
+                vec2 uv{(uv1 * A + uv2 * B + uv3 * C) * depth};
+                pixel_color = texture_mip->sample(uv.x, uv.y).color * color;
+            }
+
+            canvas.setPixel((i32)x, (i32)y, pixel_color, opacity, depth, depth, depth, depth);
+        }
+    }
+}
+
+
+enum RasterCommandType : u8 {
+    RasterCommand_Line,
+    RasterCommand_Triangle
+};
+
+struct RasterCommand {
+    RasterVertex vertices[3]; // Projected (in viewport pixels), with view-space depths. Lines only use the first 2.
+    const Texture *texture;
+    Color color;
+    f32 opacity;
+    RasterCommandType type;
+    u8 line_width;
+    u8 first_tile_x, first_tile_y, last_tile_x, last_tile_y;
+    u64 signature; // A hash of what the command draws (see TileRasterizer::track_damage)
+};
+
+// Like FNV-1a, though a word at a time (with the high half of the hash folded back in, to spread the words' bits):
+INLINE u64 _hashRasterValue(u64 hash, u32 bits) {
+    hash = (hash ^ bits) * 0x100000001B3ULL;
+    return hash ^ (hash >> 32);
+}
+
+INLINE u64 _hashRasterValue(u64 hash, f32 value) {
+    union { f32 f; u32 u; } bits{value};
+    return _hashRasterValue(hash, bits.u);
+}
+
+u64 _getRasterCommandSignature(const RasterCommand &command) {
+    u64 hash = 0xCBF29CE484222325ULL;
+    hash = _hashRasterValue(hash, (u32)command.type | (u32)command.line_width << 8);
+    u8 vertex_count = command.type == RasterCommand_Line ? 2 : 3;
+    for (u8 i = 0; i < vertex_count; i++) {
+        const RasterVertex &vertex = command.vertices[i];
+        hash = _hashRasterValue(hash, vertex.position.x);
+        hash = _hashRasterValue(hash, vertex.position.y);
+        hash = _hashRasterValue(hash, vertex.position.z);
+        if (command.texture) {
+            hash = _hashRasterValue(hash, vertex.uv.x);
+            hash = _hashRasterValue(hash, vertex.uv.y);
+        }
+    }
+    hash = _hashRasterValue(hash, (u32)(u64)command.texture);
+    hash = _hashRasterValue(hash, (u32)((u64)command.texture >> 32));
+    hash = _hashRasterValue(hash, command.color.r);
+    hash = _hashRasterValue(hash, command.color.g);
+    hash = _hashRasterValue(hash, command.color.b);
+    return _hashRasterValue(hash, command.opacity);
+}
+
+// Draws lines and triangles into a viewport's canvas in parallel, tile by tile.
+// While attached to a viewport (between begin and end), drawing into the viewport is recorded as commands instead of
+// being drawn: Edges (so any 3D lines, i.e: of grids, boxes, curves and mesh wireframes) and filled meshes.
+// On flushing, the commands are binned into the tiles that they overlap, and the tiles are then drawn on the thread
+// pool. A tile's pixels (and depths) are only written to by the thread drawing it, so no locking is needed.
+// As each tile draws its commands in the order that they were recorded, the result is the same as drawing directly.
+// Commands are flushed when they run out (before recording any more), and when detaching from the viewport.
+//
+// When tracking damage, only the tiles that changed since the last frame are cleared, drawn and resolved to the window
+// (so a static scene costs little more than recording its commands). A tile changed when the commands overlapping it
+// differ (by their signatures), or when it is invalidated, for drawing that is done directly into the canvas in it
+// (i.e: a HUD). Tiles invalidated in a frame are redrawn in the next frame too, erasing what was drawn directly.
+// Everything drawn into the canvas outside of invalidated tiles must then be recorded, so the canvas is not cleared
+// by the caller (the rasterizer clears the tiles that it draws). Textures are assumed not to change in place.
+// The whole canvas is redrawn when its dimensions, antialiasing or the viewport's bounds change, and on any frame
+// whose commands do not all fit at once.
+struct TileRasterizer {
+    RasterCommand *commands{nullptr};
+    u32 *binned_command_ids{nullptr}; // Tile after tile, the ids of the commands overlapping the tile
+    u32 *shared_command_ids{nullptr}; // The ids of the commands that every tile goes through
+    u32 command_count{0};
+    u32 shared_command_count{0};
+    u32 capacity{0};
+
+    u32 tile_offsets[TILE_RASTERIZER_MAX_TILE_COUNT + 1]; // Where each tile's command ids start (and end)
+    u32 tiles_per_row{0};
+    u32 tiles_per_column{0};
+
+    Viewport *viewport{nullptr};
+    ThreadPool *thread_pool{nullptr};
+
+    bool track_damage{false};
+    bool signatures_are_valid{false}; // Whether tile_signatures are those of a whole previous frame (of the same layout)
+    bool damage_is_checked{false};    // Whether this frame's changed tiles were found already (on its first flush)
+    bool frame_is_partial{false};     // Whether this frame's commands are flushed in more than one go
+    bool invalidated_tiles[TILE_RASTERIZER_MAX_TILE_COUNT]{};
+    bool previously_invalidated_tiles[TILE_RASTERIZER_MAX_TILE_COUNT]{};
+    bool changed_tiles[TILE_RASTERIZER_MAX_TILE_COUNT]{};
+    u64 tile_signatures[TILE_RASTERIZER_MAX_TILE_COUNT]{};
+    u16 last_width{0}, last_height{0};
+    AntiAliasing last_antialias{NoAA};
+    RectI last_bounds{};
+
+    static u64 getSizeInBytes(u32 max_command_count) {
+        return (sizeof(RasterCommand) + sizeof(u32) * (TILE_RASTERIZER_MAX_TILES_PER_COMMAND + 1)) * max_command_count;
+    }
+
+    bool allocate(u32 max_command_count, memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = getSizeInBytes(max_command_count);
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            commands = (RasterCommand*)memory_allocator->allocate(size);
+        } else
+            commands = (RasterCommand*)os::getMemory(size);
+
+        capacity = commands ? max_command_count : 0;
+        binned_command_ids = commands ? (u32*)(commands + capacity) : nullptr;
+        shared_command_ids = commands ? binned_command_ids + capacity * TILE_RASTERIZER_MAX_TILES_PER_COMMAND : nullptr;
+        return commands != nullptr;
+    }
+
+    void begin(Viewport &target_viewport, ThreadPool *pool = nullptr) {
+        if (viewport) end();
+        if (!commands) return;
+
+        viewport = &target_viewport;
+        viewport->rasterizer = this;
+        thread_pool = pool;
+        command_count = shared_command_count = 0;
+        tiles_per_row    = (viewport->canvas.dimensions.width  + TILE_RASTERIZER_TILE_SIZE - 1) / TILE_RASTERIZER_TILE_SIZE;
+        tiles_per_column = (viewport->canvas.dimensions.height + TILE_RASTERIZER_TILE_SIZE - 1) / TILE_RASTERIZER_TILE_SIZE;
+
+        const Canvas &canvas = viewport->canvas;
+        const RectI &bounds = viewport->bounds;
+        if (last_width != canvas.dimensions.width || last_height != canvas.dimensions.height ||
+            last_antialias != canvas.antialias ||
+            last_bounds.left != bounds.left || last_bounds.right != bounds.right ||
+            last_bounds.top != bounds.top || last_bounds.bottom != bounds.bottom) {
+            last_width = canvas.dimensions.width;
+            last_height = canvas.dimensions.height;
+            last_antialias = canvas.antialias;
+            last_bounds = bounds;
+            signatures_are_valid = false;
+        }
+        if (!track_damage) signatures_are_valid = false;
+
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        for (u32 tile = 0; tile < tile_count; tile++) {
+            previously_invalidated_tiles[tile] = invalidated_tiles[tile];
+            invalidated_tiles[tile] = changed_tiles[tile] = false;
+        }
+        damage_is_checked = frame_is_partial = false;
+    }
+
+    void end() {
+        if (!viewport) return;
+
+        flush();
+        if (track_damage) {
+            // Even with no commands at all, tiles that had any before (or that are invalidated) need clearing:
+            if (!damage_is_checked) drawTiles();
+            signatures_are_valid = !frame_is_partial;
+        }
+        viewport->rasterizer = nullptr;
+        viewport = nullptr;
+    }
+
+    // Marks the tiles overlapped by a rectangle of canvas pixels as changed in this frame (and the next one).
+    // Invalidation should be done before the rasterizer is ended, for the tiles to be cleared and redrawn.
+    void invalidate(RectI bounds) {
+        bounds -= RectI{0, (i32)(tiles_per_row * TILE_RASTERIZER_TILE_SIZE) - 1, 0, (i32)(tiles_per_column * TILE_RASTERIZER_TILE_SIZE) - 1};
+        if (!bounds) return;
+
+        for (i32 y = bounds.top / TILE_RASTERIZER_TILE_SIZE; y <= bounds.bottom / TILE_RASTERIZER_TILE_SIZE; y++)
+            for (i32 x = bounds.left / TILE_RASTERIZER_TILE_SIZE; x <= bounds.right / TILE_RASTERIZER_TILE_SIZE; x++)
+                invalidated_tiles[y * tiles_per_row + x] = true;
+    }
+
+    void invalidate() {
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        for (u32 tile = 0; tile < tile_count; tile++) invalidated_tiles[tile] = true;
+    }
+
+    // Resolves the canvas into the window: When tracking damage, only the tiles that changed in the last frame are.
+    void drawToWindow(const Canvas &canvas) const {
+        if (!track_damage) {
+            canvas.drawToWindow(thread_pool);
+            return;
+        }
+
+        TileResolveJob job{this, &canvas};
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        if (thread_pool && thread_pool->thread_count > 1)
+            thread_pool->parallelFor(tile_count, 1, resolveTilesJob, &job, 0);
+        else
+            resolveTilesJob(&job, 0, tile_count, 0);
+    }
+
+    void addLine(const vec3 &from, const vec3 &to, const Color &color, f32 opacity, u8 line_width) {
+        RasterCommand command;
+        command.type = RasterCommand_Line;
+        command.vertices[0].position = from;
+        command.vertices[1].position = to;
+        command.texture = nullptr;
+        command.color = color;
+        command.opacity = opacity;
+        command.line_width = line_width;
+        add(command, Rect{
+            from.x < to.x ? from.x : to.x,
+            from.x < to.x ? to.x : from.x,
+            from.y < to.y ? from.y : to.y,
+            from.y < to.y ? to.y : from.y
+        });
+    }
+
+    void addTriangle(const RasterVertex &v1, const RasterVertex &v2, const RasterVertex &v3,
+                     const Color &color, f32 opacity, const Texture *texture = nullptr) {
+        RasterCommand command;
+        command.type = RasterCommand_Triangle;
+        command.vertices[0] = v1;
+        command.vertices[1] = v2;
+        command.vertices[2] = v3;
+        command.texture = texture;
+        command.color = color;
+        command.opacity = opacity;
+        command.line_width = 0;
+
+        const vec3 &A = v1.position;
+        const vec3 &B = v2.position;
+        Rect bounds{
+            A.x < B.x ? A.x : B.x,
+            A.x < B.x ? B.x : A.x,
+            A.y < B.y ? A.y : B.y,
+            A.y < B.y ? B.y : A.y
+        };
+        if (v3.position.x < bounds.left) bounds.left = v3.position.x;
+        if (v3.position.x > bounds.right) bounds.right = v3.position.x;
+        if (v3.position.y < bounds.top) bounds.top = v3.position.y;
+        if (v3.position.y > bounds.bottom) bounds.bottom = v3.position.y;
+        add(command, bounds);
+    }
+
+    void flush() {
+        if (!viewport || !command_count) return;
+        if (track_damage && !damage_is_checked && command_count == capacity) {
+            // Commands that are yet to be recorded might overlap any tile, so all tiles are changed in this frame:
+            frame_is_partial = true;
+            invalidate();
+        }
+
+        // Bin the commands: Count the commands of each tile, turn the counts into offsets, then scatter the ids.
+        // The offsets of the tiles end up one tile ahead (at the end of each tile), and are shifted back after:
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        for (u32 tile = 0; tile <= tile_count; tile++) tile_offsets[tile] = 0;
+
+        RasterCommand *command = commands;
+        for (u32 id = 0; id < command_count; id++, command++)
+            if (isBinned(*command))
+                for (u32 y = command->first_tile_y; y <= command->last_tile_y; y++)
+                    for (u32 x = command->first_tile_x; x <= command->last_tile_x; x++)
+                        tile_offsets[y * tiles_per_row + x + 1]++;
+
+        for (u32 tile = 1; tile <= tile_count; tile++) tile_offsets[tile] += tile_offsets[tile - 1];
+
+        command = commands;
+        for (u32 id = 0; id < command_count; id++, command++)
+            if (isBinned(*command))
+                for (u32 y = command->first_tile_y; y <= command->last_tile_y; y++)
+                    for (u32 x = command->first_tile_x; x <= command->last_tile_x; x++)
+                        binned_command_ids[tile_offsets[y * tiles_per_row + x]++] = id;
+
+        for (u32 tile = tile_count; tile > 0; tile--) tile_offsets[tile] = tile_offsets[tile - 1];
+        tile_offsets[0] = 0;
+
+        drawTiles();
+        command_count = shared_command_count = 0;
+    }
+
+private:
+    void add(RasterCommand &command, Rect bounds) {
+        // Find the tiles overlapped by the command's pixels (in canvas pixels, clipped to the viewport):
+        const RectI &viewport_bounds = viewport->bounds;
+        bounds.x_range += (f32)viewport_bounds.left;
+        bounds.y_range += (f32)viewport_bounds.top;
+        bounds -= Rect{(f32)viewport_bounds.left, (f32)viewport_bounds.right, (f32)viewport_bounds.top, (f32)viewport_bounds.bottom};
+        bounds -= Rect{0, viewport->canvas.dimensions.f_width - 1.0f, 0, viewport->canvas.dimensions.f_height - 1.0f};
+        if (!bounds)
+            return;
+
+        command.first_tile_x = (u8)((u32)bounds.left / TILE_RASTERIZER_TILE_SIZE);
+        command.first_tile_y = (u8)((u32)bounds.top  / TILE_RASTERIZER_TILE_SIZE);
+        command.last_tile_x  = (u8)((u32)ceilf(bounds.right)  / TILE_RASTERIZER_TILE_SIZE);
+        command.last_tile_y  = (u8)((u32)ceilf(bounds.bottom) / TILE_RASTERIZER_TILE_SIZE);
+        if (command.last_tile_x >= tiles_per_row) command.last_tile_x = (u8)(tiles_per_row - 1);
+        if (command.last_tile_y >= tiles_per_column) command.last_tile_y = (u8)(tiles_per_column - 1);
+
+        if (command_count == capacity) flush();
+        if (track_damage) command.signature = _getRasterCommandSignature(command);
+        if (!isBinned(command)) shared_command_ids[shared_command_count++] = command_count;
+        commands[command_count++] = command;
+    }
+
+    void drawTiles() {
+        u32 tile_count = tiles_per_row * tiles_per_column;
+        if (thread_pool && thread_pool->thread_count > 1)
+            thread_pool->parallelFor(tile_count, 1, drawTilesJob, this, 0);
+        else
+            drawTilesJob(this, 0, tile_count, 0);
+        damage_is_checked = true;
+    }
+
+    // In canvas pixels (inclusive, and not clipped to the canvas):
+    RectI getTileBounds(u32 tile) const {
+        u32 tile_x = tile % tiles_per_row;
+        u32 tile_y = tile / tiles_per_row;
+        return {
+            (i32)(tile_x * TILE_RASTERIZER_TILE_SIZE),
+            (i32)(tile_x * TILE_RASTERIZER_TILE_SIZE + TILE_RASTERIZER_TILE_SIZE - 1),
+            (i32)(tile_y * TILE_RASTERIZER_TILE_SIZE),
+            (i32)(tile_y * TILE_RASTERIZER_TILE_SIZE + TILE_RASTERIZER_TILE_SIZE - 1)
+        };
+    }
+
+    // Calls the given function with the id of each command overlapping the tile, in the order they were recorded
+    // (merging the tile's own commands with the shared ones):
+    template <typename Function>
+    INLINE void forEachCommandOfTile(u32 tile, Function &&function) const {
+        u32 tile_x = tile % tiles_per_row;
+        u32 tile_y = tile / tiles_per_row;
+        const u32 *binned = binned_command_ids + tile_offsets[tile];
+        const u32 *binned_end = binned_command_ids + tile_offsets[tile + 1];
+        const u32 *shared = shared_command_ids;
+        const u32 *shared_end = shared + shared_command_count;
+        while (binned != binned_end || shared != shared_end) {
+            u32 id;
+            if (shared == shared_end || (binned != binned_end && *binned < *shared))
+                id = *(binned++);
+            else {
+                id = *(shared++);
+                const RasterCommand &command = commands[id];
+                if (tile_x < command.first_tile_x || tile_x > command.last_tile_x ||
+                    tile_y < command.first_tile_y || tile_y > command.last_tile_y)
+                    continue;
+            }
+
+            function(id);
+        }
+    }
+
+    // Whether a tile is to be drawn in this flush. On the first flush of a frame that tracks damage, the tile's
+    // signature is updated and compared against the one it had in the last frame, and a changed tile is cleared:
+    bool prepareTile(u32 tile) {
+        if (!track_damage) return true;
+        if (damage_is_checked) return changed_tiles[tile];
+
+        u64 signature = 0xCBF29CE484222325ULL;
+        if (command_count)
+            forEachCommandOfTile(tile, [&](u32 id) {
+                signature = _hashRasterValue(_hashRasterValue(signature, (u32)commands[id].signature), (u32)(commands[id].signature >> 32));
+            });
+
+        bool changed = !signatures_are_valid || signature != tile_signatures[tile] ||
+                       invalidated_tiles[tile] || previously_invalidated_tiles[tile];
+        tile_signatures[tile] = signature;
+        changed_tiles[tile] = changed;
+        if (changed) viewport->canvas.clear(getTileBounds(tile));
+
+        return changed;
+    }
+
+    static INLINE bool isBinned(const RasterCommand &command) {
+        return (u32)(command.last_tile_x - command.first_tile_x + 1) *
+               (u32)(command.last_tile_y - command.first_tile_y + 1) <= TILE_RASTERIZER_MAX_TILES_PER_COMMAND;
+    }
+
+    void draw(const RasterCommand &command, const RectI &tile_bounds) const {
+        const RasterVertex *v = command.vertices;
+        if (command.type == RasterCommand_Line)
+            _drawLine(v[0].position.x, v[0].position.y, v[0].position.z,
+                      v[1].position.x, v[1].position.y, v[1].position.z,
+                      viewport->canvas, command.color, command.opacity, command.line_width, &viewport->bounds, &tile_bounds);
+        else
+            _fillPerspectiveTriangle(v[0], v[1], v[2], viewport->canvas, command.color, command.opacity, command.texture,
+                                     &viewport->bounds, &tile_bounds);
+    }
+
+    struct TileResolveJob {
+        const TileRasterizer *rasterizer;
+        const Canvas *canvas;
+    };
+
+    static void resolveTilesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        TileResolveJob &job = *(TileResolveJob*)data;
+        for (u32 tile = start; tile < end; tile++)
+            if (job.rasterizer->changed_tiles[tile])
+                job.canvas->drawToWindow(job.rasterizer->getTileBounds(tile));
+    }
+
+    static void drawTilesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        TileRasterizer &rasterizer = *(TileRasterizer*)data;
+        for (u32 tile = start; tile < end; tile++) {
+            if (!rasterizer.prepareTile(tile) || !rasterizer.command_count) continue;
+
+            RectI tile_bounds{rasterizer.getTileBounds(tile)};
+            rasterizer.forEachCommandOfTile(tile, [&](u32 id) {
+                rasterizer.draw(rasterizer.commands[id], tile_bounds);
+            });
+        }
+    }
+};
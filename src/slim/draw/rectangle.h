@@ -26,57 +26,13 @@ void _drawRect(RectI rect, const Canvas &canvas, const Color &color, f32 opacity
     if (!rect)
         return;
 
-    if (canvas.antialias == SSAA) {
-        rect *= 2;
-
-        if (draw_horizontal) {
-            for (i32 x = rect.left; x <= rect.right; x += 2) {
-                if (draw_bottom) {
-                    canvas.setPixel(x, rect.bottom, color, opacity);
-                    canvas.setPixel(x+1, rect.bottom, color, opacity);
-                    canvas.setPixel(x, rect.bottom+1, color, opacity);
-                    canvas.setPixel(x+1, rect.bottom+1, color, opacity);
-                }
-                if (draw_top) {
-                    canvas.setPixel(x, rect.top, color, opacity);
-                    canvas.setPixel(x+1, rect.top, color, opacity);
-                    canvas.setPixel(x, rect.top+1, color, opacity);
-                    canvas.setPixel(x+1, rect.top+1, color, opacity);
-                }
-            }
-        }
-
-        if (draw_vertical) {
-            for (i32 y = rect.top; y <= rect.bottom; y += 2) {
-                if (draw_left) {
-                    canvas.setPixel(rect.left, y, color, opacity);
-                    canvas.setPixel(rect.left+1, y, color, opacity);
-                    canvas.setPixel(rect.left, y+1, color, opacity);
-                    canvas.setPixel(rect.left+1, y+1, color, opacity);
-                }
-                if (draw_right) {
-                    canvas.setPixel(rect.right, y, color, opacity);
-                    canvas.setPixel(rect.right+1, y, color, opacity);
-                    canvas.setPixel(rect.right, y+1, color, opacity);
-                    canvas.setPixel(rect.right+1, y+1, color, opacity);
-                }
-            }
-        }
-    } else {
-        if (draw_horizontal) {
-            for (i32 x = rect.left; x <= rect.right; x++) {
-                if (draw_bottom) canvas.setPixel(x, rect.bottom, color, opacity);
-                if (draw_top) canvas.setPixel(x, rect.top, color, opacity);
-            }
-        }
-
-        if (draw_vertical) {
-            for (i32 y = rect.top; y <= rect.bottom; y++) {
-                if (draw_right) canvas.setPixel(rect.right, y, color, opacity);
-                if (draw_left) canvas.setPixel(rect.left, y, color, opacity);
-            }
-        }
-    }
+    Pixel pixel{Canvas::toCanvasPixel(color, opacity)};
+    drawWithPixelWriter(canvas, pixel.opacity == 1.0f, [&](const auto &writer) {
+        if (draw_bottom) writer.writeHSpan(rect.left, rect.right, rect.bottom, pixel);
+        if (draw_top) writer.writeHSpan(rect.left, rect.right, rect.top, pixel);
+        if (draw_right) writer.writeVSpan(rect.right, rect.top, rect.bottom, pixel);
+        if (draw_left) writer.writeVSpan(rect.left, rect.top, rect.bottom, pixel);
+    });
 }
 
 void _fillRect(RectI rect, const Canvas &canvas, const Color &color, f32 opacity, const RectI *viewport_bounds) {
@@ -93,21 +49,11 @@ void _fillRect(RectI rect, const Canvas &canvas, const Color &color, f32 opacity
     if (!rect)
         return;
 
-    if (canvas.antialias == SSAA) {
-        rect *= 2;
-
-        for (i32 y = rect.top; y <= rect.bottom; y += 2) {
-            for (i32 x = rect.left; x <= rect.right; x += 2) {
-                canvas.setPixel(x, y, color, opacity);
-                canvas.setPixel(x+1, y, color, opacity);
-                canvas.setPixel(x, y+1, color, opacity);
-                canvas.setPixel(x+1, y+1, color, opacity);
-            }
-        }
-    } else
+    Pixel pixel{Canvas::toCanvasPixel(color, opacity)};
+    drawWithPixelWriter(canvas, pixel.opacity == 1.0f, [&](const auto &writer) {
         for (i32 y = rect.top; y <= rect.bottom; y++)
-            for (i32 x = rect.left; x <= rect.right; x++)
-                canvas.setPixel(x, y, color, opacity);
+            writer.writeHSpan(rect.left, rect.right, y, pixel);
+    });
 }
 
 
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "../scene/scene.h"
+#include "../scene/ray_packet.h"
+#include "../core/thread_pool.h"
+#include "../viewport/viewport.h"
+
+#define TRACE_TILE_SIZE 32 // In canvas samples (pixels, or sub-pixels with SSAA)
+
+// Packets cover blocks of neighbouring samples (2x2 for 4 rays, 4x2 for 8 rays), keeping their rays coherent:
+#define TRACE_PACKET_HEIGHT 2
+#define TRACE_PACKET_WIDTH (RAY_PACKET_WIDTH / TRACE_PACKET_HEIGHT)
+
+// How much of a surface's color is kept when facing away from the camera (the rest is lit by a head light):
+#define TRACE_AMBIENT_LIGHT 0.2f
+
+struct TraceJob {
+    const Scene *scene;
+    const Viewport *viewport;
+    u32 width, height;  // The viewport's sample counts
+    u32 tiles_per_row;
+};
+
+// Traces a packet of primary rays (each lane is one sample) against the meshes of the scene, and shades the hits.
+// A geometry's rays are given in its mesh's space with directions that are not re-normalized, so that distances
+// along them remain those of the camera's rays, and the closest hit can carry over from one geometry to the next.
+void traceSamplePacket(const TraceJob &job, u32 start_x, u32 start_y) {
+    const Scene &scene = *job.scene;
+    const Viewport &viewport = *job.viewport;
+    const Camera &camera = *viewport.camera;
+    Canvas &canvas = viewport.canvas;
+
+    vec3 directions[RAY_PACKET_WIDTH];
+    u32 geometry_ids[RAY_PACKET_WIDTH];
+    u32 triangle_ids[RAY_PACKET_WIDTH];
+    f32 distances[RAY_PACKET_WIDTH];
+    bool any_ray = false;
+    for (u8 lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+        u32 x = start_x + lane % TRACE_PACKET_WIDTH;
+        u32 y = start_y + lane / TRACE_PACKET_WIDTH;
+        geometry_ids[lane] = (u32)-1;
+        distances[lane] = -1;
+        if (x < job.width && y < job.height) {
+            directions[lane] = camera.getRayDirectionAt((f32)x, (f32)y, (f32)job.width, (f32)job.height);
+            distances[lane] = INFINITY;
+            any_ray = true;
+        }
+    }
+    if (!any_ray) return;
+
+    RayPacket packet;
+    const Geometry *geometry = scene.geometries;
+    for (u32 g = 0; g < scene.counts.geometries; g++, geometry++) {
+        if (geometry->type != GeometryType_Mesh) continue;
+
+        const Transform &transform = geometry->transform;
+        quat inv_rotation = transform.rotation.conjugate();
+        vec3 inv_scale = 1.0f / transform.scale;
+        vec3 origin = transform.internPos(camera.position);
+        for (u8 lane = 0; lane < RAY_PACKET_WIDTH; lane++)
+            if (distances[lane] < 0)
+                packet.disableRay(lane);
+            else
+                packet.setRay(lane, origin, inv_scale * (inv_rotation * directions[lane]), distances[lane]);
+
+        u32 hits = packet.castOn(scene.meshes[geometry->id]);
+        for (u8 lane = 0; hits; lane++, hits >>= 1)
+            if (hits & 1) {
+                distances[lane] = packet.distance[lane];
+                geometry_ids[lane] = g;
+                triangle_ids[lane] = packet.triangle_index[lane];
+            }
+    }
+
+    vec3 normal, position, U, V;
+    for (u8 lane = 0; lane < RAY_PACKET_WIDTH; lane++) {
+        if (geometry_ids[lane] == (u32)-1) continue;
+
+        const Geometry &hit_geometry = scene.geometries[geometry_ids[lane]];
+        const Mesh &mesh = scene.meshes[hit_geometry.id];
+        if (mesh.triangle_layout == TriangleLayout_Compact) {
+            mesh.getTriangle(triangle_ids[lane], position, U, V);
+            normal = U.cross(V);
+        } else
+            normal = mesh.triangles[triangle_ids[lane]].normal;
+
+        // Normals are transformed by the inverse-transpose (so by the inverse of the scale):
+        normal = (hit_geometry.transform.rotation * (normal / hit_geometry.transform.scale)).normalized();
+        f32 facing = fabsf(normal.dot(directions[lane]));
+        Color color = Color(hit_geometry.color) * (TRACE_AMBIENT_LIGHT + (1.0f - TRACE_AMBIENT_LIGHT) * facing);
+        color *= color;
+
+        i32 x = (i32)(start_x + lane % TRACE_PACKET_WIDTH);
+        i32 y = (i32)(start_y + lane / TRACE_PACKET_WIDTH);
+        f32 depth = distances[lane] * directions[lane].dot(camera.forward);
+        if (canvas.antialias == SSAA) {
+            x += viewport.bounds.left * 2;
+            y += viewport.bounds.top * 2;
+        } else {
+            x += viewport.bounds.left;
+            y += viewport.bounds.top;
+        }
+        u32 offset = canvas.antialias == SSAA ?
+                     ((canvas.dimensions.stride * (y >> 1) + (x >> 1)) * 4 + (2 * (y & 1)) + (x & 1)) :
+                     (canvas.dimensions.stride * y + x);
+        canvas.storePixel(offset, Pixel{color, 1.0f});
+        if (canvas.depths) {
+            if (canvas.antialias == MSAA) {
+                f32 *depths = canvas.depths + offset * 4;
+                depths[0] = depths[1] = depths[2] = depths[3] = depth;
+            } else
+                canvas.depths[offset] = depth;
+        }
+    }
+}
+
+void traceTilesJob(void *data, u32 start, u32 end, u32 thread_index) {
+    TraceJob &job = *(TraceJob*)data;
+    for (u32 tile = start; tile < end; tile++) {
+        u32 tile_x = (tile % job.tiles_per_row) * TRACE_TILE_SIZE;
+        u32 tile_y = (tile / job.tiles_per_row) * TRACE_TILE_SIZE;
+        u32 end_x = tile_x + TRACE_TILE_SIZE < job.width ? tile_x + TRACE_TILE_SIZE : job.width;
+        u32 end_y = tile_y + TRACE_TILE_SIZE < job.height ? tile_y + TRACE_TILE_SIZE : job.height;
+        for (u32 y = tile_y; y < end_y; y += TRACE_PACKET_HEIGHT)
+            for (u32 x = tile_x; x < end_x; x += TRACE_PACKET_WIDTH)
+                traceSamplePacket(job, x, y);
+    }
+}
+
+// A shaded (ray traced) render of the scene's meshes into the viewport's canvas, with a primary ray per sample.
+// Hit samples get their geometry's color (lit by a head light) and their view-space depth, so that other drawing
+// (i.e: wireframes) can still be depth-tested against them. Missed samples are left as they were.
+// The viewport is split into tiles, which the thread pool's threads pick up (and steal from one another) as they go.
+void traceScene(const Scene &scene, const Viewport &viewport, ThreadPool *thread_pool = nullptr) {
+    if (!viewport.canvas.hasPixels()) return;
+
+    TraceJob job{&scene, &viewport, viewport.dimensions.width, viewport.dimensions.height};
+    if (viewport.canvas.antialias == SSAA) {
+        job.width *= 2;
+        job.height *= 2;
+    }
+    job.tiles_per_row = (job.width + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE;
+    u32 tile_count = job.tiles_per_row * ((job.height + TRACE_TILE_SIZE - 1) / TRACE_TILE_SIZE);
+    if (thread_pool && thread_pool->thread_count > 1)
+        thread_pool->parallelFor(tile_count, 1, traceTilesJob, &job, 0);
+    else
+        traceTilesJob(&job, 0, tile_count, 0);
+}
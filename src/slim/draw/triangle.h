@@ -1,6 +1,7 @@
 #pragma once
 
 #include "./line.h"
+#include "../math/simd.h"
 
 INLINE void _drawTriangle(f32 x1, f32 y1, f32 z1,
                           f32 x2, f32 y2, f32 z2,
@@ -12,6 +13,11 @@ INLINE void _drawTriangle(f32 x1, f32 y1, f32 z1,
 }
 
 
+// Triangles are filled in tiles of samples (pixels, or sub-pixels with SSAA), each scanned in blocks of SIMD lanes.
+// Without antialiasing a block is a span of SIMD_WIDTH pixels of a row, and with SSAA it is the 2x2 sub-pixels of
+// SIMD_WIDTH/4 neighbouring pixels, so that either way a block's samples are laid out contiguously in the canvas.
+#define TRIANGLE_FILL_TILE_SIZE 8
+
 void _fillTriangle(f32 x1, f32 y1, f32 z1,
                    f32 x2, f32 y2, f32 z2,
                    f32 x3, f32 y3, f32 z3,
@@ -50,14 +56,19 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
     if (!rect)
         return;
 
-    if (canvas.antialias == SSAA) {
+    bool ssaa = canvas.antialias == SSAA;
+    if (ssaa) {
         x1 *= 2.0f;
         x2 *= 2.0f;
         x3 *= 2.0f;
         y1 *= 2.0f;
         y2 *= 2.0f;
         y3 *= 2.0f;
-        rect *= 2.0f;;
+        rect *= 2.0f;
+
+        // Include the last pixels' second sub-pixels:
+        rect.right += 1.0f;
+        rect.bottom += 1.0f;
     }
 
     // Compute area components:
@@ -79,6 +90,10 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
         y3 = y2;
         y2 = tmp;
 
+        tmp = z3;
+        z3 = z2;
+        z2 = tmp;
+
         ABx = x2 - x1;
         ABy = y2 - y1;
 
@@ -89,20 +104,15 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
         return;
 
     // Floor bounds coordinates down to their integral component:
-    u32 first_x = (u32)rect.left;
-    u32 first_y = (u32)rect.top;
-    u32 last_x  = (u32)rect.right;
-    u32 last_y  = (u32)rect.bottom;
-
-    rect.left   = (f32)first_x;
-    rect.top    = (f32)first_y;
-    rect.right  = (f32)last_x;
-    rect.bottom = (f32)last_y;
+    i32 first_x = (i32)rect.left;
+    i32 first_y = (i32)rect.top;
+    i32 last_x  = (i32)rect.right;
+    i32 last_y  = (i32)rect.bottom;
 
     // Drawing: Top-down
     // Origin: Top-left
 
-    // Compute weight constants:
+    // Compute weight constants (the areal coordinates of a sample center at x, y are then B = Bdx*x + Bdy*y + B0):
     f32 one_over_ABC = 1.0f / ABC;
 
     f32 Cdx =  ABy * one_over_ABC;
@@ -111,36 +121,123 @@ void _fillTriangle(f32 x1, f32 y1, f32 z1,
     f32 Cdy = -ABx * one_over_ABC;
     f32 Bdy =  ACx * one_over_ABC;
 
-    // Compute initial areal coordinates for the first pixel center:
-    rect.left += 0.5f;
-    rect.top += 0.5f;
-    f32 C_start = Cdx*rect.left + Cdy*rect.top + (y1*x2 - x1*y2) * one_over_ABC;
-    f32 B_start = Bdx*rect.left + Bdy*rect.top + (y3*x1 - x3*y1) * one_over_ABC;
-
-    f32 A, B, C;
+    f32 C0 = (y1*x2 - x1*y2) * one_over_ABC;
+    f32 B0 = (y3*x1 - x3*y1) * one_over_ABC;
 
-    // Scan the bounds:
     bool depth_provided = z1 != 0 || z2 != 0 || z3 != 0;
-    f32 depth = 0;
-    for (u32 y = first_y; y <= last_y; y++, C_start += Cdy, B_start += Bdy) {
-        B = B_start;
-        C = C_start;
 
-        for (u32 x = first_x; x <= last_x; x++, B += Bdx, C += Cdx) {
-            if (((Bdx < 0) && (B < 0)) ||
-                ((Cdx < 0) && (C < 0)))
-                break;
-
-            A = 1 - B - C;
-
-            // Skip the pixel if it's outside:
-            if (A < 0 || B < 0 || C < 0)
+    // Opaque samples can be written directly (as setPixel would), rather than going through setPixel one by one:
+    opacity = clampedValue(opacity);
+    bool direct_writes = opacity == 1.0f && canvas.antialias != MSAA;
+    Pixel pixel{color.clamped(), 1.0f};
+    pixel.color *= pixel.color;
+    HalfPixel half_pixel{pixel};
+
+    // The offsets of the samples of a block from its top-left sample (at even coordinates with SSAA):
+    const i32 block_width  = ssaa ? SIMD_WIDTH / 2 : SIMD_WIDTH;
+    const i32 block_height = ssaa ? 2 : 1;
+    f32 lane_x_offsets[SIMD_WIDTH], lane_y_offsets[SIMD_WIDTH];
+    for (u8 lane = 0; lane < SIMD_WIDTH; lane++) {
+        lane_x_offsets[lane] = (f32)(ssaa ? ((lane >> 1) & ~1) + (lane & 1) : lane);
+        lane_y_offsets[lane] = (f32)(ssaa ? (lane >> 1) & 1 : 0);
+    }
+    const simd_f32 lane_xs = simd::load(lane_x_offsets);
+    const simd_f32 lane_ys = simd::load(lane_y_offsets);
+    const simd_f32 zero = simd::set1(0.0f);
+    const simd_f32 one = simd::set1(1.0f);
+    const simd_f32 half = simd::set1(0.5f);
+    const simd_f32 first_xs = simd::set1((f32)first_x), last_xs = simd::set1((f32)last_x);
+    const simd_f32 first_ys = simd::set1((f32)first_y), last_ys = simd::set1((f32)last_y);
+    const simd_f32 Bdxs = simd::set1(Bdx), Bdys = simd::set1(Bdy), B0s = simd::set1(B0);
+    const simd_f32 Cdxs = simd::set1(Cdx), Cdys = simd::set1(Cdy), C0s = simd::set1(C0);
+    const simd_f32 z1s = simd::set1(z1), z2s = simd::set1(z2), z3s = simd::set1(z3);
+    f32 depths[SIMD_WIDTH];
+
+    const i32 sample_width  = ssaa ? canvas.dimensions.width  * 2 : canvas.dimensions.width;
+    const i32 sample_height = ssaa ? canvas.dimensions.height * 2 : canvas.dimensions.height;
+    const i32 tile_last = TRIANGLE_FILL_TILE_SIZE - 1;
+    for (i32 tile_y = first_y & ~tile_last; tile_y <= last_y; tile_y += TRIANGLE_FILL_TILE_SIZE) {
+        for (i32 tile_x = first_x & ~tile_last; tile_x <= last_x; tile_x += TRIANGLE_FILL_TILE_SIZE) {
+            // Reject the tile when all of its corner samples are outside of the same edge (as the areal coordinates
+            // vary linearly across it). The corners are evaluated exactly as the samples are, and tiles are never
+            // accepted whole, so that every drawn sample passes the same per-sample test (the fill rule):
+            f32 left = (f32)tile_x + 0.5f, right = left + (f32)tile_last;
+            f32 top  = (f32)tile_y + 0.5f, bottom = top + (f32)tile_last;
+            f32 corner_xs[4] = {left, right, left, right};
+            f32 corner_ys[4] = {top, top, bottom, bottom};
+            simd4_f32 corner_X = simd::load4(corner_xs);
+            simd4_f32 corner_Y = simd::load4(corner_ys);
+            simd4_f32 corner_B = simd::fmadd(simd::set4(Bdx), corner_X, simd::fmadd(simd::set4(Bdy), corner_Y, simd::set4(B0)));
+            simd4_f32 corner_C = simd::fmadd(simd::set4(Cdx), corner_X, simd::fmadd(simd::set4(Cdy), corner_Y, simd::set4(C0)));
+            simd4_f32 corner_A = simd::sub(simd::sub(simd::set4(1.0f), corner_B), corner_C);
+            simd4_f32 corners_zero = simd::set4(0.0f);
+            if (!simd::lessOrEqualMask(corners_zero, corner_A) ||
+                !simd::lessOrEqualMask(corners_zero, corner_B) ||
+                !simd::lessOrEqualMask(corners_zero, corner_C))
                 continue;
 
-            if (depth_provided)
-                depth = A*z1 + B*z2 + C*z3;
-
-            canvas.setPixel(x, y, color, opacity, depth);
+            for (i32 y = tile_y; y < tile_y + TRIANGLE_FILL_TILE_SIZE; y += block_height) {
+                if (y > last_y || y + block_height - 1 < first_y) continue;
+
+                for (i32 x = tile_x; x < tile_x + TRIANGLE_FILL_TILE_SIZE; x += block_width) {
+                    if (x > last_x || x + block_width - 1 < first_x) continue;
+
+                    simd_f32 X = simd::add(simd::set1((f32)x), lane_xs);
+                    simd_f32 Y = simd::add(simd::set1((f32)y), lane_ys);
+                    simd_f32 mask = simd::maskAnd(
+                        simd::maskAnd(simd::lessOrEqual(first_xs, X), simd::lessOrEqual(X, last_xs)),
+                        simd::maskAnd(simd::lessOrEqual(first_ys, Y), simd::lessOrEqual(Y, last_ys)));
+
+                    // Areal coordinates at the sample centers:
+                    X = simd::add(X, half);
+                    Y = simd::add(Y, half);
+                    simd_f32 B = simd::fmadd(Bdxs, X, simd::fmadd(Bdys, Y, B0s));
+                    simd_f32 C = simd::fmadd(Cdxs, X, simd::fmadd(Cdys, Y, C0s));
+                    simd_f32 A = simd::sub(simd::sub(one, B), C);
+                    mask = simd::maskAnd(mask, simd::maskAnd(simd::lessOrEqual(zero, A),
+                                               simd::maskAnd(simd::lessOrEqual(zero, B),
+                                                             simd::lessOrEqual(zero, C))));
+                    u32 covered = simd::maskBits(mask);
+                    if (!covered)
+                        continue;
+
+                    simd_f32 depth = zero;
+                    if (depth_provided)
+                        depth = simd::fmadd(A, z1s, simd::fmadd(B, z2s, simd::mul(C, z3s)));
+                    simd::store(depths, depth);
+
+                    if (direct_writes && x + block_width <= sample_width && y + block_height <= sample_height) {
+                        u32 offset = ssaa ? (canvas.dimensions.stride * (y >> 1) + (x >> 1)) * 4 : (canvas.dimensions.stride * y + x);
+                        u32 written = covered;
+                        if (canvas.depths) {
+                            f32 *out_depths = canvas.depths + offset;
+                            simd_f32 out_depth = simd::load(out_depths);
+
+                            // Samples that are not in front stay as they are when opaque (otherwise they get blended):
+                            if (depth_provided) {
+                                simd_f32 in_front = simd::maskAnd(mask, simd::lessThan(depth, out_depth));
+                                written = simd::maskBits(in_front);
+                                mask = in_front;
+                                for (u32 behind = covered & ~written, lane = 0; behind; behind >>= 1, lane++)
+                                    if ((behind & 1) && canvas.loadPixel(offset + lane).opacity != 1.0f)
+                                        canvas.setPixel(x + (i32)lane_x_offsets[lane], y + (i32)lane_y_offsets[lane], color, opacity, depths[lane]);
+                            }
+                            simd::store(out_depths, simd::select(mask, depth, out_depth));
+                        }
+                        if (canvas.half_pixels) {
+                            for (u32 lane = 0; written; written >>= 1, lane++)
+                                if (written & 1)
+                                    canvas.half_pixels[offset + lane] = half_pixel;
+                        } else
+                            for (u32 lane = 0; written; written >>= 1, lane++)
+                                if (written & 1)
+                                    canvas.pixels[offset + lane] = pixel;
+                    } else
+                        for (u32 lane = 0; covered; covered >>= 1, lane++)
+                            if (covered & 1)
+                                canvas.setPixel(x + (i32)lane_x_offsets[lane], y + (i32)lane_y_offsets[lane], color, opacity, depths[lane]);
+                }
+            }
         }
     }
 }
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "../core/base.h"
+
+// A thin layer over the widest float vectors the target supports (AVX: 8 lanes, SSE: 4 lanes),
+// with a plain scalar fallback of 4 lanes for other targets. Loads and stores are unaligned.
+// A fixed 4-lane vector (simd4_f32) is also available everywhere, for data that comes in fours.
+// Comparisons either return a bit-mask of lanes, or a lane-mask vector for branchless selection.
+// Streaming stores (to 16-byte aligned addresses) bypass the caches, for large buffers that are written but not read
+// back soon after: They should be followed by a stream fence before the buffer is read (i.e: by another thread).
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define SIMD4_SSE 1
+    typedef __m128 simd4_f32;
+#else
+    #define SIMD4_SCALAR 1
+    struct simd4_f32 { f32 lanes[4]; };
+#endif
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define SIMD_WIDTH 8
+    #define SIMD_AVX 1
+    typedef __m256 simd_f32;
+#elif defined(SIMD4_SSE)
+    #define SIMD_WIDTH 4
+    #define SIMD_SSE 1
+    typedef simd4_f32 simd_f32;
+#else
+    #define SIMD_WIDTH 4
+    #define SIMD_SCALAR 1
+    typedef simd4_f32 simd_f32;
+#endif
+
+namespace simd {
+#if defined(SIMD4_SSE)
+    INLINE simd4_f32 set4(f32 value) { return _mm_set1_ps(value); }
+    INLINE simd4_f32 load4(const f32 *values) { return _mm_loadu_ps(values); }
+    INLINE void store4(f32 *values, simd4_f32 v) { _mm_storeu_ps(values, v); }
+    INLINE void stream4(f32 *aligned_values, simd4_f32 v) { _mm_stream_ps(aligned_values, v); }
+    INLINE void streamFence() { _mm_sfence(); }
+    INLINE simd4_f32 add(simd4_f32 a, simd4_f32 b) { return _mm_add_ps(a, b); }
+    INLINE simd4_f32 sub(simd4_f32 a, simd4_f32 b) { return _mm_sub_ps(a, b); }
+    INLINE simd4_f32 mul(simd4_f32 a, simd4_f32 b) { return _mm_mul_ps(a, b); }
+    INLINE simd4_f32 div(simd4_f32 a, simd4_f32 b) { return _mm_div_ps(a, b); }
+    INLINE simd4_f32 sqrt(simd4_f32 a) { return _mm_sqrt_ps(a); }
+    INLINE simd4_f32 min(simd4_f32 a, simd4_f32 b) { return _mm_min_ps(a, b); }
+    INLINE simd4_f32 max(simd4_f32 a, simd4_f32 b) { return _mm_max_ps(a, b); }
+    INLINE u32 lessOrEqualMask(simd4_f32 a, simd4_f32 b) { return (u32)_mm_movemask_ps(_mm_cmple_ps(a, b)); }
+    INLINE simd4_f32 lessThan(simd4_f32 a, simd4_f32 b) { return _mm_cmplt_ps(a, b); }
+    INLINE simd4_f32 lessOrEqual(simd4_f32 a, simd4_f32 b) { return _mm_cmple_ps(a, b); }
+    INLINE simd4_f32 maskOr(simd4_f32 a, simd4_f32 b) { return _mm_or_ps(a, b); }
+    INLINE simd4_f32 maskAnd(simd4_f32 a, simd4_f32 b) { return _mm_and_ps(a, b); }
+    INLINE simd4_f32 maskAndNot(simd4_f32 mask, simd4_f32 a) { return _mm_andnot_ps(mask, a); } // a && !mask
+    INLINE simd4_f32 select(simd4_f32 mask, simd4_f32 a, simd4_f32 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    INLINE u32 maskBits(simd4_f32 mask) { return (u32)_mm_movemask_ps(mask); }
+
+    // Lanes truncated (towards zero) to integers:
+    INLINE void storeTruncated4(i32 *values, simd4_f32 v) { _mm_storeu_si128((__m128i*)values, _mm_cvttps_epi32(v)); }
+
+    // Turns 4 vectors (rows) into 4 vectors of their lanes (columns), i.e: from 4 pixels to their 4 channels:
+    INLINE void transpose4(simd4_f32 &a, simd4_f32 &b, simd4_f32 &c, simd4_f32 &d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+#else
+    INLINE simd4_f32 set4(f32 value) { simd4_f32 r; for (u8 i = 0; i < 4; i++) r.lanes[i] = value; return r; }
+    INLINE simd4_f32 load4(const f32 *values) { simd4_f32 r; for (u8 i = 0; i < 4; i++) r.lanes[i] = values[i]; return r; }
+    INLINE void store4(f32 *values, simd4_f32 v) { for (u8 i = 0; i < 4; i++) values[i] = v.lanes[i]; }
+    INLINE void stream4(f32 *aligned_values, simd4_f32 v) { store4(aligned_values, v); }
+    INLINE void streamFence() {}
+    INLINE simd4_f32 add(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] += b.lanes[i]; return a; }
+    INLINE simd4_f32 sub(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] -= b.lanes[i]; return a; }
+    INLINE simd4_f32 mul(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] *= b.lanes[i]; return a; }
+    INLINE simd4_f32 div(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] /= b.lanes[i]; return a; }
+    INLINE simd4_f32 sqrt(simd4_f32 a) { for (u8 i = 0; i < 4; i++) a.lanes[i] = sqrtf(a.lanes[i]); return a; }
+    INLINE simd4_f32 min(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = a.lanes[i] < b.lanes[i] ? a.lanes[i] : b.lanes[i]; return a; }
+    INLINE simd4_f32 max(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = a.lanes[i] > b.lanes[i] ? a.lanes[i] : b.lanes[i]; return a; }
+    INLINE u32 lessOrEqualMask(simd4_f32 a, simd4_f32 b) {
+        u32 mask = 0;
+        for (u8 i = 0; i < 4; i++) if (a.lanes[i] <= b.lanes[i]) mask |= 1u << i;
+        return mask;
+    }
+
+    // Scalar lane-masks are just 1 or 0 per lane:
+    INLINE simd4_f32 lessThan(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = a.lanes[i] < b.lanes[i] ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 lessOrEqual(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = a.lanes[i] <= b.lanes[i] ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 maskOr(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = (a.lanes[i] != 0.0f || b.lanes[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 maskAnd(simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = (a.lanes[i] != 0.0f && b.lanes[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 maskAndNot(simd4_f32 mask, simd4_f32 a) { for (u8 i = 0; i < 4; i++) a.lanes[i] = (mask.lanes[i] == 0.0f && a.lanes[i] != 0.0f) ? 1.0f : 0.0f; return a; }
+    INLINE simd4_f32 select(simd4_f32 mask, simd4_f32 a, simd4_f32 b) { for (u8 i = 0; i < 4; i++) a.lanes[i] = mask.lanes[i] != 0.0f ? a.lanes[i] : b.lanes[i]; return a; }
+    INLINE u32 maskBits(simd4_f32 mask) {
+        u32 bits = 0;
+        for (u8 i = 0; i < 4; i++) if (mask.lanes[i] != 0.0f) bits |= 1u << i;
+        return bits;
+    }
+
+    INLINE void storeTruncated4(i32 *values, simd4_f32 v) { for (u8 i = 0; i < 4; i++) values[i] = (i32)v.lanes[i]; }
+
+    INLINE void transpose4(simd4_f32 &a, simd4_f32 &b, simd4_f32 &c, simd4_f32 &d) {
+        simd4_f32 rows[4] = {a, b, c, d};
+        for (u8 i = 0; i < 4; i++) {
+            a.lanes[i] = rows[i].lanes[0];
+            b.lanes[i] = rows[i].lanes[1];
+            c.lanes[i] = rows[i].lanes[2];
+            d.lanes[i] = rows[i].lanes[3];
+        }
+    }
+#endif
+
+#if defined(SIMD_AVX)
+    INLINE simd_f32 set1(f32 value) { return _mm256_set1_ps(value); }
+    INLINE simd_f32 load(const f32 *values) { return _mm256_loadu_ps(values); }
+    INLINE void store(f32 *values, simd_f32 v) { _mm256_storeu_ps(values, v); }
+    INLINE simd_f32 add(simd_f32 a, simd_f32 b) { return _mm256_add_ps(a, b); }
+    INLINE simd_f32 sub(simd_f32 a, simd_f32 b) { return _mm256_sub_ps(a, b); }
+    INLINE simd_f32 mul(simd_f32 a, simd_f32 b) { return _mm256_mul_ps(a, b); }
+    INLINE simd_f32 div(simd_f32 a, simd_f32 b) { return _mm256_div_ps(a, b); }
+    INLINE simd_f32 sqrt(simd_f32 a) { return _mm256_sqrt_ps(a); }
+    INLINE simd_f32 min(simd_f32 a, simd_f32 b) { return _mm256_min_ps(a, b); }
+    INLINE simd_f32 max(simd_f32 a, simd_f32 b) { return _mm256_max_ps(a, b); }
+    INLINE u32 lessOrEqualMask(simd_f32 a, simd_f32 b) { return (u32)_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LE_OQ)); }
+    INLINE simd_f32 lessThan(simd_f32 a, simd_f32 b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    INLINE simd_f32 lessOrEqual(simd_f32 a, simd_f32 b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    INLINE simd_f32 maskOr(simd_f32 a, simd_f32 b) { return _mm256_or_ps(a, b); }
+    INLINE simd_f32 maskAnd(simd_f32 a, simd_f32 b) { return _mm256_and_ps(a, b); }
+    INLINE simd_f32 maskAndNot(simd_f32 mask, simd_f32 a) { return _mm256_andnot_ps(mask, a); } // a && !mask
+    INLINE simd_f32 select(simd_f32 mask, simd_f32 a, simd_f32 b) { return _mm256_blendv_ps(b, a, mask); }
+    INLINE u32 maskBits(simd_f32 mask) { return (u32)_mm256_movemask_ps(mask); }
+
+    INLINE simd_f32 fmadd(simd_f32 a, simd_f32 b, simd_f32 c) { return add(mul(a, b), c); }
+#else
+    INLINE simd_f32 set1(f32 value) { return set4(value); }
+    INLINE simd_f32 load(const f32 *values) { return load4(values); }
+    INLINE void store(f32 *values, simd_f32 v) { store4(values, v); }
+#endif
+
+    INLINE simd4_f32 fmadd(simd4_f32 a, simd4_f32 b, simd4_f32 c) { return add(mul(a, b), c); }
+}
@@ -0,0 +1,85 @@
+#ifdef _WIN32
+#include "./win32_base.h"
+#else
+#include "./posix_base.h"
+#endif
+#include "../app.h"
+
+#include <stdio.h>
+
+#ifndef HEADLESS_DEFAULT_FRAME_COUNT
+#define HEADLESS_DEFAULT_FRAME_COUNT 100
+#endif
+
+// A window-less driver: Runs the app's update/render loop for a fixed number of frames,
+// rendering into the off-screen window content, then reports the average timings.
+// Usage: <app> [--frames=N] [--width=W] [--height=H]
+
+SlimApp *CURRENT_APP;
+
+bool parseArgument(const char *arg, const char *prefix, u32 &value) {
+    const char *c = arg;
+    while (*prefix) if (*(c++) != *(prefix++)) return false;
+    if (*c < '0' || *c > '9') return false;
+
+    value = 0;
+    while (*c >= '0' && *c <= '9') value = value * 10 + (u32)(*(c++) - '0');
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    void* window_content_and_canvas_memory = os::getMemory(WINDOW_CONTENT_SIZE + (CANVAS_SIZE * CANVAS_COUNT));
+    if (!window_content_and_canvas_memory)
+        return -1;
+
+    window::content = (u32*)window_content_and_canvas_memory;
+    memory::canvas_memory = (u8*)window_content_and_canvas_memory + WINDOW_CONTENT_SIZE;
+
+    timers::ticks_per_second = 1000000000;
+    timers::seconds_per_tick = 1.0 / (f64)(timers::ticks_per_second);
+    timers::milliseconds_per_tick = 1000.0 * timers::seconds_per_tick;
+    timers::microseconds_per_tick = 1000.0 * timers::milliseconds_per_tick;
+    timers::nanoseconds_per_tick  = 1000.0 * timers::microseconds_per_tick;
+
+    u32 frame_count = HEADLESS_DEFAULT_FRAME_COUNT;
+    u32 width = 0;
+    u32 height = 0;
+    for (int i = 1; i < argc; i++)
+        if (!parseArgument(argv[i], "--frames=", frame_count) &&
+            !parseArgument(argv[i], "--width=", width) &&
+            !parseArgument(argv[i], "--height=", height)) {
+            printf("Unknown argument: %s\nUsage: %s [--frames=N] [--width=W] [--height=H]\n", argv[i], argv[0]);
+            return 1;
+        }
+
+    CURRENT_APP = createApp();
+    if (!CURRENT_APP->is_running)
+        return -1;
+
+    if (width) window::width = (u16)(width < MAX_WIDTH ? width : MAX_WIDTH);
+    if (height) window::height = (u16)(height < MAX_HEIGHT ? height : MAX_HEIGHT);
+    CURRENT_APP->resize(window::width, window::height);
+
+    u64 update_ticks = 0;
+    u64 render_ticks = 0;
+    u64 start_ticks = timers::getTicks();
+    u32 frame = 0;
+    for (; frame < frame_count && CURRENT_APP->is_running; frame++) {
+        CURRENT_APP->OnWindowRedraw();
+        mouse::resetChanges();
+
+        update_ticks += CURRENT_APP->update_timer.ticks_after - CURRENT_APP->update_timer.ticks_before;
+        render_ticks += CURRENT_APP->render_timer.ticks_after - CURRENT_APP->render_timer.ticks_before;
+    }
+    u64 total_ticks = timers::getTicks() - start_ticks;
+
+    if (frame) {
+        f64 frames = (f64)frame;
+        printf("%s: %lux%lu, %lu frames in %.3f ms\n", argv[0], (unsigned long)window::width, (unsigned long)window::height,
+               (unsigned long)frame, (f64)total_ticks * timers::milliseconds_per_tick);
+        printf("Update: %.3f us/frame\n", (f64)update_ticks * timers::microseconds_per_tick / frames);
+        printf("Render: %.3f us/frame\n", (f64)render_ticks * timers::microseconds_per_tick / frames);
+    }
+
+    return 0;
+}
\ No newline at end of file
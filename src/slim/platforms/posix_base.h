@@ -0,0 +1,197 @@
+#pragma once
+
+#include <new>
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+
+#include "../core/base.h"
+
+#ifndef NDEBUG
+#include <stdio.h>
+#include <string.h>
+
+void DisplayError(const char *function_name) {
+    int last_error = errno;
+    printf("ERROR: %s failed with error code %d as follows:\n%s\n", function_name, last_error, strerror(last_error));
+}
+#endif
+
+// File handles are file descriptors offset by one, so that a null handle can still signal a failure:
+INLINE void* posix_fileHandle(int file_descriptor) { return (void*)(intptr_t)(file_descriptor + 1); }
+INLINE int posix_fileDescriptor(void *handle) { return (int)((intptr_t)handle - 1); }
+
+void posix_closeFile(void *handle) {
+    close(posix_fileDescriptor(handle));
+}
+
+void* posix_openFileForReading(const char* path) {
+    int file_descriptor = open(path, O_RDONLY);
+    if (file_descriptor == -1) {
+#ifndef NDEBUG
+        DisplayError("open");
+        printf("Terminal failure: unable to open file \"%s\" for read.\n", path);
+#endif
+        return nullptr;
+    }
+    return posix_fileHandle(file_descriptor);
+}
+
+void* posix_openFileForWriting(const char* path) {
+    int file_descriptor = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_descriptor == -1) {
+#ifndef NDEBUG
+        DisplayError("open");
+        printf("Terminal failure: unable to open file \"%s\" for write.\n", path);
+#endif
+        return nullptr;
+    }
+    return posix_fileHandle(file_descriptor);
+}
+
+bool posix_readFromFile(void *out, unsigned long size, void *handle) {
+    int file_descriptor = posix_fileDescriptor(handle);
+    u8 *bytes = (u8*)out;
+    ssize_t bytes_read;
+
+    // A read may return less than requested, so keep reading until the whole size arrived:
+    while (size) {
+        bytes_read = read(file_descriptor, bytes, size);
+        if (bytes_read <= 0) {
+#ifndef NDEBUG
+            DisplayError("read");
+            printf("Terminal failure: Unable to read from file.\n");
+#endif
+            return false;
+        }
+        bytes += bytes_read;
+        size -= (unsigned long)bytes_read;
+    }
+    return true;
+}
+
+bool posix_writeToFile(void *out, unsigned long size, void *handle) {
+    int file_descriptor = posix_fileDescriptor(handle);
+    u8 *bytes = (u8*)out;
+    ssize_t bytes_written;
+
+    while (size) {
+        bytes_written = write(file_descriptor, bytes, size);
+        if (bytes_written <= 0) {
+#ifndef NDEBUG
+            DisplayError("write");
+            printf("Terminal failure: Unable to write to file.\n");
+#endif
+            return false;
+        }
+        bytes += bytes_written;
+        size -= (unsigned long)bytes_written;
+    }
+    return true;
+}
+
+
+timespec monotonic_time;
+
+void os::setWindowTitle(char* str) {
+    window::title = str;
+}
+
+void os::setCursorVisibility(bool on) {}
+void os::setWindowCapture(bool on) {}
+
+u64 timers::getTicks() {
+    clock_gettime(CLOCK_MONOTONIC, &monotonic_time);
+    return (u64)monotonic_time.tv_sec * 1000000000ULL + (u64)monotonic_time.tv_nsec;
+}
+
+void* os::getMemory(u64 size, u64 base) {
+    // The base address is only a hint (as with VirtualAlloc, the mapping may not be placed there):
+    void *address = mmap((void*)base, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return address == MAP_FAILED ? nullptr : address;
+}
+
+void os::freeMemory(void *address, u64 size) { munmap(address, (size_t)size); }
+
+void os::closeFile(void *handle) { return posix_closeFile(handle); }
+void* os::openFileForReading(const char* path) { return posix_openFileForReading(path); }
+void* os::openFileForWriting(const char* path) { return posix_openFileForWriting(path); }
+bool os::readFromFile(void *out, unsigned long size, void *handle) { return posix_readFromFile(out, size, handle); }
+bool os::writeToFile(void *out, unsigned long size, void *handle) { return posix_writeToFile(out, size, handle); }
+
+struct PosixThread {
+    os::ThreadFunction function;
+    void *data;
+};
+
+void* posix_runThread(void *param) {
+    PosixThread thread = *(PosixThread*)param;
+    free(param);
+    thread.function(thread.data);
+    return nullptr;
+}
+
+u32 os::getProcessorCount() {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32)count : 1;
+}
+
+void* os::createThread(ThreadFunction function, void *data) {
+    PosixThread *thread = (PosixThread*)malloc(sizeof(PosixThread));
+    pthread_t *handle = (pthread_t*)malloc(sizeof(pthread_t));
+    if (!thread || !handle) {
+        free(thread);
+        free(handle);
+        return nullptr;
+    }
+    thread->function = function;
+    thread->data = data;
+    if (pthread_create(handle, nullptr, posix_runThread, thread)) {
+        free(thread);
+        free(handle);
+        return nullptr;
+    }
+    return handle;
+}
+
+void os::joinThread(void *handle) {
+    pthread_join(*(pthread_t*)handle, nullptr);
+    free(handle);
+}
+
+void os::yieldThread() { sched_yield(); }
+
+void* os::createSemaphore(u32 initial_count) {
+    sem_t *semaphore = (sem_t*)malloc(sizeof(sem_t));
+    if (semaphore && sem_init(semaphore, 0, (unsigned int)initial_count)) {
+        free(semaphore);
+        return nullptr;
+    }
+    return semaphore;
+}
+
+void os::destroySemaphore(void *handle) {
+    sem_destroy((sem_t*)handle);
+    free(handle);
+}
+
+void os::signalSemaphore(void *handle, u32 count) {
+    for (u32 i = 0; i < count; i++) sem_post((sem_t*)handle);
+}
+
+void os::waitOnSemaphore(void *handle) {
+    while (sem_wait((sem_t*)handle) == -1 && errno == EINTR) {}
+}
+
+u32 os::atomicLoad(volatile u32 *value) { return __atomic_load_n(value, __ATOMIC_SEQ_CST); }
+void os::atomicStore(volatile u32 *value, u32 new_value) { __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST); }
+u32 os::atomicAdd(volatile u32 *value, u32 amount) { return __atomic_fetch_add(value, amount, __ATOMIC_SEQ_CST); }
+u32 os::atomicSubtract(volatile u32 *value, u32 amount) { return __atomic_fetch_sub(value, amount, __ATOMIC_SEQ_CST); }
+u32 os::atomicExchange(volatile u32 *value, u32 new_value) { return __atomic_exchange_n(value, new_value, __ATOMIC_SEQ_CST); }
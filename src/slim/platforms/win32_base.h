@@ -130,8 +130,56 @@ void* os::getMemory(u64 size, u64 base) {
     return VirtualAlloc((LPVOID)base, (SIZE_T)size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
 }
 
+void os::freeMemory(void *address, u64 size) { VirtualFree(address, 0, MEM_RELEASE); }
+
 void os::closeFile(void *handle) { return win32_closeFile(handle); }
 void* os::openFileForReading(const char* path) { return win32_openFileForReading(path); }
 void* os::openFileForWriting(const char* path) { return win32_openFileForWriting(path); }
 bool os::readFromFile(LPVOID out, DWORD size, HANDLE handle) { return win32_readFromFile(out, size, handle); }
-bool os::writeToFile(LPVOID out, DWORD size, HANDLE handle) { return win32_writeToFile(out, size, handle); }
\ No newline at end of file
+bool os::writeToFile(LPVOID out, DWORD size, HANDLE handle) { return win32_writeToFile(out, size, handle); }
+
+struct Win32Thread {
+    os::ThreadFunction function;
+    void *data;
+};
+
+DWORD WINAPI win32_runThread(LPVOID param) {
+    Win32Thread *thread = (Win32Thread*)param;
+    thread->function(thread->data);
+    HeapFree(GetProcessHeap(), 0, thread);
+    return 0;
+}
+
+u32 os::getProcessorCount() {
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return (u32)system_info.dwNumberOfProcessors;
+}
+
+void* os::createThread(ThreadFunction function, void *data) {
+    Win32Thread *thread = (Win32Thread*)HeapAlloc(GetProcessHeap(), 0, sizeof(Win32Thread));
+    if (!thread) return nullptr;
+    thread->function = function;
+    thread->data = data;
+    HANDLE handle = CreateThread(nullptr, 0, win32_runThread, thread, 0, nullptr);
+    if (!handle) HeapFree(GetProcessHeap(), 0, thread);
+    return handle;
+}
+
+void os::joinThread(void *handle) {
+    WaitForSingleObject((HANDLE)handle, INFINITE);
+    CloseHandle((HANDLE)handle);
+}
+
+void os::yieldThread() { SwitchToThread(); }
+
+void* os::createSemaphore(u32 initial_count) { return CreateSemaphoreA(nullptr, (LONG)initial_count, 0x7FFFFFFF, nullptr); }
+void os::destroySemaphore(void *handle) { CloseHandle((HANDLE)handle); }
+void os::signalSemaphore(void *handle, u32 count) { ReleaseSemaphore((HANDLE)handle, (LONG)count, nullptr); }
+void os::waitOnSemaphore(void *handle) { WaitForSingleObject((HANDLE)handle, INFINITE); }
+
+u32 os::atomicLoad(volatile u32 *value) { return (u32)InterlockedCompareExchange((volatile LONG*)value, 0, 0); }
+void os::atomicStore(volatile u32 *value, u32 new_value) { InterlockedExchange((volatile LONG*)value, (LONG)new_value); }
+u32 os::atomicAdd(volatile u32 *value, u32 amount) { return (u32)InterlockedExchangeAdd((volatile LONG*)value, (LONG)amount); }
+u32 os::atomicSubtract(volatile u32 *value, u32 amount) { return (u32)InterlockedExchangeAdd((volatile LONG*)value, -(LONG)amount); }
+u32 os::atomicExchange(volatile u32 *value, u32 new_value) { return (u32)InterlockedExchange((volatile LONG*)value, (LONG)new_value); }
\ No newline at end of file
@@ -2,6 +2,10 @@
 
 #include "../math/vec3.h"
 
+// A BVH is at most 256 levels deep (node depths are 8 bit), and a traversal that pushes both children of a node
+// leaves at most one of them on the stack per level:
+#define BVH_TRAVERSAL_STACK_SIZE 258
+
 struct BVHNode {
     AABB aabb;
     u32 first_index = 0;
@@ -18,4 +22,23 @@ struct BVH {
     BVHNode *nodes;
     u32 node_count;
     u8 height;
+
+    // The SAH cost the hierarchy had before it was first refitted (reset on every build):
+    f32 refit_base_sah_cost = 0;
+
+    // The Surface Area Heuristic cost of the whole hierarchy (lower is better):
+    // Each node is weighted by the probability of a random ray hitting it given that it hit the root.
+    f32 getSAHCost(f32 traversal_cost = 1.0f, f32 intersection_cost = 1.0f) const {
+        if (!node_count) return 0;
+
+        f32 root_area = nodes[0].aabb.area();
+        if (root_area <= 0) return 0;
+
+        f32 cost = 0;
+        BVHNode *node = nodes;
+        for (u32 i = 0; i < node_count; i++, node++)
+            cost += node->aabb.area() * (node->isLeaf() ? intersection_cost * (f32)node->leaf_count : traversal_cost);
+
+        return cost / root_area;
+    }
 };
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "./mesh.h"
+#include "./tlas.h"
+#include "../core/thread_pool.h"
 
 struct BVHPartitionSide {
     AABB *aabbs;
@@ -10,14 +12,15 @@ struct BVHPartitionSide {
 struct BVHPartition {
     BVHPartitionSide left, right;
     u32 left_node_count, *sorted_node_ids;
+    i32 *sort_stack;
     f32 surface_area;
 
-    void partition(u8 axis, BVHNode *nodes, i32 *stack, u32 N) {
+    void partition(u8 axis, BVHNode *nodes, u32 N) {
         u32 current_index, next_index, left_index, right_index;
         f32 current_surface_area;
         left_index = 0;
         right_index = N - 1;
-
+        i32 *stack = sort_stack;
 
         // Sort nodes by axis:
         {
@@ -118,74 +121,383 @@ struct BVHBuildIteration {
     u8 depth;
 };
 
+struct BVHBin {
+    AABB aabb;
+    u32 count;
+};
+
+enum BVHBuildMode {
+    BVHBuildMode_Binned = 0, // Fast: Bins node centroids and sweeps the bin boundaries, O(N) per level
+    BVHBuildMode_Sweep       // High quality: Sorts the nodes and sweeps every split position, O(N log N) per level
+};
+
 constexpr f32 EPS = 0.0001f;
 constexpr i32 MAX_TRIANGLES_PER_MESH_RTREE_NODE = 4;
-
-struct BVHBuilder {
-    BVHNode *nodes;
+constexpr u16 MAX_GEOMETRIES_PER_TLAS_NODE = 1;     // Geometries are costly to search through, so leaves keep one each
+constexpr u8 BVH_MAX_BIN_COUNT = 64;
+constexpr u8 BVH_DEFAULT_BIN_COUNT = 32;
+constexpr u32 BVH_MIN_SUBTREE_SIZE = 1024;   // Smallest range that gets built as a separate (parallel) subtree
+constexpr u32 BVH_SUBTREES_PER_THREAD = 8;   // Enough subtrees per thread for work-stealing to balance the load
+constexpr u32 BVH_PARALLEL_CHUNK_SIZE = 8192; // Nodes (or triangles) per chunk when processing them in parallel
+constexpr u32 BVH_REFIT_CHUNK_SIZE = 256;     // Nodes per chunk when refitting a depth level in parallel
+
+// The scratch memory of a single thread for splitting nodes (sized for the largest range it would split):
+struct BVHBuildScratch {
     BVHPartition partitions[3];
     BVHBuildIteration *iterations;
-    u32 *node_ids, *leaf_ids;
-    i32 *sort_stack;
+    BVHBin bins[3][BVH_MAX_BIN_COUNT];
+    AABB right_aabbs[BVH_MAX_BIN_COUNT];
+    u32 right_counts[BVH_MAX_BIN_COUNT];
+    u8 height;
 
-    static u32 getSizeInBytes(u32 max_leaf_count) {
-        u32 memory_size = sizeof(u32) + sizeof(i32) + 2 * (sizeof(AABB) + sizeof(f32));
+    static u64 getSizeInBytes(u32 max_leaf_count) {
+        u64 memory_size = sizeof(u32) + sizeof(i32) + 2 * (sizeof(AABB) + sizeof(f32));
         memory_size *= 3;
-        memory_size += sizeof(BVHBuildIteration) + sizeof(BVHNode) + sizeof(u32) * 2;
+        memory_size += sizeof(BVHBuildIteration);
+        memory_size *= max_leaf_count;
+
+        return memory_size;
+    }
+
+    void allocate(u32 max_leaf_count, memory::MonotonicAllocator *memory_allocator) {
+        iterations = (BVHBuildIteration*)memory_allocator->allocate(sizeof(BVHBuildIteration) * max_leaf_count);
+        for (u8 i = 0; i < 3; i++) {
+            partitions[i].sorted_node_ids     = (u32* )memory_allocator->allocate(sizeof(u32)  * max_leaf_count);
+            partitions[i].sort_stack          = (i32* )memory_allocator->allocate(sizeof(i32)  * max_leaf_count);
+            partitions[i].left.aabbs          = (AABB*)memory_allocator->allocate(sizeof(AABB) * max_leaf_count);
+            partitions[i].right.aabbs         = (AABB*)memory_allocator->allocate(sizeof(AABB) * max_leaf_count);
+            partitions[i].left.surface_areas  = (f32* )memory_allocator->allocate(sizeof(f32)  * max_leaf_count);
+            partitions[i].right.surface_areas = (f32* )memory_allocator->allocate(sizeof(f32)  * max_leaf_count);
+        }
+    }
+};
+
+struct BVHBuilder;
+
+struct BVHSubtreeJob {
+    BVHBuilder *builder;
+    BVH *bvh;
+    BVHBuildIteration iteration;
+    u16 max_leaf_size;
+};
+
+struct BVHBinningJob {
+    BVHBuilder *builder;
+    const u32 *ids;
+    AABB centroid_bounds;
+    u8 bin_count;
+};
+
+struct BVHSweepJob {
+    BVHBuilder *builder;
+    BVHPartition *partition;
+    const u32 *ids;
+    u32 N;
+    u8 axis;
+};
+
+// With a thread pool, the top levels are split by the calling thread with the split itself done in parallel
+// (binning chunks of the range, or sorting the 3 axes, on all threads). Ranges that are small enough are built
+// as independent subtrees by whichever thread picks them up, each using its own scratch memory.
+// Nodes are allocated with an atomic counter, and leaves index their range of the node ids directly,
+// so threads never need to coordinate beyond that.
+struct BVHBuilder {
+    BVHNode *nodes;
+    BVHBuildScratch scratch;
+    u32 *node_ids, *leaf_ids, *depth_sorted_node_ids;
+    TriangleVertexIndices *sorted_triangle_vertex_indices;
+
+    BVHBuildMode mode = BVHBuildMode_Binned;
+    u8 bin_count = BVH_DEFAULT_BIN_COUNT;
+
+    ThreadPool *thread_pool = nullptr;
+    BVHBuildScratch *worker_scratches = nullptr;
+    BVHSubtreeJob *subtree_jobs = nullptr;
+    BVHBin (*thread_bins)[3][BVH_MAX_BIN_COUNT] = nullptr;
+    AABB *thread_centroid_bounds = nullptr;
+    u32 subtree_threshold = 0;
+    u32 subtree_job_capacity = 0;
+    u32 max_leaf_node_count = 0;
+    volatile u32 node_count{0};
+
+    static u32 getSubtreeThreshold(u32 max_leaf_count, u32 thread_count) {
+        u32 subtree_threshold = max_leaf_count / (thread_count * BVH_SUBTREES_PER_THREAD);
+        return subtree_threshold < BVH_MIN_SUBTREE_SIZE ? BVH_MIN_SUBTREE_SIZE : subtree_threshold;
+    }
+
+    static u32 getSubtreeJobCapacity(u32 max_leaf_count, u32 thread_count) {
+        return 4 * (max_leaf_count / getSubtreeThreshold(max_leaf_count, thread_count)) + 64;
+    }
+
+    static u64 getSizeInBytes(u32 max_leaf_count, u32 thread_count = 1) {
+        u64 memory_size = sizeof(BVHNode) + sizeof(u32) * 4 + sizeof(TriangleVertexIndices);
         memory_size *= max_leaf_count;
+        memory_size += BVHBuildScratch::getSizeInBytes(max_leaf_count);
+
+        if (thread_count > 1) {
+            u32 subtree_threshold = getSubtreeThreshold(max_leaf_count, thread_count);
+            memory_size += thread_count * (sizeof(BVHBuildScratch) + BVHBuildScratch::getSizeInBytes(subtree_threshold));
+            memory_size += thread_count * (sizeof(BVHBin) * 3 * BVH_MAX_BIN_COUNT + sizeof(AABB));
+            memory_size += getSubtreeJobCapacity(max_leaf_count, thread_count) * sizeof(BVHSubtreeJob);
+        }
 
         return memory_size;
     }
 
-    BVHBuilder(Mesh *meshes, u32 mesh_count, memory::MonotonicAllocator *memory_allocator) {
+    static u32 getMaxLeafNodeCount(const Mesh *meshes, u32 mesh_count) {
         u32 max_leaf_node_count = 0;
-        if (mesh_count)
-            for (u32 m = 0; m < mesh_count; m++)
-                if (meshes[m].triangle_count > max_leaf_node_count)
-                    max_leaf_node_count = meshes[m].triangle_count;
+        for (u32 m = 0; m < mesh_count; m++)
+            if (meshes[m].triangle_count > max_leaf_node_count)
+                max_leaf_node_count = meshes[m].triangle_count;
 
-        iterations = (BVHBuildIteration*)memory_allocator->allocate(sizeof(BVHBuildIteration) * max_leaf_node_count);
-        nodes      = (BVHNode*          )memory_allocator->allocate(sizeof(BVHNode)           * max_leaf_node_count);
-        node_ids   = (u32*              )memory_allocator->allocate(sizeof(u32)                 * max_leaf_node_count);
-        leaf_ids   = (u32*              )memory_allocator->allocate(sizeof(u32)                 * max_leaf_node_count);
-        sort_stack = (i32*              )memory_allocator->allocate(sizeof(i32)                 * max_leaf_node_count);
+        return max_leaf_node_count;
+    }
 
-        for (u8 i = 0; i < 3; i++) {
-            partitions[i].sorted_node_ids     = (u32* )memory_allocator->allocate(sizeof(u32)  * max_leaf_node_count);
-            partitions[i].left.aabbs          = (AABB*)memory_allocator->allocate(sizeof(AABB) * max_leaf_node_count);
-            partitions[i].right.aabbs         = (AABB*)memory_allocator->allocate(sizeof(AABB) * max_leaf_node_count);
-            partitions[i].left.surface_areas  = (f32* )memory_allocator->allocate(sizeof(f32)  * max_leaf_node_count);
-            partitions[i].right.surface_areas = (f32* )memory_allocator->allocate(sizeof(f32)  * max_leaf_node_count);
+    BVHBuilder(Mesh *meshes, u32 mesh_count, memory::MonotonicAllocator *memory_allocator, ThreadPool *thread_pool = nullptr) :
+            BVHBuilder{getMaxLeafNodeCount(meshes, mesh_count), memory_allocator, thread_pool} {}
+
+    // A builder can build BVHs of up to max_leaf_node_count leaf nodes (triangles of a mesh, or geometries of a TLAS):
+    BVHBuilder(u32 max_leaf_node_count, memory::MonotonicAllocator *memory_allocator, ThreadPool *thread_pool = nullptr) :
+            thread_pool{thread_pool}, max_leaf_node_count{max_leaf_node_count} {
+        if (thread_pool && thread_pool->thread_count > 1) {
+            u32 thread_count = thread_pool->thread_count;
+            subtree_threshold = getSubtreeThreshold(max_leaf_node_count, thread_count);
+            subtree_job_capacity = getSubtreeJobCapacity(max_leaf_node_count, thread_count);
+
+            worker_scratches = (BVHBuildScratch*)memory_allocator->allocate(sizeof(BVHBuildScratch) * thread_count);
+            subtree_jobs     = (BVHSubtreeJob*  )memory_allocator->allocate(sizeof(BVHSubtreeJob)   * subtree_job_capacity);
+            thread_bins = (BVHBin (*)[3][BVH_MAX_BIN_COUNT])memory_allocator->allocate(sizeof(BVHBin) * 3 * BVH_MAX_BIN_COUNT * thread_count);
+            thread_centroid_bounds = (AABB*)memory_allocator->allocate(sizeof(AABB) * thread_count);
+            for (u32 t = 0; t < thread_count; t++)
+                worker_scratches[t].allocate(subtree_threshold, memory_allocator);
         }
+
+        nodes    = (BVHNode*)memory_allocator->allocate(sizeof(BVHNode) * max_leaf_node_count);
+        node_ids = (u32*    )memory_allocator->allocate(sizeof(u32)     * max_leaf_node_count);
+        leaf_ids = (u32*    )memory_allocator->allocate(sizeof(u32)     * max_leaf_node_count);
+        depth_sorted_node_ids = (u32*)memory_allocator->allocate(sizeof(u32) * max_leaf_node_count * 2);
+        sorted_triangle_vertex_indices = (TriangleVertexIndices*)memory_allocator->allocate(sizeof(TriangleVertexIndices) * max_leaf_node_count);
+        scratch.allocate(max_leaf_node_count, memory_allocator);
+    }
+
+    INLINE void allocateChildren(BVHNode &node, BVH &bvh) {
+        node.first_index = os::atomicAdd(&node_count, 2);
+        BVHNode &left_node  = bvh.nodes[node.first_index];
+        BVHNode &right_node = bvh.nodes[node.first_index + 1];
+        left_node = BVHNode{};
+        right_node = BVHNode{};
+        left_node.depth = right_node.depth = node.depth + 1;
     }
 
-    u32 splitNode(BVHNode &node, u32 start, u32 end, BVH &bvh) {
+    INLINE static u32 getBin(const AABB &aabb, u8 axis, f32 origin, f32 scale, u8 B) {
+        u32 b = (u32)((aabb.min.components[axis] + aabb.max.components[axis] - origin) * scale);
+        return b >= B ? B - 1 : b;
+    }
+
+    INLINE static void resetBins(BVHBin (*bins)[BVH_MAX_BIN_COUNT], u8 B) {
+        for (u8 axis = 0; axis < 3; axis++)
+            for (u8 b = 0; b < B; b++) {
+                bins[axis][b].aabb = {INFINITY, -INFINITY};
+                bins[axis][b].count = 0;
+            }
+    }
+
+    // Bound the centroids (using doubled centers, as only their relative positions matter):
+    void boundCentroids(const u32 *ids, u32 N, AABB &centroid_bounds) const {
+        for (u32 i = 0; i < N; i++) {
+            const AABB &aabb = nodes[ids[i]].aabb;
+            vec3 centroid{aabb.min + aabb.max};
+            centroid_bounds.min = minimum(centroid_bounds.min, centroid);
+            centroid_bounds.max = maximum(centroid_bounds.max, centroid);
+        }
+    }
+
+    // Accumulate the nodes into the bins of all 3 axes in a single pass:
+    void binCentroids(const u32 *ids, u32 N, const AABB &centroid_bounds, u8 B, BVHBin (*bins)[BVH_MAX_BIN_COUNT]) const {
+        vec3 extents{centroid_bounds.max - centroid_bounds.min};
+        f32 scales[3];
+        for (u8 axis = 0; axis < 3; axis++)
+            scales[axis] = extents.components[axis] > 0 ? (f32)B / extents.components[axis] : 0;
+
+        for (u32 i = 0; i < N; i++) {
+            const AABB &aabb = nodes[ids[i]].aabb;
+            for (u8 axis = 0; axis < 3; axis++) {
+                BVHBin &bin = bins[axis][getBin(aabb, axis, centroid_bounds.min.components[axis], scales[axis], B)];
+                bin.aabb += aabb;
+                bin.count++;
+            }
+        }
+    }
+
+    static void boundCentroidsJob(void *data, u32 start, u32 end, u32 thread_index) {
+        BVHBinningJob &job = *(BVHBinningJob*)data;
+        job.builder->boundCentroids(job.ids + start, end - start, job.builder->thread_centroid_bounds[thread_index]);
+    }
+
+    static void binCentroidsJob(void *data, u32 start, u32 end, u32 thread_index) {
+        BVHBinningJob &job = *(BVHBinningJob*)data;
+        job.builder->binCentroids(job.ids + start, end - start, job.centroid_bounds, job.bin_count, job.builder->thread_bins[thread_index]);
+    }
+
+    static void sweepJob(void *data, u32 thread_index) {
+        BVHSweepJob &job = *(BVHSweepJob*)data;
+        job.builder->sweep(*job.partition, job.axis, job.ids, job.N);
+    }
+
+    static void buildSubtreeJob(void *data, u32 thread_index) {
+        BVHSubtreeJob &job = *(BVHSubtreeJob*)data;
+        job.builder->buildSubtree(*job.bvh, job.builder->worker_scratches[thread_index], job.iteration, job.max_leaf_size);
+    }
+
+    u32 splitNode(BVHNode &node, u32 start, u32 end, BVH &bvh, BVHBuildScratch &split_scratch, bool in_parallel = false) {
+        return mode == BVHBuildMode_Binned ?
+            splitNodeBinned(node, start, end, bvh, split_scratch, in_parallel) :
+            splitNodeSweep(node, start, end, bvh, split_scratch, in_parallel);
+    }
+
+    u32 splitNodeBinned(BVHNode &node, u32 start, u32 end, BVH &bvh, BVHBuildScratch &split_scratch, bool in_parallel) {
         u32 N = end - start;
         u32 *ids = node_ids + start;
 
-        node.first_index = bvh.node_count;
-        BVHNode &left_node  = bvh.nodes[bvh.node_count++];
-        BVHNode &right_node = bvh.nodes[bvh.node_count++];
-        left_node = BVHNode{};
-        right_node = BVHNode{};
+        allocateChildren(node, bvh);
+        BVHNode &left_node  = bvh.nodes[node.first_index];
+        BVHNode &right_node = bvh.nodes[node.first_index + 1];
+
+        u8 B = bin_count < 2 ? 2 : (bin_count > BVH_MAX_BIN_COUNT ? BVH_MAX_BIN_COUNT : bin_count);
+        BVHBin (*bins)[BVH_MAX_BIN_COUNT] = split_scratch.bins;
+        AABB *right_aabbs = split_scratch.right_aabbs;
+        u32 *right_counts = split_scratch.right_counts;
+
+        AABB centroid_bounds{INFINITY, -INFINITY};
+        resetBins(bins, B);
+        if (in_parallel) {
+            u32 thread_count = thread_pool->thread_count;
+            BVHBinningJob job{this, ids, centroid_bounds, B};
+
+            for (u32 t = 0; t < thread_count; t++) thread_centroid_bounds[t] = {INFINITY, -INFINITY};
+            thread_pool->parallelFor(N, BVH_PARALLEL_CHUNK_SIZE, boundCentroidsJob, &job, 0);
+            for (u32 t = 0; t < thread_count; t++) centroid_bounds += thread_centroid_bounds[t];
+
+            job.centroid_bounds = centroid_bounds;
+            for (u32 t = 0; t < thread_count; t++) resetBins(thread_bins[t], B);
+            thread_pool->parallelFor(N, BVH_PARALLEL_CHUNK_SIZE, binCentroidsJob, &job, 0);
+            for (u32 t = 0; t < thread_count; t++)
+                for (u8 axis = 0; axis < 3; axis++)
+                    for (u8 b = 0; b < B; b++) {
+                        bins[axis][b].aabb += thread_bins[t][axis][b].aabb;
+                        bins[axis][b].count += thread_bins[t][axis][b].count;
+                    }
+        } else {
+            boundCentroids(ids, N, centroid_bounds);
+            binCentroids(ids, N, centroid_bounds, B, bins);
+        }
+        vec3 extents{centroid_bounds.max - centroid_bounds.min};
 
-        f32 smallest_surface_area = INFINITY;
+        f32 smallest_cost = INFINITY;
         u8 chosen_axis = 0;
+        u8 chosen_bin = 0;
+        u32 chosen_left_count = 0;
 
         for (u8 axis = 0; axis < 3; axis++) {
-            BVHPartition &pa = partitions[axis];
-            for (u32 i = 0; i < N; i++) pa.sorted_node_ids[i] = ids[i];
+            if (extents.components[axis] <= 0) continue;
+
+            // Sweep from the right, accumulating the bounds/counts to the right of each bin boundary:
+            AABB R{INFINITY, -INFINITY};
+            u32 right_count = 0;
+            for (u8 b = B - 1; b > 0; b--) {
+                R += bins[axis][b].aabb;
+                right_count += bins[axis][b].count;
+                right_aabbs[b - 1] = R;
+                right_counts[b - 1] = right_count;
+            }
+
+            // Sweep from the left, evaluating the cost of splitting at each bin boundary:
+            AABB L{INFINITY, -INFINITY};
+            u32 left_count = 0;
+            for (u8 b = 0; b < B - 1; b++) {
+                L += bins[axis][b].aabb;
+                left_count += bins[axis][b].count;
+                if (!left_count || !right_counts[b]) continue;
+
+                f32 cost = L.area() * (f32)left_count + right_aabbs[b].area() * (f32)right_counts[b];
+                if (cost < smallest_cost) {
+                    smallest_cost = cost;
+                    chosen_axis = axis;
+                    chosen_bin = b;
+                    chosen_left_count = left_count;
+                    left_node.aabb = L;
+                    right_node.aabb = right_aabbs[b];
+                }
+            }
+        }
 
-            // Partition the nodes for the current partition axis:
-            pa.partition(axis, nodes, sort_stack, N);
+        if (!chosen_left_count) {
+            // All centroids coincide (or fall in a single bin): Split the range in half
+            u32 middle = N / 2;
+            left_node.aabb = right_node.aabb = {INFINITY, -INFINITY};
+            for (u32 i = 0; i < N; i++)
+                (i < middle ? left_node.aabb : right_node.aabb) += nodes[ids[i]].aabb;
 
-            // Choose the current partition axis if it's smallest surface area is smallest so far:
-            if (pa.surface_area < smallest_surface_area) {
-                smallest_surface_area = pa.surface_area;
-                chosen_axis = axis;
+            return start + middle;
+        }
+
+        // Partition the ids in-place around the chosen bin boundary:
+        f32 origin = centroid_bounds.min.components[chosen_axis];
+        f32 scale = (f32)B / extents.components[chosen_axis];
+        u32 left_index = 0;
+        u32 right_index = N - 1;
+        while (left_index <= right_index) {
+            if (getBin(nodes[ids[left_index]].aabb, chosen_axis, origin, scale, B) <= chosen_bin)
+                left_index++;
+            else {
+                u32 t = ids[left_index];
+                ids[left_index] = ids[right_index];
+                ids[right_index] = t;
+                right_index--;
             }
         }
 
+        return start + chosen_left_count;
+    }
+
+    void sweep(BVHPartition &pa, u8 axis, const u32 *ids, u32 N) {
+        for (u32 i = 0; i < N; i++) pa.sorted_node_ids[i] = ids[i];
+
+        // Partition the nodes for the current partition axis:
+        pa.partition(axis, nodes, N);
+    }
+
+    u32 splitNodeSweep(BVHNode &node, u32 start, u32 end, BVH &bvh, BVHBuildScratch &split_scratch, bool in_parallel) {
+        u32 N = end - start;
+        u32 *ids = node_ids + start;
+
+        allocateChildren(node, bvh);
+        BVHNode &left_node  = bvh.nodes[node.first_index];
+        BVHNode &right_node = bvh.nodes[node.first_index + 1];
+
+        BVHPartition *partitions = split_scratch.partitions;
+        if (in_parallel) {
+            // Sort and sweep the 3 axes concurrently (each partition has its own sorting stack):
+            BVHSweepJob jobs[3];
+            JobGroup group;
+            for (u8 axis = 0; axis < 3; axis++) {
+                jobs[axis] = {this, partitions + axis, ids, N, axis};
+                thread_pool->submit(sweepJob, jobs + axis, group, 0);
+            }
+            thread_pool->wait(group, 0);
+        } else
+            for (u8 axis = 0; axis < 3; axis++)
+                sweep(partitions[axis], axis, ids, N);
+
+        // Choose the partition axis with the smallest surface area:
+        f32 smallest_surface_area = INFINITY;
+        u8 chosen_axis = 0;
+        for (u8 axis = 0; axis < 3; axis++)
+            if (partitions[axis].surface_area < smallest_surface_area) {
+                smallest_surface_area = partitions[axis].surface_area;
+                chosen_axis = axis;
+            }
+
         BVHPartition &chosen_partition_axis = partitions[chosen_axis];
         left_node.aabb  = chosen_partition_axis.left.aabbs[chosen_partition_axis.left_node_count-1];
         right_node.aabb = chosen_partition_axis.right.aabbs[chosen_partition_axis.left_node_count];
@@ -195,6 +507,64 @@ struct BVHBuilder {
         return start + chosen_partition_axis.left_node_count;
     }
 
+    void buildSubtree(BVH &bvh, BVHBuildScratch &subtree_scratch, BVHBuildIteration iteration, u16 max_leaf_size) {
+        BVHBuildIteration *stack = subtree_scratch.iterations;
+        stack[0] = iteration;
+        i32 stack_size = 0;
+
+        while (stack_size >= 0) {
+            iteration = stack[stack_size--];
+            BVHNode &node = bvh.nodes[iteration.node_id];
+            u32 N = iteration.end - iteration.start;
+            if (N <= max_leaf_size) {
+                // Leaves index their own range of the (now partitioned) node ids:
+                node.leaf_count = (u16)N;
+                node.first_index = iteration.start;
+                for (u32 i = iteration.start; i < iteration.end; i++)
+                    leaf_ids[i] = nodes[node_ids[i]].first_index;
+            } else {
+                u32 middle = splitNode(node, iteration.start, iteration.end, bvh, subtree_scratch);
+                u8 depth = iteration.depth + 1;
+                stack[++stack_size] = {iteration.start, middle, node.first_index, depth};
+                stack[++stack_size] = {middle, iteration.end, node.first_index + 1, depth};
+                if (depth > subtree_scratch.height) subtree_scratch.height = depth;
+            }
+        }
+    }
+
+    // Runs on the thread that created the thread pool (index 0), which also builds the subtrees while it waits:
+    void buildInParallel(BVH &bvh, u32 N, u16 max_leaf_size) {
+        JobGroup group;
+        u32 subtree_job_count = 0;
+
+        BVHBuildIteration *stack = scratch.iterations;
+        stack[0] = {0, N, 0, 0};
+        i32 stack_size = 0;
+
+        while (stack_size >= 0) {
+            BVHBuildIteration iteration = stack[stack_size--];
+            if (iteration.end - iteration.start <= subtree_threshold) {
+                if (subtree_job_count < subtree_job_capacity) {
+                    BVHSubtreeJob &job = subtree_jobs[subtree_job_count++];
+                    job = {this, &bvh, iteration, max_leaf_size};
+                    thread_pool->submit(buildSubtreeJob, &job, group, 0);
+                } else // Out of job slots (only for extremely unbalanced splits), so build it right here:
+                    buildSubtree(bvh, worker_scratches[0], iteration, max_leaf_size);
+
+                continue;
+            }
+
+            BVHNode &node = bvh.nodes[iteration.node_id];
+            u32 middle = splitNode(node, iteration.start, iteration.end, bvh, scratch, true);
+            u8 depth = iteration.depth + 1;
+            stack[++stack_size] = {iteration.start, middle, node.first_index, depth};
+            stack[++stack_size] = {middle, iteration.end, node.first_index + 1, depth};
+            if (depth > scratch.height) scratch.height = depth;
+        }
+
+        thread_pool->wait(group, 0);
+    }
+
     void build(BVH &bvh, u32 N, u16 max_leaf_size) {
         bvh.height = 1;
         bvh.node_count = 1;
@@ -216,109 +586,255 @@ struct BVHBuilder {
             return;
         }
 
-        u32 middle = splitNode(root, 0, N, bvh);
-        BVHBuildIteration *stack = iterations;
-        u32 *node_id;
-
-        BVHBuildIteration left{0, middle, 1, 1};
-        BVHBuildIteration right{middle, N, 2, 1};
+        node_count = 1;
+        scratch.height = 1;
+        bool in_parallel = thread_pool && thread_pool->thread_count > 1 && worker_scratches && N > subtree_threshold;
+        if (in_parallel) {
+            for (u32 t = 0; t < thread_pool->thread_count; t++) worker_scratches[t].height = 1;
+            buildInParallel(bvh, N, max_leaf_size);
+            for (u32 t = 0; t < thread_pool->thread_count; t++)
+                if (worker_scratches[t].height > scratch.height)
+                    scratch.height = worker_scratches[t].height;
+        } else
+            buildSubtree(bvh, scratch, {0, N, 0, 0}, max_leaf_size);
+
+        bvh.node_count = node_count;
+        bvh.height = scratch.height;
+        root.aabb = bvh.nodes[1].aabb + bvh.nodes[2].aabb;
+    }
 
-        stack[0] = left;
-        stack[1] = right;
+    // Pad the bounds of axis-aligned triangles, so that no node ends up with a zero-thickness box:
+    INLINE static void boundTriangle(const vec3 &v1, const vec3 &v2, const vec3 &v3, AABB &aabb) {
+        vec3 &min = aabb.min;
+        vec3 &max = aabb.max;
 
-        i32 stack_size = 1;
-        u32 leaf_count = 0;;
+        min = minimum(minimum(v1, v2), v3);
+        max = maximum(maximum(v1, v2), v3);
 
-        while (stack_size >= 0) {
-            left = stack[stack_size];
-            BVHNode &node = bvh.nodes[left.node_id];
-            N = left.end - left.start;
-            if (N <= max_leaf_size) {
-                node.depth = left.depth;
-                node.leaf_count = (u16)N;
-                node.first_index = leaf_count;
+        f32 diff = max.x - min.x;
+        if (diff < 0) diff = -diff;
+        if (diff < EPS) {
+            min.x -= EPS;
+            max.x += EPS;
+        }
 
-                node_id = node_ids + left.start;
-                for (u32 i = 0; i < N; i++, node_id++)
-                    leaf_ids[leaf_count + i] = nodes[*node_id].first_index;
-                leaf_count += N;
-                stack_size--;
-            } else {
-                middle = splitNode(node, left.start, left.end, bvh);
-                left.depth++;
-                right.depth = left.depth;
-                right.end = left.end;
-                right.start = left.end = middle;
-                left.node_id  = node.first_index;
-                right.node_id = node.first_index + 1;
-                bvh.nodes[bvh.node_count - 1].depth = left.depth;
-                bvh.nodes[bvh.node_count - 2].depth = right.depth;
-                stack[  stack_size] = left;
-                stack[++stack_size] = right;
-                if (left.depth > bvh.height) bvh.height = left.depth;
-            }
+        diff = max.y - min.y;
+        if (diff < 0) diff = -diff;
+        if (diff < EPS) {
+            min.y -= EPS;
+            max.y += EPS;
         }
 
-        BVHNode &left_node = bvh.nodes[1];
-        BVHNode &right_node = bvh.nodes[2];
-        left_node.depth = right_node.depth = 1;
-        root.aabb = left_node.aabb + right_node.aabb;
+        diff = max.z - min.z;
+        if (diff < 0) diff = -diff;
+        if (diff < EPS) {
+            min.z -= EPS;
+            max.z += EPS;
+        }
     }
 
-    void buildMesh(Mesh &mesh) {
-        for (u32 i = 0; i < mesh.triangle_count; i++) {
+    void initLeafNodes(Mesh &mesh, u32 start, u32 end) {
+        for (u32 i = start; i < end; i++) {
             TriangleVertexIndices &indices = mesh.vertex_position_indices[i];
-            const vec3 &v1 = mesh.vertex_positions[indices.ids[0]];
-            const vec3 &v2 = mesh.vertex_positions[indices.ids[1]];
-            const vec3 &v3 = mesh.vertex_positions[indices.ids[2]];
             BVHNode &node = nodes[i];
-            vec3 &min = node.aabb.min;
-            vec3 &max = node.aabb.max;
+            boundTriangle(mesh.vertex_positions[indices.ids[0]],
+                          mesh.vertex_positions[indices.ids[1]],
+                          mesh.vertex_positions[indices.ids[2]], node.aabb);
+            node.first_index = node_ids[i] = i;
+        }
+    }
+
+    // Gathers the triangles' vertex indices into the order of the BVH's leaves:
+    void sortTriangleVertexIndices(TriangleVertexIndices *indices, u32 start, u32 end) {
+        for (u32 i = start; i < end; i++) sorted_triangle_vertex_indices[i] = indices[leaf_ids[i]];
+    }
 
-            min = minimum(minimum(v1, v2), v3);
-            max = maximum(maximum(v1, v2), v3);
+    void initTriangles(Mesh &mesh, u32 start, u32 end) {
+        for (u32 i = start; i < end; i++) {
+            TriangleVertexIndices &indices = mesh.vertex_position_indices[i];
+            mesh.setTriangle(i,
+                             mesh.vertex_positions[indices.ids[0]],
+                             mesh.vertex_positions[indices.ids[1]],
+                             mesh.vertex_positions[indices.ids[2]]);
+        }
+    }
 
-            f32 diff = max.x - min.x;
-            if (diff < 0) diff = -diff;
-            if (diff < EPS) {
-                min.x -= EPS;
-                max.x += EPS;
-            }
+    // Leaves re-bound (and update) their triangles, while internal nodes merge their (already refitted) children:
+    void refitNodes(Mesh &mesh, const u32 *ids, u32 count) {
+        BVHNode *bvh_nodes = mesh.bvh.nodes;
+        for (u32 i = 0; i < count; i++) {
+            BVHNode &node = bvh_nodes[ids[i]];
+            if (node.isLeaf()) {
+                node.aabb = {INFINITY, -INFINITY};
+                for (u32 t = node.first_index; t < node.first_index + node.leaf_count; t++) {
+                    TriangleVertexIndices &indices = mesh.vertex_position_indices[t];
+                    const vec3 &v1 = mesh.vertex_positions[indices.ids[0]];
+                    const vec3 &v2 = mesh.vertex_positions[indices.ids[1]];
+                    const vec3 &v3 = mesh.vertex_positions[indices.ids[2]];
+                    AABB triangle_aabb;
+                    boundTriangle(v1, v2, v3, triangle_aabb);
+                    mesh.setTriangle(t, v1, v2, v3);
+                    node.aabb += triangle_aabb;
+                }
+            } else
+                node.aabb = bvh_nodes[node.first_index].aabb + bvh_nodes[node.first_index + 1].aabb;
+        }
+    }
 
-            diff = max.y - min.y;
-            if (diff < 0) diff = -diff;
-            if (diff < EPS) {
-                min.y -= EPS;
-                max.y += EPS;
-            }
+    struct MeshJob {
+        BVHBuilder *builder;
+        Mesh *mesh;
+        TriangleVertexIndices *indices;
+        const u32 *node_ids;
+    };
+
+    static void initLeafNodesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        job.builder->initLeafNodes(*job.mesh, start, end);
+    }
+
+    static void sortTriangleVertexIndicesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        job.builder->sortTriangleVertexIndices(job.indices, start, end);
+    }
+
+    static void copySortedTriangleVertexIndicesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        for (u32 i = start; i < end; i++) job.indices[i] = job.builder->sorted_triangle_vertex_indices[i];
+    }
+
+    static void initTrianglesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        job.builder->initTriangles(*job.mesh, start, end);
+    }
+
+    static void refitNodesJob(void *data, u32 start, u32 end, u32 thread_index) {
+        MeshJob &job = *(MeshJob*)data;
+        job.builder->refitNodes(*job.mesh, job.node_ids + start, end - start);
+    }
+
+    void forEachTriangle(Mesh &mesh, MeshJob &job, RangeJobFunction function) {
+        if (thread_pool)
+            thread_pool->parallelFor(mesh.triangle_count, BVH_PARALLEL_CHUNK_SIZE, function, &job, 0);
+        else
+            function(&job, 0, mesh.triangle_count, 0);
+    }
 
-            diff = max.z - min.z;
-            if (diff < 0) diff = -diff;
-            if (diff < EPS) {
-                min.z -= EPS;
-                max.z += EPS;
+    // Builds the mesh's BVH, then reorders its triangle vertex indices (positions, normals and uvs) to match the
+    // triangles (which are stored in the order of the BVH's leaves), so that Mesh::triangles[i] is always the
+    // triangle of Mesh::vertex_position_indices[i] (as is required for refitting and for compact triangles).
+    // The triangles are written in the mesh's triangle layout.
+    void buildMesh(Mesh &mesh) {
+        MeshJob job{this, &mesh};
+        forEachTriangle(mesh, job, initLeafNodesJob);
+
+        build(mesh.bvh, mesh.triangle_count, MAX_TRIANGLES_PER_MESH_RTREE_NODE);
+        mesh.bvh.refit_base_sah_cost = 0;
+
+        TriangleVertexIndices *triangle_vertex_indices[3] = {
+            mesh.vertex_position_indices,
+            mesh.normals_count ? mesh.vertex_normal_indices : nullptr,
+            mesh.uvs_count ? mesh.vertex_uvs_indices : nullptr
+        };
+        for (TriangleVertexIndices *indices : triangle_vertex_indices)
+            if (indices) {
+                job.indices = indices;
+                forEachTriangle(mesh, job, sortTriangleVertexIndicesJob);
+                forEachTriangle(mesh, job, copySortedTriangleVertexIndicesJob);
             }
 
+        forEachTriangle(mesh, job, initTrianglesJob);
+    }
+
+    // Refits the mesh's BVH (and triangles) to its current vertex positions, keeping its topology as is.
+    // Nodes are refitted bottom-up one depth level at a time, with the nodes of each level done in parallel.
+    // Given a rebuild threshold (say 1.5), the BVH is rebuilt instead once refitting had degraded its SAH cost
+    // by more than that factor (relative to the cost it had before it was first refitted).
+    // Returns whether the BVH got rebuilt.
+    // Note: Meshes converted by older versions of obj2mesh need to be built once (buildMesh) before refitting.
+    bool refitMesh(Mesh &mesh, f32 rebuild_threshold = 0) {
+        BVH &bvh = mesh.bvh;
+        if (rebuild_threshold > 0 && bvh.refit_base_sah_cost == 0)
+            bvh.refit_base_sah_cost = bvh.getSAHCost();
+
+        // Sort the node ids by depth (counting sort):
+        u32 level_offsets[256 + 1] = {};
+        for (u32 i = 0; i < bvh.node_count; i++) level_offsets[bvh.nodes[i].depth + 1]++;
+        for (u32 depth = 1; depth <= 256; depth++) level_offsets[depth] += level_offsets[depth - 1];
+        u32 level_ends[256];
+        for (u32 depth = 0; depth < 256; depth++) level_ends[depth] = level_offsets[depth];
+        for (u32 i = 0; i < bvh.node_count; i++) depth_sorted_node_ids[level_ends[bvh.nodes[i].depth]++] = i;
+
+        MeshJob job{this, &mesh};
+        for (i32 depth = 255; depth >= 0; depth--) {
+            u32 level_start = level_offsets[depth];
+            u32 level_node_count = level_offsets[depth + 1] - level_start;
+            if (!level_node_count) continue;
+
+            job.node_ids = depth_sorted_node_ids + level_start;
+            if (thread_pool)
+                thread_pool->parallelFor(level_node_count, BVH_REFIT_CHUNK_SIZE, refitNodesJob, &job, 0);
+            else
+                refitNodes(mesh, job.node_ids, level_node_count);
+        }
+        mesh.aabb = bvh.nodes[0].aabb;
+
+        if (rebuild_threshold > 0 && bvh.getSAHCost() > bvh.refit_base_sah_cost * rebuild_threshold) {
+            buildMesh(mesh);
+            return true;
+        }
+
+        return false;
+    }
+
+    // Builds the TLAS over the world-space bounds of the geometries. The TLAS's leaves are given the ids of their
+    // geometries. Fails (leaving the TLAS empty) when the geometries outnumber the leaf nodes the builder was made for,
+    // or the TLAS's capacity.
+    bool buildTLAS(TLAS &tlas, const Geometry *geometries, u32 geometry_count, const Mesh *meshes) {
+        tlas.bvh.refit_base_sah_cost = 0;
+        if (geometry_count > tlas.capacity || geometry_count > max_leaf_node_count) geometry_count = 0;
+        tlas.geometry_count = geometry_count;
+        if (!geometry_count) {
+            tlas.bvh.node_count = 0;
+            return false;
+        }
+
+        for (u32 i = 0; i < tlas.geometry_count; i++) {
+            BVHNode &node = nodes[i];
+            node.aabb = getGeometryBounds(geometries[i], meshes);
             node.first_index = node_ids[i] = i;
         }
 
-        build(mesh.bvh, mesh.triangle_count, MAX_TRIANGLES_PER_MESH_RTREE_NODE);
+        build(tlas.bvh, tlas.geometry_count, MAX_GEOMETRIES_PER_TLAS_NODE);
+        for (u32 i = 0; i < tlas.geometry_count; i++) tlas.geometry_ids[i] = leaf_ids[i];
+        return true;
+    }
+
+    // Refits the TLAS to the current transforms of its geometries (i.e: after some of them moved), keeping its
+    // topology as is. Children are always allocated after their parent, so a single pass over the nodes in
+    // reverse order refits them bottom-up. As with refitMesh, given a rebuild threshold the TLAS is rebuilt
+    // instead once refitting had degraded its SAH cost by more than that factor. Returns whether it got rebuilt.
+    bool refitTLAS(TLAS &tlas, const Geometry *geometries, const Mesh *meshes, f32 rebuild_threshold = 0) {
+        BVH &bvh = tlas.bvh;
+        if (!bvh.node_count) return false;
+        if (rebuild_threshold > 0 && bvh.refit_base_sah_cost == 0)
+            bvh.refit_base_sah_cost = bvh.getSAHCost();
+
+        for (u32 i = bvh.node_count; i-- > 0;) {
+            BVHNode &node = bvh.nodes[i];
+            if (node.isLeaf()) {
+                node.aabb = {INFINITY, -INFINITY};
+                for (u32 g = node.first_index; g < node.first_index + node.leaf_count; g++)
+                    node.aabb += getGeometryBounds(geometries[tlas.geometry_ids[g]], meshes);
+            } else
+                node.aabb = bvh.nodes[node.first_index].aabb + bvh.nodes[node.first_index + 1].aabb;
+        }
 
-        for (u32 i = 0; i < mesh.triangle_count; i++) {
-            Triangle &triangle = mesh.triangles[i];
-            TriangleVertexIndices &indices = mesh.vertex_position_indices[leaf_ids[i]];
-            const vec3 &v1 = mesh.vertex_positions[indices.ids[0]];
-            const vec3 &v2 = mesh.vertex_positions[indices.ids[1]];
-            const vec3 &v3 = mesh.vertex_positions[indices.ids[2]];
-
-            triangle.U = v3 - v1;
-            triangle.V = v2 - v1;
-            triangle.normal = triangle.U.cross(triangle.V).normalized();
-            triangle.position = v1;
-            triangle.local_to_tangent.X = triangle.U;
-            triangle.local_to_tangent.Y = triangle.V;
-            triangle.local_to_tangent.Z = triangle.normal;
-            triangle.local_to_tangent = triangle.local_to_tangent.inverted();
+        if (rebuild_threshold > 0 && bvh.getSAHCost() > bvh.refit_base_sah_cost * rebuild_threshold) {
+            buildTLAS(tlas, geometries, tlas.geometry_count, meshes);
+            return true;
         }
+
+        return false;
     }
-};
\ No newline at end of file
+};
@@ -2,6 +2,7 @@
 
 #include "../math/vec2.h"
 #include "../math/mat3.h"
+#include "../core/ray.h"
 
 #include "./bvh.h"
 
@@ -19,13 +20,44 @@ union TriangleVertexIndices {
 struct Triangle {
     mat3 local_to_tangent;
     vec3 position, normal, U, V;
+
+    INLINE_XPU void init(const vec3 &v1, const vec3 &v2, const vec3 &v3) {
+        U = v3 - v1;
+        V = v2 - v1;
+        normal = U.cross(V).normalized();
+        position = v1;
+        local_to_tangent.X = U;
+        local_to_tangent.Y = V;
+        local_to_tangent.Z = normal;
+        local_to_tangent = local_to_tangent.inverted();
+    }
 };
 
+// The 2 rows of a triangle's tangent-space matrix that give the u and v of a point relative to its first vertex
+// (24 bytes instead of the 84 of a full Triangle). The rest is derived from the mesh's vertices when needed:
+// The position is the first vertex, U goes from it to the third vertex and V goes from it to the second one.
+struct CompactTriangle {
+    vec3 tangent_u, tangent_v;
+
+    CompactTriangle() = default;
+    INLINE_XPU explicit CompactTriangle(const Triangle &triangle) :
+            tangent_u{triangle.local_to_tangent.X.x, triangle.local_to_tangent.Y.x, triangle.local_to_tangent.Z.x},
+            tangent_v{triangle.local_to_tangent.X.y, triangle.local_to_tangent.Y.y, triangle.local_to_tangent.Z.y} {}
+};
+
+// Full triangles are self-contained, while compact ones rely on Mesh::vertex_position_indices[i] being the
+// vertices of triangle i (as BVHBuilder::buildMesh arranges). Meshes are saved in the full layout either way.
+enum TriangleLayout {
+    TriangleLayout_Full,
+    TriangleLayout_Compact
+};
 
 struct Mesh {
     AABB aabb;
     BVH bvh;
-    Triangle *triangles;
+    Triangle *triangles{nullptr};
+    CompactTriangle *compact_triangles{nullptr};
+    TriangleLayout triangle_layout{TriangleLayout_Full};
 
     vec3 *vertex_positions{nullptr};
     vec3 *vertex_normals{nullptr};
@@ -79,6 +111,112 @@ struct Mesh {
             edge_vertex_indices{edge_vertex_indices},
             aabb{aabb}
     {}
+
+    INLINE_XPU u64 getTriangleSizeInBytes() const {
+        return triangle_layout == TriangleLayout_Compact ? sizeof(CompactTriangle) : sizeof(Triangle);
+    }
+
+    INLINE_XPU void setTriangle(u32 index, const vec3 &v1, const vec3 &v2, const vec3 &v3) {
+        Triangle triangle;
+        triangle.init(v1, v2, v3);
+        if (triangle_layout == TriangleLayout_Compact)
+            compact_triangles[index] = CompactTriangle{triangle};
+        else
+            triangles[index] = triangle;
+    }
+
+    INLINE_XPU void getTriangle(u32 index, vec3 &position, vec3 &U, vec3 &V) const {
+        if (triangle_layout == TriangleLayout_Compact) {
+            const TriangleVertexIndices &indices = vertex_position_indices[index];
+            position = vertex_positions[indices.v1];
+            U = vertex_positions[indices.v3] - position;
+            V = vertex_positions[indices.v2] - position;
+        } else {
+            const Triangle &triangle = triangles[index];
+            position = triangle.position;
+            U = triangle.U;
+            V = triangle.V;
+        }
+    }
+
+    INLINE_XPU CompactTriangle getCompactTriangle(u32 index) const {
+        return triangle_layout == TriangleLayout_Compact ? compact_triangles[index] : CompactTriangle{triangles[index]};
+    }
+
+    INLINE_XPU bool hitsTriangle(Ray &ray, u32 index, f32 max_distance, f32 &distance, vec3 &normal) const {
+        if (triangle_layout == TriangleLayout_Compact) {
+            vec3 position, U, V;
+            getTriangle(index, position, U, V);
+            normal = U.cross(V);
+            const CompactTriangle &triangle = compact_triangles[index];
+            return ray.hitsTriangle(triangle.tangent_u, triangle.tangent_v, position, normal, max_distance, distance);
+        }
+
+        const Triangle &triangle = triangles[index];
+        normal = triangle.normal;
+        return ray.hitsTriangle(triangle.local_to_tangent, triangle.position, max_distance, distance);
+    }
+
+    // Intersects a ray (given in the mesh's space) with the mesh's triangles by walking its BVH, nearer child first.
+    // Nodes that are entered beyond the closest hit so far get skipped, and any-hit mode stops at the first hit.
+    // On a hit, the ray's hit has the position, the (unnormalized) triangle normal, the distance and the triangle index.
+    // Traversal can also start from a subtree's node (i.e: for a ray that continues on its own from a ray packet).
+    INLINE_XPU bool castRay(Ray &ray, RayHitMode mode = RayHitMode_Nearest, f32 max_distance = INFINITY, u32 root_node_id = 0) const {
+        if (!bvh.node_count) return false;
+
+        u32 stack[BVH_TRAVERSAL_STACK_SIZE];
+        u32 stack_size = 0;
+        vec3 RD_rcp = 1.0f / ray.direction;
+        f32 distance, left_distance, right_distance;
+        vec3 normal;
+        bool found = false;
+        bool from_behind = false;
+
+        if (ray.hitsAABB(bvh.nodes[root_node_id].aabb, RD_rcp, max_distance, distance))
+            stack[stack_size++] = root_node_id;
+
+        while (stack_size) {
+            const BVHNode &node = bvh.nodes[stack[--stack_size]];
+            if (node.isLeaf()) {
+                for (u32 i = node.first_index; i < node.first_index + node.leaf_count; i++) {
+                    if (hitsTriangle(ray, i, max_distance, distance, normal)) {
+                        max_distance = distance;
+                        from_behind = ray.hit.from_behind;
+                        ray.hit.normal = normal;
+                        ray.hit.triangle_index = i;
+                        found = true;
+                        if (mode == RayHitMode_Any) break;
+                    }
+                }
+                if (found && mode == RayHitMode_Any) break;
+                continue;
+            }
+
+            // Children are only pushed when the ray enters them before the closest hit so far (the nearer one last):
+            u32 left = node.first_index;
+            u32 right = left + 1;
+            bool hits_left  = ray.hitsAABB(bvh.nodes[left ].aabb, RD_rcp, max_distance, left_distance);
+            bool hits_right = ray.hitsAABB(bvh.nodes[right].aabb, RD_rcp, max_distance, right_distance);
+            if (hits_left && hits_right) {
+                if (left_distance < right_distance) {
+                    stack[stack_size++] = right;
+                    stack[stack_size++] = left;
+                } else {
+                    stack[stack_size++] = left;
+                    stack[stack_size++] = right;
+                }
+            } else if (hits_left) stack[stack_size++] = left;
+            else if (hits_right) stack[stack_size++] = right;
+        }
+
+        if (found) {
+            ray.hit.from_behind = from_behind;
+            ray.hit.distance = max_distance;
+            ray.hit.position = ray.at(max_distance);
+        }
+
+        return found;
+    }
 };
 
 
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "../math/simd.h"
+#include "./mesh.h"
+
+#define RAY_PACKET_WIDTH SIMD_WIDTH
+
+// Once a subtree is entered by this few of a packet's rays (or fewer), they continue through it one at a time:
+#define RAY_PACKET_MIN_ACTIVE_RAYS (RAY_PACKET_WIDTH / 4)
+
+// A packet of 4 or 8 rays (matching the SIMD width) as SoA lanes, that traverse a mesh's BVH together:
+// Each node is slab-tested against all the rays at once, and is only descended into if any of them enters it
+// before its closest hit so far. Coherent rays (i.e: primary rays of neighbouring pixels) mostly visit the same
+// nodes, so the traversal is shared among them and the triangles of a leaf are tested against all of them at once.
+// Rays are given in the mesh's space, and unused lanes are disabled by giving them a negative distance.
+struct RayPacket {
+    f32 origin_x[RAY_PACKET_WIDTH], origin_y[RAY_PACKET_WIDTH], origin_z[RAY_PACKET_WIDTH];
+    f32 direction_x[RAY_PACKET_WIDTH], direction_y[RAY_PACKET_WIDTH], direction_z[RAY_PACKET_WIDTH];
+    f32 distance[RAY_PACKET_WIDTH];       // The maximum distance beforehand, and the closest hit's distance after
+    u32 triangle_index[RAY_PACKET_WIDTH]; // Of the closest hit's triangle ((u32)-1 for rays that missed)
+
+    INLINE void setRay(u8 lane, const vec3 &origin, const vec3 &direction, f32 max_distance = INFINITY) {
+        origin_x[lane] = origin.x;
+        origin_y[lane] = origin.y;
+        origin_z[lane] = origin.z;
+        direction_x[lane] = direction.x;
+        direction_y[lane] = direction.y;
+        direction_z[lane] = direction.z;
+        distance[lane] = max_distance;
+        triangle_index[lane] = (u32)-1;
+    }
+
+    INLINE void disableRay(u8 lane) {
+        setRay(lane, vec3{0}, vec3{0, 0, 1}, -1);
+    }
+
+    INLINE void getRay(u8 lane, Ray &ray) const {
+        ray.origin = {origin_x[lane], origin_y[lane], origin_z[lane]};
+        ray.direction = {direction_x[lane], direction_y[lane], direction_z[lane]};
+    }
+
+    // Finds the closest hits of the rays, returning a bit-mask of the rays that hit anything:
+    u32 castOn(const Mesh &mesh) {
+        if (!mesh.bvh.node_count) return 0;
+
+        Lanes lanes;
+        lanes.load(*this);
+
+        // Nearer children are visited first, as seen along the packet's overall direction:
+        f32 overall_direction[3] = {0, 0, 0};
+        for (u8 i = 0; i < RAY_PACKET_WIDTH; i++) {
+            overall_direction[0] += direction_x[i];
+            overall_direction[1] += direction_y[i];
+            overall_direction[2] += direction_z[i];
+        }
+
+        const BVHNode *nodes = mesh.bvh.nodes;
+        u32 stack[BVH_TRAVERSAL_STACK_SIZE];
+        u32 stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size) {
+            u32 node_id = stack[--stack_size];
+            const BVHNode &node = nodes[node_id];
+            u32 active_rays = lanes.hitAABB(node.aabb);
+            if (!active_rays) continue;
+
+            if (node.isLeaf()) {
+                for (u32 i = node.first_index; i < node.first_index + node.leaf_count; i++) {
+                    u32 hits = lanes.hitTriangle(mesh, i);
+                    for (u8 lane = 0; hits; lane++, hits >>= 1)
+                        if (hits & 1) triangle_index[lane] = i;
+                }
+                continue;
+            }
+
+            if (countBits(active_rays) <= RAY_PACKET_MIN_ACTIVE_RAYS) {
+                // The packet diverged: Continue through this subtree with each of the active rays on its own
+                simd::store(distance, lanes.distance);
+                castRaysOn(mesh, node_id, active_rays);
+                lanes.distance = simd::load(distance);
+                continue;
+            }
+
+            const AABB &left  = nodes[node.first_index].aabb;
+            const AABB &right = nodes[node.first_index + 1].aabb;
+            vec3 centers_offset = (right.min + right.max) - (left.min + left.max);
+            u8 axis = 0;
+            for (u8 i = 1; i < 3; i++)
+                if (fabsf(centers_offset.components[i]) > fabsf(centers_offset.components[axis]))
+                    axis = i;
+            bool left_is_nearer = (centers_offset.components[axis] > 0) == (overall_direction[axis] > 0);
+            stack[stack_size++] = node.first_index + (left_is_nearer ? 1 : 0);
+            stack[stack_size++] = node.first_index + (left_is_nearer ? 0 : 1);
+        }
+
+        simd::store(distance, lanes.distance);
+        u32 hits = 0;
+        for (u8 i = 0; i < RAY_PACKET_WIDTH; i++)
+            if (triangle_index[i] != (u32)-1)
+                hits |= 1u << i;
+
+        return hits;
+    }
+
+private:
+    // The packet's rays loaded into SIMD registers for the duration of a traversal:
+    struct Lanes {
+        simd_f32 origin_x, origin_y, origin_z;
+        simd_f32 direction_x, direction_y, direction_z;
+        simd_f32 direction_rcp_x, direction_rcp_y, direction_rcp_z;
+        simd_f32 distance;
+
+        INLINE void load(const RayPacket &packet) {
+            simd_f32 one = simd::set1(1.0f);
+            origin_x = simd::load(packet.origin_x);
+            origin_y = simd::load(packet.origin_y);
+            origin_z = simd::load(packet.origin_z);
+            direction_x = simd::load(packet.direction_x);
+            direction_y = simd::load(packet.direction_y);
+            direction_z = simd::load(packet.direction_z);
+            direction_rcp_x = simd::div(one, direction_x);
+            direction_rcp_y = simd::div(one, direction_y);
+            direction_rcp_z = simd::div(one, direction_z);
+            distance = simd::load(packet.distance);
+        }
+
+        // Slab test of all the rays against a box, returning a bit-mask of the rays entering it before their hits:
+        INLINE u32 hitAABB(const AABB &aabb) const {
+            simd_f32 min_x = simd::mul(simd::sub(simd::set1(aabb.min.x), origin_x), direction_rcp_x);
+            simd_f32 min_y = simd::mul(simd::sub(simd::set1(aabb.min.y), origin_y), direction_rcp_y);
+            simd_f32 min_z = simd::mul(simd::sub(simd::set1(aabb.min.z), origin_z), direction_rcp_z);
+            simd_f32 max_x = simd::mul(simd::sub(simd::set1(aabb.max.x), origin_x), direction_rcp_x);
+            simd_f32 max_y = simd::mul(simd::sub(simd::set1(aabb.max.y), origin_y), direction_rcp_y);
+            simd_f32 max_z = simd::mul(simd::sub(simd::set1(aabb.max.z), origin_z), direction_rcp_z);
+            simd_f32 near_t = simd::max(simd::max(simd::min(min_x, max_x), simd::min(min_y, max_y)),
+                                        simd::max(simd::min(min_z, max_z), simd::set1(0.0f)));
+            simd_f32 far_t = simd::min(simd::min(simd::max(min_x, max_x), simd::max(min_y, max_y)),
+                                       simd::min(simd::max(min_z, max_z), distance));
+            return simd::maskBits(simd::lessOrEqual(near_t, far_t));
+        }
+
+        // Branchless test of all the rays against a triangle (as in Ray::hitsTriangle for either triangle layout).
+        // Rays that hit it before their current hit have their distance updated, and are returned as a bit-mask:
+        INLINE u32 hitTriangle(const Mesh &mesh, u32 index) {
+            simd_f32 zero = simd::set1(0.0f);
+            simd_f32 t, u, v;
+            if (mesh.triangle_layout == TriangleLayout_Compact) {
+                vec3 position, U, V;
+                mesh.getTriangle(index, position, U, V);
+                vec3 N = U.cross(V);
+                const CompactTriangle &triangle = mesh.compact_triangles[index];
+
+                simd_f32 NdotRd = simd::fmadd(simd::set1(N.x), direction_x, simd::fmadd(simd::set1(N.y), direction_y, simd::mul(simd::set1(N.z), direction_z)));
+                simd_f32 NdotRo = simd::fmadd(simd::set1(N.x), origin_x, simd::fmadd(simd::set1(N.y), origin_y, simd::mul(simd::set1(N.z), origin_z)));
+                t = simd::div(simd::sub(simd::set1(N.dot(position)), NdotRo), NdotRd);
+
+                simd_f32 P_x = simd::sub(simd::fmadd(t, direction_x, origin_x), simd::set1(position.x));
+                simd_f32 P_y = simd::sub(simd::fmadd(t, direction_y, origin_y), simd::set1(position.y));
+                simd_f32 P_z = simd::sub(simd::fmadd(t, direction_z, origin_z), simd::set1(position.z));
+                u = simd::fmadd(simd::set1(triangle.tangent_u.x), P_x, simd::fmadd(simd::set1(triangle.tangent_u.y), P_y, simd::mul(simd::set1(triangle.tangent_u.z), P_z)));
+                v = simd::fmadd(simd::set1(triangle.tangent_v.x), P_x, simd::fmadd(simd::set1(triangle.tangent_v.y), P_y, simd::mul(simd::set1(triangle.tangent_v.z), P_z)));
+            } else {
+                const Triangle &triangle = mesh.triangles[index];
+                const mat3 &M = triangle.local_to_tangent;
+                simd_f32 Ro_x = simd::sub(origin_x, simd::set1(triangle.position.x));
+                simd_f32 Ro_y = simd::sub(origin_y, simd::set1(triangle.position.y));
+                simd_f32 Ro_z = simd::sub(origin_z, simd::set1(triangle.position.z));
+
+                // The ray's origin and direction in tangent space (u, v, height above the triangle's plane):
+                simd_f32 X_x = simd::set1(M.X.x), Y_x = simd::set1(M.Y.x), Z_x = simd::set1(M.Z.x);
+                simd_f32 X_y = simd::set1(M.X.y), Y_y = simd::set1(M.Y.y), Z_y = simd::set1(M.Z.y);
+                simd_f32 X_z = simd::set1(M.X.z), Y_z = simd::set1(M.Y.z), Z_z = simd::set1(M.Z.z);
+                simd_f32 tangent_origin_x = simd::fmadd(X_x, Ro_x, simd::fmadd(Y_x, Ro_y, simd::mul(Z_x, Ro_z)));
+                simd_f32 tangent_origin_y = simd::fmadd(X_y, Ro_x, simd::fmadd(Y_y, Ro_y, simd::mul(Z_y, Ro_z)));
+                simd_f32 tangent_origin_z = simd::fmadd(X_z, Ro_x, simd::fmadd(Y_z, Ro_y, simd::mul(Z_z, Ro_z)));
+                simd_f32 tangent_direction_x = simd::fmadd(X_x, direction_x, simd::fmadd(Y_x, direction_y, simd::mul(Z_x, direction_z)));
+                simd_f32 tangent_direction_y = simd::fmadd(X_y, direction_x, simd::fmadd(Y_y, direction_y, simd::mul(Z_y, direction_z)));
+                simd_f32 tangent_direction_z = simd::fmadd(X_z, direction_x, simd::fmadd(Y_z, direction_y, simd::mul(Z_z, direction_z)));
+
+                t = simd::div(simd::sub(zero, tangent_origin_z), tangent_direction_z);
+                u = simd::fmadd(t, tangent_direction_x, tangent_origin_x);
+                v = simd::fmadd(t, tangent_direction_y, tangent_origin_y);
+            }
+
+            // Parallel rays get an infinite (or NaN) t, which fails these comparisons:
+            simd_f32 hit = simd::maskAnd(simd::lessThan(zero, t), simd::lessThan(t, distance));
+            hit = simd::maskAnd(hit, simd::maskAnd(simd::lessOrEqual(zero, u), simd::lessOrEqual(zero, v)));
+            hit = simd::maskAnd(hit, simd::lessOrEqual(simd::add(u, v), simd::set1(1.0f)));
+            distance = simd::select(hit, t, distance);
+            return simd::maskBits(hit);
+        }
+    };
+
+    void castRaysOn(const Mesh &mesh, u32 node_id, u32 rays) {
+        Ray ray;
+        for (u8 lane = 0; rays; lane++, rays >>= 1) {
+            if (!(rays & 1)) continue;
+
+            getRay(lane, ray);
+            if (mesh.castRay(ray, RayHitMode_Nearest, distance[lane], node_id)) {
+                distance[lane] = ray.hit.distance;
+                triangle_index[lane] = ray.hit.triangle_index;
+            }
+        }
+    }
+
+    INLINE static u32 countBits(u32 bits) {
+        u32 count = 0;
+        for (; bits; bits &= bits - 1) count++;
+        return count;
+    }
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "./mesh.h"
+#include "./tlas.h"
 #include "./grid.h"
 #include "./box.h"
 #include "./camera.h"
@@ -39,6 +40,9 @@ struct Scene {
     u32 *mesh_triangle_counts = nullptr;
     u32 *mesh_vertex_counts = nullptr;
 
+    // Optional: Once built (see BVHBuilder::buildTLAS) scene-wide queries go through it instead of all geometries:
+    TLAS tlas;
+
     Scene(SceneCounts counts,
           char *file_path = nullptr,
           Camera *cameras = nullptr,
@@ -96,33 +100,60 @@ struct Scene {
                 load(textures[i], texture_files[i].char_ptr, memory_allocator);
     }
 
-    INLINE bool castRay(Ray &ray) const {
-        static Ray local_ray;
-        static Transform xform;
-
+    // Finds the geometry that a ray hits closest to its origin, or in any-hit mode the first one found to be hit
+    // (either way, only hits closer than the ray's current hit distance count). Meshes are intersected exactly
+    // through their BVH, while other geometries are intersected through their bounding cube.
+    // With a TLAS, only the geometries whose world-space bounds the ray enters before the closest hit are tested.
+    INLINE bool castRay(Ray &ray, RayHitMode mode = RayHitMode_Nearest) const {
         bool found{false};
-        bool current_found{false};
 
-        Geometry *geo = geometries;
-
-        for (u32 i = 0; i < counts.geometries; i++, geo++) {
-            xform = geo->transform;
-            if (geo->type == GeometryType_Mesh)
-                xform.scale *= meshes[geo->id].aabb.max;
-
-            xform.internPosAndDir(ray.origin, ray.direction, local_ray.origin, local_ray.direction);
+        if (tlas.bvh.node_count) {
+            const BVH &bvh = tlas.bvh;
+            u32 stack[BVH_TRAVERSAL_STACK_SIZE];
+            u32 stack_size = 0;
+            vec3 RD_rcp = 1.0f / ray.direction;
+            f32 distance_scale = 1.0f / ray.direction.length(); // From distances to the ray's own t (for the bounds)
+            f32 max_t = ray.hit.distance_squared < INFINITY ? sqrtf(ray.hit.distance_squared) * distance_scale : INFINITY;
+            f32 left_t, right_t;
+
+            if (ray.hitsAABB(bvh.nodes[0].aabb, RD_rcp, max_t, left_t))
+                stack[stack_size++] = 0;
+
+            while (stack_size) {
+                const BVHNode &node = bvh.nodes[stack[--stack_size]];
+                if (node.isLeaf()) {
+                    for (u32 i = node.first_index; i < node.first_index + node.leaf_count; i++)
+                        if (castRayOnGeometry(ray, tlas.geometry_ids[i], mode)) {
+                            found = true;
+                            max_t = sqrtf(ray.hit.distance_squared) * distance_scale;
+                            if (mode == RayHitMode_Any) break;
+                        }
+
+                    if (found && mode == RayHitMode_Any) break;
+                    continue;
+                }
 
-            current_found = local_ray.hitsCube();
-            if (current_found) {
-                local_ray.hit.position         = xform.externPos(local_ray.hit.position);
-                local_ray.hit.distance_squared = (local_ray.hit.position - ray.origin).squaredLength();
-                if (local_ray.hit.distance_squared < ray.hit.distance_squared) {
-                    ray.hit = local_ray.hit;
-                    ray.hit.geo_type = geo->type;
-                    ray.hit.geo_id = i;
+                u32 left = node.first_index;
+                u32 right = left + 1;
+                bool hits_left  = ray.hitsAABB(bvh.nodes[left ].aabb, RD_rcp, max_t, left_t);
+                bool hits_right = ray.hitsAABB(bvh.nodes[right].aabb, RD_rcp, max_t, right_t);
+                if (hits_left && hits_right) {
+                    if (left_t < right_t) {
+                        stack[stack_size++] = right;
+                        stack[stack_size++] = left;
+                    } else {
+                        stack[stack_size++] = left;
+                        stack[stack_size++] = right;
+                    }
+                } else if (hits_left) stack[stack_size++] = left;
+                else if (hits_right) stack[stack_size++] = right;
+            }
+        } else {
+            for (u32 i = 0; i < counts.geometries; i++)
+                if (castRayOnGeometry(ray, i, mode)) {
                     found = true;
+                    if (mode == RayHitMode_Any) break;
                 }
-            }
         }
 
         if (found) {
@@ -132,4 +163,37 @@ struct Scene {
 
         return found;
     }
+
+    // Intersects a ray with a single geometry, updating the ray's hit if it is hit closer than the current one:
+    INLINE bool castRayOnGeometry(Ray &ray, u32 geo_id, RayHitMode mode = RayHitMode_Nearest) const {
+        static Ray local_ray;
+        static Transform xform;
+
+        Geometry *geo = geometries + geo_id;
+        xform = geo->transform;
+        xform.internPosAndDir(ray.origin, ray.direction, local_ray.origin, local_ray.direction);
+
+        bool found;
+        if (geo->type == GeometryType_Mesh) {
+            // Bound the mesh's traversal by the closest hit so far (its distance being in the mesh's space):
+            f32 max_distance = INFINITY;
+            if (ray.hit.distance_squared < INFINITY)
+                max_distance = (xform.internPos(ray.at(sqrtf(ray.hit.distance_squared) / ray.direction.length())) - local_ray.origin).length();
+
+            found = meshes[geo->id].castRay(local_ray, mode, max_distance);
+        } else
+            found = local_ray.hitsCube();
+        if (!found)
+            return false;
+
+        local_ray.hit.position         = xform.externPos(local_ray.hit.position);
+        local_ray.hit.distance_squared = (local_ray.hit.position - ray.origin).squaredLength();
+        if (local_ray.hit.distance_squared >= ray.hit.distance_squared)
+            return false;
+
+        ray.hit = local_ray.hit;
+        ray.hit.geo_type = geo->type;
+        ray.hit.geo_id = geo_id;
+        return true;
+    }
 };
\ No newline at end of file
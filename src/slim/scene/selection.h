@@ -20,6 +20,7 @@ struct Selection {
     GeometryType geo_type = GeometryType_None;
     BoxSide box_side = BoxSide_None;
     bool changed = false;
+    bool transformed = false; // Whether the selected geometry got moved, scaled or rotated by the last manipulation
     bool left_mouse_button_was_pressed = false;
 
     void manipulate(const Viewport &viewport, const Scene &scene) {
@@ -33,6 +34,7 @@ struct Selection {
         ray.origin = camera.position;
         ray.direction = camera.getRayDirectionAt(x, y, dimensions.f_width, dimensions.f_height);
         ray.hit.distance_squared = INFINITY;
+        transformed = false;
 
         if (mouse::left_button.is_pressed && !left_mouse_button_was_pressed) {
             // This is the first frame after the left mouse button went down:
@@ -98,6 +100,7 @@ struct Selection {
                                 if (geometry->type == GeometryType_Mesh)
                                     xform.scale *= scene.meshes[geometry->id].aabb.max;
 
+                                transformed = true;
                                 if (mouse::left_button.is_pressed) {
                                     *world_position = ray.hit.position - world_offset;
                                 } else if (mouse::middle_button.is_pressed) {
@@ -129,6 +132,7 @@ struct Selection {
 
                     // View -> World (BoxSide_Back-track by the world offset from the hit position back to the selected-object's center):
                     *world_position = camera.rotation * vec3{x, -y, object_distance} + camera.position - world_offset;
+                    transformed = true;
                 }
             }
         }
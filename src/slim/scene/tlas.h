@@ -0,0 +1,65 @@
+#pragma once
+
+#include "./mesh.h"
+#include "../core/transform.h"
+
+// Geometries are bounded in world space by their local bounds transformed by their transform:
+// Meshes by their own bounds, and every other geometry type by the unit cube it is intersected through.
+INLINE_XPU AABB getGeometryBounds(const Geometry &geometry, const Mesh *meshes) {
+    AABB local_bounds = geometry.type == GeometryType_Mesh ? meshes[geometry.id].aabb : AABB{-1, 1};
+    return local_bounds * geometry.transform;
+}
+
+// A top-level acceleration structure: A BVH over the world-space bounds of a scene's geometries (built and refitted
+// by BVHBuilder::buildTLAS and BVHBuilder::refitTLAS). Its leaves index a range of geometry_ids, which refer to the
+// geometries that are then searched through (i.e: through their mesh's own BVH, with the query in the mesh's space).
+// Meshes that are instanced by many geometries are only stored once, as a geometry only bounds its mesh.
+struct TLAS {
+    BVH bvh{nullptr, 0, 0};
+    u32 *geometry_ids{nullptr};
+    u32 geometry_count{0};
+    u32 capacity{0};
+
+    static u64 getSizeInBytes(u32 geometry_count) {
+        return (sizeof(BVHNode) * 2 + sizeof(u32)) * geometry_count;
+    }
+
+    bool allocate(u32 max_geometry_count, memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = getSizeInBytes(max_geometry_count);
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            bvh.nodes = (BVHNode*)memory_allocator->allocate(size);
+        } else
+            bvh.nodes = (BVHNode*)os::getMemory(size);
+
+        capacity = bvh.nodes ? max_geometry_count : 0;
+        geometry_ids = bvh.nodes ? (u32*)(bvh.nodes + capacity * 2) : nullptr;
+        return bvh.nodes != nullptr;
+    }
+
+    // Gathers the ids of the geometries whose world-space bounds overlap a sphere (i.e: for proximity queries).
+    // Returns the number of overlapping geometries, of which only up to max_count ids are written.
+    u32 overlapSphere(const vec3 &center, f32 radius, u32 *ids, u32 max_count) const {
+        if (!bvh.node_count) return 0;
+
+        u32 stack[BVH_TRAVERSAL_STACK_SIZE];
+        u32 stack_size = 0;
+        u32 count = 0;
+        stack[stack_size++] = 0;
+        while (stack_size) {
+            BVHNode &node = bvh.nodes[stack[--stack_size]];
+            if (!node.aabb.overlapSphere(center, radius))
+                continue;
+
+            if (node.isLeaf()) {
+                for (u32 i = node.first_index; i < node.first_index + node.leaf_count; i++, count++)
+                    if (count < max_count) ids[count] = geometry_ids[i];
+            } else {
+                stack[stack_size++] = node.first_index;
+                stack[stack_size++] = node.first_index + 1;
+            }
+        }
+
+        return count;
+    }
+};
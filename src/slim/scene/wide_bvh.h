@@ -0,0 +1,191 @@
+#pragma once
+
+#include "../math/simd.h"
+#include "./mesh.h"
+
+#define WIDE_BVH_WIDTH SIMD_WIDTH
+#define TRIANGLE_PACKET_WIDTH 4 // Matching the maximum triangle count of the BVH builder's leaves
+
+// The triangles of a leaf, packed as SoA lanes so that they can all be tested at once (see ClosestPointOnTriangle).
+// Only what a closest-point query reads is kept: The 2 rows of the tangent-space matrix that give u and v,
+// the position and the U and V edges. Unused lanes repeat the last triangle, so they never win a strict comparison.
+// Leaves with more triangles than a packet can hold span several consecutive packets.
+struct TrianglePacket {
+    f32 tangent_x_x[TRIANGLE_PACKET_WIDTH], tangent_x_y[TRIANGLE_PACKET_WIDTH], tangent_x_z[TRIANGLE_PACKET_WIDTH];
+    f32 tangent_y_x[TRIANGLE_PACKET_WIDTH], tangent_y_y[TRIANGLE_PACKET_WIDTH], tangent_y_z[TRIANGLE_PACKET_WIDTH];
+    f32 position_x[TRIANGLE_PACKET_WIDTH], position_y[TRIANGLE_PACKET_WIDTH], position_z[TRIANGLE_PACKET_WIDTH];
+    f32 U_x[TRIANGLE_PACKET_WIDTH], U_y[TRIANGLE_PACKET_WIDTH], U_z[TRIANGLE_PACKET_WIDTH];
+    f32 V_x[TRIANGLE_PACKET_WIDTH], V_y[TRIANGLE_PACKET_WIDTH], V_z[TRIANGLE_PACKET_WIDTH];
+    u32 first_index; // Of the first triangle in the mesh
+    u32 node_id;     // Of the leaf node in the binary BVH
+    u16 count;
+    u16 has_next;    // Whether the next packet continues the same leaf
+
+    void set(const Mesh &mesh, u32 first, u16 triangle_count, u32 leaf_node_id, bool is_continued) {
+        first_index = first;
+        node_id = leaf_node_id;
+        count = triangle_count;
+        has_next = is_continued;
+        vec3 position, U, V;
+        for (u8 i = 0; i < TRIANGLE_PACKET_WIDTH; i++) {
+            u32 triangle_index = first + (i < triangle_count ? i : triangle_count - 1);
+            CompactTriangle t = mesh.getCompactTriangle(triangle_index);
+            mesh.getTriangle(triangle_index, position, U, V);
+            tangent_x_x[i] = t.tangent_u.x;
+            tangent_x_y[i] = t.tangent_u.y;
+            tangent_x_z[i] = t.tangent_u.z;
+            tangent_y_x[i] = t.tangent_v.x;
+            tangent_y_y[i] = t.tangent_v.y;
+            tangent_y_z[i] = t.tangent_v.z;
+            position_x[i] = position.x;
+            position_y[i] = position.y;
+            position_z[i] = position.z;
+            U_x[i] = U.x;
+            U_y[i] = U.y;
+            U_z[i] = U.z;
+            V_x[i] = V.x;
+            V_y[i] = V.y;
+            V_z[i] = V.z;
+        }
+    }
+};
+
+// A collapsed (4 or 8 wide, matching the SIMD width) view of a binary BVH, for CPU queries.
+// Each node keeps the bounds of all its children as SoA lanes, so they can all be tested at once.
+// Internal children index other wide nodes, while leaf children index the first triangle packet of their leaf
+// (packets keep the id of their binary leaf node, which holds the flags that queries mark for debug drawing).
+// Unused child slots have inverted (empty) bounds, which are infinitely far from everything.
+struct WideBVHNode {
+    f32 min_x[WIDE_BVH_WIDTH], min_y[WIDE_BVH_WIDTH], min_z[WIDE_BVH_WIDTH];
+    f32 max_x[WIDE_BVH_WIDTH], max_y[WIDE_BVH_WIDTH], max_z[WIDE_BVH_WIDTH];
+    u32 children[WIDE_BVH_WIDTH];
+    u8 leaf_mask;
+    u8 child_count;
+
+    INLINE bool isLeaf(u8 child) const { return leaf_mask & (1u << child); }
+
+    // The squared distances from a point to each child's bounds (0 for children containing the point):
+    INLINE simd_f32 squaredDistances(simd_f32 x, simd_f32 y, simd_f32 z) const {
+        simd_f32 zero = simd::set1(0);
+        simd_f32 dx = simd::max(simd::max(simd::sub(simd::load(min_x), x), simd::sub(x, simd::load(max_x))), zero);
+        simd_f32 dy = simd::max(simd::max(simd::sub(simd::load(min_y), y), simd::sub(y, simd::load(max_y))), zero);
+        simd_f32 dz = simd::max(simd::max(simd::sub(simd::load(min_z), z), simd::sub(z, simd::load(max_z))), zero);
+        return simd::fmadd(dx, dx, simd::fmadd(dy, dy, simd::mul(dz, dz)));
+    }
+};
+
+struct WideBVHStackEntry {
+    u32 node_id;
+    f32 squared_distance;
+};
+
+struct WideBVH {
+    WideBVHNode *nodes = nullptr;
+    TrianglePacket *packets = nullptr;
+    u32 node_count = 0;
+    u32 packet_count = 0;
+    u32 capacity = 0;
+    u32 packet_capacity = 0;
+
+    // Every wide node stems from a distinct internal node of the binary BVH, and there is a packet per leaf
+    // (for leaves of up to TRIANGLE_PACKET_WIDTH triangles, as the builder makes them):
+    static u32 getCapacity(const BVH &bvh) { return (bvh.node_count + 1) / 2; }
+    static u32 getPacketCapacity(const Mesh &mesh) {
+        u32 packet_capacity = 0;
+        for (u32 i = 0; i < mesh.bvh.node_count; i++)
+            if (mesh.bvh.nodes[i].isLeaf())
+                packet_capacity += (mesh.bvh.nodes[i].leaf_count + TRIANGLE_PACKET_WIDTH - 1) / TRIANGLE_PACKET_WIDTH;
+        return packet_capacity;
+    }
+    static u64 getSizeInBytes(const Mesh &mesh) {
+        return sizeof(WideBVHNode) * getCapacity(mesh.bvh) + sizeof(TrianglePacket) * getPacketCapacity(mesh);
+    }
+
+    // Each visited node leaves at most all-but-one of its children on the stack, per level of the binary BVH:
+    static u32 getMaxStackSize(const BVH &bvh) { return (WIDE_BVH_WIDTH - 1) * bvh.height + 1; }
+
+    bool allocate(const Mesh &mesh, memory::MonotonicAllocator *memory_allocator = nullptr) {
+        u64 size = getSizeInBytes(mesh);
+        if (memory_allocator) {
+            if (size > (memory_allocator->capacity - memory_allocator->occupied)) return false;
+            nodes = (WideBVHNode*)memory_allocator->allocate(size);
+        } else
+            nodes = (WideBVHNode*)os::getMemory(size);
+
+        capacity = nodes ? getCapacity(mesh.bvh) : 0;
+        packet_capacity = nodes ? getPacketCapacity(mesh) : 0;
+        packets = nodes ? (TrianglePacket*)(nodes + capacity) : nullptr;
+        return nodes != nullptr;
+    }
+
+    // Collapses the binary BVH top-down (breadth first): Each wide node starts with the 2 children of its
+    // binary node, then keeps opening up its largest internal child until it has a full set of children.
+    void build(const Mesh &mesh) {
+        const BVH &bvh = mesh.bvh;
+        node_count = 0;
+        packet_count = 0;
+        if (!bvh.node_count || bvh.nodes[0].isLeaf() || !capacity) return;
+
+        // Pending wide nodes temporarily hold the id of their binary node in their first child slot:
+        nodes[node_count++].children[0] = 0;
+        for (u32 wide_node_id = 0; wide_node_id < node_count; wide_node_id++) {
+            WideBVHNode &node = nodes[wide_node_id];
+            const BVHNode &binary_node = bvh.nodes[node.children[0]];
+
+            u32 candidates[WIDE_BVH_WIDTH];
+            u8 candidate_count = 2;
+            candidates[0] = binary_node.first_index;
+            candidates[1] = binary_node.first_index + 1;
+            while (candidate_count < WIDE_BVH_WIDTH) {
+                i32 largest = -1;
+                f32 largest_area = -1;
+                for (u8 i = 0; i < candidate_count; i++) {
+                    const BVHNode &candidate = bvh.nodes[candidates[i]];
+                    if (!candidate.isLeaf() && candidate.aabb.area() > largest_area) {
+                        largest_area = candidate.aabb.area();
+                        largest = i;
+                    }
+                }
+                if (largest == -1) break;
+
+                u32 first_child = bvh.nodes[candidates[largest]].first_index;
+                candidates[largest] = first_child;
+                candidates[candidate_count++] = first_child + 1;
+            }
+
+            node.leaf_mask = 0;
+            node.child_count = candidate_count;
+            for (u8 i = 0; i < WIDE_BVH_WIDTH; i++) {
+                if (i < candidate_count) {
+                    const BVHNode &child = bvh.nodes[candidates[i]];
+                    node.min_x[i] = child.aabb.min.x;
+                    node.min_y[i] = child.aabb.min.y;
+                    node.min_z[i] = child.aabb.min.z;
+                    node.max_x[i] = child.aabb.max.x;
+                    node.max_y[i] = child.aabb.max.y;
+                    node.max_z[i] = child.aabb.max.z;
+                    if (child.isLeaf()) {
+                        node.leaf_mask |= (u8)(1u << i);
+                        node.children[i] = packet_count;
+                        addPackets(mesh, child, candidates[i]);
+                    } else {
+                        node.children[i] = node_count;
+                        nodes[node_count++].children[0] = candidates[i];
+                    }
+                } else {
+                    node.min_x[i] = node.min_y[i] = node.min_z[i] = INFINITY;
+                    node.max_x[i] = node.max_y[i] = node.max_z[i] = -INFINITY;
+                    node.children[i] = 0;
+                }
+            }
+        }
+    }
+    void addPackets(const Mesh &mesh, const BVHNode &leaf, u32 leaf_node_id) {
+        u32 end = leaf.first_index + leaf.leaf_count;
+        for (u32 start = leaf.first_index; start < end; start += TRIANGLE_PACKET_WIDTH) {
+            u32 triangle_count = end - start < TRIANGLE_PACKET_WIDTH ? end - start : TRIANGLE_PACKET_WIDTH;
+            packets[packet_count++].set(mesh, start, (u16)triangle_count, leaf_node_id,
+                                        start + TRIANGLE_PACKET_WIDTH < end);
+        }
+    }
+};
@@ -7,7 +7,7 @@
 
 u32 getSizeInBytes(const Mesh &mesh) {
     u32 memory_size = getSizeInBytes(mesh.bvh);
-    memory_size += sizeof(Triangle) * mesh.triangle_count;
+    memory_size += mesh.getTriangleSizeInBytes() * mesh.triangle_count;
     memory_size += sizeof(vec3) * mesh.vertex_count;
     memory_size += sizeof(TriangleVertexIndices) * mesh.triangle_count;
     memory_size += sizeof(EdgeVertexIndices) * mesh.edge_count;
@@ -27,7 +27,10 @@ u32 getSizeInBytes(const Mesh &mesh) {
 bool allocateMemory(Mesh &mesh, memory::MonotonicAllocator *memory_allocator) {
     if (getSizeInBytes(mesh) > (memory_allocator->capacity - memory_allocator->occupied)) return false;
     allocateMemory(mesh.bvh, memory_allocator);
-    mesh.triangles               = (Triangle*             )memory_allocator->allocate(sizeof(Triangle)              * mesh.triangle_count);
+    if (mesh.triangle_layout == TriangleLayout_Compact)
+        mesh.compact_triangles   = (CompactTriangle*      )memory_allocator->allocate(sizeof(CompactTriangle)       * mesh.triangle_count);
+    else
+        mesh.triangles           = (Triangle*             )memory_allocator->allocate(sizeof(Triangle)              * mesh.triangle_count);
     mesh.vertex_positions        = (vec3*                 )memory_allocator->allocate(sizeof(vec3)                  * mesh.vertex_count);
     mesh.vertex_position_indices = (TriangleVertexIndices*)memory_allocator->allocate(sizeof(TriangleVertexIndices) * mesh.triangle_count);
     mesh.edge_vertex_indices     = (EdgeVertexIndices*    )memory_allocator->allocate(sizeof(EdgeVertexIndices)     * mesh.edge_count);
@@ -75,10 +78,63 @@ bool loadHeader(Mesh &mesh, char *file_path) {
     return true;
 }
 
+// Files always hold full triangles, so compact ones are converted to and from them a chunk at a time:
+#define MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE 256
+
+void readTriangles(Mesh &mesh, void *file) {
+    if (mesh.triangle_layout != TriangleLayout_Compact) {
+        os::readFromFile(mesh.triangles, sizeof(Triangle) * mesh.triangle_count, file);
+        return;
+    }
+
+    Triangle chunk[MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE];
+    for (u32 start = 0; start < mesh.triangle_count; start += MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE) {
+        u32 count = mesh.triangle_count - start;
+        if (count > MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE) count = MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE;
+        os::readFromFile(chunk, sizeof(Triangle) * count, file);
+        for (u32 i = 0; i < count; i++) mesh.compact_triangles[start + i] = CompactTriangle{chunk[i]};
+    }
+}
+
+void writeTriangles(const Mesh &mesh, void *file) {
+    if (mesh.triangle_layout != TriangleLayout_Compact) {
+        os::writeToFile((void*)mesh.triangles, sizeof(Triangle) * mesh.triangle_count, file);
+        return;
+    }
+
+    Triangle chunk[MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE];
+    for (u32 start = 0; start < mesh.triangle_count; start += MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE) {
+        u32 count = mesh.triangle_count - start;
+        if (count > MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE) count = MESH_SERIALIZATION__TRIANGLE_CHUNK_SIZE;
+        for (u32 i = 0; i < count; i++) {
+            TriangleVertexIndices &indices = mesh.vertex_position_indices[start + i];
+            chunk[i].init(mesh.vertex_positions[indices.v1],
+                          mesh.vertex_positions[indices.v2],
+                          mesh.vertex_positions[indices.v3]);
+        }
+        os::writeToFile(chunk, sizeof(Triangle) * count, file);
+    }
+}
+
+// Compact triangles take their vertices from the mesh's vertex indices, which older versions of obj2mesh did not
+// store in the order of the triangles. Such meshes are detected by their triangles falling outside of their leaves:
+bool trianglesFitTheirLeaves(const Mesh &mesh) {
+    for (u32 n = 0; n < mesh.bvh.node_count; n++) {
+        const BVHNode &node = mesh.bvh.nodes[n];
+        if (!node.isLeaf()) continue;
+
+        for (u32 t = node.first_index; t < node.first_index + node.leaf_count; t++)
+            for (u32 id : mesh.vertex_position_indices[t].ids)
+                if (!node.aabb.contains(mesh.vertex_positions[id]))
+                    return false;
+    }
+    return true;
+}
+
 void readContent(Mesh &mesh, void *file) {
     os::readFromFile(&mesh.aabb.min,       sizeof(vec3), file);
     os::readFromFile(&mesh.aabb.max,       sizeof(vec3), file);
-    os::readFromFile(mesh.triangles,       sizeof(Triangle) * mesh.triangle_count, file);
+    readTriangles(mesh, file);
     os::readFromFile(mesh.vertex_positions,             sizeof(vec3)                  * mesh.vertex_count,   file);
     os::readFromFile(mesh.vertex_position_indices,      sizeof(TriangleVertexIndices) * mesh.triangle_count, file);
     os::readFromFile(mesh.edge_vertex_indices,          sizeof(EdgeVertexIndices)     * mesh.edge_count,     file);
@@ -95,7 +151,7 @@ void readContent(Mesh &mesh, void *file) {
 void writeContent(const Mesh &mesh, void *file) {
     os::writeToFile((void*)&mesh.aabb.min,       sizeof(vec3), file);
     os::writeToFile((void*)&mesh.aabb.max,       sizeof(vec3), file);
-    os::writeToFile((void*)mesh.triangles,               sizeof(Triangle)              * mesh.triangle_count, file);
+    writeTriangles(mesh, file);
     os::writeToFile((void*)mesh.vertex_positions,        sizeof(vec3)                  * mesh.vertex_count,   file);
     os::writeToFile((void*)mesh.vertex_position_indices, sizeof(TriangleVertexIndices) * mesh.triangle_count, file);
     os::writeToFile((void*)mesh.edge_vertex_indices,     sizeof(EdgeVertexIndices)     * mesh.edge_count,     file);
@@ -135,18 +191,22 @@ bool save(const Mesh &mesh, char* file_path) {
     return true;
 }
 
+// The mesh's triangle layout is kept (set it before loading to load a mesh with compact triangles).
+// Loading compact triangles fails for meshes converted by older versions of obj2mesh (see trianglesFitTheirLeaves).
 bool load(Mesh &mesh, char *file_path, memory::MonotonicAllocator *memory_allocator = nullptr) {
     void *file = os::openFileForReading(file_path);
     if (!file) return false;
 
     if (memory_allocator) {
+        TriangleLayout triangle_layout = mesh.triangle_layout;
         mesh = Mesh{};
+        mesh.triangle_layout = triangle_layout;
         readHeader(mesh, file);
         if (!allocateMemory(mesh, memory_allocator)) return false;
     } else if (!mesh.vertex_positions) return false;
     readContent(mesh, file);
     os::closeFile(file);
-    return true;
+    return mesh.triangle_layout != TriangleLayout_Compact || trianglesFitTheirLeaves(mesh);
 }
 
 u32 getTotalMemoryForMeshes(String *mesh_files, u32 mesh_count, u8 *max_bvh_height = nullptr, u32 *max_triangle_count = nullptr) {
@@ -53,6 +53,13 @@ struct Frustum {
             VIEWPORT_DEFAULT__FAR_CLIPPING_PLANE_DISTANCE
     };
 
+    // How the convex hull of some view-space points (i.e: the corners of an object's bounds) relates to the frustum:
+    enum class Containment {
+        Outside = 0,
+        Intersecting,
+        Inside
+    };
+
     f32 near_clipping_plane_distance{VIEWPORT_DEFAULT__NEAR_CLIPPING_PLANE_DISTANCE};
     f32 far_clipping_plane_distance{ VIEWPORT_DEFAULT__FAR_CLIPPING_PLANE_DISTANCE};
     bool flip_z{false}, cull_back_faces{true};
@@ -139,6 +146,45 @@ struct Frustum {
         return true;
     }
 
+    // A bit for each of the planes that a view-space point is outside of (near, far, left, right, bottom, top):
+    INLINE u8 getOutsidePlanes(const vec3 &point, f32 focal_length, f32 aspect_ratio) const {
+        f32 x = focal_length * point.x;
+        f32 y = focal_length * point.y;
+        f32 z = aspect_ratio * point.z;
+        return (point.z < near_clipping_plane_distance) |
+               ((point.z > far_clipping_plane_distance) << 1) |
+               ((x + z < 0) << 2) |
+               ((z - x < 0) << 3) |
+               ((y + point.z < 0) << 4) |
+               ((point.z - y < 0) << 5);
+    }
+
+    // The hull is found to be outside only when all of its points are outside of the same plane, so a hull that is
+    // outside of the frustum but across a few of its planes (i.e: near its edges) is conservatively intersecting it.
+    // A hull that is inside has nothing to be clipped, and one that is outside has nothing to be drawn.
+    Containment getContainment(const vec3 *points, u32 point_count, f32 focal_length, f32 aspect_ratio) const {
+        u8 outside_of_all = 0x3F, outside_of_any = 0;
+        for (u32 i = 0; i < point_count; i++) {
+            u8 outside = getOutsidePlanes(points[i], focal_length, aspect_ratio);
+            outside_of_all &= outside;
+            outside_of_any |= outside;
+        }
+
+        if (outside_of_all) return Containment::Outside;
+        return outside_of_any ? Containment::Intersecting : Containment::Inside;
+    }
+
+    // Whether a view-space triangle is entirely outside of one of the planes, or (when culling back faces) is facing
+    // away from the camera. Its front face is the one its vertices wind counter-clockwise around, seen from the camera:
+    bool cullTriangle(const vec3 &A, const vec3 &B, const vec3 &C, f32 focal_length, f32 aspect_ratio) const {
+        if (cull_back_faces && (C - A).cross(B - A).dot(A) >= 0)
+            return true;
+
+        return getOutsidePlanes(A, focal_length, aspect_ratio) &
+               getOutsidePlanes(B, focal_length, aspect_ratio) &
+               getOutsidePlanes(C, focal_length, aspect_ratio);
+    }
+
     INLINE void projectPoint(vec3 &point, const Dimensions &dimensions) const {
         point.x = ((projection.scale.x * point.x / point.z) + 1) * dimensions.h_width;
         point.y = ((projection.scale.y * point.y / point.z) + 1) * dimensions.h_height;
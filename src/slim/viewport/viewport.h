@@ -4,6 +4,9 @@
 #include "./frustum.h"
 #include "../draw/canvas.h"
 
+struct TileRasterizer;
+struct DepthPyramid;
+
 struct Viewport {
     Canvas &canvas;
     Camera *camera{nullptr};
@@ -11,6 +14,8 @@ struct Viewport {
     Dimensions dimensions;
     Navigation navigation;
     RectI bounds{};
+    TileRasterizer *rasterizer{nullptr}; // When set, drawing into the viewport is recorded by it (see TileRasterizer)
+    DepthPyramid *depth_pyramid{nullptr}; // When set, meshes and BVHs drawn as lines skip what it hides (see DepthPyramid)
 
     Viewport(Canvas &canvas, Camera *camera) : canvas{canvas} {
         dimensions = canvas.dimensions;
@@ -55,4 +60,12 @@ struct Viewport {
     INLINE bool cullAndClipEdge(Edge &edge) const {
         return frustum.cullAndClipEdge(edge, camera->focal_length, dimensions.width_over_height);
     }
+
+    INLINE Frustum::Containment getContainment(const vec3 *view_space_points, u32 point_count) const {
+        return frustum.getContainment(view_space_points, point_count, camera->focal_length, dimensions.width_over_height);
+    }
+
+    INLINE bool cullTriangle(const vec3 &A, const vec3 &B, const vec3 &C) const {
+        return frustum.cullTriangle(A, B, C, camera->focal_length, dimensions.width_over_height);
+    }
 };
\ No newline at end of file